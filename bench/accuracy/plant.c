@@ -0,0 +1,248 @@
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * @file   plant.c
+ * @brief  Synthetic workload with a known sharing layout, the ground truth
+ *         for scoring Sheriff-Detect reports.
+ *
+ * Each pattern given on the command line runs as its own set of phases:
+ *
+ *   inter    one small object per thread, adjacent on the heap (false sharing)
+ *   intra    one array with a slot per thread (false sharing)
+ *   global   a global array with a slot per thread (false sharing)
+ *   true     every thread writes the same word (true sharing only)
+ *   padded   one object per thread on its own cache lines (no sharing)
+ *   reuse    falsely shared objects are freed and their memory reused by
+ *            objects of another call site that one thread writes
+ *
+ * In every iteration a thread writes its planted location with probability
+ * rate percent, and a location on its stack otherwise, so rate sets how
+ * often the threads interleave on the planted cache lines.
+ *
+ * The ground truth goes to stdout, one JSON object per line, with the
+ * allocation site (file:line) of heap objects or the name of globals, and
+ * whether Sheriff-Detect should report it.
+ *
+ * Usage: plant [-t threads] [-r rate] [-n iterations] [-p phases] pattern...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define MAX_THREADS 64
+#define CACHE_LINE 64
+
+static int num_threads = 4;
+static int rate = 100;
+static long iterations = 4000000;
+static int phases = 8;
+
+static pthread_barrier_t barrier;
+
+/* The locations thread i writes in the current pattern, NULL for none. */
+static long * targets[MAX_THREADS];
+
+/* Planted global, one slot per thread. */
+long global_slots[MAX_THREADS];
+
+/* Record an expected object. */
+static void truth(const char * pattern, int line, int falsesharing) {
+  printf("{\"pattern\": \"%s\", \"kind\": \"heap\", \"site\": \"%s:%d\", \"false_sharing\": %s}\n",
+         pattern, __FILE__, line, falsesharing ? "true" : "false");
+  fflush(stdout);
+}
+
+static void truth_global(const char * pattern, const char * name, int falsesharing) {
+  printf("{\"pattern\": \"%s\", \"kind\": \"global\", \"name\": \"%s\", \"false_sharing\": %s}\n",
+         pattern, name, falsesharing ? "true" : "false");
+  fflush(stdout);
+}
+
+/* Sheriff has no memalign, so align by hand. */
+static void * alloc_aligned(void * ptr) {
+  return (void *)(((unsigned long)ptr + CACHE_LINE - 1) & ~(unsigned long)(CACHE_LINE - 1));
+}
+
+static void * writer(void * arg) {
+  long id = (long)arg;
+  unsigned long seed = 12345 + id;
+  volatile long scratch = 0;
+  volatile long * target = targets[id];
+  long i, per_phase = iterations / phases;
+  int phase;
+
+  for (phase = 0; phase < phases; phase++) {
+    for (i = 0; i < per_phase; i++) {
+      seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+      if (target != NULL && (long)((seed >> 33) % 100) < rate) {
+        *target += i;
+      } else {
+        scratch += i;
+      }
+    }
+    pthread_barrier_wait(&barrier);
+  }
+  return NULL;
+}
+
+static void run_threads(void) {
+  pthread_t threads[MAX_THREADS];
+  long i;
+
+  for (i = 0; i < num_threads; i++) {
+    pthread_create(&threads[i], NULL, writer, (void *)i);
+  }
+  for (i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+static void plant_inter(void) {
+  int i;
+  truth("inter", __LINE__ + 2, 1);
+  for (i = 0; i < num_threads; i++) {
+    targets[i] = (long *)malloc(sizeof(long));
+    *targets[i] = 0;
+  }
+  run_threads();
+}
+
+static void plant_intra(void) {
+  int i;
+  long * slots;
+  truth("intra", __LINE__ + 1, 1);
+  slots = (long *)calloc(num_threads, sizeof(long));
+  for (i = 0; i < num_threads; i++) {
+    targets[i] = &slots[i];
+  }
+  run_threads();
+}
+
+static void plant_global(void) {
+  int i;
+  truth_global("global", "global_slots", 1);
+  for (i = 0; i < num_threads; i++) {
+    targets[i] = &global_slots[i];
+  }
+  run_threads();
+}
+
+static void plant_true(void) {
+  int i;
+  long * shared;
+  truth("true", __LINE__ + 1, 0);
+  shared = (long *)calloc(1, sizeof(long));
+  for (i = 0; i < num_threads; i++) {
+    targets[i] = shared;
+  }
+  run_threads();
+}
+
+static void plant_padded(void) {
+  int i;
+  truth("padded", __LINE__ + 2, 0);
+  for (i = 0; i < num_threads; i++) {
+    targets[i] = (long *)alloc_aligned(calloc(2, CACHE_LINE));
+  }
+  run_threads();
+}
+
+static void plant_reuse(void) {
+  long * objects[MAX_THREADS];
+  int i;
+
+  truth("reuse", __LINE__ + 2, 1);
+  for (i = 0; i < num_threads; i++) {
+    objects[i] = (long *)calloc(1, sizeof(long));
+    targets[i] = objects[i];
+  }
+  run_threads();
+  for (i = 0; i < num_threads; i++) {
+    free(objects[i]);
+  }
+
+  /* The same size class, so these take over the freed memory; only thread 0 writes. */
+  truth("reuse", __LINE__ + 2, 0);
+  for (i = 0; i < num_threads; i++) {
+    objects[i] = (long *)calloc(1, sizeof(long));
+    targets[i] = (i == 0) ? objects[i] : NULL;
+  }
+  run_threads();
+}
+
+static struct {
+  const char * name;
+  void (*plant)(void);
+} patterns[] = {
+  { "inter", plant_inter },
+  { "intra", plant_intra },
+  { "global", plant_global },
+  { "true", plant_true },
+  { "padded", plant_padded },
+  { "reuse", plant_reuse },
+};
+
+#define NUM_PATTERNS (int)(sizeof(patterns) / sizeof(patterns[0]))
+
+static void usage(const char * name) {
+  int i;
+  fprintf(stderr, "Usage: %s [-t threads] [-r rate] [-n iterations] [-p phases] pattern...\n", name);
+  fprintf(stderr, "Patterns:");
+  for (i = 0; i < NUM_PATTERNS; i++) {
+    fprintf(stderr, " %s", patterns[i].name);
+  }
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+int main(int argc, char * argv[]) {
+  int opt, i, j;
+
+  while ((opt = getopt(argc, argv, "t:r:n:p:")) != -1) {
+    switch (opt) {
+    case 't': num_threads = atoi(optarg); break;
+    case 'r': rate = atoi(optarg); break;
+    case 'n': iterations = atol(optarg); break;
+    case 'p': phases = atoi(optarg); break;
+    default: usage(argv[0]);
+    }
+  }
+  if (optind == argc || num_threads < 1 || num_threads > MAX_THREADS
+      || rate < 0 || rate > 100 || phases < 1 || iterations < phases) {
+    usage(argv[0]);
+  }
+  pthread_barrier_init(&barrier, NULL, num_threads);
+
+  for (i = optind; i < argc; i++) {
+    for (j = 0; j < NUM_PATTERNS; j++) {
+      if (strcmp(argv[i], patterns[j].name) == 0) {
+        break;
+      }
+    }
+    if (j == NUM_PATTERNS) {
+      usage(argv[0]);
+    }
+    patterns[j].plant();
+  }
+  fflush(stdout);
+  return 0;
+}
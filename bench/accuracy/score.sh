@@ -0,0 +1,117 @@
+#!/bin/sh
+#
+# Score Sheriff-Detect against the ground truth planted by plant. Every
+# pattern given (all of them by default) is run natively and under the
+# detector at each interleave rate, and the JSON report (SHERIFF_REPORT) is
+# matched against the ground truth plant prints. Writes CSV:
+#
+#   library,pattern,threads,rate,tp,fp,fn,precision,recall,native_s,detect_s,overhead
+#
+# A reported object is a true positive when it is a planted falsely shared
+# object, and a false positive otherwise: true sharing, padded or reused
+# objects that should not be blamed, or anything that was not planted. A
+# planted falsely shared object that is not reported is a false negative.
+# The last row of each library sums up all patterns and rates.
+#
+# LIBRARIES, THREADS, RATES, ITERATIONS and PHASES select the runs.
+
+LIBRARIES=${LIBRARIES:-"detect64_opt detect64"}
+THREADS=${THREADS:-4}
+RATES=${RATES:-"100 50 10 1"}
+ITERATIONS=${ITERATIONS:-4000000}
+PHASES=${PHASES:-8}
+PATTERNS=${*:-"inter intra global true padded reuse"}
+
+truth_file=$(mktemp)
+report_file=$(mktemp)
+trap 'rm -f $truth_file $report_file' EXIT
+
+# Time a command in seconds, with its stdout in $truth_file.
+timed () {
+  start=$(date +%s%N)
+  "$@" > $truth_file 2> /dev/null
+  stop=$(date +%s%N)
+  echo $(( (stop - start) / 1000000 )) | awk '{ printf "%.3f", $1 / 1000 }'
+}
+
+# Print "tp fp fn" for the report in $report_file against $truth_file.
+score () {
+  awk '
+    function field(line, name,    re) {
+      re = "\"" name "\": \"[^\"]*\""
+      if (!match(line, re)) {
+        return ""
+      }
+      return substr(line, RSTART + length(name) + 5, RLENGTH - length(name) - 6)
+    }
+    # Heap sites are matched on the file name and line, without the directory.
+    function basename(site) {
+      sub(/.*\//, "", site)
+      return site
+    }
+    FNR == NR {
+      key = (field($0, "kind") == "heap") ? basename(field($0, "site")) : field($0, "name")
+      expected[key] = ($0 ~ /"false_sharing": true/)
+      next
+    }
+    /"rank"/ {
+      found = ""
+      if (field($0, "kind") == "global") {
+        if (field($0, "name") in expected) {
+          found = field($0, "name")
+        }
+      } else {
+        sites = $0
+        sub(/.*"callsites": \[/, "", sites)
+        n = split(sites, list, "\"")
+        for (i = 2; i <= n && found == ""; i += 2) {
+          if (basename(list[i]) in expected) {
+            found = basename(list[i])
+          }
+        }
+      }
+      if (found != "" && expected[found]) {
+        if (!(found in reported)) {
+          tp++
+        }
+        reported[found] = 1
+      } else {
+        fp++
+      }
+    }
+    END {
+      for (key in expected) {
+        if (expected[key] && !(key in reported)) {
+          fn++
+        }
+      }
+      printf "%d %d %d\n", tp, fp, fn
+    }' $truth_file $report_file
+}
+
+echo "library,pattern,threads,rate,tp,fp,fn,precision,recall,native_s,detect_s,overhead"
+for library in $LIBRARIES; do
+  total_tp=0; total_fp=0; total_fn=0; total_native=0; total_detect=0
+  for pattern in $PATTERNS; do
+    for rate in $RATES; do
+      args="-t $THREADS -r $rate -n $ITERATIONS -p $PHASES $pattern"
+      native=$(timed ./plant-pthread $args)
+      : > $report_file
+      detect=$(SHERIFF_REPORT=$report_file timed ./plant-$library $args)
+      set -- $(score)
+      total_tp=$((total_tp + $1)); total_fp=$((total_fp + $2)); total_fn=$((total_fn + $3))
+      total_native=$(echo $total_native $native | awk '{ print $1 + $2 }')
+      total_detect=$(echo $total_detect $detect | awk '{ print $1 + $2 }')
+      echo $library $pattern $THREADS $rate $1 $2 $3 $native $detect
+    done
+  done
+  echo $library all $THREADS all $total_tp $total_fp $total_fn $total_native $total_detect
+done | awk '
+  # Precision with no reports and recall with nothing planted are both perfect.
+  function ratio(a, b) {
+    return (b == 0) ? "1.00" : sprintf("%.2f", a / b)
+  }
+  {
+    printf "%s,%s,%s,%s,%d,%d,%d,%s,%s,%.3f,%.3f,%s\n", $1, $2, $3, $4, $5, $6, $7,
+      ratio($5, $5 + $6), ratio($5, $5 + $7), $8, $9, ($8 > 0) ? sprintf("%.2f", $9 / $8) : "-"
+  }'
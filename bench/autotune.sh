@@ -0,0 +1,165 @@
+#!/bin/sh
+#
+# Search the run-time tunables of Sheriff (include/xtunables.h) for one
+# workload and write the fastest setting as its profile, which Sheriff
+# loads on later runs of the same program:
+#
+#   ./autotune.sh [-r runs] [-p passes] [-k protect|detect] [-o profile] command [args]
+#
+# The command must run under Sheriff, linked against a library or with
+# LD_PRELOAD. Each tunable is tried in turn at every candidate value with
+# the others at their best so far; a value is kept when the median time of
+# its runs beats the best by more than MARGIN percent. Under Sheriff-Detect
+# a value is only kept if the report (SHERIFF_REPORT) still holds at least
+# as many objects as with the defaults. The detection thresholds
+# (min_interwrites_*) trade accuracy, not time; score them with
+# bench/accuracy instead.
+#
+# The profile goes to $SHERIFF_PROFILE_DIR/<program>.conf, by default
+# $HOME/.sheriff/<program>.conf, unless -o names another file.
+
+RUNS=${RUNS:-3}
+PASSES=${PASSES:-1}
+MARGIN=${MARGIN:-2}
+KIND=""
+PROFILE=""
+
+PROTECT_TUNABLES="line_bounces cost_samples check_again_no_protection check_again_under_protection max_fault_overhead"
+DETECT_TUNABLES="checking_interval eval_checking_period eval_large_heap_base eval_large_heap_protection"
+
+candidates () {
+  case $1 in
+    line_bounces)                 echo 2 4 8 16 32 64 128 ;;
+    cost_samples)                 echo 4 8 16 32 64 ;;
+    check_again_no_protection)    echo 10 25 50 100 200 ;;
+    check_again_under_protection) echo 1 2 4 8 16 ;;
+    max_fault_overhead)           echo 5 10 25 50 100 ;;
+    checking_interval)            echo 250 500 1000 2000 5000 10000 ;;
+    eval_checking_period)         echo 5 10 20 50 100 ;;
+    eval_large_heap_base)         echo 100 500 1000 2000 5000 ;;
+    eval_large_heap_protection)   echo 50 100 250 500 1000 5000 ;;
+  esac
+}
+
+usage () {
+  echo "Usage: $0 [-r runs] [-p passes] [-k protect|detect] [-o profile] command [args]" >&2
+  exit 1
+}
+
+while getopts "r:p:k:o:" option; do
+  case $option in
+    r) RUNS=$OPTARG ;;
+    p) PASSES=$OPTARG ;;
+    k) KIND=$OPTARG ;;
+    o) PROFILE=$OPTARG ;;
+    *) usage ;;
+  esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 0 ] && usage
+
+program=$(command -v "$1")
+if [ -z "$program" ]; then
+  echo "$0: $1: not found" >&2
+  exit 1
+fi
+
+# Which Sheriff runs the command decides what to tune.
+if [ -z "$KIND" ]; then
+  case "$LD_PRELOAD $(ldd "$program" 2>/dev/null)" in
+    *libsheriff_detect*) KIND=detect ;;
+    *libsheriff_protect*) KIND=protect ;;
+    *) echo "$0: $1 does not seem to run under Sheriff; use -k" >&2; exit 1 ;;
+  esac
+fi
+case $KIND in
+  protect) TUNABLES=$PROTECT_TUNABLES ;;
+  detect) TUNABLES=$DETECT_TUNABLES ;;
+  *) usage ;;
+esac
+
+if [ -z "$PROFILE" ]; then
+  PROFILE=${SHERIFF_PROFILE_DIR:-$HOME/.sheriff}/$(basename "$program").conf
+fi
+
+report_file=$(mktemp)
+trap 'rm -f $report_file' EXIT
+
+# Median wall time in seconds of RUNS runs with the given settings, or
+# "fail" if a run fails. The last report stays in $report_file. Any
+# existing profile is left out of the measurement.
+measure () {
+  times=""
+  i=0
+  while [ $i -lt $RUNS ]; do
+    : > $report_file
+    start=$(date +%s%N)
+    if ! env SHERIFF_PROFILE=/dev/null SHERIFF_REPORT=$report_file "$@" > /dev/null 2>&1; then
+      echo fail
+      return
+    fi
+    stop=$(date +%s%N)
+    times="$times $(( (stop - start) / 1000 ))"
+    i=$((i + 1))
+  done
+  echo $times | tr ' ' '\n' | sort -n | awk '{ t[NR] = $1 } END { printf "%.6f\n", t[int((NR + 1) / 2)] / 1e6 }'
+}
+
+# Environment assignments for the best values so far.
+settings () {
+  for tunable in $TUNABLES; do
+    eval value=\$best_$tunable
+    if [ -n "$value" ]; then
+      echo "SHERIFF_$(echo $tunable | tr a-z A-Z)=$value"
+    fi
+  done
+}
+
+baseline=$(measure "$@")
+if [ "$baseline" = fail ]; then
+  echo "$0: $* fails with the default tunables" >&2
+  exit 1
+fi
+baseline_objects=$(grep -c '"rank"' $report_file)
+best=$baseline
+echo "defaults: ${baseline}s" >&2
+
+pass=0
+while [ $pass -lt $PASSES ]; do
+  for tunable in $TUNABLES; do
+    variable=SHERIFF_$(echo $tunable | tr a-z A-Z)
+    for value in $(candidates $tunable); do
+      time=$(measure $(settings) $variable=$value "$@")
+      if [ "$time" = fail ]; then
+        echo "$tunable = $value: failed" >&2
+        continue
+      fi
+      objects=$(grep -c '"rank"' $report_file)
+      if [ $KIND = detect ] && [ $objects -lt $baseline_objects ]; then
+        echo "$tunable = $value: ${time}s, reports $objects of $baseline_objects objects" >&2
+        continue
+      fi
+      echo "$tunable = $value: ${time}s" >&2
+      if echo $time $best $MARGIN | awk '{ exit !($1 < $2 * (1 - $3 / 100)) }'; then
+        best=$time
+        eval best_$tunable=$value
+      fi
+    done
+  done
+  pass=$((pass + 1))
+done
+
+mkdir -p "$(dirname "$PROFILE")" || exit 1
+{
+  echo "# Sheriff $KIND profile written by autotune.sh for: $*"
+  echo "# median ${baseline}s with the defaults, ${best}s with these tunables."
+  for tunable in $TUNABLES; do
+    eval value=\$best_$tunable
+    if [ -n "$value" ]; then
+      echo "$tunable = $value"
+    else
+      echo "# $tunable: default"
+    fi
+  done
+} > "$PROFILE"
+echo "wrote $PROFILE: ${baseline}s -> ${best}s" >&2
@@ -0,0 +1,222 @@
+#!/bin/sh
+#
+# Performance regression gate: runs the micro suite (sheriffbench), the
+# startup time of an empty program (startup) and the macro suite (kernels/)
+# natively and under each 64-bit Sheriff library, and compares every
+# benchmark with a stored baseline:
+#
+#   ./gate.sh [-n runs] [-w warmup] [-b baseline] [-u]
+#
+# Each benchmark runs WARMUP times unmeasured, then RUNS times. The report
+# gives the median, a 95% confidence interval of the median from order
+# statistics, the overhead over the native run of the same benchmark, and
+# the change against the baseline. A benchmark regressed when even the
+# lower end of its interval is slower than the baseline by more than its
+# tolerance. The exit code is 1 if any benchmark regressed, 2 if any run
+# failed, 0 otherwise.
+#
+# The baseline (bench/baseline.txt by default) holds lines of
+# "benchmark tolerance_percent median"; micro medians are ns per operation,
+# startup medians are microseconds from exec to main, macro medians are
+# seconds. -u writes the medians of this run to it,
+# keeping the tolerances already there; new benchmarks get TOLERANCE.
+# Baselines only compare on the machine that wrote them.
+#
+# THREADS, SCALE and KERNELS choose the workloads. Build first with make.
+
+RUNS=${RUNS:-5}
+WARMUP=${WARMUP:-1}
+TOLERANCE=${TOLERANCE:-10}
+THREADS=${THREADS:-4}
+SCALE=${SCALE:-1}
+KERNELS=${KERNELS:-"linear_regression string_match word_count reverse_index kmeans streamcluster fluidanimate canneal histogram_omp"}
+BASELINE=baseline.txt
+UPDATE=no
+
+MICRO="fault twincopy:1 diff:64 interleave:8 refresh spawn mutex barrier"
+MICRO_LIBRARIES="pthread protect64 detect64 detect64_opt"
+MACRO_LIBRARIES="pthread protect64 detect64_opt"
+
+usage () {
+  echo "Usage: $0 [-n runs] [-w warmup] [-b baseline] [-u]" >&2
+  exit 2
+}
+
+while getopts "n:w:b:u" option; do
+  case $option in
+    n) RUNS=$OPTARG ;;
+    w) WARMUP=$OPTARG ;;
+    b) BASELINE=$(cd "$(dirname "$OPTARG")" && pwd)/$(basename "$OPTARG") ;;
+    u) UPDATE=yes ;;
+    *) usage ;;
+  esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 0 ] || usage
+
+cd "$(dirname "$0")" || exit 2
+
+samples=$(mktemp)
+trap 'rm -f $samples' EXIT
+
+# Print the ns_per_op of a micro benchmark given as name[:param].
+micro_run () {
+  binary=$1
+  name=$(echo $2 | cut -d: -f1)
+  param=$(echo $2 | cut -s -d: -f2)
+  ./$binary $name $THREADS $param 2>/dev/null | tail -n 1 | awk -F, 'NF == 5 { print $5 }'
+}
+
+# Print the microseconds from exec to main of an empty program.
+startup_run () {
+  ./startup-pthread 1 ./startup-$1 2>/dev/null | tail -n 1 | awk -F, 'NF == 4 { print $3 }'
+}
+
+# Print the wall time in seconds of a kernel; nothing if it fails.
+macro_run () {
+  start=$(date +%s%N)
+  if (cd kernels && ./$1 $THREADS $SCALE > /dev/null 2>&1); then
+    stop=$(date +%s%N)
+    echo $(( (stop - start) / 1000 )) | awk '{ printf "%.6f\n", $1 / 1e6 }'
+  fi
+}
+
+# Run one benchmark WARMUP + RUNS times and append "name library values"
+# to the samples, or "name library fail".
+measure () {
+  name=$1
+  library=$2
+  shift 2
+  values=""
+  i=0
+  while [ $i -lt $((WARMUP + RUNS)) ]; do
+    value=$("$@")
+    if [ -z "$value" ]; then
+      echo "$name $library fail" >> $samples
+      echo "$name/$library: failed" >&2
+      return
+    fi
+    [ $i -ge $WARMUP ] && values="$values $value"
+    i=$((i + 1))
+  done
+  echo "$name $library$values" >> $samples
+}
+
+for benchmark in $MICRO; do
+  for library in $MICRO_LIBRARIES; do
+    measure micro/$(echo $benchmark | tr : /) $library micro_run sheriffbench-$library $benchmark
+  done
+done
+
+for library in $MICRO_LIBRARIES; do
+  measure startup $library startup_run $library
+done
+
+for kernel in $KERNELS; do
+  for library in $MACRO_LIBRARIES; do
+    measure macro/$kernel $library macro_run $kernel-shared-$library
+  done
+done
+
+stored=$BASELINE
+[ -f "$stored" ] || stored=/dev/null
+updated=$(mktemp)
+
+awk -v tolerance=$TOLERANCE -v update=$UPDATE -v updated=$updated '
+  # Sort a[1..n] in place.
+  function sort(a, n,    i, j, t) {
+    for (i = 2; i <= n; i++) {
+      t = a[i]
+      for (j = i - 1; j > 0 && a[j] > t; j--) {
+        a[j + 1] = a[j]
+      }
+      a[j + 1] = t
+    }
+  }
+
+  FILENAME == ARGV[1] {
+    if ($0 !~ /^#/ && NF == 3) {
+      tol[$1] = $2
+      base[$1] = $3
+    }
+    next
+  }
+
+  {
+    key = $1 "/" ($2 == "pthread" ? "native" : $2)
+    keys[++count] = key
+    bench[key] = $1
+    if ($3 == "fail") {
+      failed[key] = 1
+      next
+    }
+    n = NF - 2
+    for (i = 1; i <= n; i++) {
+      v[i] = $(i + 2)
+    }
+    sort(v, n)
+    median[key] = (n % 2) ? v[(n + 1) / 2] : (v[n / 2] + v[n / 2 + 1]) / 2
+    # Ranks bounding the median with about 95% confidence.
+    lo = int(n / 2 - 0.98 * sqrt(n))
+    hi = int(n / 2 + 1 + 0.98 * sqrt(n) + 0.999)
+    low[key] = v[lo < 1 ? 1 : lo]
+    high[key] = v[hi > n ? n : hi]
+  }
+
+  END {
+    status = 0
+    printf "%-40s %12s %25s %9s %12s %8s  %s\n", "benchmark", "median", "95% interval", "overhead", "baseline", "change", "result"
+    for (i = 1; i <= count; i++) {
+      key = keys[i]
+      if (key in failed) {
+        printf "%-40s %12s %25s %9s %12s %8s  %s\n", key, "-", "-", "-", "-", "-", "FAILED"
+        status = 2
+        if (update == "yes" && key in base) {
+          printf "%s %s %s\n", key, tol[key], base[key] > updated
+        }
+        continue
+      }
+      native = bench[key] "/native"
+      overhead = (native in median && median[native] > 0) ? sprintf("%.2fx", median[key] / median[native]) : "-"
+      t = (key in tol) ? tol[key] : tolerance
+      if (key in base && base[key] > 0) {
+        change = sprintf("%+.1f%%", 100 * (median[key] / base[key] - 1))
+        if (low[key] > base[key] * (1 + t / 100)) {
+          result = "REGRESSED"
+          if (status == 0) {
+            status = 1
+          }
+        }
+        else if (high[key] < base[key] * (1 - t / 100)) {
+          result = "improved"
+        }
+        else {
+          result = "ok"
+        }
+        baseline = sprintf("%.6g", base[key])
+      }
+      else {
+        change = "-"
+        baseline = "-"
+        result = "new"
+      }
+      printf "%-40s %12.6g %12.6g..%-12.6g %9s %12s %8s  %s (tolerance %s%%)\n", key, median[key], low[key], high[key], overhead, baseline, change, result, t
+      if (update == "yes") {
+        printf "%s %s %.6g\n", key, t, median[key] > updated
+      }
+    }
+    exit status
+  }
+' $stored $samples
+status=$?
+
+if [ $UPDATE = yes ]; then
+  {
+    echo "# Sheriff regression baseline: benchmark tolerance_percent median"
+    echo "# Written by gate.sh on $(uname -n), $(date -u +%Y-%m-%d), RUNS=$RUNS THREADS=$THREADS SCALE=$SCALE"
+    cat $updated
+  } > "$BASELINE"
+  echo "wrote $BASELINE" >&2
+fi
+rm -f $updated
+exit $status
@@ -0,0 +1,109 @@
+/*
+ * Canneal, after PARSEC. A large netlist is annealed by swapping the
+ * locations of random pairs of elements, each wired to a few fixed pins;
+ * every thread works on its own part of the netlist, which is large and
+ * rarely shared, and counts accepted and rejected moves in a packed global
+ * array.
+ */
+#include "kernel.h"
+
+#define FANOUT 4
+#define PINS 4096
+#define STEPS 8
+#define MOVES_PER_STEP 100000
+
+typedef struct {
+  int x, y;
+  int fanout[FANOUT];
+} element;
+
+typedef struct {
+  long accepted;
+  long rejected;
+} PER_THREAD anneal_stats;
+
+anneal_stats canneal_stats[MAX_THREADS]; /* planted: canneal_stats */
+
+static element * netlist;
+static int pins[PINS][2];
+static long num_elements;
+
+static void generate_input(void) {
+  long i;
+  int f;
+  num_elements = 400000L * scale;
+  for (i = 0; i < PINS; i++) {
+    pins[i][0] = rand_next() % 1000;
+    pins[i][1] = rand_next() % 1000;
+  }
+  netlist = (element *)malloc(num_elements * sizeof(element));
+  for (i = 0; i < num_elements; i++) {
+    netlist[i].x = rand_next() % 1000;
+    netlist[i].y = rand_next() % 1000;
+    for (f = 0; f < FANOUT; f++) {
+      netlist[i].fanout[f] = rand_next() % PINS;
+    }
+  }
+}
+
+static inline long wire_cost(long e, int x, int y) {
+  long cost = 0;
+  int f;
+  for (f = 0; f < FANOUT; f++) {
+    int * pin = pins[netlist[e].fanout[f]];
+    cost += labs((long)pin[0] - x) + labs((long)pin[1] - y);
+  }
+  return cost;
+}
+
+static void * anneal_worker(void * arg) {
+  long id = (long)arg;
+  long start, end;
+  unsigned long seed = 1 + id;
+  int step, move;
+
+  thread_range(id, num_elements, &start, &end);
+  for (step = 0; step < STEPS; step++) {
+    for (move = 0; move < MOVES_PER_STEP * scale; move++) {
+      long a, b, before, after;
+      seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+      a = start + (seed >> 33) % (end - start);
+      seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+      b = start + (seed >> 33) % (end - start);
+
+      before = wire_cost(a, netlist[a].x, netlist[a].y) + wire_cost(b, netlist[b].x, netlist[b].y);
+      after = wire_cost(a, netlist[b].x, netlist[b].y) + wire_cost(b, netlist[a].x, netlist[a].y);
+      if (after < before) {
+        int x = netlist[a].x, y = netlist[a].y;
+        netlist[a].x = netlist[b].x;
+        netlist[a].y = netlist[b].y;
+        netlist[b].x = x;
+        netlist[b].y = y;
+        canneal_stats[id].accepted++;
+      }
+      else {
+        canneal_stats[id].rejected++;
+      }
+    }
+    pthread_barrier_wait(&kernel_barrier);
+  }
+  return NULL;
+}
+
+int main(int argc, char * argv[]) {
+  long accepted = 0, cost = 0, i;
+
+  parse_args(argc, argv);
+  generate_input();
+
+  run_threads(anneal_worker);
+
+  for (i = 0; i < num_threads; i++) {
+    accepted += canneal_stats[i].accepted;
+  }
+  for (i = 0; i < num_elements; i += 97) {
+    cost += wire_cost(i, netlist[i].x, netlist[i].y);
+  }
+  printf("result %ld %ld\n", accepted, cost);
+  return 0;
+}
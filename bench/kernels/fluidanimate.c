@@ -0,0 +1,93 @@
+/*
+ * Fluidanimate, after PARSEC. Particles live in a grid of cells; every step
+ * the threads compute the density of the particles in their cells from the
+ * neighbouring cells and count the interactions in a packed global array.
+ */
+#include "kernel.h"
+
+#define GRID 64
+#define PER_CELL 8
+#define STEPS 10
+
+typedef struct {
+  long interactions;
+  long particles;
+} PER_THREAD fluid_stats;
+
+fluid_stats fluid_counts[MAX_THREADS]; /* planted: fluid_counts */
+
+static float * position;
+static float * density;
+static int grid;
+
+static void generate_input(void) {
+  long i, n;
+  grid = GRID * scale;
+  n = (long)grid * grid * PER_CELL;
+  position = (float *)malloc(n * 2 * sizeof(float));
+  density = (float *)calloc(n, sizeof(float));
+  for (i = 0; i < n; i++) {
+    long cell = i / PER_CELL;
+    position[2*i] = (cell % grid) + (float)(rand_next() % 1000) / 1000.0f;
+    position[2*i+1] = (cell / grid) + (float)(rand_next() % 1000) / 1000.0f;
+  }
+}
+
+static void * fluid_worker(void * arg) {
+  long id = (long)arg;
+  long start, end, cell;
+  int step;
+
+  thread_range(id, (long)grid * grid, &start, &end);
+  for (step = 0; step < STEPS; step++) {
+    for (cell = start; cell < end; cell++) {
+      int cx = cell % grid, cy = cell / grid, dx, dy, p, q;
+      for (p = cell * PER_CELL; p < (cell + 1) * PER_CELL; p++) {
+        float rho = 0;
+        for (dy = -1; dy <= 1; dy++) {
+          for (dx = -1; dx <= 1; dx++) {
+            int nx = cx + dx, ny = cy + dy;
+            long neighbour;
+            if (nx < 0 || ny < 0 || nx >= grid || ny >= grid) {
+              continue;
+            }
+            neighbour = (long)ny * grid + nx;
+            for (q = neighbour * PER_CELL; q < (neighbour + 1) * PER_CELL; q++) {
+              float ddx = position[2*p] - position[2*q];
+              float ddy = position[2*p+1] - position[2*q+1];
+              float r2 = ddx * ddx + ddy * ddy;
+              if (r2 < 1.0f) {
+                rho += (1.0f - r2) * (1.0f - r2);
+                fluid_counts[id].interactions++;
+              }
+            }
+          }
+        }
+        density[p] = rho;
+        fluid_counts[id].particles++;
+      }
+    }
+    pthread_barrier_wait(&kernel_barrier);
+  }
+  return NULL;
+}
+
+int main(int argc, char * argv[]) {
+  long interactions = 0;
+  double sum = 0;
+  long i;
+
+  parse_args(argc, argv);
+  generate_input();
+
+  run_threads(fluid_worker);
+
+  for (i = 0; i < num_threads; i++) {
+    interactions += fluid_counts[i].interactions;
+  }
+  for (i = 0; i < (long)grid * grid * PER_CELL; i++) {
+    sum += density[i];
+  }
+  printf("result %ld %.3f\n", interactions, sum);
+  return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * Histogram, after Phoenix, written with OpenMP. Every thread of each
+ * parallel loop counts the pixels it gets in its slot of a packed global
+ * array of bins.
+ */
+#include <omp.h>
+#include "kernel.h"
+
+#define BINS 8
+
+typedef struct {
+  int bins[BINS];
+} PER_THREAD hist_bins;
+
+hist_bins hist_counts[MAX_THREADS]; /* planted: hist_counts */
+
+static unsigned char * pixels;
+static long num_pixels;
+
+static void generate_input(void) {
+  long i;
+  num_pixels = 16000000L * scale;
+  pixels = (unsigned char *)malloc(num_pixels);
+  for (i = 0; i < num_pixels; i++) {
+    pixels[i] = rand_next() & 0xff;
+  }
+}
+
+int main(int argc, char * argv[]) {
+  long total[BINS];
+  int pass, i, b;
+
+  parse_args(argc, argv);
+  generate_input();
+  omp_set_num_threads(num_threads);
+
+  for (pass = 0; pass < 4; pass++) {
+    long p;
+#pragma omp parallel for schedule(dynamic, 65536)
+    for (p = 0; p < num_pixels; p++) {
+      hist_counts[omp_get_thread_num()].bins[pixels[p] * BINS / 256]++;
+    }
+  }
+
+  printf("result");
+  for (b = 0; b < BINS; b++) {
+    total[b] = 0;
+    for (i = 0; i < num_threads; i++) {
+      total[b] += hist_counts[i].bins[b];
+    }
+    printf(" %ld", total[b]);
+  }
+  printf("\n");
+  return 0;
+}
@@ -0,0 +1,99 @@
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * @file   kernel.h
+ * @brief  Shared pieces of the benchmark kernels.
+ *
+ * Every kernel is built twice: as is, its per-thread data is packed and
+ * falsely shared; with -DPADDED every per-thread slot gets its own cache
+ * line. The planted objects are marked with a "planted" comment on the line
+ * that declares or allocates them, which run.sh uses as ground truth:
+ * "planted: name" for a global, a bare "planted" for a heap allocation.
+ *
+ * Usage of every kernel: <kernel> [threads] [scale]
+ */
+
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define MAX_THREADS 64
+#define CACHE_LINE 64
+
+#ifdef PADDED
+#define PER_THREAD __attribute__((aligned(CACHE_LINE)))
+/* Sheriff has no memalign, so align by hand. */
+#define PER_THREAD_ALLOC(count, size) \
+  ((void *)(((unsigned long)calloc((count) + 1, (size)) + CACHE_LINE - 1) & ~(unsigned long)(CACHE_LINE - 1)))
+#else
+#define PER_THREAD
+#define PER_THREAD_ALLOC(count, size) calloc((count), (size))
+#endif
+
+static int num_threads = 4;
+static int scale = 1;
+
+static pthread_barrier_t kernel_barrier;
+
+/* Deterministic inputs, the same for every run. */
+static unsigned long rand_state = 12345;
+
+static inline unsigned long rand_next(void) {
+  rand_state = rand_state * 6364136223846793005UL + 1442695040888963407UL;
+  return rand_state >> 33;
+}
+
+static void parse_args(int argc, char * argv[]) {
+  if (argc > 1) {
+    num_threads = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    scale = atoi(argv[2]);
+  }
+  if (num_threads < 1 || num_threads > MAX_THREADS || scale < 1) {
+    fprintf(stderr, "Usage: %s [threads] [scale]\n", argv[0]);
+    exit(1);
+  }
+  pthread_barrier_init(&kernel_barrier, NULL, num_threads);
+}
+
+/* Run fn on every thread and wait for all of them. */
+static __attribute__((unused)) void run_threads(void * (*fn)(void *)) {
+  pthread_t threads[MAX_THREADS];
+  long i;
+
+  for (i = 0; i < num_threads; i++) {
+    pthread_create(&threads[i], NULL, fn, (void *)i);
+  }
+  for (i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+/* The part [*start, *end) of n items which thread id works on. */
+static inline void thread_range(long id, long n, long * start, long * end) {
+  *start = n * id / num_threads;
+  *end = n * (id + 1) / num_threads;
+}
+
+#endif
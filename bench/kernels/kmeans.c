@@ -0,0 +1,115 @@
+/*
+ * K-means, after Phoenix. In every iteration the threads assign their points
+ * to the nearest cluster and add them to private partial sums; the number of
+ * points each thread visited and moved is kept in a packed global array.
+ */
+#include "kernel.h"
+
+#define DIM 3
+#define K 8
+#define ITERATIONS 10
+
+typedef struct {
+  long visited;
+  long moved;
+} PER_THREAD kmeans_progress;
+
+kmeans_progress kmeans_changed[MAX_THREADS]; /* planted: kmeans_changed */
+
+static int * points;
+static int * cluster_of;
+static long num_points;
+static double centers[K][DIM];
+static double * partial[MAX_THREADS];
+
+static void generate_input(void) {
+  long i;
+  int d;
+  num_points = 200000L * scale;
+  points = (int *)malloc(num_points * DIM * sizeof(int));
+  cluster_of = (int *)malloc(num_points * sizeof(int));
+  for (i = 0; i < num_points * DIM; i++) {
+    points[i] = rand_next() % 1000;
+  }
+  for (i = 0; i < num_points; i++) {
+    cluster_of[i] = -1;
+  }
+  for (i = 0; i < K; i++) {
+    for (d = 0; d < DIM; d++) {
+      centers[i][d] = points[i * DIM + d];
+    }
+  }
+}
+
+static void * kmeans_worker(void * arg) {
+  long id = (long)arg;
+  long start, end, i;
+  int iter, c, d;
+  /* Sums of every dimension, then the count, for every cluster. */
+  double * sums = (double *)malloc(K * (DIM + 1) * sizeof(double));
+
+  thread_range(id, num_points, &start, &end);
+  partial[id] = sums;
+  for (iter = 0; iter < ITERATIONS; iter++) {
+    memset(sums, 0, K * (DIM + 1) * sizeof(double));
+    for (i = start; i < end; i++) {
+      int best = 0;
+      double bestDist = 1e30;
+      for (c = 0; c < K; c++) {
+        double dist = 0;
+        for (d = 0; d < DIM; d++) {
+          double diff = points[i * DIM + d] - centers[c][d];
+          dist += diff * diff;
+        }
+        if (dist < bestDist) {
+          bestDist = dist;
+          best = c;
+        }
+      }
+      kmeans_changed[id].visited++;
+      if (cluster_of[i] != best) {
+        cluster_of[i] = best;
+        kmeans_changed[id].moved++;
+      }
+      for (d = 0; d < DIM; d++) {
+        sums[best * (DIM + 1) + d] += points[i * DIM + d];
+      }
+      sums[best * (DIM + 1) + DIM] += 1;
+    }
+
+    /* Thread 0 computes the new centers from everybody's sums. */
+    pthread_barrier_wait(&kernel_barrier);
+    if (id == 0) {
+      for (c = 0; c < K; c++) {
+        double total[DIM + 1] = { 0 };
+        int t;
+        for (t = 0; t < num_threads; t++) {
+          for (d = 0; d <= DIM; d++) {
+            total[d] += partial[t][c * (DIM + 1) + d];
+          }
+        }
+        for (d = 0; d < DIM && total[DIM] > 0; d++) {
+          centers[c][d] = total[d] / total[DIM];
+        }
+      }
+    }
+    pthread_barrier_wait(&kernel_barrier);
+  }
+  return NULL;
+}
+
+int main(int argc, char * argv[]) {
+  long moved = 0;
+  int i;
+
+  parse_args(argc, argv);
+  generate_input();
+
+  run_threads(kmeans_worker);
+
+  for (i = 0; i < num_threads; i++) {
+    moved += kmeans_changed[i].moved;
+  }
+  printf("result %ld %.3f %.3f\n", moved, centers[0][0], centers[K-1][DIM-1]);
+  return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Linear regression, after Phoenix. Every thread sums up its part of the
+ * points directly into its slot of a packed array of partial sums.
+ */
+#include "kernel.h"
+
+typedef struct {
+  long long SX, SY, SXX, SYY, SXY;
+} PER_THREAD lreg_args;
+
+static unsigned char * points;
+static long num_points;
+static lreg_args * args;
+
+static void generate_input(void) {
+  long i;
+  num_points = 4000000L * scale;
+  points = (unsigned char *)malloc(num_points * 2);
+  for (i = 0; i < num_points; i++) {
+    unsigned char x = rand_next() & 0xff;
+    points[2*i] = x;
+    points[2*i+1] = (unsigned char)(x / 2 + (rand_next() & 0x1f));
+  }
+}
+
+static void * linear_regression_map(void * arg) {
+  long id = (long)arg;
+  long start, end, i;
+  int pass;
+
+  thread_range(id, num_points, &start, &end);
+  for (pass = 0; pass < 4; pass++) {
+    for (i = start; i < end; i++) {
+      long long x = points[2*i], y = points[2*i+1];
+      args[id].SX += x;
+      args[id].SY += y;
+      args[id].SXX += x * x;
+      args[id].SYY += y * y;
+      args[id].SXY += x * y;
+    }
+    pthread_barrier_wait(&kernel_barrier);
+  }
+  return NULL;
+}
+
+int main(int argc, char * argv[]) {
+  long long SX = 0, SY = 0, SXX = 0, SXY = 0;
+  long n;
+  int i;
+
+  parse_args(argc, argv);
+  generate_input();
+  args = (lreg_args *)PER_THREAD_ALLOC(num_threads, sizeof(lreg_args)); /* planted */
+
+  run_threads(linear_regression_map);
+
+  for (i = 0; i < num_threads; i++) {
+    SX += args[i].SX;
+    SY += args[i].SY;
+    SXX += args[i].SXX;
+    SXY += args[i].SXY;
+  }
+  n = num_points * 4;
+  printf("result %.6f %.6f\n",
+         (double)(n * SXY - SX * SY) / (n * SXX - SX * SX),
+         (double)(SY * SXX - SX * SXY) / (n * SXX - SX * SX));
+  return 0;
+}
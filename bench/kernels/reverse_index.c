@@ -0,0 +1,80 @@
+/*
+ * Reverse index, after Phoenix. Documents are lists of links; every thread
+ * scans its documents, builds its own index of where each link appears and
+ * counts documents and links in its slot of a packed array.
+ */
+#include "kernel.h"
+
+#define NUM_TARGETS 1024
+#define LINKS_PER_DOC 16
+
+typedef struct {
+  long docs;
+  long links;
+} PER_THREAD index_stats;
+
+static int * docs;
+static long num_docs;
+static index_stats * counts;
+static long * index_tables[MAX_THREADS];
+
+static void generate_input(void) {
+  long i;
+  num_docs = 250000L * scale;
+  docs = (int *)malloc(num_docs * LINKS_PER_DOC * sizeof(int));
+  for (i = 0; i < num_docs * LINKS_PER_DOC; i++) {
+    /* Some slots hold no link. */
+    docs[i] = (rand_next() % 4 == 0) ? -1 : (int)(rand_next() % NUM_TARGETS);
+  }
+}
+
+static void * reverse_index_map(void * arg) {
+  long id = (long)arg;
+  long start, end, i;
+  int l, pass;
+  long * table = (long *)calloc(NUM_TARGETS, sizeof(long));
+
+  /* Documents come in batches, each followed by a merge point. */
+  thread_range(id, num_docs, &start, &end);
+  for (pass = 0; pass < 4; pass++) {
+    for (i = start + pass; i < end; i += 4) {
+      counts[id].docs++;
+      for (l = 0; l < LINKS_PER_DOC; l++) {
+        int target = docs[i * LINKS_PER_DOC + l];
+        if (target >= 0) {
+          /* Remember the last document linking to the target. */
+          if (i > table[target]) {
+            table[target] = i;
+          }
+          counts[id].links++;
+        }
+      }
+    }
+    pthread_barrier_wait(&kernel_barrier);
+  }
+  index_tables[id] = table;
+  return NULL;
+}
+
+int main(int argc, char * argv[]) {
+  long docs_seen = 0, links = 0, last = 0;
+  int i, t;
+
+  parse_args(argc, argv);
+  generate_input();
+  counts = (index_stats *)PER_THREAD_ALLOC(num_threads, sizeof(index_stats)); /* planted */
+
+  run_threads(reverse_index_map);
+
+  for (i = 0; i < num_threads; i++) {
+    docs_seen += counts[i].docs;
+    links += counts[i].links;
+    for (t = 0; t < NUM_TARGETS; t++) {
+      if (index_tables[i][t] > last) {
+        last = index_tables[i][t];
+      }
+    }
+  }
+  printf("result %ld %ld %ld\n", docs_seen, links, last);
+  return 0;
+}
@@ -0,0 +1,97 @@
+#!/bin/sh
+#
+# Run each kernel given (all of them by default), falsely shared and padded,
+# natively, under Sheriff-Protect and under Sheriff-Detect. Writes CSV:
+#
+#   kernel,variant,native_s,protect_s,detect_s,protect_overhead,
+#   detect_overhead,speedup,output,detection
+#
+# speedup is the native time of the falsely shared variant over the time of
+# this run under Sheriff-Protect. output is "same" when both Sheriff runs
+# print the native result. detection is "exact" when the detector reports
+# precisely the planted objects (none for the padded variant), otherwise it
+# lists what was missed and how many objects were reported.
+#
+# THREADS and SCALE are passed to every kernel.
+
+THREADS=${THREADS:-4}
+SCALE=${SCALE:-1}
+KERNELS=${*:-"linear_regression string_match word_count reverse_index kmeans streamcluster fluidanimate canneal histogram_omp"}
+
+output_file=$(mktemp)
+trap 'rm -f $output_file' EXIT
+
+# Time a command in seconds, leaving its output in $output_file.
+timed () {
+  start=$(date +%s%N)
+  "$@" > $output_file 2>&1
+  stop=$(date +%s%N)
+  echo $(( (stop - start) / 1000000 )) | awk '{ printf "%.3f", $1 / 1000 }'
+}
+
+# The planted objects of a kernel: global names, or file:line of heap allocations.
+planted () {
+  grep -n 'planted' $1.c | grep -v '^[0-9]*: \*' | while IFS=: read line rest; do
+    name=$(echo "$rest" | sed -n 's/.*planted: *\([A-Za-z_0-9]*\).*/\1/p')
+    if [ -n "$name" ]; then
+      echo "global $name"
+    else
+      echo "heap $1.c:$line"
+    fi
+  done
+}
+
+# Compare a detection report with the expected objects.
+check () {
+  report="$1"
+  expected="$2"
+  reported=$(echo "$report" | grep -c '^Object [0-9]*:')
+  missed=""
+  count=0
+  while read kind what; do
+    [ -z "$kind" ] && continue
+    count=$((count + 1))
+    if [ $kind = global ]; then
+      echo "$report" | grep -q "Global object: name \"$what\"" || missed="$missed $what"
+    else
+      echo "$report" | grep -q "Call site [0-9]* .*/$what\$" || missed="$missed $what"
+    fi
+  done <<END
+$expected
+END
+  if [ -z "$missed" ] && [ $reported -eq $count ]; then
+    echo "exact"
+  else
+    echo "missed:${missed:- none} reported: $reported"
+  fi
+}
+
+echo "kernel,variant,native_s,protect_s,detect_s,protect_overhead,detect_overhead,speedup,output,detection"
+for kernel in $KERNELS; do
+  shared_native=""
+  for variant in shared padded; do
+    native=$(timed ./$kernel-$variant-pthread $THREADS $SCALE)
+    result=$(grep '^result' $output_file)
+    protect=$(timed ./$kernel-$variant-protect64 $THREADS $SCALE)
+    protect_result=$(grep '^result' $output_file)
+    detect=$(timed ./$kernel-$variant-detect64_opt $THREADS $SCALE)
+    detect_result=$(grep '^result' $output_file)
+
+    if [ $variant = shared ]; then
+      shared_native=$native
+      expected=$(planted $kernel)
+    else
+      expected=""
+    fi
+    detection=$(check "$(cat $output_file)" "$expected")
+
+    if [ -n "$result" ] && [ "$result" = "$protect_result" ] && [ "$result" = "$detect_result" ]; then
+      output=same
+    else
+      output=different
+    fi
+
+    echo "$kernel,$variant,$native,$protect,$detect,$(echo $native $protect $detect $shared_native | \
+      awk '{ printf "%.2f,%.2f,%.2f", $2 / $1, $3 / $1, $4 / $2 }'),$output,$detection"
+  done
+done
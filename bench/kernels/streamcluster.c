@@ -0,0 +1,101 @@
+/*
+ * Streamcluster, after PARSEC's pgain(). For every candidate center, the
+ * threads add up how much opening it would save over their points. Each
+ * thread accumulates into its own element of work_mem, which PARSEC lays
+ * out with a stride; here the stride is one element unless padded.
+ */
+#include "kernel.h"
+
+#define DIM 8
+#define CANDIDATES 40
+
+#ifdef PADDED
+#define STRIDE (CACHE_LINE / sizeof(double))
+#else
+#define STRIDE 1
+#endif
+
+static float * points;
+static float * assigned_cost;
+static long num_points;
+static double * work_mem;
+static int opened;
+static double total_gain;
+
+static void generate_input(void) {
+  long i;
+  num_points = 100000L * scale;
+  points = (float *)malloc(num_points * DIM * sizeof(float));
+  assigned_cost = (float *)malloc(num_points * sizeof(float));
+  for (i = 0; i < num_points * DIM; i++) {
+    points[i] = (float)(rand_next() % 10000) / 100.0f;
+  }
+  for (i = 0; i < num_points; i++) {
+    assigned_cost[i] = 1e9f;
+  }
+}
+
+static inline float dist(long a, long b) {
+  float sum = 0;
+  int d;
+  for (d = 0; d < DIM; d++) {
+    float diff = points[a * DIM + d] - points[b * DIM + d];
+    sum += diff * diff;
+  }
+  return sum;
+}
+
+static void * pgain_worker(void * arg) {
+  long id = (long)arg;
+  long start, end, i;
+  int c;
+
+  thread_range(id, num_points, &start, &end);
+  for (c = 0; c < CANDIDATES; c++) {
+    long center = (c * 7919L) % num_points;
+
+    work_mem[id * STRIDE] = 0;
+    for (i = start; i < end; i++) {
+      float cost = dist(i, center);
+      if (cost < assigned_cost[i]) {
+        work_mem[id * STRIDE] += assigned_cost[i] - cost;
+      }
+    }
+    pthread_barrier_wait(&kernel_barrier);
+
+    /* Thread 0 decides whether opening the center pays off. */
+    if (id == 0) {
+      double gain = 0;
+      int t;
+      for (t = 0; t < num_threads; t++) {
+        gain += work_mem[t * STRIDE];
+      }
+      opened = (gain > 0);
+      if (opened) {
+        total_gain += gain;
+      }
+    }
+    pthread_barrier_wait(&kernel_barrier);
+
+    if (opened) {
+      for (i = start; i < end; i++) {
+        float cost = dist(i, center);
+        if (cost < assigned_cost[i]) {
+          assigned_cost[i] = cost;
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char * argv[]) {
+  parse_args(argc, argv);
+  generate_input();
+  work_mem = (double *)PER_THREAD_ALLOC(num_threads * STRIDE, sizeof(double)); /* planted */
+
+  run_threads(pgain_worker);
+
+  printf("result %.1f\n", total_gain);
+  return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * String match, after Phoenix. Every thread hashes the words of its part of
+ * the text, compares them against a few keys and counts the words and the
+ * hits in its slot of a packed array.
+ */
+#include "kernel.h"
+
+#define NUM_KEYS 4
+#define WORD_LEN 8
+
+typedef struct {
+  long words;
+  long hits[NUM_KEYS];
+} PER_THREAD match_stats;
+
+static char * text;
+static long num_words;
+static unsigned long keys[NUM_KEYS];
+static match_stats * stats;
+
+static unsigned long hash_word(const char * word) {
+  unsigned long h = 5381;
+  int i;
+  for (i = 0; i < WORD_LEN; i++) {
+    h = h * 33 + word[i];
+  }
+  return h;
+}
+
+static void generate_input(void) {
+  long i;
+  num_words = 2000000L * scale;
+  text = (char *)malloc(num_words * WORD_LEN);
+  for (i = 0; i < num_words * WORD_LEN; i++) {
+    text[i] = 'a' + rand_next() % 4;
+  }
+  for (i = 0; i < NUM_KEYS; i++) {
+    keys[i] = hash_word(&text[(rand_next() % num_words) * WORD_LEN]);
+  }
+}
+
+static void * string_match_map(void * arg) {
+  long id = (long)arg;
+  long start, end, i;
+  int k, pass;
+
+  /* One pass per batch of keys, as Phoenix runs one map task per chunk. */
+  thread_range(id, num_words, &start, &end);
+  for (pass = 0; pass < 4; pass++) {
+    for (i = start; i < end; i++) {
+      unsigned long h = hash_word(&text[i * WORD_LEN]);
+      stats[id].words++;
+      for (k = 0; k < NUM_KEYS; k++) {
+        if (h == keys[k] + pass) {
+          stats[id].hits[k]++;
+        }
+      }
+    }
+    pthread_barrier_wait(&kernel_barrier);
+  }
+  return NULL;
+}
+
+int main(int argc, char * argv[]) {
+  long words = 0, hits[NUM_KEYS] = { 0 };
+  int i, k;
+
+  parse_args(argc, argv);
+  generate_input();
+  stats = (match_stats *)PER_THREAD_ALLOC(num_threads, sizeof(match_stats)); /* planted */
+
+  run_threads(string_match_map);
+
+  for (i = 0; i < num_threads; i++) {
+    words += stats[i].words;
+    for (k = 0; k < NUM_KEYS; k++) {
+      hits[k] += stats[i].hits[k];
+    }
+  }
+  printf("result %ld %ld %ld %ld %ld\n", words, hits[0], hits[1], hits[2], hits[3]);
+  return 0;
+}
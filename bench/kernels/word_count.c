@@ -0,0 +1,60 @@
+/*
+ * Word count, after Phoenix. Every thread scans its part of the text and
+ * counts characters and words in its slot of a packed global array.
+ */
+#include "kernel.h"
+
+typedef struct {
+  long chars;
+  long words;
+} PER_THREAD word_stats;
+
+word_stats wc_stats[MAX_THREADS]; /* planted: wc_stats */
+
+static char * text;
+static long text_len;
+
+static void generate_input(void) {
+  long i;
+  text_len = 16000000L * scale;
+  text = (char *)malloc(text_len);
+  for (i = 0; i < text_len; i++) {
+    text[i] = (rand_next() % 6 == 0) ? ' ' : 'a' + rand_next() % 26;
+  }
+}
+
+static void * word_count_map(void * arg) {
+  long id = (long)arg;
+  long start, end, i;
+  int inword = 0;
+
+  thread_range(id, text_len, &start, &end);
+  for (i = start; i < end; i++) {
+    wc_stats[id].chars++;
+    if (text[i] == ' ') {
+      inword = 0;
+    }
+    else if (!inword) {
+      inword = 1;
+      wc_stats[id].words++;
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char * argv[]) {
+  long chars = 0, words = 0;
+  int i;
+
+  parse_args(argc, argv);
+  generate_input();
+
+  run_threads(word_count_map);
+
+  for (i = 0; i < num_threads; i++) {
+    chars += wc_stats[i].chars;
+    words += wc_stats[i].words;
+  }
+  printf("result %ld %ld\n", chars, words);
+  return 0;
+}
@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# Sweep every benchmark over 1 to 64 threads for each binary given, for
+# instance ./run.sh sheriffbench-pthread sheriffbench-detect64.
+# Writes CSV to stdout: binary,benchmark,threads,param,ops,ns_per_op
+#
+# THREADS and the parameter lists can be overridden from the environment.
+
+THREADS=${THREADS:-"1 2 4 8 16 32 64"}
+DIFF_BYTES=${DIFF_BYTES:-"1 8 64 512 4096"}
+INTERLEAVE_LINES=${INTERLEAVE_LINES:-"1 8 64"}
+
+run () {
+  binary=$1
+  shift
+  row=$(./$binary "$@" 2>/dev/null | tail -n 1)
+  if [ -n "$row" ]; then
+    echo "$binary,$row"
+  else
+    echo "$binary: $* failed" >&2
+  fi
+}
+
+echo "binary,benchmark,threads,param,ops,ns_per_op"
+for binary in "$@"; do
+  for threads in $THREADS; do
+    run $binary fault $threads
+    run $binary twincopy $threads 0
+    run $binary twincopy $threads 1
+    for bytes in $DIFF_BYTES; do
+      run $binary diff $threads $bytes
+    done
+    for lines in $INTERLEAVE_LINES; do
+      run $binary interleave $threads $lines
+    done
+    run $binary refresh $threads
+    run $binary spawn $threads
+    run $binary mutex $threads
+    run $binary barrier $threads
+  done
+done
@@ -0,0 +1,293 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   sheriffbench.cpp
+ * @brief  Costs of Sheriff's primitives, one at a time.
+ *
+ * Usage: sheriffbench <benchmark> <threads> [param]
+ *
+ * Prints one CSV row: benchmark,threads,param,ops,ns_per_op, where ns_per_op
+ * is the mean over all threads. Linked against pthreads it gives the
+ * baseline, linked against a Sheriff library it gives that library's cost.
+ *
+ *   fault       write faults on pages protected again by each sync
+ *   twincopy    one page copy, param 0 memcpy, 1 streaming stores
+ *   diff        sync with 64 dirty pages, param changed bytes per page, per page
+ *   interleave  sync with pages written by every thread, param cache lines
+ *               per page each thread writes, per page
+ *   refresh     first read of a page after the sync that refreshed it
+ *   spawn       pthread_create and pthread_join of an empty thread
+ *   mutex       uncontended lock and unlock pairs while all threads run
+ *   barrier     pthread_barrier_wait across all threads
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "pagecopy.h"
+
+enum { MAX_THREADS = 64 };
+enum { PAGE_SIZE = 4096 };
+enum { CACHE_LINE_SIZE = 64 };
+enum { PAGES = 64 };
+enum { SHARED_PAGES = 16 };
+enum { ROUNDS = 20 };
+enum { SYNC_OPS = 2000 };
+enum { COPIES = 20000 };
+enum { TWIN_PAGES = 1024 };
+
+typedef long (*benchFunc)(int index, double * elapsed);
+
+struct benchmark {
+  const char * name;
+  benchFunc run;
+  int defaultParam;
+};
+
+static int numThreads;
+static int param;
+
+static pthread_mutex_t locks[MAX_THREADS];
+static pthread_barrier_t barrier;
+static char * pages[MAX_THREADS];
+static char * sharedPages;
+
+static double elapsed[MAX_THREADS];
+static long ops[MAX_THREADS];
+
+// Sheriff has no memalign, so align by hand.
+static char * allocPages (int count) {
+  char * ptr = (char *)malloc((count + 1) * PAGE_SIZE);
+  ptr = (char *)(((unsigned long)ptr + PAGE_SIZE - 1) & ~(unsigned long)(PAGE_SIZE - 1));
+  memset(ptr, 0, count * PAGE_SIZE);
+  return ptr;
+}
+
+static double now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Each thread syncs on its own lock, so only the commit is measured.
+static inline void sync (int index) {
+  pthread_mutex_lock(&locks[index]);
+  pthread_mutex_unlock(&locks[index]);
+}
+
+static long benchFault (int index, double * time) {
+  char * mine = pages[index];
+
+  for (int round = 0; round < ROUNDS; round++) {
+    double start = now();
+    for (int page = 0; page < PAGES; page++) {
+      mine[page * PAGE_SIZE + round]++;
+    }
+    *time += now() - start;
+    sync(index);
+  }
+  return ROUNDS * PAGES;
+}
+
+// Twins come from a pool much larger than the caches, so copy into one.
+static long benchTwincopy (int index, double * time) {
+  char * src = pages[index];
+  char * pool = allocPages(TWIN_PAGES);
+
+  double start = now();
+  for (int i = 0; i < COPIES; i++) {
+    char * dest = pool + (i % TWIN_PAGES) * PAGE_SIZE;
+    if (param == 0) {
+      memcpy(dest, src, PAGE_SIZE);
+    }
+    else {
+      pagecopy::copyNonTemporal(dest, src);
+    }
+  }
+  *time += now() - start;
+  return COPIES;
+}
+
+static long benchDiff (int index, double * time) {
+  char * mine = pages[index];
+  int stride = PAGE_SIZE / param;
+
+  for (int round = 0; round < ROUNDS; round++) {
+    for (int page = 0; page < PAGES; page++) {
+      for (int offset = 0; offset < PAGE_SIZE; offset += stride) {
+        mine[page * PAGE_SIZE + offset]++;
+      }
+    }
+    double start = now();
+    sync(index);
+    *time += now() - start;
+  }
+  return ROUNDS * PAGES;
+}
+
+static long benchInterleave (int index, double * time) {
+  int word = index % (CACHE_LINE_SIZE / sizeof(long));
+  int stride = (PAGE_SIZE / CACHE_LINE_SIZE) / param;
+
+  for (int round = 0; round < ROUNDS; round++) {
+    pthread_barrier_wait(&barrier);
+    for (int page = 0; page < SHARED_PAGES; page++) {
+      for (int line = 0; line < PAGE_SIZE / CACHE_LINE_SIZE; line += stride) {
+        long * words = (long *)(sharedPages + page * PAGE_SIZE + line * CACHE_LINE_SIZE);
+        words[word]++;
+      }
+    }
+    double start = now();
+    sync(index);
+    *time += now() - start;
+  }
+  return ROUNDS * SHARED_PAGES;
+}
+
+static long benchRefresh (int index, double * time) {
+  volatile char * mine = pages[index];
+  long sum = 0;
+
+  for (int round = 0; round < ROUNDS; round++) {
+    for (int page = 0; page < PAGES; page++) {
+      mine[page * PAGE_SIZE]++;
+    }
+    sync(index);
+
+    double start = now();
+    for (int page = 0; page < PAGES; page++) {
+      sum += mine[page * PAGE_SIZE + CACHE_LINE_SIZE];
+    }
+    *time += now() - start;
+  }
+  return ROUNDS * PAGES + (sum & 0);
+}
+
+static void * empty (void * arg) {
+  return arg;
+}
+
+static long benchSpawn (int index, double * time) {
+  for (int round = 0; round < ROUNDS; round++) {
+    pthread_t thread;
+    double start = now();
+    pthread_create(&thread, NULL, empty, NULL);
+    pthread_join(thread, NULL);
+    *time += now() - start;
+  }
+  return ROUNDS;
+}
+
+static long benchMutex (int index, double * time) {
+  double start = now();
+  for (int i = 0; i < SYNC_OPS; i++) {
+    sync(index);
+  }
+  *time += now() - start;
+  return SYNC_OPS;
+}
+
+static long benchBarrier (int index, double * time) {
+  double start = now();
+  for (int i = 0; i < SYNC_OPS / 10; i++) {
+    pthread_barrier_wait(&barrier);
+  }
+  *time += now() - start;
+  return SYNC_OPS / 10;
+}
+
+static struct benchmark benchmarks[] = {
+  { "fault",      benchFault,      0 },
+  { "twincopy",   benchTwincopy,   1 },
+  { "diff",       benchDiff,       8 },
+  { "interleave", benchInterleave, 1 },
+  { "refresh",    benchRefresh,    0 },
+  { "spawn",      benchSpawn,      0 },
+  { "mutex",      benchMutex,      0 },
+  { "barrier",    benchBarrier,    0 },
+};
+
+static struct benchmark * current;
+
+static void * worker (void * arg) {
+  long index = (long)arg;
+  double time = 0;
+
+  pthread_barrier_wait(&barrier);
+  long count = current->run(index, &time);
+
+  elapsed[index] = time;
+  ops[index] = count;
+  return NULL;
+}
+
+int main (int argc, char * argv[]) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <benchmark> <threads> [param]\n", argv[0]);
+    return 1;
+  }
+
+  for (unsigned int i = 0; i < sizeof(benchmarks)/sizeof(benchmarks[0]); i++) {
+    if (strcmp(argv[1], benchmarks[i].name) == 0) {
+      current = &benchmarks[i];
+    }
+  }
+  numThreads = atoi(argv[2]);
+  if (current == NULL || numThreads < 1 || numThreads > MAX_THREADS) {
+    fprintf(stderr, "Unknown benchmark %s or bad thread count %s.\n", argv[1], argv[2]);
+    return 1;
+  }
+  param = (argc > 3) ? atoi(argv[3]) : current->defaultParam;
+  if ((current->run == benchDiff && (param < 1 || param > PAGE_SIZE))
+      || (current->run == benchInterleave && (param < 1 || param > PAGE_SIZE / CACHE_LINE_SIZE))) {
+    fprintf(stderr, "Bad parameter %d for %s.\n", param, current->name);
+    return 1;
+  }
+
+  for (int i = 0; i < numThreads; i++) {
+    pthread_mutex_init(&locks[i], NULL);
+    pages[i] = allocPages(PAGES);
+  }
+  sharedPages = allocPages(SHARED_PAGES);
+  pthread_barrier_init(&barrier, NULL, numThreads);
+
+  pthread_t threads[MAX_THREADS];
+  for (long i = 0; i < numThreads; i++) {
+    pthread_create(&threads[i], NULL, worker, (void *)i);
+  }
+  for (int i = 0; i < numThreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  double total = 0;
+  long totalOps = 0;
+  for (int i = 0; i < numThreads; i++) {
+    total += elapsed[i];
+    totalOps += ops[i];
+  }
+  printf("%s,%d,%d,%ld,%.1f\n", current->name, numThreads, param, totalOps,
+         totalOps > 0 ? total / totalOps : 0.0);
+  return 0;
+}
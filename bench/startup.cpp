@@ -0,0 +1,135 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   startup.cpp
+ * @brief  Time from exec to main, and to exit, of an empty program.
+ *
+ * Usage: startup <runs> <program>
+ *
+ * Runs program, another build of this file, runs times and prints one CSV
+ * row: program,runs,main_us,exit_us, the medians of the time from exec to
+ * the first line of main and to the end of waitpid. Linked against
+ * pthreads it gives the baseline, linked against a Sheriff library it gives
+ * what that library's initialization and finalization cost a short-lived
+ * program that never spawns a thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+
+enum { MAX_RUNS = 1000 };
+
+static unsigned long monotonicNs (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+// One run: exec the program with the start time in its environment and
+// read back when it reached main.
+static bool runOnce (const char * program, unsigned long * mainNs, unsigned long * exitNs) {
+  int fds[2];
+  char start[32];
+
+  if (pipe(fds) != 0) {
+    return false;
+  }
+
+  unsigned long begin = monotonicNs();
+  pid_t pid = fork();
+  if (pid == 0) {
+    snprintf(start, sizeof(start), "%lu", monotonicNs());
+    setenv("SHERIFF_STARTUP_NS", start, 1);
+    dup2(fds[1], STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    if (null != -1) {
+      dup2(null, STDERR_FILENO);
+      close(null);
+    }
+    close(fds[0]);
+    close(fds[1]);
+    execl(program, program, (char *)NULL);
+    _exit(127);
+  }
+  close(fds[1]);
+  if (pid == -1) {
+    close(fds[0]);
+    return false;
+  }
+
+  char buf[32];
+  ssize_t len = read(fds[0], buf, sizeof(buf) - 1);
+  close(fds[0]);
+
+  int status;
+  waitpid(pid, &status, 0);
+  *exitNs = monotonicNs() - begin;
+
+  if (len <= 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    return false;
+  }
+  buf[len] = '\0';
+  *mainNs = strtoul(buf, NULL, 10);
+  return true;
+}
+
+static double medianUs (unsigned long * values, int n) {
+  std::sort(values, values + n);
+  return ((n % 2) ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2) / 1000.0;
+}
+
+int main (int argc, char * argv[]) {
+  const char * start = getenv("SHERIFF_STARTUP_NS");
+
+  // Started by another instance: report how long it took to get here.
+  if (start != NULL) {
+    printf("%lu\n", monotonicNs() - strtoul(start, NULL, 10));
+    return 0;
+  }
+
+  if (argc != 3 || atoi(argv[1]) < 1 || atoi(argv[1]) > MAX_RUNS) {
+    fprintf(stderr, "Usage: %s <runs> <program>\n", argv[0]);
+    return 1;
+  }
+
+  int runs = atoi(argv[1]);
+  unsigned long mainNs[MAX_RUNS];
+  unsigned long exitNs[MAX_RUNS];
+
+  for (int i = 0; i < runs; i++) {
+    if (!runOnce(argv[2], &mainNs[i], &exitNs[i])) {
+      fprintf(stderr, "%s: %s failed\n", argv[0], argv[2]);
+      return 1;
+    }
+  }
+
+  printf("program,runs,main_us,exit_us\n");
+  printf("%s,%d,%.1f,%.1f\n", argv[2], runs, medianUs(mainNs, runs), medianUs(exitNs, runs));
+  return 0;
+}
@@ -0,0 +1,151 @@
+// g++ -g -O2 -I../include annotations.cpp -rdynamic ../libsheriff_protect64.so -ldl -lpthread
+//
+// The annotations of sheriff.h on a small workload. Every thread counts into
+// its own slot of an array whose slots share cache lines, which is isolated;
+// it reads a large table that nobody writes once it is filled, which is
+// excluded; and the first thread hands a value to the second through a flag
+// without any pthread call, publishing it with a commit point. Each thread
+// also checks in on an atomic counter from the atomic arena. Each step is a
+// named phase in the SHERIFF_TRACE output. A reporter waits for the
+// check-ins as a real thread of the main process, not an isolated one.
+// Every thread also fills its own 2MB stripe of a mapped array that is
+// protected in 2MB units, so it takes a single fault for it.
+// Without Sheriff the annotations are skipped.
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <pthread.h>
+
+#include "sheriff.h"
+
+enum { NUM_THREADS = 4 };
+enum { TABLE_SIZE = 1 << 20 };
+enum { ITERATIONS = 1000000 };
+enum { STRIPE_SIZE = 1 << 21 };
+
+long counters[NUM_THREADS];
+volatile int ready = 0;
+volatile long handoff = 0;
+
+static int * table;
+static long * checkins;
+static char * stripes;
+long reported = 0;
+
+void * worker (void * v) {
+  long index = (long) v;
+
+  if (sheriff_phase_begin != NULL) {
+    sheriff_phase_begin("count");
+  }
+  for (int i = 0; i < ITERATIONS; i++) {
+    counters[index] += table[(i * 31 + index) % TABLE_SIZE];
+  }
+  memset(stripes + index * STRIPE_SIZE, (int)index + 1, STRIPE_SIZE);
+
+  if (sheriff_phase_begin != NULL) {
+    sheriff_phase_begin("handoff");
+  }
+  if (index == 0) {
+    handoff = counters[0];
+    ready = 1;
+    if (sheriff_commit_point != NULL) {
+      sheriff_commit_point();
+    }
+  }
+  else if (index == 1) {
+    while (!ready) {
+      if (sheriff_commit_point != NULL) {
+        sheriff_commit_point();
+      }
+    }
+  }
+
+  __sync_fetch_and_add(checkins, 1);
+
+  if (sheriff_phase_end != NULL) {
+    sheriff_phase_end();
+  }
+  return NULL;
+}
+
+// Shares the main process, so it neither commits nor waits for a commit.
+void * reporter (void * v) {
+  while (*(volatile long *)checkins < NUM_THREADS) {
+    usleep(1000);
+  }
+  reported = *checkins;
+  return NULL;
+}
+
+int main (int argc, char * argv[]) {
+  pthread_t threads[NUM_THREADS];
+  pthread_t report;
+
+  table = (int *) malloc(TABLE_SIZE * sizeof(int));
+  for (int i = 0; i < TABLE_SIZE; i++) {
+    table[i] = i % 7;
+  }
+
+  // Atomic operations on this counter work across threads under Sheriff.
+  checkins = (long *) ((sheriff_atomic_alloc != NULL) ? sheriff_atomic_alloc(sizeof(long))
+                       : malloc(sizeof(long)));
+  *checkins = 0;
+
+  stripes = (char *) mmap(NULL, NUM_THREADS * STRIPE_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (stripes == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+
+  // Annotate before the threads are spawned, so that all of them inherit it.
+  if (sheriff_region_isolate != NULL) {
+    if (sheriff_region_isolate(counters, sizeof(counters)) != 0
+        || sheriff_region_exclude(table, TABLE_SIZE * sizeof(int)) != 0) {
+      fprintf(stderr, "Can not annotate the counters and the table.\n");
+      return 1;
+    }
+  }
+  if (sheriff_region_unit != NULL) {
+    if (sheriff_region_unit(stripes, NUM_THREADS * STRIPE_SIZE, 1 << 21) != 0) {
+      fprintf(stderr, "Can not set the protection unit of the stripes.\n");
+      return 1;
+    }
+  }
+
+  if (sheriff_thread_mode != NULL) {
+    sheriff_thread_mode(reporter, SHERIFF_THREAD_SHARED);
+  }
+  pthread_create(&report, NULL, reporter, NULL);
+
+  for (long i = 0; i < NUM_THREADS; i++) {
+    pthread_create(&threads[i], NULL, worker, (void *) i);
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  pthread_join(report, NULL);
+
+  long expected = 0;
+  for (int i = 0; i < ITERATIONS; i++) {
+    expected += table[(i * 31) % TABLE_SIZE];
+  }
+
+  for (int i = 0; i < NUM_THREADS; i++) {
+    printf("counter %d: %ld\n", i, counters[i]);
+  }
+  printf("handoff %ld, expected %ld\n", handoff, expected);
+  printf("check-ins %ld, reported %ld\n", *checkins, reported);
+
+  bool filled = true;
+  for (int i = 0; i < NUM_THREADS; i++) {
+    filled = filled && stripes[i * STRIPE_SIZE] == i + 1
+      && stripes[(i + 1) * STRIPE_SIZE - 1] == i + 1;
+  }
+  printf("stripes %s\n", filled ? "filled" : "missing");
+  return (handoff == expected && counters[0] == expected && *checkins == NUM_THREADS
+          && reported == NUM_THREADS && filled) ? 0 : 1;
+}
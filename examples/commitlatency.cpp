@@ -0,0 +1,90 @@
+// g++ -g -O2 commitlatency.cpp -rdynamic ../libsheriff_detect64_opt.so -ldl -lpthread
+//
+// Measures how long one synchronization takes, which is dominated by the
+// commit, for a growing number of pages dirtied in the transaction before it.
+// Each row: dirty pages, mean and median latency in microseconds.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+enum { NUM_THREADS = 2 };
+enum { NUM_ROUNDS = 50 };
+enum { MAX_PAGES = 4096 };
+enum { PAGE_SIZE = 4096 };
+
+static const int dirtyPages[] = { 1, 4, 16, 64, 256, 1024, 4096 };
+enum { NUM_SIZES = sizeof(dirtyPages)/sizeof(dirtyPages[0]) };
+
+static char * pages[NUM_THREADS];
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t barrier;
+
+static double latency[NUM_SIZES][NUM_ROUNDS];
+
+static double now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare (const void * a, const void * b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+void * worker (void * v) {
+  long index = (long) v;
+  char * mine = pages[index];
+
+  for (int size = 0; size < NUM_SIZES; size++) {
+    pthread_barrier_wait(&barrier);
+
+    for (int round = 0; round < NUM_ROUNDS; round++) {
+      // Dirty one word on every page, the commit then has to diff them all.
+      for (int page = 0; page < dirtyPages[size]; page++) {
+        mine[page * PAGE_SIZE + (round % 64) * 8]++;
+      }
+
+      double start = now();
+      pthread_mutex_lock(&lock);
+      pthread_mutex_unlock(&lock);
+      double stop = now();
+
+      if (index == 0) {
+        latency[size][round] = stop - start;
+      }
+    }
+  }
+  return NULL;
+}
+
+int main (int argc, char * argv[]) {
+  pthread_t threads[NUM_THREADS];
+
+  for (int i = 0; i < NUM_THREADS; i++) {
+    pages[i] = (char *)malloc(MAX_PAGES * PAGE_SIZE);
+    memset(pages[i], 0, MAX_PAGES * PAGE_SIZE);
+  }
+  pthread_barrier_init(&barrier, NULL, NUM_THREADS);
+
+  for (long i = 0; i < NUM_THREADS; i++) {
+    pthread_create(&threads[i], NULL, worker, (void *)i);
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  printf("pages\tmean_us\tmedian_us\n");
+  for (int size = 0; size < NUM_SIZES; size++) {
+    double sum = 0;
+    for (int round = 0; round < NUM_ROUNDS; round++) {
+      sum += latency[size][round];
+    }
+    qsort(latency[size], NUM_ROUNDS, sizeof(double), compare);
+    printf("%d\t%.1f\t%.1f\n", dirtyPages[size], sum / NUM_ROUNDS, latency[size][NUM_ROUNDS/2]);
+  }
+  return 0;
+}
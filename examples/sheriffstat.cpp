@@ -0,0 +1,117 @@
+// g++ -g -O2 sheriffstat.cpp -o sheriffstat
+//
+// Live view of a program running under Sheriff with SHERIFF_STATS=1: reads
+// its stats segment every interval and prints how much of the threads' wall
+// and CPU time went to each Sheriff subsystem since the last sample. Threads
+// refresh their CPU time at commits, so an interval without commits shows
+// no CPU time.
+//
+// Usage: sheriffstat <pid of the main thread> [interval in seconds]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../include/util/statsegment.h"
+
+struct totals {
+  int threads;
+  unsigned long wallNs;
+  unsigned long cpuNs;
+  unsigned long cycles[STAT_SUBSYSTEMS];
+  unsigned long calls[STAT_SUBSYSTEMS];
+};
+
+static unsigned long timestamp (void) {
+  unsigned int low, high;
+  asm volatile ("rdtsc" : "=a" (low), "=d" (high));
+  return ((unsigned long)high << 32) | low;
+}
+
+static unsigned long monotonicNs (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void add (totals * t, const volatile statslot * slot) {
+  t->wallNs += slot->wallNs;
+  t->cpuNs += slot->cpuNs;
+  for (int i = 0; i < STAT_SUBSYSTEMS; i++) {
+    t->cycles[i] += slot->cycles[i];
+    t->calls[i] += slot->calls[i];
+  }
+}
+
+// Live threads publish their CPU time only every so often, their wall time
+// is taken from the clock.
+static void sample (const volatile statsegment * segment, totals * t) {
+  unsigned long now = monotonicNs();
+
+  memset(t, 0, sizeof(*t));
+  add(t, &segment->retired);
+  t->threads = segment->retired.thread;
+  for (int i = 0; i < STAT_SLOTS; i++) {
+    const volatile statslot * slot = &segment->slots[i];
+    if (slot->pid != 0) {
+      add(t, slot);
+      t->wallNs += (now - slot->startNs) - slot->wallNs;
+      t->threads++;
+    }
+  }
+}
+
+int main (int argc, char * argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <pid> [interval]\n", argv[0]);
+    return 1;
+  }
+  int interval = (argc > 2) ? atoi(argv[2]) : 1;
+
+  char path[64];
+  snprintf(path, sizeof(path), "/dev/shm/sheriff-stats.%s", argv[1]);
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror(path);
+    return 1;
+  }
+  const volatile statsegment * segment = (const volatile statsegment *)
+    mmap(NULL, sizeof(statsegment), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED || segment->magic != STAT_MAGIC || segment->version != STAT_VERSION) {
+    fprintf(stderr, "%s: not a Sheriff stats segment\n", path);
+    return 1;
+  }
+
+  totals last, now;
+  sample(segment, &last);
+
+  printf("threads,wall_ms,cpu_ms");
+  for (int i = 0; i < STAT_SUBSYSTEMS; i++) {
+    printf(",%s_wall,%s_cpu", statSubsystemNames[i], statSubsystemNames[i]);
+  }
+  printf("\n");
+
+  // The segment is removed when the program exits.
+  while (access(path, F_OK) == 0) {
+    sleep(interval);
+    sample(segment, &now);
+
+    double nsPerTick = (double)(monotonicNs() - segment->startNs) / (double)(timestamp() - segment->startTsc);
+    double wall = (double)(now.wallNs - last.wallNs);
+    double cpu = (double)(now.cpuNs - last.cpuNs);
+
+    printf("%d,%.1f,%.1f", now.threads, wall / 1e6, cpu / 1e6);
+    for (int i = 0; i < STAT_SUBSYSTEMS; i++) {
+      double ns = (now.cycles[i] - last.cycles[i]) * nsPerTick;
+      printf(",%.2f,%.2f", wall > 0 ? 100.0 * ns / wall : 0.0, cpu > 0 ? 100.0 * ns / cpu : 0.0);
+    }
+    printf("\n");
+    fflush(stdout);
+    last = now;
+  }
+  return 0;
+}
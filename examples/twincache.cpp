@@ -0,0 +1,115 @@
+// g++ -g -O2 twincache.cpp -rdynamic ../libsheriff_detect64_opt.so -ldl -lpthread
+//
+// A compute-heavy kernel which dirties many pages in every transaction and
+// then works on a small, cache-resident table. Twins made on the write
+// faults compete with the table for the caches. Each thread reports its own
+// counters from perf_event_open: cache misses when the hardware counters are
+// available, and the task clock and page faults from the software counters.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+enum { NUM_THREADS = 2 };
+enum { NUM_TRANSACTIONS = 200 };
+enum { DIRTY_PAGES = 256 };
+enum { TABLE_WORDS = 16384 };
+enum { PASSES = 20 };
+enum { PAGE_SIZE = 4096 };
+
+enum { COUNTER_MISSES = 0, COUNTER_CLOCK, COUNTER_FAULTS, NUM_COUNTERS };
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static char * pages[NUM_THREADS];
+static long * tables[NUM_THREADS];
+
+static int openCounter (int type, int config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void * worker (void * v) {
+  long index = (long) v;
+  char * mine = pages[index];
+  long * table = tables[index];
+  long sum = 0;
+
+  int counters[NUM_COUNTERS];
+  counters[COUNTER_MISSES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  counters[COUNTER_CLOCK] = openCounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+  counters[COUNTER_FAULTS] = openCounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+  for (int i = 0; i < NUM_COUNTERS; i++) {
+    if (counters[i] != -1) {
+      ioctl(counters[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+
+  for (int trans = 0; trans < NUM_TRANSACTIONS; trans++) {
+    for (int page = 0; page < DIRTY_PAGES; page++) {
+      mine[page * PAGE_SIZE + (trans % 64) * 8]++;
+    }
+    for (int pass = 0; pass < PASSES; pass++) {
+      for (int i = 0; i < TABLE_WORDS; i++) {
+        sum += table[i] * pass;
+      }
+    }
+    pthread_mutex_lock(&lock);
+    pthread_mutex_unlock(&lock);
+  }
+
+  long long values[NUM_COUNTERS];
+  for (int i = 0; i < NUM_COUNTERS; i++) {
+    values[i] = -1;
+    if (counters[i] != -1) {
+      ioctl(counters[i], PERF_EVENT_IOC_DISABLE, 0);
+      if (read(counters[i], &values[i], sizeof(values[i])) != sizeof(values[i])) {
+        values[i] = -1;
+      }
+      close(counters[i]);
+    }
+  }
+
+  pthread_mutex_lock(&lock);
+  if (values[COUNTER_MISSES] == -1) {
+    printf("thread %ld\tcache-misses n/a\ttask-clock %.1f ms\tpage-faults %lld\t(%ld)\n",
+           index, values[COUNTER_CLOCK] / 1e6, values[COUNTER_FAULTS], sum);
+  }
+  else {
+    printf("thread %ld\tcache-misses %lld\ttask-clock %.1f ms\tpage-faults %lld\t(%ld)\n",
+           index, values[COUNTER_MISSES], values[COUNTER_CLOCK] / 1e6, values[COUNTER_FAULTS], sum);
+  }
+  fflush(stdout);
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+int main (int argc, char * argv[]) {
+  pthread_t threads[NUM_THREADS];
+
+  for (int i = 0; i < NUM_THREADS; i++) {
+    pages[i] = (char *)malloc(DIRTY_PAGES * PAGE_SIZE);
+    memset(pages[i], 0, DIRTY_PAGES * PAGE_SIZE);
+    tables[i] = (long *)malloc(TABLE_WORDS * sizeof(long));
+    for (int j = 0; j < TABLE_WORDS; j++) {
+      tables[i][j] = j;
+    }
+  }
+
+  for (long i = 0; i < NUM_THREADS; i++) {
+    pthread_create(&threads[i], NULL, worker, (void *)i);
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  return 0;
+}
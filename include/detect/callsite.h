@@ -34,6 +34,8 @@
 #include <setjmp.h>
 #include <execinfo.h>
 
+#include "xmodules.h"
+
 class CallSite {
 public:
   CallSite() {
@@ -85,79 +87,48 @@ public:
   // Check and store callsite
   inline void storeCallsite(unsigned long tmp, unsigned long * frames) {
     //fprintf(stderr, "try to store callsite with tmp %lx and frames %d\n", tmp, *frames);
-    if ((tmp > textStart) && (tmp < textEnd)) {
+    if (xmodules::getInstance().inAttributableText(tmp)) {
       _callsite[*frames] = tmp-5;
       //fprintf(stderr, "Saving callsite %p\n", _callsite[*frames]);
       (*frames)++;
     }
     else if((*frames) >= 1) {
-      // We should stop getting callsites if we already jump out of text segment. 
+      // We should stop getting callsites if we already jump out of application text. 
       // Otherwise, some application will crash, fixed by Tongping Liu (09/28/1012).
       (*frames) = CALL_SITE_DEPTH;
     }
   }
 
-  /// The following function is borrowed from plug project that is written by Gene Nowark.
+  /// Walk the frame pointer chain. Libraries built without frame pointers
+  /// (ld.so, glibc) leave garbage in the frame register, so every frame 
+  /// is validated against the previous one before it is dereferenced, 
+  /// instead of trusting __builtin_frame_address(n).
   unsigned short fetch(int skip) 
   {  
-    sigjmp_buf __backtrace_jump;
-#ifdef X86_32BIT 
-#define RA(a)								\
-    __builtin_frame_address(a) ? /*fprintf(stderr,"%d: 0x%x\n", a, __builtin_return_address(a)),*/ (unsigned long)__builtin_return_address(a) : 0UL;
-#else 
-    // On 64bit machine, we can use -O0 for application and sheriff, 
-    // but some library (glibc) may use other different optimization level, 
-    // which makes it unable to get callsite. 
-    // For example, __bultin_frame_adress(a) can return "5", in this case,
-    // we have to stop to get callsite information otherwise the program can crash.
-#define RA(a)								\
-    ((unsigned long)__builtin_frame_address(a) > 0x7fffff000 && (unsigned long)__builtin_frame_address(a) < 0x7fffffffffff)  ? /*fprintf(stderr,"%d: 0x%x\n", a, __builtin_return_address(a)),*/ (unsigned long)__builtin_return_address(a) : 0UL;
-#endif 
-
-
-#define STORE_CALLSITE_AND_CHECK_EXIT		\
-    if(tmp == 0) break;				\
-    storeCallsite(tmp, &frames);		\
-    if(frames == CALL_SITE_DEPTH) break;  
-
-    unsigned long tmp;
+    enum { MAX_FRAME_SIZE = 0x100000 };
+    enum { MAX_FRAMES = 16 };
+    unsigned long * fp = (unsigned long *)__builtin_frame_address(0);
     unsigned long frames = 0;
-	
-    // setjmp should be OK here because SEGV can't be masked.
-    // And sigsetjmp requires a kernel crossing and is fscking expensive in any case.
-    if(setjmp(__backtrace_jump) == 0) {
-    
-      switch(skip) {
-      case 1:
-	tmp = RA(1);
-	STORE_CALLSITE_AND_CHECK_EXIT;
-      case 2:
-	tmp = RA(2);
-	STORE_CALLSITE_AND_CHECK_EXIT;
-      case 3:
-	tmp = RA(3);
-	STORE_CALLSITE_AND_CHECK_EXIT;
-      case 4:
-	tmp = RA(4);
-	STORE_CALLSITE_AND_CHECK_EXIT;
-      case 5:
-	tmp = RA(5);
-	STORE_CALLSITE_AND_CHECK_EXIT;
-      case 6:
-	tmp = RA(6);
-	STORE_CALLSITE_AND_CHECK_EXIT;
-      case 7:
-	tmp = RA(7);
-	STORE_CALLSITE_AND_CHECK_EXIT;
-      case 8:
-	tmp = RA(8);
-	STORE_CALLSITE_AND_CHECK_EXIT;
-      default:
-	break;
+
+    for(int level = 0; level < MAX_FRAMES && frames < CALL_SITE_DEPTH; level++) {
+      unsigned long tmp = fp[1];
+      unsigned long * next = (unsigned long *)fp[0];
+
+      if(tmp == 0) {
+        break;
+      }
+
+      if(level >= skip) {
+        storeCallsite(tmp, &frames);
+      }
+
+      // The stack grows downwards, so callers have higher frames.
+      if(next <= fp || ((unsigned long)next - (unsigned long)fp) > MAX_FRAME_SIZE
+         || ((unsigned long)next & (sizeof(unsigned long) - 1)) != 0) {
+        break;
       }
+      fp = next;
     }
-      
-    //fprintf(stderr, "FETCH: skip %d now exit\n", skip);
 
     return frames;
   }
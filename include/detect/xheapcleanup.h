@@ -35,6 +35,8 @@
 #endif
 
 #include <stdlib.h>
+
+#include "xtunables.h"
 /* This class is used to manage the page entries.
  * Page fault handler will ask for one page entry here.
  * Normally, we will keep 256 pages entries. If the page entry 
@@ -84,7 +86,7 @@ public:
       // If we are allocate on a new project, if the existing object has some 
       // interleaving writes, then we must choose a different object. 
       for(int i = index; i < index+cachelines; i++) {
-        if(_cacheInvalidates[i] >= xdefines::MIN_INVALIDATES_CARE) {
+        if(_cacheInvalidates[i] >= (unsigned long)xtunables::get(xtunables::MIN_INVALIDATES_CARE)) {
           return false;
         }
         // We don't need atomic operation here.
@@ -101,7 +103,7 @@ public:
       // Otherwise, it will introduce an invalid interleaving since it is possible
       // that a new thread is working on the same object.
       for(int i = index; i < index+cachelines; i++) {
-        if(_cacheInvalidates[i] >= xdefines::MIN_INVALIDATES_CARE) {
+        if(_cacheInvalidates[i] >= (unsigned long)xtunables::get(xtunables::MIN_INVALIDATES_CARE)) {
           // We don't need to calculate the first interleaving since it is an
           // unavoidable update. 
  //         fprintf(stderr, "cacheline %d's invalidates %d lastthread %d\n", i, _cacheInvalidates[i], _cacheLastThread[i]);
@@ -15,6 +15,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <fcntl.h>
 #include <errno.h>
 
 #include "mm.h"
@@ -23,8 +25,10 @@
 #include "objecttable.h"
 #include "objectheader.h"
 #include "elfinfo.h"
+#include "xmodules.h"
 #include "callsite.h"
 #include "stats.h"
+#include "xtunables.h"
 
 template <unsigned long NElts = 1>
 class xtracker {
@@ -36,49 +40,24 @@ public:
 
   xtracker()
   {
-    int    count;
-    void * ptr;
-
-    if (NElts == xdefines::PROTECTEDHEAP_SIZE)
-      _isHeap = true;
-
-    /* Get current executable file name. */
-    count=readlink("/proc/self/exe", _exec_filename, MAXBUFSIZE);
-    if (count <= 0 || count >= MAXBUFSIZE)
-    {
-      fprintf(stderr, "Failed to get current executable file name\n" );
-      exit(1);
-    }
-    _exec_filename[count] = '\0';
-
-    /* Get text segmentations information. */
-    _elf_info.hdr = (Elf_Ehdr*)grab_file(_exec_filename, &_elf_info.size);
-    if (!_elf_info.hdr) {
-      printf("Can't grab file %s\n", _exec_filename);
-      exit(1);
-    }
-  
-    /* Get the text segment information and saved to global _textinfo */
-    get_textseg_info(&_elf_info);
-    parse_elf();
+    _isHeap = (NElts == xdefines::PROTECTEDHEAP_SIZE);
   }
 
   virtual ~xtracker() {
-    release_file(_elf_info.hdr, _elf_info.size);
   }
  
   void print_objects_info() {
 
-    char base[MAXBUFSIZE];
     int k = 0;      
+    int reported = 0;
+    int report = openReport();
 
-    sprintf (base, "addr2line -e %s", _exec_filename);
-  
     if (ObjectTable::getInstance().getObjectsNum() > 0) {
       fprintf(stderr, "Sheriff-Detect: false sharing detected.\n");
     }
     else {
       fprintf(stderr, "Sheriff-Detect: no false sharing found.\n");
+      closeReport(report);
       return;
     }
   
@@ -102,12 +81,13 @@ public:
       ObjectInfo & object = i->second;
       k++;
         
-      if(object.interwrites < xdefines::MIN_INTERWRITES_OUTPUT) {
+      if(object.interwrites < (unsigned long)xtunables::get(xtunables::MIN_INTERWRITES_OUTPUT)) {
         continue;
       }
       //fprintf(stderr, "Object %d: cache interleaving writes %d (%d per cache line, %d times on %d actual line(s), object writes = %d)\n\tObject start = %lx; length = %d.\n", k, object.interwrites, object.interwrites/object.lines, object.interwrites/object.actuallines, object.actuallines, object.totalwrites, object.start, object.totallength);
       
       fprintf(stderr, "Object %d: cache interleaving writes %d on %d cache lines:\n  Object start = %lx; length = %d.\n", k, object.interwrites, object.actuallines, object.start, object.totallength);
+      reportObject(report, k, object, reported++ == 0);
       if (object.is_heap_object == true) {
       //  fprintf(stderr, "\tHeap object accumulated by %d, unit length = %d, total length = %d, cache lines = %d.\n", object.times, object.unitlength, object.totallength, object.totallength/xdefines::CACHE_LINE_SIZE);
 
@@ -116,164 +96,132 @@ public:
         CallSite * callsite = (CallSite *) &object.callsite[0];
         for(int j = 0; j < callsite->getDepth(); j++) {
           unsigned long ipaddr = callsite->getItem(j);
-          char command[MAXBUFSIZE];
             
-         fprintf(stderr, "\tCall site %d %lx: ", j, ipaddr);
-          if(ipaddr >= textStart && ipaddr <= textEnd) {
-            sprintf(command, "%s %x", base, ipaddr);
-            system(command);
+          if(ipaddr == 0) {
+            break;
           }
+          fprintf(stderr, "\tCall site %d %lx: ", j, ipaddr);
+          xmodules::getInstance().printSourceLine(ipaddr);
         }
         fprintf(stderr, "\n\n");
       }
       else {
         // Print object information about globals.
-        Elf_Sym *symbol = find_symbol(&_elf_info, (intptr_t)object.start);
+        xmodules::moduleinfo * module;
+        Elf_Sym *symbol = xmodules::getInstance().findObjectSymbol((unsigned long)object.start, &module);
         if(symbol != NULL) {
-          const char * symname = _elf_info.strtab + symbol->st_name;
-          fprintf(stderr, "\tGlobal object: name \"%s\", start %lx, size %d\n", symname, symbol->st_value, symbol->st_size);
+          const char * symname = xmodules::getInstance().getSymbolName(module, symbol);
+          fprintf(stderr, "\tGlobal object: name \"%s\", start %lx, size %ld, module %s\n", symname, module->base + symbol->st_value, (long)symbol->st_size, module->path);
         }
       }
     }
+
+    closeReport(report);
   }
 
-  void *grab_file(const char *filename, unsigned long *size) {
-    struct stat st;
-    void *map;
-    int fd;
+  /// @brief Open the machine readable report named by SHERIFF_REPORT, if any.
+  /// The report is JSON with one object per line, in the same order and with
+  /// the same threshold as the text report, so that tools can score it.
+  int openReport() {
+    char path[PATH_MAX];
 
-    fd = open(filename, O_RDONLY);
-    if (fd < 0 || fstat(fd, &st) != 0)
-      return NULL;
+    if(!xtunables::getInstance().outputPath("SHERIFF_REPORT", path, sizeof(path))) {
+      return -1;
+    }
 
-    *size = st.st_size;
-    map = MM::allocatePrivate (*size, fd);
-    close(fd);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1) {
+      fprintf(stderr, "Sheriff-Detect: can not open report %s: %s\n", path, strerror(errno));
+      return -1;
+    }
 
-    if (map == MAP_FAILED)
-      return NULL;
-    return map;
+    writeReport(fd, "{\"version\": 1, \"objects\": [");
+    return fd;
   }
 
-  int check_elf(struct elf_info * _elf_info) 
-  {
-    Elf_Ehdr *hdr = _elf_info->hdr;
-
-    if (_elf_info->size < sizeof(*hdr)) {
-        /* file too small, assume this is an empty .o file */
-        return -1;
+  void closeReport(int fd) {
+    if(fd != -1) {
+      writeReport(fd, "\n]}\n");
+      close(fd);
     }
-    
-    /* Is this a valid ELF file? */
-    if ((hdr->e_ident[EI_MAG0] != ELFMAG0) ||
-       (hdr->e_ident[EI_MAG1] != ELFMAG1) ||
-       (hdr->e_ident[EI_MAG2] != ELFMAG2) ||
-       (hdr->e_ident[EI_MAG3] != ELFMAG3)) {
-      /* Not an ELF file - silently ignore it */
-      return -1;
-   }
-
-   return 0;
   }
 
-  void get_textseg_info(struct elf_info * _elf_info) 
-  {
-    Elf_Ehdr *hdr = _elf_info->hdr;
-    Elf_Shdr *sechdrs;
-    int i;
-  
-    if(check_elf(_elf_info)) {
-      printf("errorneous elf file.\n");
-      exit(1);
+  /// @brief Write one reported object. threads is -1 when some word of the
+  /// object was written by more than one thread (true sharing).
+  void reportObject(int fd, int rank, ObjectInfo & object, bool first) {
+    if(fd == -1) {
+      return;
     }
-    
-    sechdrs =(Elf_Shdr *)((char *)hdr + hdr->e_shoff);
-    _elf_info->sechdrs = sechdrs;
 
-    /* Fix endianness in section headers */
-    for (i = 0; i < hdr->e_shnum; i++) {
-      char *secstrings=(char*)((unsigned long)hdr + sechdrs[hdr->e_shstrndx].sh_offset);
-      char *secname;
-      secname = secstrings + sechdrs[i].sh_name;
+    writeReport(fd, "%s\n  {\"rank\": %d, \"kind\": \"%s\", \"interwrites\": %lu, \"lines\": %lu, \"start\": \"0x%lx\", \"length\": %lu, \"threads\": %d",
+                first ? "" : ",", rank, object.is_heap_object ? "heap" : "global",
+                object.interwrites, object.actuallines, (unsigned long)object.start,
+                object.totallength, object.access_threads == 0xFFFF ? -1 : object.access_threads);
 
-      if (strncmp(secname, ".text", 5) != 0) {
-        continue;
+    if(object.is_heap_object) {
+      CallSite * callsite = (CallSite *) &object.callsite[0];
+      char line[MAXBUFSIZE];
+
+      writeReport(fd, ", \"callsites\": [");
+      for(unsigned long j = 0; j < callsite->getDepth(); j++) {
+        unsigned long ipaddr = callsite->getItem(j);
+        if(ipaddr == 0) {
+          break;
+        }
+        if(!xmodules::getInstance().getSourceLine(ipaddr, line, sizeof(line))) {
+          strcpy(line, "??");
+        }
+        writeReport(fd, j == 0 ? "" : ", ");
+        writeString(fd, line);
       }
-   
-      textStart = hdr->e_entry;
-      textEnd   = hdr->e_entry + sechdrs[i].sh_size;
-      assert(textEnd >= textStart);
+      writeReport(fd, "]");
     }
-
-    fprintf(stderr, "textStart 0x%lx textEnd 0x%lx\n", textStart, textEnd);
-    return; 
+    else {
+      xmodules::moduleinfo * module;
+      Elf_Sym *symbol = xmodules::getInstance().findObjectSymbol((unsigned long)object.start, &module);
+      if(symbol != NULL) {
+        writeReport(fd, ", \"name\": ");
+        writeString(fd, xmodules::getInstance().getSymbolName(module, symbol));
+        writeReport(fd, ", \"module\": ");
+        writeString(fd, module->path);
+      }
+    }
+    writeReport(fd, "}");
   }
 
-  int parse_elf()
-  {
-    unsigned int i;
-    Elf_Ehdr *hdr = _elf_info.hdr;
-    Elf_Shdr *sechdrs;
-  
-    if (check_elf(&_elf_info)) {
-      fprintf (stderr, "Erroneous ELF file.\n");
-      exit(-1);
-    }
-  
+  // Formatted write without stdio buffers, since this runs at exit.
+  static void writeReport(int fd, const char * format, ...) {
+    char buf[MAXBUFSIZE];
+    va_list args;
 
-    sechdrs =(Elf_Shdr *)((char *)hdr + hdr->e_shoff);
-    _elf_info.sechdrs = sechdrs;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
 
-    /* Fix endianness in section headers */
-    for (i = 0; i < hdr->e_shnum; i++) {
-      if (sechdrs[i].sh_type != SHT_SYMTAB)
-        continue;
-  
-      if(sechdrs[i].sh_size == 0) 
-        continue;
-  
-      _elf_info.symtab_start = (Elf_Sym*)((unsigned long)hdr + sechdrs[i].sh_offset);
-      _elf_info.symtab_stop  = (Elf_Sym*)((unsigned long)hdr + sechdrs[i].sh_offset + sechdrs[i].sh_size);
-      _elf_info.strtab       = (char *)((unsigned long)hdr + sechdrs[sechdrs[i].sh_link].sh_offset);
-      break;
+    if(len > (int)sizeof(buf) - 1) {
+      len = sizeof(buf) - 1;
+    }
+    if(len > 0) {
+      write(fd, buf, len);
     }
-  
-    return 0; 
   }
 
-  /*
-   * Find symbols according to specific address.  
-   */
-  Elf_Sym * find_symbol(struct elf_info *elf, Elf_Addr addr)
-  {
-    int bFound = 0;
-    Elf_Sym *symbol;
-    Elf_Ehdr *hdr = elf->hdr;
-  
-    for (symbol = elf->symtab_start; symbol < elf->symtab_stop; symbol++) {
-      if (symbol->st_shndx >= SHN_LORESERVE)
-        continue;
-      
-      /* Checked only when it is a global variable. */
-      if(ELF_ST_BIND(symbol->st_info) != STB_GLOBAL || ELF_ST_TYPE(symbol->st_info) != STT_OBJECT)
-        continue;
-  
-      /* If the addr is in the range of current symbol, that get it. */
-      if(addr >= symbol->st_value && addr < (symbol->st_value + symbol->st_size)) {
-        bFound = 1;
-        break;
+  static void writeString(int fd, const char * str) {
+    char buf[MAXBUFSIZE];
+    int len = 0;
+
+    buf[len++] = '"';
+    for(; *str != '\0' && len < MAXBUFSIZE - 3; str++) {
+      if(*str == '"' || *str == '\\') {
+        buf[len++] = '\\';
+        buf[len++] = *str;
+      }
+      else if((unsigned char)*str >= 0x20) {
+        buf[len++] = *str;
       }
     }
-  
-    if(bFound)
-      return symbol;
-    else
-      return NULL;
-  }
-
-  void release_file(void *file, unsigned long size)
-  {
-    munmap(file, size);
+    buf[len++] = '"';
+    write(fd, buf, len);
   }
 
   void finalize() {
@@ -425,7 +373,8 @@ public:
 
   int getObjectWrites(int * start, int * stop, int * memstart, wordchangeinfo * wordchange) {
     int offset;
-    offset = ((intptr_t)start - (intptr_t)memstart)/sizeof(unsigned long);
+    // The word changes are kept at the same byte offset, one entry per int.
+    offset = ((intptr_t)start - (intptr_t)memstart)/sizeof(int);
       
     wordchangeinfo * cur = &wordchange[offset];
     int    writes = 0;
@@ -506,7 +455,7 @@ public:
 #endif   
         // Whenever interleaved writes is larger than the specified threshold
         // We are trying to report it. 
-        if(writes > xdefines::MIN_INTERWRITES_CARE) {
+        if(writes > xtunables::get(xtunables::MIN_INTERWRITES_CARE)) {
           // Check whether the current object causes enough invalidations or not.
           // We only need to check two ends for continuous memory allocation for same callsite.
           long units = ((intptr_t)nextobject - (intptr_t)pos)/(unitsize+sizeof(objectHeader));
@@ -555,65 +504,128 @@ public:
     return ((start & xdefines::CACHELINE_SIZE_MASK) + size + xdefines::CACHE_LINE_SIZE - 1)/xdefines::CACHE_LINE_SIZE;
   }
 
+  // Only cache lines with interleaved writes are visited, the owning 
+  // objects are found through the sorted symbol index of each module.
   void checkGlobalObjects(unsigned long *cacheInvalidates, int * memBase, unsigned long size, wordchangeinfo * wordchange) {
-    struct elf_info *elf = &_elf_info;  
-    Elf_Ehdr *hdr = elf->hdr;
-    Elf_Sym *symbol;
+    xmodules & modules = xmodules::getInstance();
+    unsigned long memStart = (unsigned long)memBase;
+    unsigned long memEnd = memStart + size;
 
- //   fprintf(stderr, "symbol table start %x and stop %x \n", elf->symtab_start, elf->symtab_stop);
-    for (symbol = elf->symtab_start; symbol < elf->symtab_stop; symbol++) {
-      if (symbol->st_shndx >= SHN_LORESERVE)
+    // Check every module whose writable segment overlaps with this region.
+    for(int i = 0; i < modules.getModulesNum(); i++) {
+      xmodules::moduleinfo * module = modules.getModule(i);
+
+      if(module->dataEnd <= memStart || module->dataStart >= memEnd) {
         continue;
+      }
 
-      /* Checked only when it is a global variable. */
-      if(ELF_ST_BIND(symbol->st_info) != STB_GLOBAL || ELF_ST_TYPE(symbol->st_info) != STT_OBJECT)
+      if(!modules.loadSymbols(module) || module->objectsNum == 0) {
         continue;
+      }
 
-      // Now current symbol is one normal object. 
-      long objectStart = symbol->st_value;
-      long objectSize = symbol->st_size;
-      long objectOffset = objectStart - (intptr_t)memBase;
-      long lines = getCachelines(objectStart, symbol->st_size);
-      long actuallines = 0;
-      long interwrites = getCacheInvalidates(objectOffset/xdefines::CACHE_LINE_SIZE, lines, cacheInvalidates, &actuallines);
-   
-      long totalwrites = getObjectWrites((int *)objectStart, (int *)(objectStart + objectSize), memBase, wordchange);
-//      fprintf(stderr, "memBase %p cacheInvalidates %p, start %lx size %d, Now lines %d global with interwrites %d totalWrites %d\n", memBase, cacheInvalidates, objectStart, objectSize, lines, interwrites, totalwrites); 
-      // For globals, only when we need to output this object then we need to store that.
-      // Since there is no accumulation for global objects.
-      if (interwrites > xdefines::MIN_INTERWRITES_OUTPUT && totalwrites >= (xdefines::MIN_INTERWRITES_OUTPUT)) {
-        // Save the object information
-        ObjectInfo objectinfo;
-        objectinfo.is_heap_object = false;
-        //objectinfo.is_heap_object = true;
-        objectinfo.interwrites = interwrites;
-        objectinfo.totalwrites = totalwrites;
-        objectinfo.unitlength = symbol->st_size;
-        //fprintf(stderr, "get globals with interwirtes larger than 0, interwrites %d\n", interwrites); 
-        objectinfo.lines = lines;
-        objectinfo.actuallines = actuallines;
-        objectinfo.totallength = symbol->st_size;
-        objectinfo.symbol = (void *)symbol;
-        objectinfo.start = (unsigned long *)objectStart;
-        objectinfo.stop = (unsigned long *)(objectStart + objectSize);
-        objectinfo.wordchange_start = &wordchange[objectOffset/sizeof(unsigned long)];
-        objectinfo.wordchange_stop = (wordchangeinfo *)((intptr_t)&wordchange[objectOffset/sizeof(unsigned long)] + objectinfo.totallength);
-
-        // Check the first object for share type.
-        objectinfo.access_threads = getAccessThreads((unsigned long *)objectStart, objectSize, (wordchangeinfo *)objectinfo.wordchange_start);
-        ObjectTable::getInstance().insertObject(objectinfo);
+      unsigned long start = (module->dataStart > memStart ? module->dataStart : memStart);
+      unsigned long end = (module->dataEnd < memEnd ? module->dataEnd : memEnd);
+      unsigned long line = (start - memStart)/xdefines::CACHE_LINE_SIZE;
+      unsigned long lastline = (end - memStart + xdefines::CACHE_LINE_SIZE - 1)/xdefines::CACHE_LINE_SIZE;
+
+      // Objects are checked in the address order, so one object is checked only once.
+      long checked = -1;
+
+      for(; line < lastline; line++) {
+        if(cacheInvalidates[line] == 0) {
+          continue;
+        }
+
+        unsigned long lineStart = memStart + line * xdefines::CACHE_LINE_SIZE;
+        unsigned long lineEnd = lineStart + xdefines::CACHE_LINE_SIZE;
+        long index = modules.findObjectIndex(module, lineStart);
+
+        // The object starting before this line may still cover it.
+        if(index < 0 || module->objects[index].start + module->objects[index].size <= lineStart) {
+          index++;
+        }
+
+        for(; index < (long)module->objectsNum && module->objects[index].start < lineEnd; index++) {
+          xmodules::objectsymbol * object = &module->objects[index];
+
+          if(index <= checked) {
+            continue;
+          }
+          checked = index;
+
+          if(object->start < memStart || object->start + object->size > memEnd) {
+            continue;
+          }
+
+          checkGlobalObject(object->start, object->size, cacheInvalidates, memBase, wordchange);
+        }
       }
     }
   } 
+
+  void checkGlobalObject(unsigned long objectStart, long objectSize, unsigned long *cacheInvalidates, int * memBase, wordchangeinfo * wordchange) {
+    long objectOffset = objectStart - (intptr_t)memBase;
+    long lines = getCachelines(objectStart, objectSize);
+    long actuallines = 0;
+    long interwrites = getCacheInvalidates(objectOffset/xdefines::CACHE_LINE_SIZE, lines, cacheInvalidates, &actuallines);
+   
+    long totalwrites = getObjectWrites((int *)objectStart, (int *)(objectStart + objectSize), memBase, wordchange);
+    // For globals, only when we need to output this object then we need to store that.
+    // Since there is no accumulation for global objects.
+    if (interwrites > xtunables::get(xtunables::MIN_INTERWRITES_OUTPUT) && totalwrites >= (xtunables::get(xtunables::MIN_INTERWRITES_OUTPUT))) {
+      // Save the object information
+      ObjectInfo objectinfo;
+      objectinfo.is_heap_object = false;
+      objectinfo.interwrites = interwrites;
+      objectinfo.totalwrites = totalwrites;
+      objectinfo.unitlength = objectSize;
+      objectinfo.lines = lines;
+      objectinfo.actuallines = actuallines;
+      objectinfo.totallength = objectSize;
+      objectinfo.symbol = NULL;
+      objectinfo.start = (unsigned long *)objectStart;
+      objectinfo.stop = (unsigned long *)(objectStart + objectSize);
+      objectinfo.wordchange_start = (wordchangeinfo *)((intptr_t)wordchange + objectOffset);
+      objectinfo.wordchange_stop = (wordchangeinfo *)((intptr_t)wordchange + objectOffset + objectinfo.totallength);
+
+      // Check the first object for share type.
+      objectinfo.access_threads = getAccessThreads((unsigned long *)objectStart, objectSize, (wordchangeinfo *)objectinfo.wordchange_start);
+      ObjectTable::getInstance().insertObject(objectinfo);
+    }
+  }
  
-private:
+  // A range mapped by the application is treated as one heap object,
+  // so that it is reported with the callsite of its mmap.
+  void checkMappedObject(unsigned long objectStart, long objectSize, CallSite * callsite, unsigned long *cacheInvalidates, int * memBase, wordchangeinfo * wordchange) {
+    long objectOffset = objectStart - (intptr_t)memBase;
+    long lines = getCachelines(objectStart, objectSize);
+    long actuallines = 0;
+    long interwrites = getCacheInvalidates(objectOffset/xdefines::CACHE_LINE_SIZE, lines, cacheInvalidates, &actuallines);
+
+    if(interwrites > xtunables::get(xtunables::MIN_INTERWRITES_CARE)) {
+      ObjectInfo objectinfo;
+      objectinfo.is_heap_object = true;
+      objectinfo.interwrites = interwrites;
+      objectinfo.totalwrites = getObjectWrites((int *)objectStart, (int *)(objectStart + objectSize), memBase, wordchange);
+      objectinfo.unitlength = objectSize;
+      objectinfo.lines = lines;
+      objectinfo.actuallines = actuallines;
+      objectinfo.totallength = objectSize;
+      objectinfo.start = (unsigned long *)objectStart;
+      objectinfo.stop = (unsigned long *)(objectStart + objectSize);
+      objectinfo.wordchange_start = (wordchangeinfo *)((intptr_t)wordchange + objectOffset);
+      objectinfo.wordchange_stop = (wordchangeinfo *)((intptr_t)wordchange + objectOffset + objectSize);
+      memcpy((void *)&objectinfo.callsite, (void *)callsite, sizeof(CallSite));
+
+      objectinfo.access_threads = getAccessThreads((unsigned long *)objectStart, objectSize, (wordchangeinfo *)objectinfo.wordchange_start);
+      ObjectTable::getInstance().insertObject(objectinfo);
+    }
+  }
 
-  struct elf_info _elf_info;
+private:
 
   // Profiling type.
   bool _isHeap;
-  
-  char _exec_filename[MAXBUFSIZE];
 };
 
 
@@ -31,6 +31,7 @@
 #include "dllist.h"
 #include "sanitycheckheap.h"
 #include "zoneheap.h"
+#include "mm.h"
 /**
  * @file InternalHeap.h
  * @brief A shared heap for internal allocation needs.
@@ -63,14 +64,37 @@ public:
       
 //      fprintf(stderr, "Internal heap start %p to %lx\n", start, (intptr_t)start + xdefines::INTERNALHEAP_SIZE);  
       _alreadyMalloced = true;
+      if(*regions() < MAX_REGIONS) {
+        region()[(*regions())++] = start;
+      }
       return(start);
     }
   }
   
   void free (void * addr) {}
 
+  /// @brief Make every region this process maps private to it. Only the
+  /// pages in use are copied, most of a region is never touched.
+  static void detachAll (void) {
+    for(int i = 0; i < *regions(); i++) {
+      MM::privatize(region()[i], xdefines::INTERNALHEAP_SIZE, xdefines::INTERNALHEAP_SIZE, true);
+    }
+  }
+
 private:
 
+  enum { MAX_REGIONS = 8 };
+
+  static int * regions (void) {
+    static int count = 0;
+    return &count;
+  }
+
+  static void ** region (void) {
+    static void * starts[MAX_REGIONS];
+    return starts;
+  }
+
   bool _alreadyMalloced;  
 
 };
@@ -169,6 +193,23 @@ public:
     return *theOneTrueObject;
   }
   
+  /// @brief Take a private copy of the heap in a process forked by the
+  /// application, so that its synchronization objects are its own. The
+  /// heap is copied under the lock, which is then replaced by a new one.
+  void detach (void) {
+    pthread_mutexattr_t attr;
+
+    lock();
+    void * heap = MM::copy(this, sizeof(InternalHeap));
+    SourceInternalHeap::detachAll();
+    unlock();
+    MM::install(heap, this, sizeof(InternalHeap));
+
+    MM::privatize(_lock, 0, sizeof(pthread_mutex_t));
+    WRAP(pthread_mutexattr_init)(&attr);
+    WRAP(pthread_mutex_init)(_lock, &attr);
+  }
+
   void * malloc (size_t sz) {
     void * ptr = NULL;
     lock(); 
@@ -30,6 +30,7 @@
 
 #include "xdefines.h"
 #include "xplock.h"
+#include "mm.h"
 
 template <unsigned long Size>
 class SourceSharedHeap
@@ -69,7 +70,7 @@ public:
     _lock->lock();
     
     if (*_remaining < sz) {
-      fprintf (stderr, "Out of memory error: available = %u, requested = %u, thread = %d.\n",
+      fprintf (stderr, "Out of memory error: available = %zu, requested = %zu, thread = %d.\n",
        *_remaining, sz, (int) pthread_self());
       exit(-1);
     }
@@ -87,6 +88,25 @@ public:
     return p;
   }
 
+  /// @brief Nothing to do: the constructor maps the heap. Calling this
+  /// before the first spawn makes sure every thread shares it.
+  void initialize (void) { sanityCheck(); }
+
+  /// @brief Give a process forked by the application its own copy of the
+  /// heap, which every thread of the program shares otherwise.
+  void detach (void) {
+    _lock->lock();
+    void * meta = MM::copy(_position, xdefines::PageSize);
+    _lock->unlock();
+    MM::install(meta, _position, xdefines::PageSize);
+    _lock->detach();
+    MM::privatize((void *)_start, *_position - _start, Size);
+  }
+
+  inline bool inRange (void * ptr) {
+    return ((char *)ptr >= _start && (char *)ptr < _end);
+  }
+
   // These should never be used.
   inline void free (void * ptr) { sanityCheck(); }
   inline size_t getSize (void * ptr) { sanityCheck(); return 0; } // FIXME
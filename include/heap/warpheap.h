@@ -41,6 +41,7 @@
 #include "sanitycheckheap.h"
 #include "zoneheap.h"
 #include "objectheader.h"
+#include "mm.h"
 
 #define ALIGN_TO_PAGE 0 // doesn't work...
 
@@ -166,6 +167,19 @@ public:
 	  }
   }
 
+  /// @brief Give a process forked by the application locks of its own,
+  /// unlocked whatever the other threads of the program were doing.
+  void detach (void)
+  {
+    pthread_mutexattr_t attr;
+
+    MM::privatize(_lock[0], 0, sizeof(pthread_mutex_t) * NumHeaps);
+    WRAP(pthread_mutexattr_init) (&attr);
+    for(int i = 0; i < NumHeaps; i++) {
+      WRAP(pthread_mutex_init) (_lock[i], &attr);
+    }
+  }
+
   void * malloc (int ind, size_t sz)
   {
 	  lock(ind);
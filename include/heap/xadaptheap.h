@@ -22,6 +22,8 @@
 #ifndef _XADAPTHEAP_H_
 #define _XADAPTHEAP_H_
 
+#include "mm.h"
+
 /**
  * @class xadaptheap
  * @brief Manages a heap whose metadata is allocated from a given source.
@@ -79,6 +81,17 @@ public:
 	return _heap->nextPage(); 
   }
 
+  /// @brief Give a process forked by the application its own copy of the
+  /// heap and its metadata. It allocates from its own per-thread heap
+  /// only, so the others may be copied in the middle of an allocation.
+  void detach (void) {
+    size_t metasize = sizeof(Heap<Source, ChunkSize>);
+
+    Source::detach();
+    MM::privatize(_heap, metasize, metasize);
+    _heap->detach();
+  }
+
   void setHeapId(int index) {
     _heapid = index;
   }
@@ -113,6 +113,17 @@ public:
     parent::initialize();
   }
 
+  /// @brief Give a process forked by the application its own copy of the
+  /// heap, see xpersist::detach(). The bump pointer is copied under the lock.
+  void detach (void) {
+    _lock->lock();
+    void * meta = MM::copy(_position, xdefines::PageSize);
+    _lock->unlock();
+    MM::install(meta, _position, xdefines::PageSize);
+    _lock->detach();
+    parent::detach(*_position);
+  }
+
   // These should never be used.
   inline void free (void * ptr) { sanityCheck(); }
   inline size_t getSize (void * ptr) { sanityCheck(); return 0; }
@@ -0,0 +1,437 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xmmapheap.h
+ * @brief  A persistent arena for anonymous mappings created by the application.
+ *         Every mapping is carved from one xpersist region, so that writes are
+ *         committed and shared like the heap, and get their own shadow metadata.
+ *         Mappings are kept in a table sorted by address on a shared page,
+ *         which lets any thread unmap or remap what another thread has mapped.
+ */
+
+#ifndef SHERIFF_XMMAPHEAP_H
+#define SHERIFF_XMMAPHEAP_H
+
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "xdefines.h"
+#include "xplock.h"
+#include "callsite.h"
+#include "xpageentry.h"
+#if defined(DETECT_FALSE_SHARING)
+#include "xpersist.h"
+#else
+#include "xpersist_opt.h"
+#endif
+
+template <unsigned long Size>
+class xmmapheap : public xpersist<char,Size>
+{
+  typedef xpersist<char,Size> parent;
+
+  enum mappingState { MAPPING_FREE = 0, MAPPING_USED, MAPPING_RETIRED };
+
+  // One chunk of the arena.
+  struct mapping {
+    char * start;
+    size_t size;
+    size_t unit;
+    int    state;
+    CallSite callsite;
+  };
+
+  // Everything here is shared by all threads.
+  struct metadata {
+    char * position;
+    size_t remaining;
+    size_t magic;
+    int    mappings;
+    xplock lock;
+    mapping table[xdefines::MAX_MMAP_RECORDS];
+  };
+
+public:
+
+  xmmapheap (void)
+  {
+    // Like xheap, the metadata can not live in the arena itself since
+    // it must never be protected.
+    size_t sz = (sizeof(metadata) + xdefines::PAGE_SIZE_MASK) & ~xdefines::PAGE_SIZE_MASK;
+    void * base = mmap (NULL, sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED) {
+      fprintf (stderr, "Failed to allocate the mapping table.\n");
+      ::abort();
+    }
+
+    _meta = (metadata *)base;
+    new (&_meta->lock) xplock;
+    _meta->position  = (char *)parent::base();
+    _meta->remaining = parent::size();
+    _meta->magic     = 0xCAFEBABE;
+    _meta->mappings  = 0;
+  }
+
+  void initialize(void) {
+    parent::initialize();
+  }
+
+  /// @brief Give a process forked by the application its own copy of the
+  /// arena, see xpersist::detach(). The table is copied under the lock.
+  void detach (void) {
+    size_t sz = (sizeof(metadata) + xdefines::PAGE_SIZE_MASK) & ~xdefines::PAGE_SIZE_MASK;
+
+    _meta->lock.lock();
+    void * meta = MM::copy(_meta, sz);
+    _meta->lock.unlock();
+    MM::install(meta, _meta, sz);
+    _meta->lock.detach();
+    parent::detach(_meta->position);
+  }
+
+  inline void * getend(void) {
+    return _meta->position;
+  }
+
+  /// @brief Get a page-aligned chunk, or NULL when the arena can not hold it
+  /// so that the caller can fall back to a plain mapping.
+  void * malloc (size_t sz, CallSite * callsite) {
+    sanityCheck();
+    sz = roundup(sz);
+
+    _meta->lock.lock();
+
+    char * ptr = NULL;
+    int index;
+
+    // First fit on the freed chunks, the remainder stays free.
+    for(index = 0; index < _meta->mappings; index++) {
+      mapping * m = &_meta->table[index];
+      if(m->state == MAPPING_FREE && m->size >= sz) {
+        if(m->size > sz && !split(index, sz)) {
+          continue;
+        }
+        ptr = m->start;
+        break;
+      }
+    }
+
+    // Otherwise, bump the pointer. Chunks protected in coarse units start
+    // on a unit boundary, the gap is left as a free chunk.
+    size_t unit = chooseUnit(sz);
+    size_t pad = ((unit - ((intptr_t)_meta->position & (unit - 1))) & (unit - 1));
+    if(ptr == NULL && pad > 0 && _meta->remaining >= pad + sz
+       && _meta->mappings + 1 < xdefines::MAX_MMAP_RECORDS) {
+      index = _meta->mappings++;
+      _meta->table[index].start = _meta->position;
+      _meta->table[index].size = pad;
+      _meta->table[index].state = MAPPING_FREE;
+      _meta->position += pad;
+      _meta->remaining -= pad;
+    }
+
+    if(ptr == NULL && _meta->remaining >= sz && _meta->mappings < xdefines::MAX_MMAP_RECORDS) {
+      index = _meta->mappings++;
+      ptr = _meta->position;
+      _meta->table[index].start = ptr;
+      _meta->table[index].size = sz;
+      _meta->position += sz;
+      _meta->remaining -= sz;
+    }
+
+    if(ptr != NULL) {
+      _meta->table[index].state = MAPPING_USED;
+      _meta->table[index].unit = unit;
+      if(callsite != NULL) {
+        _meta->table[index].callsite = *callsite;
+      }
+    }
+
+    _meta->lock.unlock();
+    return ptr;
+  }
+
+  /// @brief Unmap [ptr, ptr+sz), which may cover part of a chunk or several chunks.
+  int free (void * ptr, size_t sz) {
+    sanityCheck();
+    char * start = (char *)ptr;
+    char * end = start + roundup(sz);
+
+    _meta->lock.lock();
+
+    for(int index = 0; index < _meta->mappings; index++) {
+      mapping * m = &_meta->table[index];
+      char * mend = m->start + m->size;
+
+      if(m->state != MAPPING_USED || mend <= start || m->start >= end) {
+        continue;
+      }
+
+      // Cut off the parts that are still mapped.
+      if(m->start < start) {
+        if(!split(index, start - m->start)) {
+          break;
+        }
+        continue;
+      }
+      if(mend > end && !split(index, end - m->start)) {
+        break;
+      }
+
+      release(index);
+    }
+
+    coalesce();
+    _meta->lock.unlock();
+    return 0;
+  }
+
+  /// @brief Resize a chunk in place when possible, otherwise move it if allowed.
+  /// @return the new address, or MAP_FAILED with errno set.
+  void * remap (void * ptr, size_t oldsz, size_t newsz, int flags) {
+    sanityCheck();
+    char * start = (char *)ptr;
+    oldsz = roundup(oldsz);
+    newsz = roundup(newsz);
+
+    if(newsz <= oldsz) {
+      if(newsz < oldsz) {
+        free(start + newsz, oldsz - newsz);
+      }
+      return ptr;
+    }
+
+    // Grow the chunk in place when it is the last one.
+    CallSite callsite;
+    _meta->lock.lock();
+    int index = findMapping(start);
+    if(index >= 0) {
+      callsite = _meta->table[index].callsite;
+    }
+    if(index >= 0 && _meta->table[index].start == start
+       && _meta->table[index].size == oldsz
+       && start + oldsz == _meta->position
+       && _meta->remaining >= newsz - oldsz) {
+      _meta->table[index].size = newsz;
+      _meta->position += newsz - oldsz;
+      _meta->remaining -= newsz - oldsz;
+      _meta->lock.unlock();
+      return ptr;
+    }
+    _meta->lock.unlock();
+
+    if(!(flags & MREMAP_MAYMOVE)) {
+      errno = ENOMEM;
+      return MAP_FAILED;
+    }
+
+    void * newptr = malloc(newsz, &callsite);
+    if(newptr == NULL) {
+      errno = ENOMEM;
+      return MAP_FAILED;
+    }
+
+    memcpy(newptr, ptr, oldsz);
+    free(ptr, oldsz);
+    return newptr;
+  }
+
+  /// @brief Write faults on chunks with a coarse unit unprotect the whole
+  /// unit around the fault, clipped to the chunk. The table is read under
+  /// the lock, another thread may be splitting it; nothing holding the lock
+  /// writes to the arena, so this can not fault while holding it.
+  void handleWrite (void * addr) {
+    size_t unit = xdefines::PageSize;
+    char * chunkStart = NULL;
+    char * chunkEnd = NULL;
+
+    _meta->lock.lock();
+    int index = findMapping((char *)addr);
+    if(index >= 0) {
+      unit = _meta->table[index].unit;
+      chunkStart = _meta->table[index].start;
+      chunkEnd = chunkStart + _meta->table[index].size;
+    }
+    _meta->lock.unlock();
+
+    // Twin pages are taken one per 4K, so fall back to a single page
+    // once the twins of a whole unit would not fit any more.
+    if(unit <= xdefines::PageSize
+       || xpageentry::getInstance().available() < (int)(unit/xdefines::PageSize)) {
+      parent::handleWrite(addr);
+      return;
+    }
+
+    char * start = (char *)((intptr_t)addr & ~(unit - 1));
+    char * end = start + unit;
+    if(start < chunkStart) {
+      start = chunkStart;
+    }
+    if(end > chunkEnd) {
+      end = chunkEnd;
+    }
+    parent::unprotectRange(start, end - start);
+  }
+
+  /// @brief Override the protection unit of the chunks within a range.
+  /// @return the number of chunks changed, 0 for an unsupported unit.
+  int setProtectionUnit (void * ptr, size_t sz, size_t unit) {
+    char * start = (char *)ptr;
+    char * end = start + sz;
+    int changed = 0;
+
+    if(unit != xdefines::PROTECTION_UNIT_SMALL && unit != xdefines::PROTECTION_UNIT_MEDIUM
+       && unit != xdefines::PROTECTION_UNIT_LARGE) {
+      return 0;
+    }
+
+    _meta->lock.lock();
+    for(int index = 0; index < _meta->mappings; index++) {
+      mapping * m = &_meta->table[index];
+      if(m->state == MAPPING_USED && m->start < end && m->start + m->size > start) {
+        m->unit = unit;
+        changed++;
+      }
+    }
+    _meta->lock.unlock();
+    return changed;
+  }
+
+  void finalize (void * end) {
+#if defined(DETECT_FALSE_SHARING) || defined(DETECT_FALSE_SHARING_OPT)
+  #ifdef DETECT_FALSE_SHARING_OPT
+    parent::closeProtection();
+  #endif
+    // Report every live or retired mapping under its own callsite.
+    for(int index = 0; index < _meta->mappings; index++) {
+      mapping * m = &_meta->table[index];
+      if(m->state != MAPPING_FREE) {
+        parent::checkMappedObject(m->start, m->size, &m->callsite);
+      }
+    }
+#endif
+  }
+
+private:
+
+  void sanityCheck (void) {
+    if (_meta->magic != 0xCAFEBABE) {
+      fprintf (stderr, "Fatal error: sanity check failed in process %d.\n", getpid());
+      ::abort();
+    }
+  }
+
+  /// Big arrays are rarely shared at page granularity, so they are
+  /// protected in coarser units to save faults.
+  inline size_t chooseUnit (size_t sz) {
+    if(sz >= xdefines::LARGE_UNIT_THRESHOLD) {
+      return xdefines::PROTECTION_UNIT_LARGE;
+    }
+    else if(sz >= xdefines::MEDIUM_UNIT_THRESHOLD) {
+      return xdefines::PROTECTION_UNIT_MEDIUM;
+    }
+    return xdefines::PROTECTION_UNIT_SMALL;
+  }
+
+  inline size_t roundup (size_t sz) {
+    return (sz + xdefines::PAGE_SIZE_MASK) & ~xdefines::PAGE_SIZE_MASK;
+  }
+
+  /// @return the index of the chunk holding addr, or -1.
+  int findMapping (char * addr) {
+    int low = 0;
+    int high = _meta->mappings - 1;
+
+    while(low <= high) {
+      int mid = (low + high)/2;
+      mapping * m = &_meta->table[mid];
+      if(addr < m->start) {
+        high = mid - 1;
+      }
+      else if(addr >= m->start + m->size) {
+        low = mid + 1;
+      }
+      else {
+        return mid;
+      }
+    }
+    return -1;
+  }
+
+  /// Split one chunk at offset, the new chunk right after it gets the same state.
+  bool split (int index, size_t offset) {
+    if(_meta->mappings >= xdefines::MAX_MMAP_RECORDS) {
+      return false;
+    }
+
+    memmove(&_meta->table[index+1], &_meta->table[index],
+            (_meta->mappings - index) * sizeof(mapping));
+    _meta->mappings++;
+
+    _meta->table[index].size = offset;
+    _meta->table[index+1].start += offset;
+    _meta->table[index+1].size -= offset;
+    return true;
+  }
+
+  /// Give back the pages of one chunk. In detection, a chunk which has seen
+  /// interleaved writes is retired instead, so that it can still be reported.
+  void release (int index) {
+    mapping * m = &_meta->table[index];
+
+    m->state = MAPPING_FREE;
+#if defined(DETECT_FALSE_SHARING) || defined(DETECT_FALSE_SHARING_OPT)
+    if(!parent::cleanupHeapObject(m->start, m->size)) {
+      m->state = MAPPING_RETIRED;
+    }
+#endif
+    parent::discardRange(m->start, m->size);
+  }
+
+  /// Merge neighbouring free chunks and give the last ones back to the bump pointer.
+  void coalesce (void) {
+    int to = 0;
+
+    for(int from = 0; from < _meta->mappings; from++) {
+      mapping * m = &_meta->table[from];
+      if(to > 0 && m->state == MAPPING_FREE && _meta->table[to-1].state == MAPPING_FREE) {
+        _meta->table[to-1].size += m->size;
+        continue;
+      }
+      if(to != from) {
+        _meta->table[to] = *m;
+      }
+      to++;
+    }
+    _meta->mappings = to;
+
+    if(to > 0 && _meta->table[to-1].state == MAPPING_FREE) {
+      _meta->position -= _meta->table[to-1].size;
+      _meta->remaining += _meta->table[to-1].size;
+      _meta->mappings--;
+    }
+  }
+
+  metadata * _meta;
+};
+
+#endif
@@ -51,8 +51,11 @@ public:
 
   void openProtection() { getHeap()->openProtection(); }
   void closeProtection() { getHeap()->closeProtection(); }
+  void shareView() { getHeap()->shareView(); }
+  void detach() { getHeap()->detach(); }
   void setProtectionPeriod() { getHeap()->setProtectionPeriod(); }
   void unprotectNonProfitPages (void *end) { getHeap()->unprotectNonProfitPages(end); }
+  void evaluateRuns (unsigned long trans) { getHeap()->evaluateRuns(trans); }
    
   int getDirtyPages() { return getHeap()->getDirtyPages(); }
  
@@ -60,6 +63,8 @@ public:
  
   bool inRange (void * ptr) { return getHeap()->inRange(ptr); }
   void handleWrite (void * ptr) { getHeap()->handleWrite(ptr); }
+  void handleWriteRange (void * ptr, size_t sz) { getHeap()->handleWriteRange(ptr, sz); }
+  unsigned long annotate (void * ptr, size_t sz, int hint) { return getHeap()->annotate(ptr, sz, hint); }
   void periodicCheck() { getHeap()->periodicCheck( ); }
 
   void * malloc (size_t sz) { return getHeap()->malloc(sz); }
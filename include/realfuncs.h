@@ -1,26 +1,71 @@
 #ifndef _REAL_H_
 #define _REAL_H_
 
+#include <stdarg.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <signal.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <spawn.h>
 
 #define WRAP(x) _real_##x
 
 // libc functions
 extern void* (*WRAP(mmap))(void*, size_t, int, int, int, off_t);
+extern int (*WRAP(munmap))(void*, size_t);
+extern int (*WRAP(mprotect))(void*, size_t, int);
+extern void* (*WRAP(mremap))(void*, size_t, size_t, int, ...);
 extern void* (*WRAP(malloc))(size_t);
 extern void  (*WRAP(free))(void *);
 extern void* (*WRAP(realloc))(void *, size_t);
 extern void* (*WRAP(memalign))(size_t, size_t);
 extern size_t (*WRAP(malloc_usable_size))(void *);
 extern ssize_t (*WRAP(read))(int, void*, size_t);
+extern ssize_t (*WRAP(pread))(int, void*, size_t, off_t);
+extern ssize_t (*WRAP(pread64))(int, void*, size_t, off64_t);
+extern ssize_t (*WRAP(readv))(int, const struct iovec*, int);
+extern ssize_t (*WRAP(recv))(int, void*, size_t, int);
+extern ssize_t (*WRAP(recvfrom))(int, void*, size_t, int, struct sockaddr*, socklen_t*);
+extern ssize_t (*WRAP(recvmsg))(int, struct msghdr*, int);
+extern size_t (*WRAP(fread))(void*, size_t, size_t, FILE*);
+extern char* (*WRAP(fgets))(char*, int, FILE*);
+extern char* (*WRAP(__fgets_chk))(char*, size_t, int, FILE*);
+extern int (*WRAP(fgetc))(FILE*);
+extern int (*WRAP(getc))(FILE*);
+extern ssize_t (*WRAP(getdelim))(char**, size_t*, int, FILE*);
+extern int (*WRAP(vfscanf))(FILE*, const char*, va_list);
+extern int (*WRAP(__isoc99_vfscanf))(FILE*, const char*, va_list);
+extern int (*WRAP(__isoc23_vfscanf))(FILE*, const char*, va_list);
+extern struct dirent* (*WRAP(readdir))(DIR*);
+extern struct dirent64* (*WRAP(readdir64))(DIR*);
 extern ssize_t (*WRAP(write))(int, const void*, size_t);
 extern int (*WRAP(sigwait))(const sigset_t*, int*);
+extern long (*WRAP(syscall))(long, ...);
+extern int (*WRAP(sigaction))(int, const struct sigaction*, struct sigaction*);
+
+// processes
+extern pid_t (*WRAP(fork))(void);
+extern int (*WRAP(execve))(const char*, char* const*, char* const*);
+extern int (*WRAP(execvp))(const char*, char* const*);
+extern int (*WRAP(execvpe))(const char*, char* const*, char* const*);
+extern int (*WRAP(posix_spawn))(pid_t*, const char*, const posix_spawn_file_actions_t*,
+                                const posix_spawnattr_t*, char* const*, char* const*);
+extern int (*WRAP(posix_spawnp))(pid_t*, const char*, const posix_spawn_file_actions_t*,
+                                 const posix_spawnattr_t*, char* const*, char* const*);
+
+// libdl functions
+extern void* (*WRAP(dlopen))(const char*, int);
+extern int (*WRAP(dlclose))(void*);
 
 // pthread basics
 extern int (*WRAP(pthread_create))(pthread_t*, const pthread_attr_t*, void *(*)(void*), void*);
 extern int (*WRAP(pthread_cancel))(pthread_t);
 extern int (*WRAP(pthread_join))(pthread_t, void**);
 extern int (*WRAP(pthread_exit))(void*);
+extern pthread_t (*WRAP(pthread_self))(void);
+extern int (*WRAP(pthread_kill))(pthread_t, int);
 
 // pthread mutexes
 extern int (*WRAP(pthread_mutexattr_init))(pthread_mutexattr_t*);
@@ -0,0 +1,127 @@
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   sheriff.h
+ * @brief  Annotations an application can give Sheriff, from C or C++.
+ *
+ * Sheriff finds transaction boundaries from the pthread calls it
+ * interposes, and tracks the whole heap, the mapped arena and the globals.
+ * Code that knows better can say so:
+ *
+ *  - sheriff_region_exclude() stops tracking the pages overlapping a range.
+ *    Writes go straight to shared memory, as without Sheriff, and are not
+ *    reported. Meant for read-only data and data one thread owns.
+ *  - sheriff_region_isolate() keeps the pages overlapping a range protected,
+ *    whatever the cost model of Sheriff-Protect decides. Sheriff-Detect
+ *    gives them private copies as it does for falsely shared pages.
+ *  - sheriff_region_include() undoes either annotation.
+ *  - sheriff_region_unit() sets how much memory one write fault opens in
+ *    the mapped arrays overlapping a range: 4096, 65536 or 2097152 bytes.
+ *    Arrays mapped with mmap pick 64K from 4MB and 2M from 64MB on their
+ *    own. Coarser units take fewer faults on big arrays written in
+ *    streams, but twin and diff every page of the unit. The unit holds
+ *    for all threads at once. Returns -1 with errno set to EINVAL for
+ *    another unit or a range holding no mapped array.
+ *  - sheriff_phase_begin() and sheriff_phase_end() name stretches of a
+ *    thread in the SHERIFF_TRACE output.
+ *  - sheriff_trace_dump() writes the SHERIFF_TRACE output now, as it is
+ *    written at exit, with the events recorded so far. Returns 0, or -1
+ *    with errno set to EINVAL when tracing is off, or to the error of
+ *    writing the file.
+ *  - sheriff_commit_point() publishes this thread's writes and picks up
+ *    those of other threads, for lock-free code that synchronizes without
+ *    pthread calls.
+ *  - sheriff_atomic_alloc() returns memory from an arena that every
+ *    thread maps shared and Sheriff never tracks, for atomic flags,
+ *    counters and lock-free queues: atomic operations on it work as
+ *    without Sheriff, at native speed. sheriff_atomic_free(), free() and
+ *    realloc() take it back. Sheriff reports an atomic instruction that
+ *    writes tracked memory the first time it faults; with
+ *    SHERIFF_ATOMIC_PAGES=1 it also stops tracking the page it wrote.
+ *  - sheriff_thread_mode() chooses which threads run isolated, as
+ *    processes that commit at every synchronization, and which run as
+ *    real threads of the process that creates them. The mode applies to
+ *    the threads started with a routine, or with routine NULL, to every
+ *    thread the caller creates from now on. Threads are isolated by
+ *    default; SHERIFF_SHARED_THREADS lists functions, by name, whose
+ *    threads share (the start routine or the function calling
+ *    pthread_create). A process stops tracking its own writes for good
+ *    when it starts its first real thread: it and its real threads write
+ *    shared memory directly, and commits only happen in isolated threads.
+ *    Returns 0, or -1 with errno set to EINVAL for an unknown mode or to
+ *    ENOMEM when too many routines were given a mode.
+ *
+ * Annotations work on whole pages. They are kept per thread, like the
+ * mappings they change: annotate before spawning the threads that should
+ * see an annotation. Memory Sheriff does not track, such as stacks or the
+ * large objects Sheriff-Protect leaves shared, counts as excluded already.
+ * The region functions return 0, or -1 with errno set to EINVAL when
+ * isolating a range that holds no memory Sheriff tracks.
+ *
+ * The functions are declared weak, so a program using them still links
+ * without Sheriff and can test for it:
+ *
+ *   if (sheriff_commit_point != NULL) {
+ *     sheriff_commit_point();
+ *   }
+ */
+
+#ifndef SHERIFF_H
+#define SHERIFF_H
+
+#include <stddef.h>
+
+#ifndef SHERIFF_WEAK
+#if defined(__GNUC__)
+#define SHERIFF_WEAK __attribute__((weak))
+#else
+#define SHERIFF_WEAK
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int sheriff_region_exclude (void * start, size_t size) SHERIFF_WEAK;
+  int sheriff_region_include (void * start, size_t size) SHERIFF_WEAK;
+  int sheriff_region_isolate (void * start, size_t size) SHERIFF_WEAK;
+  int sheriff_region_unit (void * start, size_t size, size_t unit) SHERIFF_WEAK;
+
+  void sheriff_phase_begin (const char * name) SHERIFF_WEAK;
+  void sheriff_phase_end (void) SHERIFF_WEAK;
+  int sheriff_trace_dump (void) SHERIFF_WEAK;
+
+  void sheriff_commit_point (void) SHERIFF_WEAK;
+
+  void * sheriff_atomic_alloc (size_t size) SHERIFF_WEAK;
+  void sheriff_atomic_free (void * ptr) SHERIFF_WEAK;
+
+#define SHERIFF_THREAD_DEFAULT  0
+#define SHERIFF_THREAD_ISOLATED 1
+#define SHERIFF_THREAD_SHARED   2
+
+  int sheriff_thread_mode (void * (*start_routine)(void *), int mode) SHERIFF_WEAK;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -27,6 +27,29 @@ class xplock {
 public:
 
   xplock (void) {
+    create();
+  }
+
+  /// @brief Give a process forked by the application a lock of its own,
+  /// instead of the one it shares with the program that forked it.
+  void detach() {
+    munmap(_lock, xdefines::PageSize);
+    create();
+  }
+
+  /// @brief Lock the lock.
+  void lock() {
+    WRAP(pthread_mutex_lock) (_lock);
+  }
+
+  /// @brief Unlock the lock.
+  void unlock() {
+    WRAP(pthread_mutex_unlock)(_lock);
+  }
+
+private:
+
+  void create (void) {
     /// The lock's attributes.
     pthread_mutexattr_t attr;
 
@@ -43,18 +66,6 @@ public:
     WRAP(pthread_mutex_init) (_lock, &attr);
   }
 
-  /// @brief Lock the lock.
-  void lock() {
-    WRAP(pthread_mutex_lock) (_lock);
-  }
-
-  /// @brief Unlock the lock.
-  void unlock() {
-    WRAP(pthread_mutex_unlock)(_lock);
-  }
-
-private:
-
   /// A pointer to the lock.
   pthread_mutex_t * _lock;
 };
@@ -18,6 +18,7 @@
 #include <dlfcn.h>
 
 #include "xdefines.h"
+#include "xcounters.h"
 #include "internalheap.h"
 #if defined(DETECT_FALSE_SHARING)
 #include "xmemory.h"
@@ -75,6 +76,7 @@ public:
   
     assert(realMutex != NULL);
     // Now lock it.
+    xcycles timer(STAT_SYNC);
     return WRAP(pthread_mutex_lock) (realMutex);
   }
 
@@ -120,6 +122,7 @@ public:
     pthread_cond_t * realCond = getRealCond(cond);
     pthread_mutex_t * realMutex = getRealMutex(lck);
 
+    xcycles timer(STAT_SYNC);
     return WRAP(pthread_cond_wait) (realCond, realMutex);
   }
 
@@ -156,6 +159,7 @@ public:
     // barrier must be initialized explicitly.
     assert(realBarrier);  
 
+    xcycles timer(STAT_SYNC);
     return WRAP(pthread_barrier_wait)(realBarrier);
   }
 
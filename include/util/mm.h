@@ -28,8 +28,12 @@
 #ifndef SHERIFF_MM_H
 #define SHERIFF_MM_H
 
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 
+#include "xdefines.h"
 #include "realfuncs.h"
 
 class MM {
@@ -53,8 +57,69 @@ public:
     return allocate (false, sz, fd, startaddr);
   }
 
+  /// @brief Copy a range into fresh private memory, see install(). With
+  /// resident, only the pages in memory are copied: the untouched pages of
+  /// an anonymous shared mapping read as zeros anyway, and reading them
+  /// would fill them in for every process that shares the mapping.
+  static void * copy (void * start, size_t sz, bool resident = false) {
+    sz = roundup(sz);
+    char * copy = (char *)allocatePrivate(sz);
+    if(copy == MAP_FAILED || !resident) {
+      if(copy != MAP_FAILED) {
+        memcpy(copy, start, sz);
+      }
+      return copy;
+    }
+
+    unsigned char vec[256];
+    size_t pages = sz / xdefines::PageSize;
+    for(size_t page = 0; page < pages; page += sizeof(vec)) {
+      size_t count = (pages - page < sizeof(vec)) ? pages - page : sizeof(vec);
+      size_t offset = page * xdefines::PageSize;
+      if(mincore((char *)start + offset, count * xdefines::PageSize, vec) != 0) {
+        memcpy(copy + offset, (char *)start + offset, count * xdefines::PageSize);
+        continue;
+      }
+      for(size_t i = 0; i < count; i++) {
+        if(vec[i] & 1) {
+          memcpy(copy + offset + i * xdefines::PageSize,
+                 (char *)start + offset + i * xdefines::PageSize, xdefines::PageSize);
+        }
+      }
+    }
+    return copy;
+  }
+
+  /// @brief Move a copy made by copy() over the range it was taken from,
+  /// which is private to this process from then on.
+  static void install (void * copy, void * start, size_t sz) {
+    sz = roundup(sz);
+    if(copy == MAP_FAILED
+       || WRAP(mremap)(copy, sz, sz, MREMAP_MAYMOVE | MREMAP_FIXED, start) == MAP_FAILED) {
+      fprintf(stderr, "Failed to make %p private: %s\n", start, strerror(errno));
+      ::abort();
+    }
+  }
+
+  /// @brief Make sz bytes of a shared mapping private to this process. The
+  /// first used bytes keep their contents, the rest reads as zeros.
+  static void privatize (void * start, size_t used, size_t sz, bool resident = false) {
+    used = roundup(used);
+    if(used > 0) {
+      install(copy(start, used, resident), start, used);
+    }
+    if(sz > used && allocatePrivate(sz - used, -1, (char *)start + used) == MAP_FAILED) {
+      fprintf(stderr, "Failed to make %p private: %s\n", start, strerror(errno));
+      ::abort();
+    }
+  }
+
 private:
 
+  static inline size_t roundup (size_t sz) {
+    return (sz + xdefines::PAGE_SIZE_MASK) & ~xdefines::PAGE_SIZE_MASK;
+  }
+
   static void * allocate (bool isShared,
 			  size_t sz,
 			  int fd,
@@ -62,7 +127,9 @@ private:
   {
     int protInfo   = PROT_READ | PROT_WRITE;
     int sharedInfo = isShared ? MAP_SHARED : MAP_PRIVATE;
-    sharedInfo     |= ((fd == -1) ? MAP_ANONYMOUS : 0);
+    // Anonymous memory holds sparse shadow metadata, so don't let the
+    // kernel refuse it for lack of swap.
+    sharedInfo     |= ((fd == -1) ? MAP_ANONYMOUS | MAP_NORESERVE : 0);
     sharedInfo     |= ((startaddr != NULL) ? MAP_FIXED : 0);
     
     return mmap (startaddr,
@@ -0,0 +1,77 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/**
+ * @class pagecopy
+ * @brief Copies and prefetches of whole pages for twins. A twin is only read
+ *        again at commit, so it is written around the caches when it is made
+ *        and brought back just before it is diffed.
+ */
+
+#ifndef SHERIFF_PAGECOPY_H
+#define SHERIFF_PAGECOPY_H
+
+#include <string.h>
+
+#ifdef SSE_SUPPORT
+#include <emmintrin.h>
+#endif
+
+#include "xdefines.h"
+
+class pagecopy {
+public:
+
+  /// @brief Copy one page with streaming stores. Both pages are page aligned.
+  inline static void copyNonTemporal (void * dest, const void * src) {
+#ifdef SSE_SUPPORT
+    __m128i * destbuf = (__m128i *) dest;
+    const __m128i * srcbuf = (const __m128i *) src;
+
+    for (size_t i = 0; i < xdefines::PageSize / sizeof(__m128i); i += 4) {
+      __m128i chunk0 = _mm_load_si128 (&srcbuf[i]);
+      __m128i chunk1 = _mm_load_si128 (&srcbuf[i+1]);
+      __m128i chunk2 = _mm_load_si128 (&srcbuf[i+2]);
+      __m128i chunk3 = _mm_load_si128 (&srcbuf[i+3]);
+      _mm_stream_si128 (&destbuf[i], chunk0);
+      _mm_stream_si128 (&destbuf[i+1], chunk1);
+      _mm_stream_si128 (&destbuf[i+2], chunk2);
+      _mm_stream_si128 (&destbuf[i+3], chunk3);
+    }
+
+    // Streaming stores are weakly ordered.
+    _mm_sfence();
+#else
+    memcpy (dest, src, xdefines::PageSize);
+#endif
+  }
+
+  /// @brief Start loading one page into the cache.
+  inline static void prefetch (const void * page) {
+#ifdef SSE_SUPPORT
+    for (int offset = 0; offset < xdefines::PageSize; offset += xdefines::CACHE_LINE_SIZE) {
+      _mm_prefetch ((const char *)page + offset, _MM_HINT_T0);
+    }
+#endif
+  }
+};
+
+#endif
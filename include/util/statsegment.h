@@ -0,0 +1,77 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   statsegment.h
+ * @brief  Layout of the live stats segment, shared by the library and the
+ *         tools that read it (examples/sheriffstat.cpp). Self-contained on
+ *         purpose, so that tools do not pull in the library headers.
+ *
+ * With SHERIFF_STATS set, the segment is the file
+ * /dev/shm/sheriff-stats.<pid of the main thread>, removed at exit.
+ */
+
+#ifndef SHERIFF_STATSEGMENT_H
+#define SHERIFF_STATSEGMENT_H
+
+enum { STAT_MAGIC = 0x53484552 };
+enum { STAT_VERSION = 1 };
+enum { STAT_SLOTS = 256 };
+
+/// Where the cycles go. SEGV includes FAULT; the waits are mostly off CPU.
+enum statSubsystem {
+  STAT_SEGV,      // The write fault signal handler.
+  STAT_FAULT,     // Twinning and recording a written page.
+  STAT_COMMIT,    // Diffing and committing dirty pages.
+  STAT_UPDATE,    // Refreshing the local view at begin.
+  STAT_CHECK,     // Periodic checking of interleaving writes.
+  STAT_SYNC,      // Waiting for mutexes, condition variables and barriers.
+  STAT_SPAWN,     // Forking a thread.
+  STAT_JOIN,      // Waiting for a thread to finish.
+  STAT_SUBSYSTEMS
+};
+
+static const char * const statSubsystemNames[STAT_SUBSYSTEMS] = {
+  "segv", "fault", "commit", "update", "check", "sync", "spawn", "join"
+};
+
+/// Counters of one thread, or the sum of the threads that have exited.
+struct statslot {
+  volatile int pid;             // 0 when the slot is free.
+  int thread;
+  unsigned long startNs;        // CLOCK_MONOTONIC at thread start.
+  unsigned long wallNs;         // Wall time so far.
+  unsigned long cpuNs;          // CPU time so far.
+  unsigned long cycles[STAT_SUBSYSTEMS];
+  unsigned long calls[STAT_SUBSYSTEMS];
+};
+
+struct statsegment {
+  unsigned int magic;
+  unsigned int version;
+  int mainPid;
+  unsigned long startTsc;       // TSC and CLOCK_MONOTONIC at start, to
+  unsigned long startNs;        // convert cycles to time.
+  struct statslot retired;
+  struct statslot slots[STAT_SLOTS];
+};
+
+#endif
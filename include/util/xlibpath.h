@@ -0,0 +1,239 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xlibpath.h
+ * @brief  Find a library the way the loader would for a given caller.
+ *
+ * The loader searches for the library named in dlopen() along the
+ * DT_RPATH or DT_RUNPATH of the object that called it, and expands
+ * $ORIGIN to that object's directory. Sheriff's dlopen() calls the real
+ * one, so the loader sees libsheriff as the caller. resolve() does the
+ * caller's part of the search in its place: the DT_RPATH of the caller and
+ * of the executable, LD_LIBRARY_PATH and the DT_RUNPATH of the caller, in
+ * the loader's order. The search that does not depend on the caller, in
+ * ld.so.cache and the default directories, is left to the loader.
+ */
+
+#ifndef SHERIFF_XLIBPATH_H
+#define SHERIFF_XLIBPATH_H
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <link.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/auxv.h>
+
+class xlibpath {
+public:
+
+  /// @brief Find the file dlopen(filename) loads when called from caller.
+  /// @return whether path holds it; otherwise filename can be passed on.
+  static bool resolve (const char * filename, void * caller, char * path, size_t size) {
+    Dl_info info;
+    struct link_map * map = NULL;
+
+    // Setuid programs restrict $ORIGIN and the environment; leave them to
+    // the loader.
+    if(filename == NULL || getauxval(AT_SECURE)
+       || dladdr1(caller, &info, (void **)&map, RTLD_DL_LINKMAP) == 0 || map == NULL) {
+      return false;
+    }
+
+    char origin[PATH_MAX];
+    if(!originOf(map, origin, sizeof(origin))) {
+      return false;
+    }
+
+    if(strchr(filename, '/') != NULL) {
+      return (strstr(filename, "$ORIGIN") != NULL || strstr(filename, "${ORIGIN}") != NULL)
+        && expand(filename, strlen(filename), origin, path, size);
+    }
+
+    const char * rpath = dynamicString(map, DT_RPATH);
+    const char * runpath = dynamicString(map, DT_RUNPATH);
+
+    // DT_RPATH applies only where no DT_RUNPATH is given, the executable's
+    // after the caller's.
+    if(runpath == NULL) {
+      if(search(rpath, origin, filename, path, size)) {
+        return true;
+      }
+
+      struct link_map * main = mainMap(map);
+      char mainOrigin[PATH_MAX];
+      if(main != map && main != NULL && dynamicString(main, DT_RUNPATH) == NULL
+         && originOf(main, mainOrigin, sizeof(mainOrigin))
+         && search(dynamicString(main, DT_RPATH), mainOrigin, filename, path, size)) {
+        return true;
+      }
+    }
+
+    return search(getenv("LD_LIBRARY_PATH"), origin, filename, path, size)
+      || search(runpath, origin, filename, path, size);
+  }
+
+private:
+
+  /// The directory of an object, what $ORIGIN stands for.
+  static bool originOf (struct link_map * map, char * origin, size_t size) {
+    ssize_t len;
+
+    if(map->l_name != NULL && map->l_name[0] != '\0') {
+      len = strlen(map->l_name);
+      if(len >= (ssize_t)size) {
+        return false;
+      }
+      memcpy(origin, map->l_name, len);
+    }
+    else {
+      // The executable has no name in its link map.
+      len = readlink("/proc/self/exe", origin, size - 1);
+      if(len <= 0) {
+        return false;
+      }
+    }
+
+    while(len > 0 && origin[len - 1] != '/') {
+      len--;
+    }
+    if(len > 1) {
+      len--;
+    }
+    else if(len == 0) {
+      origin[len++] = '.';
+    }
+    origin[len] = '\0';
+    return true;
+  }
+
+  /// A string entry of the dynamic section, NULL if there is none.
+  static const char * dynamicString (struct link_map * map, ElfW(Sxword) tag) {
+    ElfW(Addr) strtab = 0;
+    ElfW(Xword) offset = 0;
+    bool found = false;
+
+    if(map->l_ld == NULL) {
+      return NULL;
+    }
+    for(ElfW(Dyn) * dyn = map->l_ld; dyn->d_tag != DT_NULL; dyn++) {
+      if(dyn->d_tag == DT_STRTAB) {
+        strtab = dyn->d_un.d_ptr;
+      }
+      else if(dyn->d_tag == tag) {
+        offset = dyn->d_un.d_val;
+        found = true;
+      }
+    }
+    if(!found || strtab == 0) {
+      return NULL;
+    }
+
+    // The loader relocates the entry in place where the section is
+    // writable, elsewhere it is still an offset from the load address.
+    if(strtab < map->l_addr) {
+      strtab += map->l_addr;
+    }
+    return (const char *)strtab + offset;
+  }
+
+  static struct link_map * mainMap (struct link_map * map) {
+    while(map->l_prev != NULL) {
+      map = map->l_prev;
+    }
+    return map;
+  }
+
+  /// @brief Look for filename in each directory of a colon separated list.
+  static bool search (const char * list, const char * origin, const char * filename,
+                      char * path, size_t size) {
+    if(list == NULL) {
+      return false;
+    }
+
+    for(const char * dir = list; ; ) {
+      const char * end = strchr(dir, ':');
+      size_t len = (end != NULL) ? (size_t)(end - dir) : strlen(dir);
+      char expanded[PATH_MAX];
+
+      // An empty entry is the current directory. Other dynamic string
+      // tokens than $ORIGIN are left to the loader.
+      if(len == 0) {
+        strcpy(expanded, ".");
+      }
+      else if(!expand(dir, len, origin, expanded, sizeof(expanded))) {
+        expanded[0] = '\0';
+      }
+
+      if(expanded[0] != '\0' && strchr(expanded, '$') == NULL
+         && strlen(expanded) + strlen(filename) + 2 <= size) {
+        strcpy(path, expanded);
+        strcat(path, "/");
+        strcat(path, filename);
+        if(access(path, R_OK) == 0) {
+          return true;
+        }
+      }
+
+      if(end == NULL) {
+        return false;
+      }
+      dir = end + 1;
+    }
+  }
+
+  /// @brief Copy len characters of text to out, with $ORIGIN replaced.
+  static bool expand (const char * text, size_t len, const char * origin, char * out, size_t size) {
+    size_t used = 0;
+    size_t originLen = strlen(origin);
+
+    for(size_t i = 0; i < len; ) {
+      size_t token = 0;
+      if(strncmp(text + i, "$ORIGIN", 7) == 0 && i + 7 <= len) {
+        token = 7;
+      }
+      else if(strncmp(text + i, "${ORIGIN}", 9) == 0 && i + 9 <= len) {
+        token = 9;
+      }
+
+      if(token != 0) {
+        if(used + originLen >= size) {
+          return false;
+        }
+        memcpy(out + used, origin, originLen);
+        used += originLen;
+        i += token;
+      }
+      else {
+        if(used + 1 >= size) {
+          return false;
+        }
+        out[used++] = text[i++];
+      }
+    }
+    out[used] = '\0';
+    return true;
+  }
+};
+
+#endif
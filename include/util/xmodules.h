@@ -0,0 +1,566 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xmodules.h
+ * @brief  Map of loaded modules (executable and shared objects), built
+ *         through dl_iterate_phdr so that load bias of PIE executables and
+ *         shared libraries is handled. Used to attribute callsites and
+ *         global objects to the module they belong to.
+ */
+
+#ifndef SHERIFF_XMODULES_H
+#define SHERIFF_XMODULES_H
+
+#include <link.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+#include "mm.h"
+#include "elfinfo.h"
+
+class xmodules {
+public:
+  enum { MAX_MODULES = 256 };
+  enum { MAX_PATH_LENGTH = 512 };
+
+  // One entry of the sorted address index of data objects.
+  struct objectsymbol {
+    unsigned long start;
+    unsigned long size;
+    Elf_Sym * symbol;
+
+    bool operator < (const objectsymbol & that) const {
+      return start < that.start;
+    }
+  };
+
+  struct moduleinfo {
+    char path[MAX_PATH_LENGTH];
+
+    // Load bias, added to every address found in the ELF file.
+    unsigned long base;
+
+    // Absolute ranges of executable and writable segments.
+    unsigned long textStart;
+    unsigned long textEnd;
+    unsigned long dataStart;
+    unsigned long dataEnd;
+    unsigned long relroStart;
+    unsigned long relroEnd;
+
+    // The GOT of the PLT, which lazy binding writes. 0 if there is none.
+    unsigned long pltGotStart;
+    unsigned long pltGotEnd;
+
+    bool isMain;
+    bool isSelf;      // libsheriff itself
+    bool isRuntime;   // loader, libc, libstdc++ and friends
+    bool present;     // used by refresh() to drop unloaded modules
+
+    // Symbols are only loaded when we need to report something.
+    bool symbolsLoaded;
+    struct elf_info elf;
+
+    // STT_OBJECT symbols sorted by absolute start address.
+    objectsymbol * objects;
+    unsigned long objectsNum;
+    unsigned long objectsMapSize;
+  };
+
+  xmodules()
+  {
+    _selfStart = _selfEnd = 0;
+    _modules = 0;
+    _lastHit = 0;
+    _scanIndex = 0;
+  }
+
+  static xmodules& getInstance (void) {
+    static char buf[sizeof(xmodules)];
+    static xmodules * theOneTrueObject = new (buf) xmodules();
+    return *theOneTrueObject;
+  }
+
+  void initialize(void) {
+    _modules = 0;
+    refresh();
+  }
+
+  /// @brief Synchronize the map with the loader, called after dlopen/dlclose.
+  void refresh(void) {
+    for(int i = 0; i < _modules; i++) {
+      _module[i].present = false;
+    }
+
+    _scanIndex = 0;
+    dl_iterate_phdr(phdrCallback, this);
+
+    // Drop those modules which has been unloaded.
+    int j = 0;
+    for(int i = 0; i < _modules; i++) {
+      if(!_module[i].present) {
+        releaseSymbols(&_module[i]);
+        continue;
+      }
+      if(i != j) {
+        memcpy(&_module[j], &_module[i], sizeof(moduleinfo));
+      }
+      j++;
+    }
+    _modules = j;
+    _lastHit = 0;
+  }
+
+  int getModulesNum(void) {
+    return _modules;
+  }
+
+  moduleinfo * getModule(int index) {
+    return &_module[index];
+  }
+
+  /// @brief Whether addr lies in the text of a module whose callsites we report.
+  inline bool inAttributableText(unsigned long addr) {
+    moduleinfo * m = &_module[_lastHit];
+
+    if(addr >= m->textStart && addr < m->textEnd) {
+      return !(m->isSelf || m->isRuntime);
+    }
+
+    for(int i = 0; i < _modules; i++) {
+      m = &_module[i];
+      if(addr >= m->textStart && addr < m->textEnd) {
+        _lastHit = i;
+        return !(m->isSelf || m->isRuntime);
+      }
+    }
+    return false;
+  }
+
+  /// @brief Whether addr lies in the text of libsheriff itself.
+  inline bool inSelf(unsigned long addr) {
+    return (addr >= _selfStart && addr < _selfEnd);
+  }
+
+  /// @brief Find the module whose text or writable data holds addr.
+  moduleinfo * findModule(unsigned long addr) {
+    for(int i = 0; i < _modules; i++) {
+      moduleinfo * m = &_module[i];
+      if((addr >= m->textStart && addr < m->textEnd)
+        || (addr >= m->dataStart && addr < m->dataEnd)) {
+        return m;
+      }
+    }
+    return NULL;
+  }
+
+  /// @brief Find the global object which holds addr, NULL if there is none.
+  Elf_Sym * findObjectSymbol(unsigned long addr, moduleinfo ** owner) {
+    moduleinfo * m = findModule(addr);
+
+    if(m == NULL || !loadSymbols(m)) {
+      return NULL;
+    }
+
+    long index = findObjectIndex(m, addr);
+    if(index < 0 || addr >= m->objects[index].start + m->objects[index].size) {
+      return NULL;
+    }
+
+    if(owner) {
+      *owner = m;
+    }
+    return m->objects[index].symbol;
+  }
+
+  /// @brief Index of the last object starting at or before addr, -1 if none.
+  long findObjectIndex(moduleinfo * m, unsigned long addr) {
+    long low = 0;
+    long high = (long)m->objectsNum - 1;
+    long found = -1;
+
+    while(low <= high) {
+      long mid = (low + high) / 2;
+      if(m->objects[mid].start <= addr) {
+        found = mid;
+        low = mid + 1;
+      }
+      else {
+        high = mid - 1;
+      }
+    }
+    return found;
+  }
+
+  const char * getSymbolName(moduleinfo * m, Elf_Sym * symbol) {
+    return m->elf.strtab + symbol->st_name;
+  }
+
+  // Both global and file-static data objects are candidates.
+  static inline bool isDataObject(Elf_Sym * symbol) {
+    return (symbol->st_shndx < SHN_LORESERVE && symbol->st_shndx != SHN_UNDEF
+            && symbol->st_size != 0
+            && ELF_ST_TYPE(symbol->st_info) == STT_OBJECT);
+  }
+
+  /// @brief Print source line of addr using addr2line on the owning module.
+  void printSourceLine(unsigned long addr) {
+    char command[MAX_PATH_LENGTH + 64];
+    moduleinfo * m = findModule(addr);
+
+    if(m == NULL || m->path[0] == '\0') {
+      fprintf(stderr, "??\n");
+      return;
+    }
+
+    sprintf(command, "addr2line -e %s %lx", m->path, addr - m->base);
+    system(command);
+  }
+
+  /// @brief Get the "file:line" of addr into buf, without the trailing
+  /// discriminator. Returns false if the owning module is unknown.
+  bool getSourceLine(unsigned long addr, char * buf, int len) {
+    char command[MAX_PATH_LENGTH + 64];
+    moduleinfo * m = findModule(addr);
+
+    buf[0] = '\0';
+    if(m == NULL || m->path[0] == '\0') {
+      return false;
+    }
+
+    sprintf(command, "addr2line -e %s %lx", m->path, addr - m->base);
+    FILE * pipe = popen(command, "r");
+    if(pipe == NULL) {
+      return false;
+    }
+
+    if(fgets(buf, len, pipe) == NULL) {
+      buf[0] = '\0';
+    }
+    pclose(pipe);
+
+    buf[strcspn(buf, " \n")] = '\0';
+    return (buf[0] != '\0');
+  }
+
+  /// @brief Load the symbol table of this module, prefer .symtab over .dynsym.
+  bool loadSymbols(moduleinfo * m) {
+    if(m->symbolsLoaded) {
+      return (m->elf.symtab_start != NULL);
+    }
+
+    m->symbolsLoaded = true;
+    m->elf.symtab_start = m->elf.symtab_stop = NULL;
+    m->elf.hdr = (Elf_Ehdr *)grabFile(m->path, &m->elf.size);
+    if(m->elf.hdr == NULL) {
+      return false;
+    }
+
+    if(checkElf(&m->elf) != 0
+       || (!parseSymbols(&m->elf, SHT_SYMTAB) && !parseSymbols(&m->elf, SHT_DYNSYM))) {
+      releaseSymbols(m);
+      m->symbolsLoaded = true;
+      return false;
+    }
+
+    buildObjectIndex(m);
+    return true;
+  }
+
+private:
+
+  static int phdrCallback(struct dl_phdr_info * info, size_t size, void * data) {
+    xmodules * modules = (xmodules *)data;
+    const char * name = info->dlpi_name;
+    // The first entry is always the main executable.
+    bool isMain = (modules->_scanIndex++ == 0);
+    moduleinfo * m;
+
+    // Skip the nameless vdso.
+    if(!isMain && name[0] == '\0') {
+      return 0;
+    }
+
+    // Already known?
+    for(int i = 0; i < modules->_modules; i++) {
+      m = &modules->_module[i];
+      if(m->base == info->dlpi_addr && (isMain ? m->isMain : strcmp(m->path, name) == 0)) {
+        m->present = true;
+        return 0;
+      }
+    }
+
+    if(modules->_modules >= MAX_MODULES) {
+      fprintf(stderr, "Too many modules, increase MAX_MODULES\n");
+      return 1;
+    }
+
+    m = &modules->_module[modules->_modules];
+    memset(m, 0, sizeof(moduleinfo));
+    m->base = info->dlpi_addr;
+    m->isMain = isMain;
+    m->present = true;
+    m->textStart = m->dataStart = m->relroStart = ~0UL;
+
+    if(isMain) {
+      int count = readlink("/proc/self/exe", m->path, MAX_PATH_LENGTH - 1);
+      m->path[count > 0 ? count : 0] = '\0';
+    }
+    else {
+      strncpy(m->path, name, MAX_PATH_LENGTH - 1);
+    }
+
+    for(int i = 0; i < info->dlpi_phnum; i++) {
+      const ElfW(Phdr) * phdr = &info->dlpi_phdr[i];
+      unsigned long start = info->dlpi_addr + phdr->p_vaddr;
+      unsigned long end = start + phdr->p_memsz;
+
+      if(phdr->p_type == PT_LOAD && (phdr->p_flags & PF_X)) {
+        updateRange(&m->textStart, &m->textEnd, start, end);
+      }
+      else if(phdr->p_type == PT_LOAD && (phdr->p_flags & PF_W)) {
+        updateRange(&m->dataStart, &m->dataEnd, start, end);
+      }
+      else if(phdr->p_type == PT_GNU_RELRO) {
+        updateRange(&m->relroStart, &m->relroEnd, start, end);
+      }
+      else if(phdr->p_type == PT_DYNAMIC) {
+        findPltGot(m, (ElfW(Dyn) *)start);
+      }
+    }
+    fixRange(&m->textStart, &m->textEnd);
+    fixRange(&m->dataStart, &m->dataEnd);
+    fixRange(&m->relroStart, &m->relroEnd);
+
+    unsigned long self = (unsigned long)&xmodules::phdrCallback;
+    m->isSelf = (self >= m->textStart && self < m->textEnd);
+    if(m->isSelf) {
+      modules->_selfStart = m->textStart;
+      modules->_selfEnd = m->textEnd;
+    }
+    m->isRuntime = isRuntimeLibrary(m->path);
+
+    modules->_modules++;
+    return 0;
+  }
+
+  /// The PLT's part of the GOT: three reserved entries, then one per
+  /// PLT relocation.
+  static void findPltGot(moduleinfo * m, ElfW(Dyn) * dyn) {
+    unsigned long got = 0, relsz = 0, relent = sizeof(ElfW(Rela));
+
+    for(; dyn->d_tag != DT_NULL; dyn++) {
+      switch(dyn->d_tag) {
+      case DT_PLTGOT:
+        got = dyn->d_un.d_ptr;
+        break;
+      case DT_PLTRELSZ:
+        relsz = dyn->d_un.d_val;
+        break;
+      case DT_PLTREL:
+        relent = (dyn->d_un.d_val == DT_REL) ? sizeof(ElfW(Rel)) : sizeof(ElfW(Rela));
+        break;
+      }
+    }
+    if(got == 0) {
+      return;
+    }
+
+    // The loader relocates the entry in place where the section is
+    // writable, elsewhere it is still an offset from the load address.
+    if(got < m->base) {
+      got += m->base;
+    }
+    m->pltGotStart = got;
+    m->pltGotEnd = got + (3 + relsz / relent) * sizeof(void *);
+  }
+
+  static void updateRange(unsigned long * start, unsigned long * end, unsigned long s, unsigned long e) {
+    if(s < *start) {
+      *start = s;
+    }
+    if(e > *end) {
+      *end = e;
+    }
+  }
+
+  static void fixRange(unsigned long * start, unsigned long * end) {
+    if(*start == ~0UL) {
+      *start = *end = 0;
+    }
+  }
+
+  // System libraries are not interesting as callsites.
+  static bool isRuntimeLibrary(const char * path) {
+    static const char * prefixes[] = {
+      "ld-", "libc.", "libc-", "libpthread", "libdl", "libm.", "libm-",
+      "librt", "libstdc++", "libgcc_s", "linux-vdso", "linux-gate", NULL
+    };
+    const char * name = strrchr(path, '/');
+
+    name = (name == NULL) ? path : name + 1;
+    for(int i = 0; prefixes[i] != NULL; i++) {
+      if(strncmp(name, prefixes[i], strlen(prefixes[i])) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void * grabFile(const char * filename, unsigned long * size) {
+    struct stat st;
+    void * map;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+      return NULL;
+    }
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      return NULL;
+    }
+
+    *size = st.st_size;
+    map = MM::allocatePrivate(*size, fd);
+    close(fd);
+
+    if (map == MAP_FAILED)
+      return NULL;
+    return map;
+  }
+
+  int checkElf(struct elf_info * elf) {
+    Elf_Ehdr * hdr = elf->hdr;
+
+    if (elf->size < sizeof(*hdr)) {
+      return -1;
+    }
+
+    /* Is this a valid ELF file? */
+    if ((hdr->e_ident[EI_MAG0] != ELFMAG0) ||
+       (hdr->e_ident[EI_MAG1] != ELFMAG1) ||
+       (hdr->e_ident[EI_MAG2] != ELFMAG2) ||
+       (hdr->e_ident[EI_MAG3] != ELFMAG3)) {
+      return -1;
+    }
+
+    return 0;
+  }
+
+  bool parseSymbols(struct elf_info * elf, unsigned int type) {
+    Elf_Ehdr * hdr = elf->hdr;
+    Elf_Shdr * sechdrs = (Elf_Shdr *)((char *)hdr + hdr->e_shoff);
+
+    elf->sechdrs = sechdrs;
+    for (unsigned int i = 0; i < hdr->e_shnum; i++) {
+      if (sechdrs[i].sh_type != type || sechdrs[i].sh_size == 0)
+        continue;
+
+      elf->symtab_start = (Elf_Sym*)((unsigned long)hdr + sechdrs[i].sh_offset);
+      elf->symtab_stop  = (Elf_Sym*)((unsigned long)hdr + sechdrs[i].sh_offset + sechdrs[i].sh_size);
+      elf->strtab       = (char *)((unsigned long)hdr + sechdrs[sechdrs[i].sh_link].sh_offset);
+      return true;
+    }
+    return false;
+  }
+
+  // Build the sorted index once, so that lookups are O(log symbols).
+  void buildObjectIndex(moduleinfo * m) {
+    unsigned long count = 0;
+    Elf_Sym * symbol;
+
+    for(symbol = m->elf.symtab_start; symbol < m->elf.symtab_stop; symbol++) {
+      if(isDataObject(symbol)) {
+        count++;
+      }
+    }
+
+    m->objectsNum = 0;
+    if(count == 0) {
+      return;
+    }
+
+    m->objectsMapSize = count * sizeof(objectsymbol);
+    m->objects = (objectsymbol *)MM::allocatePrivate(m->objectsMapSize);
+    if(m->objects == MAP_FAILED) {
+      m->objects = NULL;
+      return;
+    }
+
+    for(symbol = m->elf.symtab_start; symbol < m->elf.symtab_stop; symbol++) {
+      if(isDataObject(symbol)) {
+        objectsymbol * object = &m->objects[m->objectsNum++];
+        object->start = m->base + symbol->st_value;
+        object->size = symbol->st_size;
+        object->symbol = symbol;
+      }
+    }
+
+    std::sort(m->objects, m->objects + m->objectsNum);
+
+    // Aliases share the same address, keep one of them and prefer
+    // the global name over a local one.
+    unsigned long j = 0;
+    for(unsigned long i = 0; i < m->objectsNum; i++) {
+      if(j > 0 && m->objects[j-1].start == m->objects[i].start) {
+        if(ELF_ST_BIND(m->objects[i].symbol->st_info) == STB_GLOBAL) {
+          m->objects[j-1] = m->objects[i];
+        }
+        continue;
+      }
+      m->objects[j++] = m->objects[i];
+    }
+    m->objectsNum = j;
+  }
+
+  void releaseSymbols(moduleinfo * m) {
+    if(m->objects != NULL) {
+      munmap(m->objects, m->objectsMapSize);
+    }
+    m->objects = NULL;
+    m->objectsNum = 0;
+
+    if(m->elf.hdr != NULL) {
+      munmap(m->elf.hdr, m->elf.size);
+    }
+    m->elf.hdr = NULL;
+    m->elf.symtab_start = m->elf.symtab_stop = NULL;
+    m->symbolsLoaded = false;
+  }
+
+  unsigned long _selfStart;
+  unsigned long _selfEnd;
+  int _modules;
+  int _lastHit;
+  int _scanIndex;
+  moduleinfo _module[MAX_MODULES];
+};
+
+#endif
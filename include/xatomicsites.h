@@ -0,0 +1,160 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xatomicsites.h
+ * @brief  Atomic instructions that write tracked memory.
+ *
+ * Threads are processes, so an atomic instruction on a tracked page only
+ * changes this thread's copy until its next commit: a spin on a flag never
+ * ends and concurrent counters lose updates. Such memory belongs in the
+ * atomic arena (sheriff_atomic_alloc). The write fault tells which
+ * instruction wrote the page; each atomic one is reported once, whichever
+ * thread hits it first. With the atomic_pages tunable the faulting page is
+ * also excluded from tracking in that thread, see sheriff.h.
+ *
+ * Only x86 is decoded: a lock prefix, or xchg with a memory operand, which
+ * locks implicitly.
+ */
+
+#ifndef SHERIFF_XATOMICSITES_H
+#define SHERIFF_XATOMICSITES_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "xdefines.h"
+#include "xmodules.h"
+#include "mm.h"
+#include "xsignals.h"
+
+class xatomicsites {
+public:
+
+  static xatomicsites& getInstance (void) {
+    static char buf[sizeof(xatomicsites)];
+    static xatomicsites * theOneTrueObject = new (buf) xatomicsites();
+    return *theOneTrueObject;
+  }
+
+  /// @brief Map the instructions already reported. Runs when protection
+  /// opens, before the first fork, so that every thread shares them.
+  void initialize (void) {
+    if(_sites != NULL) {
+      return;
+    }
+
+    void * sites = MM::allocateShared(sizeof(unsigned long) * xdefines::MAX_ATOMIC_SITES);
+    if(sites == MAP_FAILED) {
+      fprintf(stderr, "Failed to map the atomic sites: %s\n", strerror(errno));
+      ::abort();
+    }
+    _sites = (unsigned long *)sites;
+  }
+
+  /// @brief Look at the instruction behind a write fault at addr.
+  /// @return whether it is atomic. The first time it is seen, it is reported.
+  bool check (void * context, void * addr) {
+    unsigned long pc = programCounter(context);
+    if(pc == 0 || !isAtomic((const unsigned char *)pc)) {
+      return false;
+    }
+
+    if(firstSeen(pc)) {
+      xmodules::moduleinfo * m = xmodules::getInstance().findModule(pc);
+      xsignals::report("Sheriff: the atomic instruction at %s+0x%lx writes tracked memory at %p, "
+                       "other threads only see it after this one synchronizes. Allocate such memory "
+                       "with sheriff_atomic_alloc(), or set SHERIFF_ATOMIC_PAGES=1.\n",
+                       (m != NULL && m->path[0] != '\0') ? m->path : "??",
+                       (m != NULL) ? pc - m->base : pc, addr);
+    }
+    return true;
+  }
+
+private:
+
+  xatomicsites()
+  : _sites (NULL)
+  {
+  }
+
+  static unsigned long programCounter (void * context) {
+    ucontext_t * uc = (ucontext_t *)context;
+#if defined(__x86_64__)
+    return uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+    return uc->uc_mcontext.gregs[REG_EIP];
+#else
+    return 0;
+#endif
+  }
+
+  static bool isAtomic (const unsigned char * pc) {
+    // Legacy prefixes come first, then a REX prefix on x86-64.
+    for(int i = 0; i < 15; i++, pc++) {
+      switch(*pc) {
+      case 0xF0:
+        return true;
+      case 0x26: case 0x2E: case 0x36: case 0x3E: case 0x64: case 0x65:
+      case 0x66: case 0x67: case 0xF2: case 0xF3:
+        continue;
+      }
+#if defined(__x86_64__)
+      if((*pc & 0xF0) == 0x40) {
+        pc++;
+      }
+#endif
+      return (*pc == 0x86 || *pc == 0x87);
+    }
+    return false;
+  }
+
+  /// @return true if pc was not reported yet. Once the table is full,
+  /// nothing more is reported.
+  bool firstSeen (unsigned long pc) {
+    if(_sites == NULL) {
+      return true;
+    }
+
+    for(int i = 0; i < xdefines::MAX_ATOMIC_SITES; i++) {
+      if(_sites[i] == pc) {
+        return false;
+      }
+      if(_sites[i] == 0 && __sync_bool_compare_and_swap(&_sites[i], 0UL, pc)) {
+        return true;
+      }
+      if(_sites[i] == pc) {
+        return false;
+      }
+    }
+    return false;
+  }
+
+  /// Instructions reported so far, shared by all threads.
+  volatile unsigned long * _sites;
+};
+
+#endif
@@ -0,0 +1,217 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xcostmodel.h
+ * @brief  Whether protecting a run of pages pays off, for Sheriff-Protect.
+ *
+ * Protecting a page costs a write fault, a twin copy, a diff at commit and
+ * a refresh at the next begin, every transaction it is written in. What it
+ * saves are the cache line transfers between threads that write the same
+ * lines concurrently. The costs are measured once at startup by a short
+ * self-benchmark on a scratch mapping; the savings are estimated from the
+ * lines that commits find interleaved with another thread, each taken to
+ * save line_bounces transfers of line_transfer_ns. All of them are
+ * tunables (xtunables.h), so a profile can pin them.
+ *
+ * The self-benchmark runs when protection is first opened, at the first
+ * thread spawn, so programs that never spawn a thread do not pay for it.
+ */
+
+#ifndef SHERIFF_XCOSTMODEL_H
+#define SHERIFF_XCOSTMODEL_H
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "xdefines.h"
+#include "xtunables.h"
+#include "pagecopy.h"
+#include "realfuncs.h"
+
+class xcostmodel {
+public:
+
+  static xcostmodel& getInstance (void) {
+    static char buf[sizeof(xcostmodel)];
+    static xcostmodel * theOneTrueObject = new (buf) xcostmodel();
+    return *theOneTrueObject;
+  }
+
+  /// @brief Measure the cost of each step of protecting a page, once.
+  /// The SEGV handler in place is restored afterwards. Keeps the defaults
+  /// if the scratch mapping can not be set up.
+  void calibrate (void) {
+    if(_calibrated) {
+      return;
+    }
+    _calibrated = true;
+
+    const size_t pages = xdefines::CALIBRATION_PAGES;
+    const size_t size = pages * xdefines::PageSize;
+
+    int fd = syscall(SYS_memfd_create, "sheriff-calibration", 0);
+    if(fd == -1 || ftruncate(fd, size) != 0) {
+      if(fd != -1) {
+        close(fd);
+      }
+      return;
+    }
+
+    // As in xpersist: a shared view, a private protected view and twins.
+    char * shared = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    char * local = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    char * twins = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    close(fd);
+
+    if(shared != MAP_FAILED && local != MAP_FAILED && twins != MAP_FAILED) {
+      measure(shared, local, twins, pages);
+    }
+
+    if(shared != MAP_FAILED) {
+      munmap(shared, size);
+    }
+    if(local != MAP_FAILED) {
+      munmap(local, size);
+    }
+    if(twins != MAP_FAILED) {
+      munmap(twins, size);
+    }
+
+    const char * stats = getenv("SHERIFF_STATS");
+    if(stats != NULL && stats[0] != '\0') {
+      fprintf(stderr, "Sheriff cost model: fault %d ns, twin %d ns, commit %d ns, update %d ns per page\n",
+              xtunables::get(xtunables::PROTECTION_FAULT_NS), xtunables::get(xtunables::TWIN_NS),
+              xtunables::get(xtunables::COMMIT_NS), xtunables::get(xtunables::UPDATE_NS));
+    }
+  }
+
+  /// @brief Cost of protecting one page written in a transaction.
+  static inline unsigned long pageCost (void) {
+    return (unsigned long)xtunables::get(xtunables::PROTECTION_FAULT_NS)
+      + xtunables::get(xtunables::TWIN_NS)
+      + xtunables::get(xtunables::COMMIT_NS)
+      + xtunables::get(xtunables::UPDATE_NS);
+  }
+
+  /// @brief Transfers saved by isolating one interleaved cache line.
+  static inline unsigned long lineSavings (void) {
+    return (unsigned long)xtunables::get(xtunables::LINE_TRANSFER_NS)
+      * xtunables::get(xtunables::LINE_BOUNCES);
+  }
+
+  /// @brief Whether protection paid off for a run whose commits wrote
+  /// these pages and found these lines interleaved with other threads.
+  static inline bool pays (unsigned long dirtyPages, unsigned long interleavedLines) {
+    return interleavedLines * lineSavings() >= dirtyPages * pageCost();
+  }
+
+private:
+
+  xcostmodel()
+    : _calibrated(false)
+  {
+  }
+
+  static void calibrationHandle (int, siginfo_t * siginfo, void *) {
+    void * page = (void *)((intptr_t)siginfo->si_addr & ~xdefines::PAGE_SIZE_MASK);
+    mprotect(page, xdefines::PageSize, PROT_READ | PROT_WRITE);
+  }
+
+  static unsigned long monotonicNs (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+  }
+
+  void measure (char * shared, char * local, char * twins, size_t pages) {
+    struct sigaction siga, saved;
+    unsigned long start;
+
+    // Populate the file and the twins, so that only the protocol is timed.
+    memset(shared, 1, pages * xdefines::PageSize);
+    memset(twins, 0, pages * xdefines::PageSize);
+
+    sigemptyset(&siga.sa_mask);
+    siga.sa_flags = SA_SIGINFO | SA_RESTART;
+    siga.sa_sigaction = calibrationHandle;
+    if(WRAP(sigaction)(SIGSEGV, &siga, &saved) != 0) {
+      return;
+    }
+
+    // A write fault, with the copy-on-write of the page.
+    start = monotonicNs();
+    for(size_t i = 0; i < pages; i++) {
+      local[i * xdefines::PageSize] = 2;
+    }
+    int faultNs = (monotonicNs() - start) / pages;
+    WRAP(sigaction)(SIGSEGV, &saved, NULL);
+
+    start = monotonicNs();
+    for(size_t i = 0; i < pages; i++) {
+      pagecopy::copyNonTemporal(twins + i * xdefines::PageSize, local + i * xdefines::PageSize);
+    }
+    int twinNs = (monotonicNs() - start) / pages;
+
+    // One word in every cache line changes before the commit.
+    for(size_t i = 0; i < pages * xdefines::PageSize; i += xdefines::CACHE_LINE_SIZE) {
+      local[i] = 3;
+    }
+    start = monotonicNs();
+    for(size_t i = 0; i < pages; i++) {
+      diffPage((unsigned long *)(local + i * xdefines::PageSize),
+               (unsigned long *)(twins + i * xdefines::PageSize),
+               (unsigned long *)(shared + i * xdefines::PageSize));
+    }
+    int commitNs = (monotonicNs() - start) / pages;
+
+    start = monotonicNs();
+    for(size_t i = 0; i < pages; i++) {
+      madvise(local + i * xdefines::PageSize, xdefines::PageSize, MADV_DONTNEED);
+      mprotect(local + i * xdefines::PageSize, xdefines::PageSize, PROT_READ);
+    }
+    int updateNs = (monotonicNs() - start) / pages;
+
+    xtunables & tunables = xtunables::getInstance();
+    tunables.calibrated(xtunables::PROTECTION_FAULT_NS, faultNs);
+    tunables.calibrated(xtunables::TWIN_NS, twinNs);
+    tunables.calibrated(xtunables::COMMIT_NS, commitNs);
+    tunables.calibrated(xtunables::UPDATE_NS, updateNs);
+  }
+
+  static void diffPage (unsigned long * local, unsigned long * twin, volatile unsigned long * share) {
+    for(size_t i = 0; i < xdefines::PageSize / sizeof(unsigned long); i++) {
+      if(local[i] != twin[i]) {
+        share[i] = local[i];
+      }
+    }
+  }
+
+  bool _calibrated;
+};
+
+#endif
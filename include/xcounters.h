@@ -0,0 +1,273 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xcounters.h
+ * @brief  Cycles spent in each Sheriff subsystem, always counted.
+ *
+ * Every thread adds the TSC cycles of its faults, commits, updates, checks,
+ * waits, spawns and joins to its own slot of a shared stats segment, and
+ * folds the slot into the retired totals when it exits. With SHERIFF_STATS
+ * set the segment is a file in /dev/shm that tools can read live, and the
+ * breakdown is printed at exit as percent of wall and CPU time. Cycles are
+ * elapsed time, so on an oversubscribed machine they include time spent
+ * descheduled and the CPU share can exceed 100%.
+ */
+
+#ifndef SHERIFF_XCOUNTERS_H
+#define SHERIFF_XCOUNTERS_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "xdefines.h"
+#include "xtrace.h"
+#include "statsegment.h"
+
+class xcounters {
+public:
+
+  static xcounters& getInstance (void) {
+    static char buf[sizeof(xcounters)];
+    static xcounters * theOneTrueObject = new (buf) xcounters();
+    return *theOneTrueObject;
+  }
+
+  /// @brief Map the segment and take slot 0 for the main thread. Must run
+  /// before any thread is spawned.
+  void initialize (void) {
+    const char * live = getenv("SHERIFF_STATS");
+    int pid = syscall(SYS_getpid);
+
+    _report = (live != NULL && live[0] != '\0');
+#ifdef GET_CHARACTERISTICS
+    _report = true;
+#endif
+
+    if(_report) {
+      snprintf(_path, sizeof(_path), "/dev/shm/sheriff-stats.%d", pid);
+      int fd = open(_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if(fd != -1 && ftruncate(fd, sizeof(statsegment)) == 0) {
+        _segment = (statsegment *)mmap(NULL, sizeof(statsegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      }
+      if(fd == -1 || _segment == MAP_FAILED) {
+        fprintf(stderr, "Sheriff: can not create stats segment %s: %s\n", _path, strerror(errno));
+        _segment = NULL;
+        _path[0] = '\0';
+      }
+      if(fd != -1) {
+        close(fd);
+      }
+    }
+
+    if(_segment == NULL) {
+      _segment = (statsegment *)mmap(NULL, sizeof(statsegment), PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+      if(_segment == MAP_FAILED) {
+        fprintf(stderr, "Sheriff: can not map stats segment: %s\n", strerror(errno));
+        ::abort();
+      }
+    }
+
+    _segment->startTsc = xtrace::timestamp();
+    _segment->startNs = clockNs(CLOCK_MONOTONIC);
+    _segment->mainPid = pid;
+    _segment->version = STAT_VERSION;
+    _segment->magic = STAT_MAGIC;
+    setThread(0);
+  }
+
+  /// @brief Take the slot of a newly spawned thread.
+  void setThread (int thread) {
+    int pid = syscall(SYS_getpid);
+    statslot * slot = &_segment->slots[thread % STAT_SLOTS];
+
+    // More live threads than slots: count privately until exit.
+    if(!__sync_bool_compare_and_swap(&slot->pid, 0, pid)
+       && !(thread == 0 && slot->pid == pid)) {
+      slot = &_private;
+    }
+
+    memset((char *)slot + sizeof(slot->pid), 0, sizeof(statslot) - sizeof(slot->pid));
+    slot->pid = pid;
+    slot->thread = thread;
+    slot->startNs = clockNs(CLOCK_MONOTONIC);
+    _slot = slot;
+    _published = slot->startNs;
+  }
+
+  inline void add (statSubsystem subsystem, unsigned long cycles) {
+    _slot->cycles[subsystem] += cycles;
+    _slot->calls[subsystem]++;
+  }
+
+  /// @brief A commit finished; refresh the times every so often, since
+  /// reading the CPU time is a system call.
+  inline void commitDone (void) {
+    unsigned long now = clockNs(CLOCK_MONOTONIC);
+    if(now - _published >= xdefines::STAT_PUBLISH_INTERVAL_MS * 1000000UL) {
+      publish(now);
+    }
+  }
+
+  /// @brief Refresh the wall and CPU time of this thread.
+  void publish (unsigned long now = clockNs(CLOCK_MONOTONIC)) {
+    _slot->wallNs = now - _slot->startNs;
+    _slot->cpuNs = clockNs(CLOCK_PROCESS_CPUTIME_ID);
+    _published = now;
+  }
+
+  /// @brief This thread exits: fold its slot into the retired totals.
+  void retire (void) {
+    statslot * retired = &_segment->retired;
+
+    publish();
+    __sync_fetch_and_add(&retired->wallNs, _slot->wallNs);
+    __sync_fetch_and_add(&retired->cpuNs, _slot->cpuNs);
+    for(int i = 0; i < STAT_SUBSYSTEMS; i++) {
+      __sync_fetch_and_add(&retired->cycles[i], _slot->cycles[i]);
+      __sync_fetch_and_add(&retired->calls[i], _slot->calls[i]);
+    }
+    __sync_fetch_and_add(&retired->thread, 1);
+    __sync_synchronize();
+    _slot->pid = 0;
+  }
+
+  /// @brief A process forked by the application counts privately and
+  /// prints nothing: the segment belongs to the program.
+  void detach (void) {
+    _slot = &_private;
+    _report = false;
+  }
+
+  /// @brief Print the breakdown at exit (SHERIFF_STATS or GET_CHARACTERISTICS)
+  /// and remove the live segment.
+  void finalize (void) {
+    if(!_report) {
+      return;
+    }
+
+    publish();
+
+    statslot total;
+    memset(&total, 0, sizeof(total));
+    accumulate(&total, &_segment->retired);
+    total.thread = _segment->retired.thread;
+    for(int i = 0; i < STAT_SLOTS; i++) {
+      if(_segment->slots[i].pid != 0) {
+        accumulate(&total, &_segment->slots[i]);
+        total.thread++;
+      }
+    }
+    if(_slot == &_private) {
+      accumulate(&total, &_private);
+      total.thread++;
+    }
+
+    double nsPerTick = 1.0;
+    unsigned long ticks = xtrace::timestamp() - _segment->startTsc;
+    if(ticks != 0) {
+      nsPerTick = (double)(clockNs(CLOCK_MONOTONIC) - _segment->startNs) / (double)ticks;
+    }
+
+    fprintf(stderr, "Sheriff overhead by subsystem: %d threads, wall %.1f ms, cpu %.1f ms (summed over threads)\n",
+            total.thread, total.wallNs / 1e6, total.cpuNs / 1e6);
+    fprintf(stderr, "  %-10s %12s %12s %8s %8s\n", "subsystem", "calls", "ms", "%wall", "%cpu");
+    for(int i = 0; i < STAT_SUBSYSTEMS; i++) {
+      double ns = total.cycles[i] * nsPerTick;
+      fprintf(stderr, "  %-10s %12lu %12.2f %7.2f%%", statSubsystemNames[i], total.calls[i], ns / 1e6,
+              total.wallNs ? 100.0 * ns / total.wallNs : 0.0);
+      // Blocked waits are off CPU, a share of CPU time means nothing for them.
+      if(i == STAT_SYNC || i == STAT_JOIN || total.cpuNs == 0) {
+        fprintf(stderr, " %8s\n", "-");
+      }
+      else {
+        fprintf(stderr, " %7.2f%%\n", 100.0 * ns / total.cpuNs);
+      }
+    }
+
+    if(_path[0] != '\0') {
+      unlink(_path);
+    }
+  }
+
+private:
+
+  xcounters()
+    : _segment(NULL),
+      _slot(&_private),
+      _published(0),
+      _report(false)
+  {
+    _path[0] = '\0';
+  }
+
+  static void accumulate (statslot * total, statslot * slot) {
+    total->wallNs += slot->wallNs;
+    total->cpuNs += slot->cpuNs;
+    for(int i = 0; i < STAT_SUBSYSTEMS; i++) {
+      total->cycles[i] += slot->cycles[i];
+      total->calls[i] += slot->calls[i];
+    }
+  }
+
+  static unsigned long clockNs (clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+  }
+
+  statsegment * _segment;
+
+  // Per process: the slot this thread counts into.
+  statslot * _slot;
+  statslot _private;
+  unsigned long _published;
+
+  bool _report;
+  char _path[64];
+};
+
+/// @brief Adds the cycles of its scope to a subsystem.
+class xcycles {
+public:
+  xcycles (statSubsystem subsystem)
+    : _subsystem(subsystem),
+      _start(xtrace::timestamp())
+  {
+  }
+
+  ~xcycles() {
+    xcounters::getInstance().add(_subsystem, xtrace::timestamp() - _start);
+  }
+
+private:
+  statSubsystem _subsystem;
+  unsigned long _start;
+};
+
+#endif
@@ -44,10 +44,6 @@
 extern "C"
 {
 
-  extern int textStart, textEnd;
-
-  // If one transaction is less than 5ms, then we will close the protection.
-  enum { THRESH_TRAN_LENGTH = 5000 };
 
   enum { CHECK_AGAIN_NO_PROTECTION = 50 };
 
@@ -81,9 +77,21 @@ extern "C"
   extern unsigned long * global_thread_index;
 };
 
+// Defaults of the detection thresholds in xtunables.h, which can also be
+// overridden at build time (e.g. -DSHERIFF_MIN_INTERWRITES_CARE=20).
+#ifndef SHERIFF_MIN_INTERWRITES_OUTPUT
+#define SHERIFF_MIN_INTERWRITES_OUTPUT 2
+#endif
+#ifndef SHERIFF_MIN_INTERWRITES_CARE
+#define SHERIFF_MIN_INTERWRITES_CARE 10
+#endif
+
 class xdefines {
 public:
   enum { STACK_SIZE = 1024 * 1024 };
+
+  // Alternate signal stack of each process, on top of the kernel's minimum.
+  enum { SIGNAL_STACK_SIZE = 65536 };
 #ifdef X86_32BIT
   enum { PROTECTEDHEAP_SIZE = 1048576UL * 800 };
 #else
@@ -91,6 +99,97 @@ public:
 #endif
   enum { SHAREDHEAP_SIZE = 1048576UL * 100 };
 
+  // Memory for lock-free code (sheriff_atomic_alloc) comes from this arena,
+  // which is mapped shared and never tracked.
+  enum { ATOMICHEAP_SIZE = 1048576UL * 64 };
+  enum { ATOMICHEAP_CHUNK = 65536 };
+
+  // Atomic instructions found writing tracked memory, each reported once.
+  enum { MAX_ATOMIC_SITES = 256 };
+
+  // Anonymous mappings created by the application are carved from this arena.
+  // Page numbers inside one xpersist region are ints, so keep it below 2GB.
+#ifdef X86_32BIT
+  enum { MMAPHEAP_SIZE = 1048576UL * 256 };
+#else
+  enum { MMAPHEAP_SIZE = 1048576UL * 1024 };
+#endif
+  enum { MMAP_TRACK_THRESHOLD = 262144 };
+
+  // Granularities of protection: how much memory one write fault unprotects.
+  // Mapped chunks at least as big as the thresholds use the coarser units.
+  enum { PROTECTION_UNIT_SMALL = 4096 };
+  enum { PROTECTION_UNIT_MEDIUM = 65536 };
+  enum { PROTECTION_UNIT_LARGE = 2097152 };
+  enum { MEDIUM_UNIT_THRESHOLD = 1048576UL * 4 };
+  enum { LARGE_UNIT_THRESHOLD = 1048576UL * 64 };
+  enum { MAX_MMAP_RECORDS = 4096 };
+
+  // Share of vm.max_map_count that private page runs may use, and the
+  // limit assumed when it can not be read.
+  enum { VMA_BUDGET_PERCENT = 50 };
+  enum { DEFAULT_MAX_MAP_COUNT = 65530 };
+
+  // Ranges a commit can queue before it has to issue the system calls.
+  enum { MAX_QUEUED_RANGES = 4096 };
+
+  // Events kept by the trace ring (SHERIFF_TRACE), and threads named in it.
+  enum { TRACE_EVENTS = 1 << 17 };
+  enum { MAX_TRACE_THREADS = 4096 };
+  enum { MAX_TRACE_PATH = 512 };
+
+  // Least time between refreshes of a thread's wall and CPU time in the stats segment.
+  enum { STAT_PUBLISH_INTERVAL_MS = 100 };
+
+  // Share of a thread's CPU time that faults may take before Sheriff-Protect
+  // stops protecting. Only used when the page fault counter can be opened.
+  enum { MAX_FAULT_OVERHEAD_PERCENT = 25 };
+
+  // Cost model of Sheriff-Protect (xcostmodel.h). The costs per page are
+  // defaults for when calibration on CALIBRATION_PAGES pages fails.
+  enum { PROTECTION_FAULT_NS = 4000 };
+  enum { TWIN_NS = 500 };
+  enum { COMMIT_NS = 500 };
+  enum { UPDATE_NS = 1000 };
+  enum { LINE_TRANSFER_NS = 100 };
+  enum { LINE_BOUNCES = 16 };
+  enum { CALIBRATION_PAGES = 64 };
+
+  // Protection is decided per run of pages, once a run has been written
+  // in COST_SAMPLES page commits. Each process can keep up to
+  // MAX_UNPROTECTED_RUNS runs of each region unprotected.
+  enum { COST_RUN_PAGES = 16 };
+  enum { COST_SAMPLES = 16 };
+  enum { MAX_UNPROTECTED_RUNS = 1024 };
+
+  // The delay before all protection is opened again doubles at most this
+  // many times.
+  enum { MAX_PROTECTION_BACKOFF = 6 };
+
+  // How the application annotated a page (sheriff.h): tracked as usual,
+  // excluded from tracking, or isolated whatever the cost model decides.
+  enum { PAGE_TRACKED = 0, PAGE_EXCLUDED = 1, PAGE_ISOLATED = 2 };
+
+  // OpenMP teams (xomp.h): the largest team, how deep regions may nest,
+  // and the named critical sections that get a lock of their own.
+  enum { MAX_OMP_THREADS = 256 };
+  enum { MAX_OMP_NESTING = 16 };
+  enum { MAX_OMP_CRITICALS = 64 };
+
+  // A futex wait on tracked memory can not be woken from another thread,
+  // so it sleeps this long between two transactions instead.
+  enum { FUTEX_POLL_NS = 100000 };
+
+  // Thread modes of sheriff_thread_mode() (sheriff.h), and how many start
+  // routines and SHERIFF_SHARED_THREADS names xthreadpolicy.h keeps.
+  enum { THREAD_DEFAULT = 0, THREAD_ISOLATED = 1, THREAD_SHARED = 2 };
+  enum { MAX_THREAD_POLICIES = 32 };
+  enum { MAX_POLICY_NAME = 128 };
+
+  // Distinct phase names (sheriff_phase_begin) kept by the trace.
+  enum { MAX_TRACE_PHASES = 256 };
+  enum { MAX_PHASE_NAME = 48 };
+
 #if defined(DETECT_FALSE_SHARING) || defined(DETECT_FALSE_SHARING_OPT)
   enum { PROTECTEDHEAP_CHUNK = 1048576 };
   enum { LARGE_CHUNK = 1024 };
@@ -106,7 +205,6 @@ public:
 #endif
 
   enum { EVAL_CHECKING_PERIOD = 20 };
-  enum { MAX_GLOBALS_SIZE = 1048576UL * 20 };
   enum { INTERNALHEAP_SIZE = 1048576UL * 20 };
   enum { PageSize = 4096UL };
   enum { PAGE_SIZE_MASK = (PageSize-1) };
@@ -117,8 +215,9 @@ public:
   enum { CACHES_PER_PAGE = 64};
   enum { CACHELINE_SIZE_MASK = 0x3F};
   enum { MIN_PAGE_INTERWRITES_CARE = 20};
-  enum { MIN_INTERWRITES_OUTPUT = 2};
-  enum { MIN_INTERWRITES_CARE = 10};
+  // Detection thresholds, see SHERIFF_MIN_INTERWRITES_* above.
+  enum { MIN_INTERWRITES_OUTPUT = SHERIFF_MIN_INTERWRITES_OUTPUT};
+  enum { MIN_INTERWRITES_CARE = SHERIFF_MIN_INTERWRITES_CARE};
   enum { MIN_CONWRITES_CARE = 5};
   enum { MIN_INVALIDATES_CARE = MIN_INTERWRITES_CARE};
   enum { MIN_WRITES_CARE = 100000};
@@ -21,13 +21,14 @@
 
 /*
  * @file   xglobals.h
- * @brief  Global start and end definition. 
+ * @brief  Globals of every loaded module, one persistent region per module. 
  * @author Emery Berger <http://www.cs.umass.edu/~emery>
  */ 
 
 #ifndef _XGLOBALS_H_
 #define _XGLOBALS_H_
 
+#include <new>
 
 #include "xdefines.h"
 #if defined(DETECT_FALSE_SHARING)
@@ -35,65 +36,276 @@
 #else
 #include "xpersist_opt.h"
 #endif
+#include "xmodules.h"
 
-#if defined(__APPLE__)
-// We are going to use the Mach-O substitutes for _end, etc.,
-// despite the strong admonition not to. Beware.
-#include <mach-o/getsect.h>
-#endif
+// Macros to align to the nearest page down and up, respectively.
+#define PAGE_ALIGN_DOWN(x) (((size_t) (x)) & ~xdefines::PAGE_SIZE_MASK)
+#define PAGE_ALIGN_UP(x) ((((size_t) (x)) + xdefines::PAGE_SIZE_MASK) & ~xdefines::PAGE_SIZE_MASK)
 
-extern "C" {
+/// @class xglobals
+/// @brief Maps the writable data and bss of each loaded module onto its own
+/// persistent store. The size of every mapping comes from the program headers.
+/// Sheriff itself and the runtime libraries (loader, libc, libstdc++, ...)
+/// are excluded since their state must stay private to each process.
+class xglobals {
+public:
+  enum { MAX_REGIONS = 64 };
 
-#if !defined(__APPLE__)
+  typedef xpersist<char> regionType;
 
-  extern char __data_start;
+  xglobals (void)
+    : _regions (0),
+      _lastHit (0)
+  {
+    for(int i = 0; i < MAX_REGIONS; i++) {
+      _used[i] = false;
+    }
+  }
 
-  extern char _etext;
-  extern char _edata;
+  void initialize (void) {
+    addModules(false);
+  }
 
-  // _end marks the first address after the UNinitialized global data.
-  extern int _end;
-#endif
+  /// @brief Pick up modules loaded (or drop those unloaded) since last time.
+  /// Modules loaded after threads are spawned are private to the loading process.
+  void refresh (bool protect) {
+    xmodules & modules = xmodules::getInstance();
 
-}
+    // Drop regions whose module has been unloaded, the memory is gone.
+    int j = 0;
+    for(int i = 0; i < _regions; i++) {
+      bool found = false;
+      for(int k = 0; k < modules.getModulesNum(); k++) {
+        xmodules::moduleinfo * m = modules.getModule(k);
+        if(_region[i]->inRange((void *)m->dataStart)) {
+          found = true;
+          break;
+        }
+      }
 
-// Macros to align to the nearest page down and up, respectively.
-#define PAGE_ALIGN_DOWN(x) (((size_t) (x)) & ~xdefines::PAGE_SIZE_MASK)
-#define PAGE_ALIGN_UP(x) ((((size_t) (x)) + xdefines::PAGE_SIZE_MASK) & ~xdefines::PAGE_SIZE_MASK)
+      if(!found) {
+        freeRegion(_region[i]);
+        continue;
+      }
+      _region[j++] = _region[i];
+    }
+    _regions = j;
+    _lastHit = 0;
 
-// Macros that define the start and end addresses of program-wide globals.
-#if defined(__APPLE__)
-  #define GLOBALS_START  PAGE_ALIGN_DOWN(((size_t) get_etext() - 1))
-  #define GLOBALS_END    PAGE_ALIGN_UP(((size_t) get_end() - 1))
-#else
-  #define GLOBALS_START  PAGE_ALIGN_DOWN((size_t) &__data_start)
-  #define GLOBALS_END    PAGE_ALIGN_UP(((size_t) &_end - 1))
-#endif
+    addModules(protect);
+  }
+
+  void finalize (void * end) {
+    for(int i = 0; i < _regions; i++) {
+      _region[i]->finalize(end);
+    }
+  }
 
-#define GLOBALS_SIZE   (GLOBALS_END - GLOBALS_START)
+  void openProtection (void) {
+    for(int i = 0; i < _regions; i++) {
+      _region[i]->openProtection();
+    }
+  }
 
-#include <iostream>
-using namespace std;
+  void closeProtection (void) {
+    for(int i = 0; i < _regions; i++) {
+      _region[i]->closeProtection();
+    }
+  }
 
-/// @class xglobals
-/// @brief Maps the globals region onto a persistent store.
-class xglobals : public xpersist<char, xdefines::MAX_GLOBALS_SIZE>  {
-public:
+  void shareView (void) {
+    for(int i = 0; i < _regions; i++) {
+      _region[i]->shareView();
+    }
+  }
 
-  xglobals (void)
-    : xpersist<char,xdefines::MAX_GLOBALS_SIZE> ((void *) GLOBALS_START,
-						 (size_t) GLOBALS_SIZE)
-  {
-    // Force assertion even if NDEBUG is on.
-#ifdef NDEBUG
-#undef NDEBUG
-    // Make sure that we have enough room for the globals!
-    assert (GLOBALS_SIZE <= xdefines::MAX_GLOBALS_SIZE);
-#define NDEBUG 1
+  void detach (void) {
+    for(int i = 0; i < _regions; i++) {
+      _region[i]->detach(NULL);
+    }
+  }
+
+  inline void begin (void) {
+    for(int i = 0; i < _regions; i++) {
+      _region[i]->begin();
+    }
+  }
+
+  inline void commit (bool doChecking) {
+    for(int i = 0; i < _regions; i++) {
+      _region[i]->commit(doChecking);
+    }
+  }
+
+  int getDirtyPages (void) {
+    int pages = 0;
+    for(int i = 0; i < _regions; i++) {
+      pages += _region[i]->getDirtyPages();
+    }
+    return pages;
+  }
+
+  inline void periodicCheck (void) {
+    for(int i = 0; i < _regions; i++) {
+      _region[i]->periodicCheck();
+    }
+  }
+
+#if !defined(DETECT_FALSE_SHARING)
+  void cleanup (void) {
+    for(int i = 0; i < _regions; i++) {
+      _region[i]->cleanup();
+    }
+  }
+
+  void setProtectionPeriod (void) {
+    for(int i = 0; i < _regions; i++) {
+      _region[i]->setProtectionPeriod();
+    }
+  }
+#endif
+
+#if !defined(DETECT_FALSE_SHARING) && !defined(DETECT_FALSE_SHARING_OPT)
+  void evaluateRuns (unsigned long trans) {
+    for(int i = 0; i < _regions; i++) {
+      _region[i]->evaluateRuns(trans);
+    }
+  }
+#endif
+
+#if defined(DETECT_FALSE_SHARING_OPT)
+  void unprotectNonProfitPages (void * end) {
+    for(int i = 0; i < _regions; i++) {
+      _region[i]->unprotectNonProfitPages(end);
+    }
+  }
 #endif
-    //fprintf(stderr, "globals start %lx\n", GLOBALS_START);
+
+  /// @return true iff the address is in one of the regions.
+  inline bool inRange (void * addr) {
+    return (findRegion(addr) != NULL);
+  }
+
+  inline void handleWrite (void * addr) {
+    findRegion(addr)->handleWrite(addr);
   }
 
+  inline void handleWriteRange (void * start, size_t sz) {
+    for(int i = 0; i < _regions; i++) {
+      _region[i]->handleWriteRange(start, sz);
+    }
+  }
+
+  unsigned long annotate (void * start, size_t sz, int hint) {
+    unsigned long pages = 0;
+    for(int i = 0; i < _regions; i++) {
+      pages += _region[i]->annotate(start, sz, hint);
+    }
+    return pages;
+  }
+
+  void sharemem_write_word (void * addr, unsigned long val) {
+    findRegion(addr)->sharemem_write_word(addr, val);
+  }
+
+  unsigned long sharemem_read_word (void * addr) {
+    return findRegion(addr)->sharemem_read_word(addr);
+  }
+
+private:
+
+  inline regionType * findRegion (void * addr) {
+    if(_regions == 0) {
+      return NULL;
+    }
+
+    if(_region[_lastHit]->inRange(addr)) {
+      return _region[_lastHit];
+    }
+
+    for(int i = 0; i < _regions; i++) {
+      if(_region[i]->inRange(addr)) {
+        _lastHit = i;
+        return _region[i];
+      }
+    }
+    return NULL;
+  }
+
+  void addModules (bool protect) {
+    xmodules & modules = xmodules::getInstance();
+
+    for(int i = 0; i < modules.getModulesNum(); i++) {
+      xmodules::moduleinfo * m = modules.getModule(i);
+
+      if(m->isSelf || m->isRuntime || m->dataEnd <= m->dataStart) {
+        continue;
+      }
+
+      // The RELRO part is read-only after relocation, skip it.
+      size_t start = PAGE_ALIGN_DOWN(m->dataStart);
+      size_t end = PAGE_ALIGN_UP(m->dataEnd);
+      if(m->relroEnd > m->relroStart && PAGE_ALIGN_UP(m->relroEnd) > start) {
+        start = PAGE_ALIGN_UP(m->relroEnd);
+      }
+
+      if(start >= end || findRegion((void *)start) != NULL) {
+        continue;
+      }
+
+      regionType * region = allocRegion((void *)start, end - start);
+      if(region == NULL) {
+        fprintf(stderr, "Too many modules with globals, %s is not protected\n", m->path);
+        continue;
+      }
+
+      region->initialize();
+
+      // Lazy binding writes the GOT of the PLT where it is not RELRO. Pages
+      // holding nothing else are shared as they are without Sheriff; on the
+      // page it shares with .data, its entries are committed but left out of
+      // the statistics.
+      if(m->pltGotEnd > start && m->pltGotStart < end) {
+        size_t first = PAGE_ALIGN_UP(m->pltGotStart);
+        size_t last = PAGE_ALIGN_DOWN(m->pltGotEnd);
+        if(first < last) {
+          region->annotate((void *)first, last - first, xdefines::PAGE_EXCLUDED);
+        }
+        region->untrace((void *)m->pltGotStart, m->pltGotEnd - m->pltGotStart);
+      }
+      if(protect) {
+        region->openProtection();
+      }
+    }
+  }
+
+  regionType * allocRegion (void * start, size_t size) {
+    for(int i = 0; i < MAX_REGIONS; i++) {
+      if(!_used[i]) {
+        _used[i] = true;
+        _region[_regions] = new (_buf[i]) regionType(start, size);
+        return _region[_regions++];
+      }
+    }
+    return NULL;
+  }
+
+  void freeRegion (regionType * region) {
+    for(int i = 0; i < MAX_REGIONS; i++) {
+      if((void *)_buf[i] == (void *)region) {
+        region->~regionType();
+        _used[i] = false;
+      }
+    }
+  }
+
+  int _regions;
+  int _lastHit;
+  regionType * _region[MAX_REGIONS];
+
+  // Regions are constructed in place, they are never moved.
+  bool _used[MAX_REGIONS];
+  char _buf[MAX_REGIONS][sizeof(regionType)] __attribute__((aligned(16)));
 };
 
 #endif
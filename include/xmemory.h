@@ -56,6 +56,7 @@
 #include "internalheap.h"
 #include "xoneheap.h"
 #include "xheap.h"
+#include "xmmapheap.h"
 
 #include "xplock.h"
 #include "xpageentry.h"
@@ -65,6 +66,13 @@
 
 #include "stats.h"
 #include "finetime.h"
+#include "xtrace.h"
+#include "xcounters.h"
+#include "xperfevents.h"
+#include "xtunables.h"
+#include "xatomicsites.h"
+#include "xsignals.h"
+#include "xtimer.h"
 
 class xmemory {
 private:
@@ -93,6 +101,7 @@ public:
     _heap.initialize();
     _heap.setHeapId(0);
     _globals.initialize();
+    _mheap.initialize();
     xpageentry::getInstance().initialize();
     xpagestore::getInstance().initialize();
   
@@ -105,6 +114,7 @@ public:
 
   void finalize() {
     _globals.finalize(NULL);
+    _mheap.finalize(_mheap.getend());
     _heap.finalize (_heap.getend());
   }
 
@@ -155,10 +165,16 @@ Remalloc_again:
   }
 
 
+  /// @brief Allocate from the atomic arena, which every thread maps shared.
+  inline void * atomicMalloc (size_t sz) {
+    return _aheap.malloc(_heapid, sz);
+  }
+
   inline void * realloc (void * ptr, size_t sz, bool isProtected) {
     size_t s = getSize (ptr);
 
-    void * newptr =  malloc (sz, isProtected);
+    // Memory of the atomic arena stays there.
+    void * newptr = _aheap.inRange(ptr) ? atomicMalloc(sz) : malloc (sz, isProtected);
     if (newptr && s != 0) {
       size_t copySz = (s < sz) ? s : sz;
       memcpy (newptr, ptr, copySz);
@@ -169,6 +185,11 @@ Remalloc_again:
   }
 
   inline void free (void * ptr) {
+    if (_aheap.inRange(ptr)) {
+      _aheap.free(_heapid, ptr);
+      return;
+    }
+
     size_t s = getSize(ptr);
 
     //printf("Now free ptr %p with size %d\n", ptr, s);
@@ -181,11 +202,67 @@ Remalloc_again:
     return _heap.getSize (ptr);
   }
  
+  /// @brief Serve an anonymous private mapping from the persistent arena.
+  /// @return NULL if the arena is full.
+  inline void * mmap (size_t sz) {
+    CallSite callsite;
+#if defined(DETECT_FALSE_SHARING) || defined(DETECT_FALSE_SHARING_OPT)
+    callsite.fetch(CALL_SITE_DEPTH);
+#endif
+    return _mheap.malloc(sz, &callsite);
+  }
+
+  inline bool inMappedRange (void * addr) {
+    return _mheap.inRange(addr);
+  }
+
+  /// @brief Whether addr lies in memory this thread may have a private copy of.
+  inline bool inTrackedRange (void * addr) {
+    return (_heap.inRange(addr) || _mheap.inRange(addr) || _globals.inRange(addr));
+  }
+
+  inline bool inAtomicRange (void * addr) {
+    return _aheap.inRange(addr);
+  }
+
+  inline int munmap (void * addr, size_t sz) {
+    return _mheap.free(addr, sz);
+  }
+
+  /// @brief Protect the mappings within a range in units of the given size.
+  /// @return the number of mappings changed.
+  inline int setProtectionUnit (void * addr, size_t sz, size_t unit) {
+    return _mheap.setProtectionUnit(addr, sz, unit);
+  }
+
+  inline void * mremap (void * addr, size_t oldsz, size_t newsz, int flags) {
+    return _mheap.remap(addr, oldsz, newsz, flags);
+  }
+
+  /// @brief Annotate the pages overlapping a range, see sheriff.h.
+  /// @return the number of pages annotated.
+  unsigned long annotate (void * start, size_t sz, int hint) {
+    return _heap.annotate(start, sz, hint) + _mheap.annotate(start, sz, hint)
+      + _globals.annotate(start, sz, hint);
+  }
+
   void openProtection() {
     //fprintf(stderr, "Now %d open the protection\n", getpid());
+    // Shared state that has to be mapped before the first fork.
+    _aheap.initialize();
+    xatomicsites::getInstance().initialize();
     _globals.openProtection();
     _heap.openProtection();
+    _mheap.openProtection();
     _protection = true;
+    if(trace_enabled) {
+      xtrace::getInstance().record(xtrace::PROTECTION, xtrace::timestamp(), 1);
+    }
+  }
+
+  /// @brief Track the globals of modules loaded or unloaded by dlopen/dlclose.
+  void refreshModules(bool protect) {
+    _globals.refresh(protect);
   }
 
   void closeProtection() {
@@ -195,10 +272,41 @@ Remalloc_again:
       // memory spaces (globals and heap).
       _globals.closeProtection();
       _heap.closeProtection();
+      _mheap.closeProtection();
       _protection = false;
+      if(trace_enabled) {
+        xtrace::getInstance().record(xtrace::PROTECTION, xtrace::timestamp(), 0);
+      }
     }
   }
 
+  /// @brief Stop tracking for good in this process, see xthread::spawnShared().
+  /// Called once this thread's writes are committed.
+  void shareView() {
+    stopCheckingTimer();
+    _globals.shareView();
+    _heap.shareView();
+    _mheap.shareView();
+    if(_protection && trace_enabled) {
+      xtrace::getInstance().record(xtrace::PROTECTION, xtrace::timestamp(), 0);
+    }
+    _protection = false;
+  }
+
+  /// @brief Leave Sheriff in a process forked by the application. Its memory
+  /// becomes a private copy, as after a fork without Sheriff, and faults
+  /// and alarms go to the application's handlers again.
+  void detach() {
+    _globals.detach();
+    _heap.detach();
+    _mheap.detach();
+    _aheap.detach();
+    InternalHeap::getInstance().detach();
+
+    xsignals::getInstance().restore();
+    _protection = false;
+  }
+
   inline void setThreadIndex (int heapid) {
     _heapid = heapid%xdefines::NUM_HEAPS;
     _heap.setHeapId(heapid%xdefines::NUM_HEAPS);
@@ -206,45 +314,107 @@ Remalloc_again:
 
   /// Beginning of an atomic transaction.
   inline void begin (bool startTimer, bool startThread) {
+    unsigned long tracestart = xtrace::start();
     //stopCheckingTimer();
     _globals.begin();
     _heap.begin();
+    _mheap.begin();
 
     if(startTimer) { 
       startCheckingTimer();
     }
+    if(trace_enabled) {
+      xtrace::getInstance().beginTransaction(tracestart);
+    }
   }
 
   // Actual page fault handler.
   inline void handleWrite (void * addr) {
+    xcycles timer(STAT_FAULT);
+    if(trace_enabled) {
+      xtrace::getInstance().fault();
+    }
     if (_heap.inRange (addr)) {
       _heap.handleWrite (addr);
+    } else if (_mheap.inRange (addr)) {
+      _mheap.handleWrite (addr);
     } else if (_globals.inRange (addr)) {
       _globals.handleWrite (addr);
     } else {
       // Something must be wrong here.
-      fprintf(stderr, "address %p is out of range!\n", addr);
+      xsignals::report("address %p is out of range!\n", addr);
     }
   }
+
+  /// @return whether addr is in memory that Sheriff protects.
+  inline bool tracks (void * addr) {
+    return _heap.inRange (addr) || _mheap.inRange (addr) || _globals.inRange (addr);
+  }
   
+  /// @brief Prepare a buffer that a system call is about to fill, since
+  /// the kernel fails with EFAULT instead of faulting on protected pages.
+  inline void handleWriteRange (void * start, size_t sz) {
+    stopCheckingTimer();
+    _heap.handleWriteRange (start, sz);
+    _mheap.handleWriteRange (start, sz);
+    _globals.handleWriteRange (start, sz);
+    if(_timerStarted) {
+      startCheckingTimer();
+    }
+  }
+
   // Commit those local changes to the shared mapping.
   inline void commit (bool doChecking, bool update) {
     stopCheckingTimer();
+    xperfevents::getInstance().sample();
+
+    unsigned long tracestart = 0, tracepages = 0;
+    if(trace_enabled) {
+      tracestart = xtrace::timestamp();
+      tracepages = getDirtyPages();
+      xtrace::getInstance().endTransaction(tracestart);
+    }
 
     // Commit local modifications to the shared mapping.
-    _heap.commit(doChecking);
-    _globals.commit(doChecking);
+    {
+      xcycles timer(STAT_COMMIT);
+      _heap.commit(doChecking);
+      _mheap.commit(doChecking);
+      _globals.commit(doChecking);
+    }
+    xcounters::getInstance().commitDone();
+
+    if(trace_enabled) {
+      xtrace::getInstance().record(xtrace::COMMIT, tracestart, tracepages);
+    }
   } 
 
+  /// @brief Pages written in the current transaction.
+  int getDirtyPages (void) {
+    return _heap.getDirtyPages() + _mheap.getDirtyPages() + _globals.getDirtyPages();
+  }
+
   /// @brief Disable checking timer
   inline void stopCheckingTimer() {
     if(_timerStarted)
-      ualarm(0, 0);
+      xtimer::getInstance().stop();
   } 
+
+  /// @brief Stop the checking timer for a while.
+  /// @return the microseconds it had left, 0 if it was not running.
+  inline useconds_t suspendCheckingTimer() {
+    return _timerStarted ? xtimer::getInstance().stop() : 0;
+  }
+
+  inline void resumeCheckingTimer(useconds_t left) {
+    if(left != 0) {
+      xtimer::getInstance().start(left);
+    }
+  }
  
   // Start the timer 
   inline void startCheckingTimer() {
-    ualarm(xdefines::PERIODIC_CHECKING_INTERVAL, 0);
+    xtimer::getInstance().start(xtunables::get(xtunables::CHECKING_INTERVAL));
     _timerStarted = true;
   }
 
@@ -257,10 +427,12 @@ Remalloc_again:
   } 
 
   void doPeriodicChecking () {
+    xcycles timer(STAT_CHECK);
    // if(_doChecking == 1) {
     //  stopCheckingTimer();
     _globals.periodicCheck();
     _heap.periodicCheck();
+    _mheap.periodicCheck();
    // }
 
     startCheckingTimer(); 
@@ -269,6 +441,8 @@ Remalloc_again:
   unsigned long sharemem_read_word(void * dest) {
     if(_heap.inRange(dest)) {
       return _heap.sharemem_read_word(dest);
+    } else if(_mheap.inRange(dest)) {
+      return _mheap.sharemem_read_word(dest);
     } else if(_globals.inRange(dest)) {
       return _globals.sharemem_read_word(dest);
     }
@@ -278,6 +452,8 @@ Remalloc_again:
   void sharemem_write_word(void * dest, unsigned long val) {
     if(_heap.inRange(dest)) {
       _heap.sharemem_write_word(dest, val);
+    } else if(_mheap.inRange(dest)) {
+      _mheap.sharemem_write_word(dest, val);
     } else if(_globals.inRange(dest)) {
       _globals.sharemem_write_word(dest, val);
     }
@@ -290,82 +466,87 @@ private:
   }
 
   /* Signal-related functions for tracking page accesses. */
-  /// @brief Signal handler to trap SEGVs.
+  /// @brief Signal handler to trap SEGVs. Write faults on tracked memory
+  /// are Sheriff's, every other fault is the application's.
   static void segvHandle (int signum,
 			  siginfo_t * siginfo,
 			  void * context) 
   {
+    void * addr = siginfo->si_addr; // address of access
+
+    if (siginfo->si_code != SEGV_ACCERR || !xmemory::getInstance().tracks (addr)) {
+      xsignals::getInstance().forward (signum, siginfo, context);
+      return;
+    }
+
+    xcycles timer(STAT_SEGV);
     //xmemory::getInstance().disableCheck();
     xmemory::getInstance().stopCheckingTimer();
 
-    void * addr = siginfo->si_addr; // address of access
-
-    // Check if this was a SEGV that we are supposed to trap.
-    if (siginfo->si_code == SEGV_ACCERR) {
+    // An atomic instruction on this page can not be made to work, stop
+    // tracking the page if asked to. Its first write is still ahead.
+    if (xatomicsites::getInstance().check(context, addr)
+        && xtunables::get(xtunables::ATOMIC_PAGES)) {
+      void * page = (void *) (((size_t) addr) & ~(xdefines::PageSize-1));
+      xmemory::getInstance().annotate(page, xdefines::PageSize, xdefines::PAGE_EXCLUDED);
+    } else {
       // It is a write operation. Handle that.
       xmemory::getInstance().handleWrite (addr);
-    } else if (siginfo->si_code == SEGV_MAPERR) {
-      fprintf (stderr, "%d : map error with addr %p!\n", getpid(), addr);
-      ::abort();
-    } else {
-
-      fprintf (stderr, "%d : other access error with addr %p.\n", getpid(), addr);
-      ::abort();
     }
 
     xmemory::getInstance().startCheckingTimer();
     //xmemory::getInstance().enableCheck();
   }
 
-  /// @brief Handle those timers about checking.
+  /// @brief A bus error on tracked memory means that the file system of
+  /// the backing files is full.
+  static void busHandle (int signum,
+			 siginfo_t * siginfo,
+			 void * context)
+  {
+    if (xmemory::getInstance().tracks (siginfo->si_addr)) {
+      xsignals::report ("Sheriff: bus error at %p, is the file system of the backing files full?\n",
+                        siginfo->si_addr);
+    }
+    xsignals::getInstance().forward (signum, siginfo, context);
+  }
+
+  /// @brief Handle those timers about checking. Alarms Sheriff did not set
+  /// are the application's, see xtimer.h.
   static void checkingTimerHandle (int signum,
 				   siginfo_t * siginfo,
 				   void * context) 
   {
-    xmemory::getInstance().doPeriodicChecking();
+    if (xtimer::getInstance().fired (siginfo)) {
+      xmemory& memory = xmemory::getInstance();
+      if (memory._timerStarted) {
+        memory.doPeriodicChecking();
+      }
+      return;
+    }
+    xsignals::getInstance().forward (signum, siginfo, context);
   }
 
-  /// @brief Install a handler for SEGV signals.
+  /// @brief Install the handlers for faults and alarms.
   void installSignalHandler() {
-    stack_t         _sigstk;
-#if defined(linux)
-    // Set up an alternate signal stack.
-    _sigstk.ss_sp = mmap (NULL, SIGSTKSZ, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
-    _sigstk.ss_size = SIGSTKSZ;
-    _sigstk.ss_flags = 0;
-    sigaltstack (&_sigstk, (stack_t *) 0);
-#endif
-    // Now set up a signal handler for SIGSEGV events.
-    struct sigaction siga;
-    sigemptyset (&siga.sa_mask);
+    xsignals& signals = xsignals::getInstance();
+    sigset_t mask;
 
-    // Set the following signals to a set 
-    sigaddset (&siga.sa_mask, SIGSEGV);
-    sigaddset (&siga.sa_mask, SIGALRM);
+    signals.installStack();
 
-    sigprocmask (SIG_BLOCK, &siga.sa_mask, NULL);
+    sigemptyset (&mask);
+    sigaddset (&mask, SIGSEGV);
+    sigaddset (&mask, SIGALRM);
+    sigaddset (&mask, SIGBUS);
+    sigprocmask (SIG_BLOCK, &mask, NULL);
 
-    // Point to the handler function.
-#if defined(linux)
-    siga.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART | SA_NODEFER;
-#else
-    siga.sa_flags = SA_SIGINFO | SA_RESTART;
-#endif
-
-    siga.sa_sigaction = xmemory::segvHandle;
-    if (sigaction (SIGSEGV, &siga, NULL) == -1) {
-      fprintf (stderr, "Signal handler for SIGSEGV failed to install.\n");
-      exit (-1);
-    }
+    signals.install (SIGSEGV, xmemory::segvHandle);
+    signals.install (SIGBUS, xmemory::busHandle);
 
     // We use the alarm to trigger checking timer.
-    siga.sa_sigaction = xmemory::checkingTimerHandle;
-    if (sigaction (SIGALRM, &siga, NULL) == -1) {
-      fprintf (stderr, "Signal handler for SIGALRM failed to install.\n");
-      exit (-1);
-    }
+    signals.install (SIGALRM, xmemory::checkingTimerHandle);
 
-    sigprocmask (SIG_UNBLOCK, &siga.sa_mask, NULL);
+    sigprocmask (SIG_UNBLOCK, &mask, NULL);
   }
 
 private:
@@ -377,6 +558,12 @@ private:
   /// The globals region.
   xglobals          _globals;
 
+  /// Anonymous mappings created by the application.
+  xmmapheap<xdefines::MMAPHEAP_SIZE> _mheap;
+
+  /// Memory for lock-free code, shared by all threads and never tracked.
+  warpheap<xdefines::NUM_HEAPS, xdefines::ATOMICHEAP_CHUNK, xoneheap<SourceSharedHeap<xdefines::ATOMICHEAP_SIZE> > > _aheap;
+
 
   typedef std::set<void *, less<void *>, HL::STLAllocator<void *, privateheap> > pagesetType;
 
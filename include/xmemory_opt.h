@@ -53,6 +53,7 @@
 #include "internalheap.h"
 #include "xoneheap.h"
 #include "xheap.h"
+#include "xmmapheap.h"
 
 #include "xplock.h"
 #include "xpageentry.h"
@@ -62,6 +63,14 @@
 
 #include "stats.h"
 #include "finetime.h"
+#include "xtrace.h"
+#include "xcounters.h"
+#include "xperfevents.h"
+#include "xtunables.h"
+#include "xcostmodel.h"
+#include "xatomicsites.h"
+#include "xsignals.h"
+#include "xtimer.h"
 
 class xmemory {
 private:
@@ -92,6 +101,7 @@ public:
     _bheap.initialize();
     _bheap.setHeapId(0);
     _globals.initialize();
+    _mheap.initialize();
     xpageentry::getInstance().initialize();
     xpagestore::getInstance().initialize();
   
@@ -105,7 +115,8 @@ public:
     _needChecking = true;
 #else
     _lasttrans = 0;
-    _lastema = 0;
+    _closings = 0;
+    _isolating = false;
 #endif
     _init = true;
   }
@@ -116,6 +127,7 @@ public:
 
   void finalize() {
     _globals.finalize(NULL);
+    _mheap.finalize(_mheap.getend());
     _bheap.finalize (_bheap.getend());
   }
 
@@ -178,10 +190,16 @@ Remalloc_again:
   }
 
 
+  /// @brief Allocate from the atomic arena, which every thread maps shared.
+  inline void * atomicMalloc (size_t sz) {
+    return _aheap.malloc(_heapid, sz);
+  }
+
   inline void * realloc (void * ptr, size_t sz, bool isProtected) {
     size_t s = getSize (ptr);
 
-    void * newptr =  malloc (sz, isProtected);
+    // Memory of the atomic arena stays there.
+    void * newptr = _aheap.inRange(ptr) ? atomicMalloc(sz) : malloc (sz, isProtected);
     if (newptr && s != 0) {
       size_t copySz = (s < sz) ? s : sz;
       memcpy (newptr, ptr, copySz);
@@ -192,6 +210,11 @@ Remalloc_again:
   }
 
   inline void free (void * ptr) {
+    if (_aheap.inRange(ptr)) {
+      _aheap.free(_heapid, ptr);
+      return;
+    }
+
     size_t s = getSize (ptr);
   
 #ifdef DETECT_FALSE_SHARING_OPT
@@ -211,63 +234,198 @@ Remalloc_again:
     return _bheap.getSize (ptr);
   }
  
+  /// @brief Serve an anonymous private mapping from the persistent arena.
+  /// @return NULL if the arena is full.
+  inline void * mmap (size_t sz) {
+    CallSite callsite;
+#if defined(DETECT_FALSE_SHARING) || defined(DETECT_FALSE_SHARING_OPT)
+    callsite.fetch(CALL_SITE_DEPTH);
+#endif
+    return _mheap.malloc(sz, &callsite);
+  }
+
+  inline bool inMappedRange (void * addr) {
+    return _mheap.inRange(addr);
+  }
+
+  /// @brief Whether addr lies in memory this thread may have a private copy of.
+  inline bool inTrackedRange (void * addr) {
+    return (_bheap.inRange(addr) || _mheap.inRange(addr) || _globals.inRange(addr));
+  }
+
+  inline bool inAtomicRange (void * addr) {
+    return _aheap.inRange(addr);
+  }
+
+  inline int munmap (void * addr, size_t sz) {
+    return _mheap.free(addr, sz);
+  }
+
+  /// @brief Protect the mappings within a range in units of the given size.
+  /// @return the number of mappings changed.
+  inline int setProtectionUnit (void * addr, size_t sz, size_t unit) {
+    return _mheap.setProtectionUnit(addr, sz, unit);
+  }
+
+  inline void * mremap (void * addr, size_t oldsz, size_t newsz, int flags) {
+    return _mheap.remap(addr, oldsz, newsz, flags);
+  }
+
+  /// @brief Annotate the pages overlapping a range, see sheriff.h.
+  /// @return the number of pages annotated.
+  unsigned long annotate (void * start, size_t sz, int hint) {
+    unsigned long pages = _bheap.annotate(start, sz, hint) + _mheap.annotate(start, sz, hint)
+      + _globals.annotate(start, sz, hint);
+#ifndef DETECT_FALSE_SHARING_OPT
+    // Isolated pages need their transactions even when protection is closed.
+    if(hint == xdefines::PAGE_ISOLATED && pages != 0) {
+      _isolating = true;
+    }
+#endif
+    return pages;
+  }
+
   void openProtection() {
+#ifndef DETECT_FALSE_SHARING_OPT
+    // Measure what protecting a page costs, before the first thread runs.
+    xcostmodel::getInstance().calibrate();
+#endif
+    // Shared state that has to be mapped before the first fork.
+    _aheap.initialize();
+    xatomicsites::getInstance().initialize();
     _globals.openProtection();
     _bheap.openProtection();
+    _mheap.openProtection();
+    if(trace_enabled) {
+      xtrace::getInstance().record(xtrace::PROTECTION, xtrace::timestamp(), 1);
+    }
     _protectLargeHeap = true;
     _protection = true;
   }
 
+  /// @brief Track the globals of modules loaded or unloaded by dlopen/dlclose.
+  void refreshModules(bool protect) {
+    _globals.refresh(protect);
+  }
+
   void closeProtection() {
     // Only do it when the protection is set.
     if (_protection) {
       // memory spaces (globals and heap).
       _globals.closeProtection();
       _bheap.closeProtection();
+      _mheap.closeProtection();
+      if(trace_enabled) {
+        xtrace::getInstance().record(xtrace::PROTECTION, xtrace::timestamp(), 0);
+      }
       _protectLargeHeap = false;
       _protection = false;
     }
   }
 
+  /// @brief Stop tracking for good in this process, see xthread::spawnShared().
+  /// Called once this thread's writes are committed.
+  void shareView() {
+#ifdef DETECT_FALSE_SHARING_OPT
+    stopCheckingTimer();
+#endif
+    _globals.shareView();
+    _bheap.shareView();
+    _mheap.shareView();
+    if(_protection && trace_enabled) {
+      xtrace::getInstance().record(xtrace::PROTECTION, xtrace::timestamp(), 0);
+    }
+    _protectLargeHeap = false;
+    _protection = false;
+  }
+
+  /// @brief Leave Sheriff in a process forked by the application. Its memory
+  /// becomes a private copy, as after a fork without Sheriff, and faults
+  /// and alarms go to the application's handlers again.
+  void detach() {
+    _globals.detach();
+    _bheap.detach();
+    _mheap.detach();
+#ifndef DETECT_FALSE_SHARING_OPT
+    _sheap.detach();
+#endif
+    _aheap.detach();
+    InternalHeap::getInstance().detach();
+
+    xsignals::getInstance().restore();
+    _protectLargeHeap = false;
+    _protection = false;
+  }
+
   inline void setThreadIndex (int heapid) {
     _heapid = heapid%xdefines::NUM_HEAPS;
     _bheap.setHeapId(heapid%xdefines::NUM_HEAPS);
   }
 
   inline void begin (bool startTimer, bool startThread) {
+    unsigned long tracestart = xtrace::start();
 #ifdef DETECT_FALSE_SHARING_OPT
     stopCheckingTimer();
     _globals.begin();
     _bheap.begin();
+    _mheap.begin();
     if(startTimer) { 
       startCheckingTimer(true);
     }
 #else
-    if (_protection) {
+    if (_protection || _isolating) {
       // Reset global and heap protection.
       _globals.begin();
       _bheap.begin();
+      _mheap.begin();
     }
     if (startThread) {
       _lasttrans = _stats.getTrans();
-      start(&_lasttime);
     }
 #endif
+    if(trace_enabled) {
+      xtrace::getInstance().beginTransaction(tracestart);
+    }
   }
 
   // Actual page fault handler.
   inline void handleWrite (void * addr) {
+    xcycles timer(STAT_FAULT);
+    if(trace_enabled) {
+      xtrace::getInstance().fault();
+    }
     if (_bheap.inRange (addr)) {
       _bheap.handleWrite (addr);
+    } else if (_mheap.inRange (addr)) {
+      _mheap.handleWrite (addr);
     } else if (_globals.inRange (addr)) {
       _globals.handleWrite (addr);
     } else {
       // Something must be wrong here.
-      fprintf(stderr, "address %p is out of range!\n", addr);
+      xsignals::report("address %p is out of range!\n", addr);
     }
   }
+
+  /// @return whether addr is in memory that Sheriff protects.
+  inline bool tracks (void * addr) {
+    return _bheap.inRange (addr) || _mheap.inRange (addr) || _globals.inRange (addr);
+  }
   
 
+  /// @brief Prepare a buffer that a system call is about to fill, since
+  /// the kernel fails with EFAULT instead of faulting on protected pages.
+  inline void handleWriteRange (void * start, size_t sz) {
+#ifdef DETECT_FALSE_SHARING_OPT
+    disableCheck();
+#endif
+    _bheap.handleWriteRange (start, sz);
+    _mheap.handleWriteRange (start, sz);
+    _globals.handleWriteRange (start, sz);
+#ifdef DETECT_FALSE_SHARING_OPT
+    enableCheck();
+#endif
+  }
+
   // EDB: This comment needs to be rewritten for clarity.
 
   // How to disable protection periodically for large objects.  Since
@@ -285,10 +443,27 @@ Remalloc_again:
 #ifdef DETECT_FALSE_SHARING_OPT
     stopCheckingTimer();
 #endif
+    xperfevents::getInstance().sample();
+
+    unsigned long tracestart = 0, tracepages = 0;
+    if(trace_enabled) {
+      tracestart = xtrace::timestamp();
+      tracepages = getDirtyPages();
+      xtrace::getInstance().endTransaction(tracestart);
+    }
 
     // Commit local modifications to the shared mapping.
-    _bheap.commit(doChecking);
-    _globals.commit(doChecking);
+    {
+      xcycles timer(STAT_COMMIT);
+      _bheap.commit(doChecking);
+      _mheap.commit(doChecking);
+      _globals.commit(doChecking);
+    }
+    xcounters::getInstance().commitDone();
+
+    if(trace_enabled) {
+      xtrace::getInstance().record(xtrace::COMMIT, tracestart, tracepages);
+    }
   
     // Update the transaction number.
     _stats.updateTrans();
@@ -300,6 +475,11 @@ Remalloc_again:
 #endif
 } 
 
+  /// @brief Pages written in the current transaction.
+  int getDirtyPages (void) {
+    return _bheap.getDirtyPages() + _mheap.getDirtyPages() + _globals.getDirtyPages();
+  }
+
   inline int getElapsedMs() {
     return (elapsed2ms(stop(&_lasttime, NULL)));
   }
@@ -315,9 +495,12 @@ Remalloc_again:
   }
 
 #ifndef DETECT_FALSE_SHARING_OPT // For Sheriff-Protect only
+  /// @brief Protection is decided per run of pages by the cost model. As a
+  /// safety net, all protection is closed when the measured faults take
+  /// too much CPU time, and opened again to sample after a delay that
+  /// doubles every time it had to be closed.
   void evaluateProtection (bool update) {
     int trans;
-    unsigned long elapse = 0;
 
     if(update) {
       trans = _stats.updateTrans();
@@ -327,36 +510,32 @@ Remalloc_again:
       trans = _stats.getTrans();
     }
 
-    // Check for the transaction length
-    if(_protection && (trans-_lasttrans > CHECK_AGAIN_UNDER_PROTECTION)) {
-      elapse = getElapsedMs();
-      double ema = getAverage(elapse, trans);
-
-      // Don't protect if tran length is shorter than predefined threshold.
-      if(ema <= THRESH_TRAN_LENGTH) {
-        _globals.cleanup();
-        _bheap.cleanup();
-          
-        // We need to disable protection.
-        closeProtection();
-      }
-    
-      _lasttrans = trans;
-      _lastema = ema;
-      start(&_lasttime);
-    }
-    else if(!_protection && trans - _lasttrans > CHECK_AGAIN_NO_PROTECTION) {
-      // If we are not protected, we check periodically whether transaction
-      // length is long enough.
-      elapse = getElapsedMs();
-      double ema = getAverage(elapse, trans);
-      if(ema > THRESH_TRAN_LENGTH) {
-        // Open protection again. 
-        openProtection();
+    if(_protection) {
+      _globals.evaluateRuns(trans);
+      _bheap.evaluateRuns(trans);
+      _mheap.evaluateRuns(trans);
+
+      if(trans - _lasttrans > (unsigned long)xtunables::get(xtunables::CHECK_AGAIN_UNDER_PROTECTION)) {
+        // Measured share of CPU time lost to faults since the last check, -1 without counters.
+        int overhead = xperfevents::getInstance().faultOverhead();
+        xperfevents::getInstance().resetWindow();
+
+        if(overhead > xtunables::get(xtunables::MAX_FAULT_OVERHEAD)) {
+          _globals.cleanup();
+          _bheap.cleanup();
+          _mheap.cleanup();
+          closeProtection();
+          if(_closings < xdefines::MAX_PROTECTION_BACKOFF) {
+            _closings++;
+          }
+        }
+        _lasttrans = trans;
       }
+    }
+    else if(trans - _lasttrans > ((unsigned long)xtunables::get(xtunables::CHECK_AGAIN_NO_PROTECTION) << (_closings > 0 ? _closings - 1 : 0))) {
+      xperfevents::getInstance().resetWindow();
+      openProtection();
       _lasttrans = trans;
-      _lastema = ema;
-      start(&_lasttime);
     }
   }
 #endif
@@ -365,8 +544,8 @@ Remalloc_again:
   bool checkProtection(int events) {
     bool doProtect = false;
 
-    int remaining = events % xdefines::EVAL_LARGE_HEAP_BASE;
-    if(remaining < xdefines::EVAL_LARGE_HEAP_PROTECTION) {
+    int remaining = events % xtunables::get(xtunables::EVAL_LARGE_HEAP_BASE);
+    if(remaining < xtunables::get(xtunables::EVAL_LARGE_HEAP_PROTECTION)) {
       doProtect = true;
     }
 
@@ -394,7 +573,11 @@ Remalloc_again:
       // Protect those shared pages.
       _globals.setProtectionPeriod();
       _bheap.setProtectionPeriod();
+      _mheap.setProtectionPeriod();
       _protectLargeHeap = true;
+      if(trace_enabled) {
+        xtrace::getInstance().record(xtrace::PROTECTION, xtrace::timestamp(), 1);
+      }
     }
     else if (doProtect == false && _protectLargeHeap == true) {
       // Here, we need to switch off the protection.
@@ -402,10 +585,14 @@ Remalloc_again:
       // later changes should happen on the shared mapping directly.
       // We only need to work on those shared pages.TONGPING  
       _bheap.unprotectNonProfitPages(_bheap.getend());
+      _mheap.unprotectNonProfitPages(_mheap.getend());
       _globals.unprotectNonProfitPages(NULL);
       // In order to improve the performance, only close protection for those shared pages
       // but no interleaving writes in the period.
       _protectLargeHeap = false;
+      if(trace_enabled) {
+        xtrace::getInstance().record(xtrace::PROTECTION, xtrace::timestamp(), 0);
+      }
     }
   }
 #endif
@@ -414,7 +601,7 @@ Remalloc_again:
     int elapse = getElapsedMs();
     double ema = getAverage(elapse, trans);
 
-    if(ema <= xdefines::PERIODIC_CHECKING_INTERVAL*2) {
+    if(ema <= xtunables::get(xtunables::CHECKING_INTERVAL)*2) {
       // Close the protection when transaction is short.
       _needChecking = false;
     }
@@ -430,8 +617,20 @@ Remalloc_again:
   /// @brief Disable checking timer
   inline void stopCheckingTimer() {
     if(_timerStarted)
-      ualarm(0, 0);
+      xtimer::getInstance().stop();
   } 
+
+  /// @brief Stop the checking timer for a while.
+  /// @return the microseconds it had left, 0 if it was not running.
+  inline useconds_t suspendCheckingTimer() {
+    return _timerStarted ? xtimer::getInstance().stop() : 0;
+  }
+
+  inline void resumeCheckingTimer(useconds_t left) {
+    if(left != 0) {
+      xtimer::getInstance().start(left);
+    }
+  }
  
   // Save some time to set the timer. TONGPING 
   inline void startCheckingTimer (bool evaluate) {
@@ -440,20 +639,21 @@ Remalloc_again:
     // When the transaction is too short, we don't need to start the 
     // checking timer. TONGPING
     if(!evaluate) {
-      ualarm(xdefines::PERIODIC_CHECKING_INTERVAL, 0);
+      xtimer::getInstance().start(xtunables::get(xtunables::CHECKING_INTERVAL));
       _timerStarted = true;
       return;
     }
  
     int trans = _stats.getTrans();
  
-    if(trans%xdefines::EVAL_CHECKING_PERIOD == 0 && trans > xdefines::EVAL_CHECKING_PERIOD) {
+    int period = xtunables::get(xtunables::EVAL_CHECKING_PERIOD);
+    if(trans%period == 0 && trans > period) {
       evalCheckingTimer(trans);     
     }
       
     // Evaluate the checking timer.
     if(_needChecking) {
-      ualarm(xdefines::PERIODIC_CHECKING_INTERVAL, 0);
+      xtimer::getInstance().start(xtunables::get(xtunables::CHECKING_INTERVAL));
       _timerStarted = true;
     }
     else {
@@ -470,10 +670,12 @@ Remalloc_again:
   } 
 
   void doPeriodicChecking () {
+    xcycles timer(STAT_CHECK);
     if(_doChecking == 1) {
       stopCheckingTimer();
       _globals.periodicCheck();
       _bheap.periodicCheck();
+      _mheap.periodicCheck();
 #ifdef DETECT_FALSE_SHARING_OPT
       evaluateProtection(true, false);
 #endif
@@ -485,6 +687,8 @@ Remalloc_again:
   unsigned long sharemem_read_word(void * dest) {
     if(_bheap.inRange(dest)) {
       return _bheap.sharemem_read_word(dest);
+    } else if(_mheap.inRange(dest)) {
+      return _mheap.sharemem_read_word(dest);
     } else if(_globals.inRange(dest)) {
       return _globals.sharemem_read_word(dest);
     }
@@ -494,6 +698,8 @@ Remalloc_again:
   void sharemem_write_word(void * dest, unsigned long val) {
     if(_bheap.inRange(dest)) {
       _bheap.sharemem_write_word(dest, val);
+    } else if(_mheap.inRange(dest)) {
+      _mheap.sharemem_write_word(dest, val);
     } else if(_globals.inRange(dest)) {
       _globals.sharemem_write_word(dest, val);
     }
@@ -509,35 +715,39 @@ public:
 
   /* Signal-related functions for tracking page accesses. */
 
-  /// @brief Signal handler to trap SEGVs.
+  /// @brief Signal handler to trap SEGVs. Write faults on tracked memory
+  /// are Sheriff's, every other fault is the application's.
   static void segvHandle (int signum,
 			  siginfo_t * siginfo,
 			  void * context) 
   {
-#ifdef DETECT_FALSE_SHARING_OPT
-    xmemory::getInstance().disableCheck();
-#endif
     void * addr = siginfo->si_addr; // address of access
 
-    // Check if this was a SEGV that we are supposed to trap.
-    if (siginfo->si_code == SEGV_ACCERR) {
-      // Compute the page that holds this address.
-      void * page = (void *) (((size_t) addr) & ~(xdefines::PageSize-1));
-
-      // Unprotect the page and record the write.
-      mprotect ((char *) page,
-                xdefines::PageSize,
-                PROT_READ | PROT_WRITE);
+    if (siginfo->si_code != SEGV_ACCERR || !xmemory::getInstance().tracks (addr)) {
+      xsignals::getInstance().forward (signum, siginfo, context);
+      return;
+    }
 
-    // It is a write operation. Handle that.
-      xmemory::getInstance().handleWrite (addr);
-    } else if (siginfo->si_code == SEGV_MAPERR) {
-      fprintf (stderr, "%d : map error with addr %p!\n", getpid(), addr);
-      ::abort();
+    xcycles timer(STAT_SEGV);
+#ifdef DETECT_FALSE_SHARING_OPT
+    xmemory::getInstance().disableCheck();
+#endif
+    // Compute the page that holds this address.
+    void * page = (void *) (((size_t) addr) & ~(xdefines::PageSize-1));
+
+    // Unprotect the page and record the write.
+    mprotect ((char *) page,
+              xdefines::PageSize,
+              PROT_READ | PROT_WRITE);
+
+    // An atomic instruction on this page can not be made to work, stop
+    // tracking the page if asked to. Its first write is still ahead.
+    if (xatomicsites::getInstance().check(context, addr)
+        && xtunables::get(xtunables::ATOMIC_PAGES)) {
+      xmemory::getInstance().annotate(page, xdefines::PageSize, xdefines::PAGE_EXCLUDED);
     } else {
-
-      fprintf (stderr, "%d : other access error with addr %p.\n", getpid(), addr);
-      ::abort();
+      // It is a write operation. Handle that.
+      xmemory::getInstance().handleWrite (addr);
     }
 
 #ifdef DETECT_FALSE_SHARING_OPT
@@ -545,54 +755,55 @@ public:
 #endif
   }
 
-  /// @brief Handle those timers about checking.
+  /// @brief A bus error on tracked memory means that the file system of
+  /// the backing files is full.
+  static void busHandle (int signum,
+			 siginfo_t * siginfo,
+			 void * context)
+  {
+    if (xmemory::getInstance().tracks (siginfo->si_addr)) {
+      xsignals::report ("Sheriff: bus error at %p, is the file system of the backing files full?\n",
+                        siginfo->si_addr);
+    }
+    xsignals::getInstance().forward (signum, siginfo, context);
+  }
+
+  /// @brief Handle those timers about checking. Alarms Sheriff did not set
+  /// are the application's, see xtimer.h.
   static void checkingTimerHandle (int signum,
 				   siginfo_t * siginfo,
 				   void * context) 
   {
-    xmemory::getInstance().doPeriodicChecking();
+    if (xtimer::getInstance().fired (siginfo)) {
+      xmemory& memory = xmemory::getInstance();
+      if (memory._timerStarted) {
+        memory.doPeriodicChecking();
+      }
+      return;
+    }
+    xsignals::getInstance().forward (signum, siginfo, context);
   }
 
-  /// @brief Install a handler for SEGV signals.
+  /// @brief Install the handlers for faults and alarms.
   void installSignalHandler() {
-#if defined(linux)
-    // Set up an alternate signal stack.
-    _sigstk.ss_sp = mmap (NULL, SIGSTKSZ, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
-    _sigstk.ss_size = SIGSTKSZ;
-    _sigstk.ss_flags = 0;
-    sigaltstack (&_sigstk, (stack_t *) 0);
-#endif
-    // Now set up a signal handler for SIGSEGV events.
-    struct sigaction siga;
-    sigemptyset (&siga.sa_mask);
+    xsignals& signals = xsignals::getInstance();
+    sigset_t mask;
 
-    // Set the following signals to a set 
-    sigaddset (&siga.sa_mask, SIGSEGV);
-    sigaddset (&siga.sa_mask, SIGALRM);
+    signals.installStack();
 
-    sigprocmask (SIG_BLOCK, &siga.sa_mask, NULL);
+    sigemptyset (&mask);
+    sigaddset (&mask, SIGSEGV);
+    sigaddset (&mask, SIGALRM);
+    sigaddset (&mask, SIGBUS);
+    sigprocmask (SIG_BLOCK, &mask, NULL);
 
-    // Point to the handler function.
-#if defined(linux)
-    siga.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART | SA_NODEFER;
-#else
-    siga.sa_flags = SA_SIGINFO | SA_RESTART;
-#endif
-
-    siga.sa_sigaction = xmemory::segvHandle;
-    if (sigaction (SIGSEGV, &siga, NULL) == -1) {
-      fprintf (stderr, "Signal handler for SIGSEGV failed to install.\n");
-      exit (-1);
-    }
+    signals.install (SIGSEGV, xmemory::segvHandle);
+    signals.install (SIGBUS, xmemory::busHandle);
 
     // We use the alarm to trigger checking timer.
-    siga.sa_sigaction = xmemory::checkingTimerHandle;
-    if (sigaction (SIGALRM, &siga, NULL) == -1) {
-      fprintf (stderr, "Signal handler for SIGALRM failed to install.\n");
-      exit (-1);
-    }
+    signals.install (SIGALRM, xmemory::checkingTimerHandle);
 
-    sigprocmask (SIG_UNBLOCK, &siga.sa_mask, NULL);
+    sigprocmask (SIG_UNBLOCK, &mask, NULL);
   }
 
 private:
@@ -604,10 +815,16 @@ private:
   /// The globals region.
   xglobals          _globals;
 
+  /// Anonymous mappings created by the application.
+  xmmapheap<xdefines::MMAPHEAP_SIZE> _mheap;
+
 #ifndef DETECT_FALSE_SHARING_OPT
   warpheap<xdefines::NUM_HEAPS, xdefines::SHAREDHEAP_CHUNK,xoneheap<SourceSharedHeap<xdefines::SHAREDHEAP_SIZE> > > _sheap;
 #endif
 
+  /// Memory for lock-free code, shared by all threads and never tracked.
+  warpheap<xdefines::NUM_HEAPS, xdefines::ATOMICHEAP_CHUNK, xoneheap<SourceSharedHeap<xdefines::ATOMICHEAP_SIZE> > > _aheap;
+
   typedef std::set<void *, less<void *>,
 		   HL::STLAllocator<void *, privateheap> > // myHeap> >
   pagesetType;
@@ -623,9 +840,6 @@ private:
   /// Internal share heap.
   InternalHeap    _internalheap;
 
-  /// A signal stack, for catching signals.
-  stack_t         _sigstk;
-
   /// A lock that protect the global area.
   int   _maintid;
 
@@ -641,6 +855,12 @@ private:
 
   bool _needChecking;
   bool _protectLargeHeap;
+
+  // Times protection was closed for too many faults.
+  int _closings;
+
+  // Some pages were isolated by the application.
+  bool _isolating;
 };
 
 #endif
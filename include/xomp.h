@@ -0,0 +1,507 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xomp.h
+ * @brief  OpenMP teams of Sheriff threads, in place of libgomp's.
+ *
+ * libgomp keeps its teams in memory every thread writes and waits on raw
+ * futexes issued by inline assembly, neither of which works when threads
+ * are processes. Sheriff takes over the entry points GCC emits for
+ * parallel regions and for the constructs that synchronize inside them
+ * (source/xomp.cpp):
+ *
+ *  - a parallel region spawns its team as Sheriff threads and joins them at
+ *    its end, which is its implicit barrier;
+ *  - barriers, critical sections and atomic blocks use process-shared
+ *    objects and commit and update around them, as pthread barriers and
+ *    mutexes do under Sheriff;
+ *  - loops and sections are split statically: every thread gets one
+ *    contiguous block, or every n-th chunk for a static schedule with a
+ *    chunk size, whatever schedule was asked for.
+ *
+ * Nested regions run with a team of one. Tasks and ordered go to libgomp,
+ * which without a team of its own runs them in the calling thread.
+ * copyprivate and task reductions abort once a team has more than one
+ * thread.
+ *
+ * As with pthreads under Sheriff, threads share the heap and the globals
+ * only. The stack of the thread that starts a region, reduction targets
+ * and arrays GCC passes by address among it, is read-only in the other
+ * threads of the team: a write there aborts with a message instead of
+ * being lost.
+ */
+
+#ifndef SHERIFF_XOMP_H
+#define SHERIFF_XOMP_H
+
+#include <alloca.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "xdefines.h"
+#include "xrun.h"
+#include "xtrace.h"
+#include "xcounters.h"
+#include "xsignals.h"
+#include "internalheap.h"
+#include "mm.h"
+
+class xomp {
+public:
+
+  typedef void (*regionFunction) (void *);
+  typedef unsigned long long iteration;
+
+  /// How a loop of a combined parallel construct is split.
+  struct loopSplit {
+    bool active;
+    iteration start;
+    iteration increment;
+    iteration count;
+    iteration chunk;
+  };
+
+  static xomp& getInstance (void) {
+    static char buf[sizeof(xomp)];
+    static xomp * theOneTrueObject = new (buf) xomp();
+    return *theOneTrueObject;
+  }
+
+  /// @brief Map the locks shared by every team. Runs before any thread.
+  void initialize (void) {
+    _shared = (sharedLocks *)MM::allocateShared(sizeof(sharedLocks));
+    if(_shared == MAP_FAILED) {
+      fprintf(stderr, "Failed to map the OpenMP locks: %s\n", strerror(errno));
+      ::abort();
+    }
+
+    initLocks();
+
+    pthread_barrierattr_init(&_barrierAttr);
+    pthread_barrierattr_setpshared(&_barrierAttr, PTHREAD_PROCESS_SHARED);
+
+    _team.size = 1;
+    _team.num = 0;
+    _team.barrier = NULL;
+    _initialized = true;
+  }
+
+  /// @brief Give a process forked by the application locks of its own,
+  /// unlocked. Named critical sections keep their slots.
+  void detach (void) {
+    if(!_initialized) {
+      return;
+    }
+    MM::privatize(_shared, sizeof(sharedLocks), sizeof(sharedLocks));
+    initLocks();
+  }
+
+  int threadNum (void) const {
+    return _team.num;
+  }
+
+  int teamSize (void) const {
+    return (_team.size > 0) ? _team.size : 1;
+  }
+
+  /// @brief Whether this thread is in a team of more than one, here or in
+  /// an enclosing region.
+  bool inParallel (void) const {
+    if(_team.size > 1) {
+      return true;
+    }
+    for(int i = 1; i < _depth; i++) {
+      if(_outer[i].size > 1) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// @brief Start a parallel region: spawn the team and make this thread
+  /// its thread 0. Nested regions get a team of one.
+  void parallelStart (regionFunction fn, void * data, unsigned threads, const loopSplit * split) {
+    int size = 1;
+
+    if(_depth == xdefines::MAX_OMP_NESTING) {
+      fprintf(stderr, "Sheriff supports OpenMP regions nested at most %d deep.\n",
+              xdefines::MAX_OMP_NESTING);
+      ::abort();
+    }
+
+    _outer[_depth++] = _team;
+    if(_initialized && _team.size <= 1 && _depth == 1) {
+      size = (threads != 0) ? threads : defaultThreads();
+      if(size > xdefines::MAX_OMP_THREADS) {
+        size = xdefines::MAX_OMP_THREADS;
+      }
+    }
+
+    _team.size = size;
+    _team.num = 0;
+    _team.barrier = NULL;
+    if(size > 1) {
+      _team.barrier = (pthread_barrier_t *)InternalHeap::getInstance().malloc(sizeof(pthread_barrier_t));
+      WRAP(pthread_barrier_init)(_team.barrier, &_barrierAttr, size);
+
+      // The frames of the spawn itself, and those every thread runs in,
+      // lie below this gap. Everything above it is ours.
+      char * gap = (char *)alloca(xdefines::PageSize);
+      asm volatile ("" : : "r" (gap) : "memory");
+      findStack(gap);
+
+      // Every thread reads its start from the copy of our memory it gets.
+      for(int i = 1; i < size; i++) {
+        _starts[i].fn = fn;
+        _starts[i].data = data;
+        _starts[i].team.size = size;
+        _starts[i].team.num = i;
+        _starts[i].team.barrier = _team.barrier;
+        _starts[i].split.active = false;
+        if(split != NULL) {
+          _starts[i].split = *split;
+        }
+        _starts[i].spawner = syscall(SYS_getpid);
+        _starts[i].guardStart = (char *)PAGE_ALIGN_UP(gap);
+        _starts[i].guardEnd = _stackHigh;
+        _threads[i] = xrun::getInstance().spawn(threadStart, &_starts[i]);
+      }
+    }
+
+    if(split != NULL && split->active) {
+      splitLoop(split->start, split->increment, split->count, split->chunk);
+    }
+  }
+
+  /// @brief End the parallel region this thread started: join the team.
+  void parallelEnd (void) {
+    if(_depth == 0) {
+      return;
+    }
+
+    if(_team.size > 1) {
+      for(int i = 1; i < _team.size; i++) {
+        xrun::getInstance().join(_threads[i], NULL);
+      }
+      WRAP(pthread_barrier_destroy)(_team.barrier);
+      InternalHeap::getInstance().free(_team.barrier);
+    }
+    _team = _outer[--_depth];
+  }
+
+  /// @brief Wait for the whole team, publishing this thread's writes and
+  /// picking up the others'.
+  void barrier (void) {
+    if(_team.barrier == NULL) {
+      return;
+    }
+
+    xrun& runner = xrun::getInstance();
+    runner.atomicEnd(true, true);
+    unsigned long tracestart = xtrace::start();
+    {
+      xcycles timer(STAT_SYNC);
+      WRAP(pthread_barrier_wait)(_team.barrier);
+    }
+    if(trace_enabled) {
+      xtrace::getInstance().record(xtrace::BARRIER, tracestart, 0);
+    }
+    runner.atomicBegin(true, false);
+  }
+
+  void criticalStart (void) {
+    lock(&_shared->critical);
+  }
+
+  void criticalEnd (void) {
+    unlock(&_shared->critical);
+  }
+
+  /// @brief A named critical section. name points to a variable GCC
+  /// allocates for the name, its address identifies the section.
+  void criticalNameStart (void ** name) {
+    lock(namedLock(name));
+  }
+
+  void criticalNameEnd (void ** name) {
+    unlock(namedLock(name));
+  }
+
+  void atomicStart (void) {
+    lock(&_shared->atomic);
+  }
+
+  void atomicEnd (void) {
+    unlock(&_shared->atomic);
+  }
+
+  /// @brief Whether this thread runs a single construct: thread 0 does.
+  bool singleStart (void) {
+    return (_team.num == 0);
+  }
+
+  /// @brief Abort on a construct Sheriff can not run with a team of more
+  /// than one.
+  void unsupported (const char * construct) {
+    if(teamSize() > 1) {
+      fprintf(stderr, "Sheriff does not support OpenMP %s.\n", construct);
+      ::abort();
+    }
+  }
+
+  /// @brief Split a loop of count iterations between the team.
+  /// chunk is 0 for contiguous blocks.
+  void splitLoop (iteration start, iteration increment, iteration count, iteration chunk) {
+    iteration size = teamSize();
+    iteration num = _team.num;
+
+    _loop.start = start;
+    _loop.increment = increment;
+    _loop.count = count;
+    if(chunk != 0) {
+      _loop.chunk = chunk;
+      _loop.next = num * chunk;
+      _loop.stride = size * chunk;
+    }
+    else {
+      iteration share = count / size;
+      iteration rest = count % size;
+
+      _loop.chunk = share + ((num < rest) ? 1 : 0);
+      _loop.next = num * share + ((num < rest) ? num : rest);
+      _loop.stride = count;
+      if(_loop.chunk == 0) {
+        _loop.next = count;
+      }
+    }
+  }
+
+  /// @brief The next chunk of the current loop for this thread, as the
+  /// first iteration and the one after the last.
+  bool nextChunk (iteration * first, iteration * end) {
+    if(_loop.next >= _loop.count) {
+      return false;
+    }
+
+    iteration last = _loop.next + _loop.chunk;
+    if(last > _loop.count) {
+      last = _loop.count;
+    }
+    *first = _loop.start + _loop.next * _loop.increment;
+    *end = _loop.start + last * _loop.increment;
+    _loop.next += _loop.stride;
+    return true;
+  }
+
+  /// @brief Number of iterations from start to end, going up or down.
+  static iteration countIterations (bool up, iteration start, iteration end, iteration increment) {
+    if(up) {
+      return (end > start) ? (end - start + increment - 1) / increment : 0;
+    }
+    iteration step = -increment;
+    return (start > end) ? (start - end + step - 1) / step : 0;
+  }
+
+private:
+
+  void initLocks (void) {
+    pthread_mutexattr_t attr;
+
+    WRAP(pthread_mutexattr_init)(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    WRAP(pthread_mutex_init)(&_shared->critical, &attr);
+    WRAP(pthread_mutex_init)(&_shared->atomic, &attr);
+    for(int i = 0; i < xdefines::MAX_OMP_CRITICALS; i++) {
+      WRAP(pthread_mutex_init)(&_shared->named[i], &attr);
+    }
+  }
+
+
+  xomp()
+  : _initialized (false),
+    _depth (0),
+    _stackLow (NULL),
+    _stackHigh (NULL),
+    _shared (NULL)
+  {
+  }
+
+  struct team {
+    int size;
+    int num;
+    pthread_barrier_t * barrier;
+  };
+
+  struct start {
+    regionFunction fn;
+    void * data;
+    struct team team;
+    loopSplit split;
+
+    /// The process that spawned the thread, and the part of its stack the
+    /// thread may not write.
+    long spawner;
+    char * guardStart;
+    char * guardEnd;
+  };
+
+  struct loopState {
+    iteration start;
+    iteration increment;
+    iteration count;
+    iteration chunk;
+    iteration next;
+    iteration stride;
+  };
+
+  struct sharedLocks {
+    pthread_mutex_t critical;
+    pthread_mutex_t atomic;
+    void * volatile names[xdefines::MAX_OMP_CRITICALS];
+    pthread_mutex_t named[xdefines::MAX_OMP_CRITICALS];
+  };
+
+  static void * threadStart (void * arg) {
+    struct start * s = (struct start *)arg;
+    xomp& omp = getInstance();
+
+    omp._team = s->team;
+    omp._depth = 1;
+
+    // A thread of a process that stopped tracking shares the stack for real.
+    if(syscall(SYS_getpid) != s->spawner && s->guardStart < s->guardEnd) {
+      xsignals::getInstance().guard(s->guardStart, s->guardEnd - s->guardStart,
+                                    "Sheriff: a thread of an OpenMP team wrote %p, on the stack of "
+                                    "the thread that started the region, and the write would be lost. "
+                                    "Share such variables through the heap or globals.\n");
+      WRAP(mprotect)(s->guardStart, s->guardEnd - s->guardStart, PROT_READ);
+    }
+    if(s->split.active) {
+      omp.splitLoop(s->split.start, s->split.increment, s->split.count, s->split.chunk);
+    }
+    s->fn(s->data);
+    return NULL;
+  }
+
+  /// @brief Find the stack sp lies on, unless it is the one found last.
+  void findStack (char * sp) {
+    if(sp >= _stackLow && sp < _stackHigh) {
+      return;
+    }
+
+    pthread_attr_t attr;
+    void * addr;
+    size_t size;
+
+    if(pthread_getattr_np(WRAP(pthread_self)(), &attr) != 0) {
+      _stackLow = _stackHigh = NULL;
+      return;
+    }
+    pthread_attr_getstack(&attr, &addr, &size);
+    pthread_attr_destroy(&attr);
+    _stackLow = (char *)addr;
+    _stackHigh = (char *)addr + size;
+    if(sp < _stackLow || sp >= _stackHigh) {
+      _stackLow = _stackHigh = NULL;
+    }
+  }
+
+  /// @return the team size libgomp would use, from OMP_NUM_THREADS and
+  /// omp_set_num_threads().
+  static int defaultThreads (void) {
+    int (*maxThreads)(void) = (int (*)(void))dlsym(RTLD_NEXT, "omp_get_max_threads");
+    int threads = (maxThreads != NULL) ? maxThreads() : sysconf(_SC_NPROCESSORS_ONLN);
+    return (threads > 0) ? threads : 1;
+  }
+
+  void lock (pthread_mutex_t * mutex) {
+    xrun& runner = xrun::getInstance();
+    runner.atomicEnd(true, true);
+    unsigned long tracestart = xtrace::start();
+    {
+      xcycles timer(STAT_SYNC);
+      WRAP(pthread_mutex_lock)(mutex);
+    }
+    if(trace_enabled) {
+      xtrace::getInstance().record(xtrace::LOCK, tracestart, 0);
+    }
+    runner.atomicBegin(false, false);
+  }
+
+  void unlock (pthread_mutex_t * mutex) {
+    xrun& runner = xrun::getInstance();
+    runner.atomicEnd(false, true);
+    WRAP(pthread_mutex_unlock)(mutex);
+    runner.atomicBegin(true, false);
+  }
+
+  /// @return the lock of a named critical section, claiming one for a
+  /// name seen for the first time.
+  pthread_mutex_t * namedLock (void ** name) {
+    int first = ((unsigned long)name / sizeof(void *)) % xdefines::MAX_OMP_CRITICALS;
+
+    for(int i = 0; i < xdefines::MAX_OMP_CRITICALS; i++) {
+      int slot = (first + i) % xdefines::MAX_OMP_CRITICALS;
+      if(_shared->names[slot] == name
+         || (_shared->names[slot] == NULL
+             && __sync_bool_compare_and_swap(&_shared->names[slot], (void *)NULL, (void *)name))
+         || _shared->names[slot] == name) {
+        return &_shared->named[slot];
+      }
+    }
+
+    fprintf(stderr, "Sheriff supports at most %d named critical sections.\n",
+            xdefines::MAX_OMP_CRITICALS);
+    ::abort();
+    return NULL;
+  }
+
+  bool _initialized;
+
+  /// The team of this thread, and those of the regions it is nested in.
+  struct team _team;
+  struct team _outer[xdefines::MAX_OMP_NESTING];
+  int _depth;
+
+  /// The stack regions are started on, see findStack().
+  char * _stackLow;
+  char * _stackHigh;
+
+  /// The loop or sections this thread is working through.
+  loopState _loop;
+
+  /// Starts and handles of the team this thread spawned.
+  struct start _starts[xdefines::MAX_OMP_THREADS];
+  void * _threads[xdefines::MAX_OMP_THREADS];
+
+  pthread_barrierattr_t _barrierAttr;
+  sharedLocks * _shared;
+};
+
+#endif
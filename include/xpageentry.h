@@ -13,6 +13,7 @@
 
 #include "xdefines.h"
 #include "xpageinfo.h"
+#include "xsignals.h"
 
 
 /* This class is used to manage the page entries.
@@ -33,6 +34,7 @@ public:
 	xpageentry()
 	{
 		_start = NULL;
+		_twins = 0;
 		_cur = 0;
         _total = 0;
 	}
@@ -45,8 +47,6 @@ public:
 
 	void initialize(void) {
 		void * start;
-        struct pageinfo * cur;
-        int i = 0;
         unsigned long pagestart;
 
 		// We don't need to allocate all pages, only the difference between newnum and oldnum.
@@ -63,23 +63,17 @@ public:
          			 -1,
          			 0);
 
-		if(start == NULL || pagestart == 0)  {
+		if(start == MAP_FAILED || pagestart == (unsigned long)MAP_FAILED)  {
 			fprintf(stderr, "%d fail to allocate page entries : %s\n", getpid(), strerror(errno));
 			::abort();
 		}
-		
-		// start to initialize it.
-        cur = (struct pageinfo *)start;
-        i = 0;
-        while(i < PAGE_ENTRY_NUM) {
-            cur->origTwinPage = (void *)(pagestart + i * xdefines::PageSize);
-            cur++;
-            i++;
-        }
 
+		// Entries get their twin page when handed out, so that only the
+		// entries a program uses are ever touched.
 		_cur = 0;
 		_total = PAGE_ENTRY_NUM;
 		_start = (struct pageinfo *)start;
+		_twins = pagestart;
 		return;
 	}
 
@@ -87,16 +81,22 @@ public:
 		struct pageinfo * entry = NULL;
 		if(_cur < _total) {
 			entry = &_start[_cur];
+			entry->origTwinPage = (void *)(_twins + _cur * xdefines::PageSize);
 			_cur++;
 		}
  		else {
 			// There is no enough entry now, re-allocate new entries now.
-			fprintf(stderr, "NO enough page entry, now _cur %x, _total %x!!!\n", _cur, _total);
+			xsignals::report("NO enough page entry, now _cur %x, _total %x!!!\n", _cur, _total);
 			::abort();
 		}
 		return entry;
     }
 
+	// How many entries are left in this transaction.
+	int available(void) {
+		return _total - _cur;
+	}
+
 	void cleanup(void) {
 		_cur = 0;
 	}
@@ -109,6 +109,9 @@ private:
 	int _cur;
 	
 	struct pageinfo * _start;
+
+	// Twin pages, one per entry.
+	unsigned long _twins;
 };
 
 #endif
@@ -0,0 +1,157 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xpagelist.h
+ * @brief  The pages of one region a thread has written, by page number.
+ *
+ * The write fault handler adds to it, so it may neither allocate nor lock.
+ * Its two arrays are reserved once, as large as the region, and only the
+ * parts in use are ever touched. Entries keep the order the pages were
+ * first written in; sort() puts them in page order, so that a commit can
+ * batch neighbouring pages. It is used like the std::map it replaces.
+ */
+
+#ifndef SHERIFF_XPAGELIST_H
+#define SHERIFF_XPAGELIST_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <utility>
+
+class xpagelist {
+public:
+  typedef std::pair<int, void *> entry;
+  typedef entry * iterator;
+
+  xpagelist()
+  : _entries (NULL),
+    _slots (NULL),
+    _pages (0),
+    _count (0)
+  {
+  }
+
+  /// @brief Reserve room for every page of a region of this many pages.
+  void initialize (size_t pages) {
+    _entries = (entry *)reserve(pages * sizeof(entry));
+    _slots = (int *)reserve(pages * sizeof(int));
+    _pages = pages;
+    _count = 0;
+  }
+
+  /// @brief Give the reserved room back.
+  void release (void) {
+    if(_entries != NULL) {
+      munmap(_entries, _pages * sizeof(entry));
+      munmap(_slots, _pages * sizeof(int));
+    }
+    _entries = NULL;
+    _slots = NULL;
+    _pages = 0;
+    _count = 0;
+  }
+
+  inline iterator begin (void) { return _entries; }
+  inline iterator end (void) { return _entries + _count; }
+  inline size_t size (void) const { return _count; }
+  inline bool empty (void) const { return _count == 0; }
+
+  inline iterator find (int pageNo) {
+    int slot = _slots[pageNo];
+    return (slot == 0) ? end() : &_entries[slot - 1];
+  }
+
+  /// @return the entry of the page, and whether it was added.
+  std::pair<iterator, bool> insert (const entry& e) {
+    iterator i = find(e.first);
+    if(i != end()) {
+      return std::pair<iterator, bool>(i, false);
+    }
+
+    // The entry is complete before it is counted, for the periodic check
+    // that may interrupt this.
+    _entries[_count] = e;
+    _slots[e.first] = _count + 1;
+    __asm__ __volatile__ ("" : : : "memory");
+    _count++;
+    return std::pair<iterator, bool>(&_entries[_count - 1], true);
+  }
+
+  /// @brief Remove an entry, the last one takes its place.
+  void erase (iterator i) {
+    iterator last = end() - 1;
+
+    _slots[i->first] = 0;
+    if(i != last) {
+      *i = *last;
+      _slots[i->first] = (i - _entries) + 1;
+    }
+    _count--;
+  }
+
+  void clear (void) {
+    for(size_t i = 0; i < _count; i++) {
+      _slots[_entries[i].first] = 0;
+    }
+    _count = 0;
+  }
+
+  /// @brief Put the entries in page order. Not from a signal handler.
+  void sort (void) {
+    std::sort(begin(), end(), pageOrder);
+    for(size_t i = 0; i < _count; i++) {
+      _slots[_entries[i].first] = i + 1;
+    }
+  }
+
+private:
+
+  static bool pageOrder (const entry& a, const entry& b) {
+    return a.first < b.first;
+  }
+
+  static void * reserve (size_t sz) {
+    void * ptr = mmap(NULL, sz, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(ptr == MAP_FAILED) {
+      fprintf(stderr, "Sheriff: can not reserve the page list: %s\n", strerror(errno));
+      ::abort();
+    }
+    return ptr;
+  }
+
+  /// Dirty pages, in the order they were first written.
+  entry * _entries;
+
+  /// Per page, its index in _entries plus one, 0 if it is not there.
+  int * _slots;
+
+  size_t _pages;
+  size_t _count;
+};
+
+#endif
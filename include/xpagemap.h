@@ -0,0 +1,253 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xpagemap.h
+ * @brief  The mapping type (MAP_SHARED or MAP_PRIVATE) of every page of one
+ *         region, kept in a bitmap. Remaps are only issued for the pages
+ *         which change type, one mmap per run, and the number of runs is
+ *         counted so that the VMAs of the process can be kept under a budget.
+ *         Like the mappings themselves, the bitmap is private to a process.
+ */
+
+#ifndef SHERIFF_XPAGEMAP_H
+#define SHERIFF_XPAGEMAP_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "xdefines.h"
+#include "mm.h"
+
+class xpagemap {
+
+  enum { BITS_PER_WORD = sizeof(unsigned long) * 8 };
+
+public:
+
+  xpagemap (void)
+    : _base (NULL),
+      _pages (0),
+      _fd (-1),
+      _bitmap (NULL),
+      _runs (0)
+  { }
+
+  /// @brief Track a region which is mapped MAP_SHARED from fd as a whole.
+  void initialize (void * base, unsigned long pages, int fd) {
+    _base = (char *)base;
+    _pages = pages;
+    _fd = fd;
+
+    _bitmap = (unsigned long *)
+      MM::allocatePrivate (((pages + BITS_PER_WORD - 1)/BITS_PER_WORD) * sizeof(unsigned long));
+    if(_bitmap == MAP_FAILED) {
+      fprintf(stderr, "Failed to allocate the page map: %s\n", strerror(errno));
+      ::abort();
+    }
+
+    _runs = 1;
+    totalRuns() += _runs;
+  }
+
+  /// @brief Stop tracking the region, whose mappings are gone.
+  void release (void) {
+    if(_bitmap != NULL) {
+      munmap(_bitmap, ((_pages + BITS_PER_WORD - 1)/BITS_PER_WORD) * sizeof(unsigned long));
+      _bitmap = NULL;
+    }
+    totalRuns() -= _runs;
+    _runs = 0;
+  }
+
+  inline bool isPrivate (unsigned long page) {
+    return (_bitmap[page/BITS_PER_WORD] >> (page % BITS_PER_WORD)) & 1;
+  }
+
+  /// @brief Map pages read-only MAP_PRIVATE, skipping those already private.
+  void mapPrivate (unsigned long first, unsigned long count) {
+    remapRuns (first, count, true, PROT_READ);
+  }
+
+  /// @brief Map pages MAP_SHARED, skipping those already shared.
+  void mapShared (unsigned long first, unsigned long count, int prot) {
+    remapRuns (first, count, false, prot);
+  }
+
+  /// @brief Find the first run of private pages at or after page.
+  /// @return false when there is none.
+  bool nextPrivateRun (unsigned long & page, unsigned long & count) {
+    // Skip whole words of shared pages.
+    while(page < _pages) {
+      if(page % BITS_PER_WORD == 0 && _bitmap[page/BITS_PER_WORD] == 0) {
+        page += BITS_PER_WORD;
+      }
+      else if(!isPrivate(page)) {
+        page++;
+      }
+      else {
+        break;
+      }
+    }
+    if(page >= _pages) {
+      return false;
+    }
+
+    count = 0;
+    while(page + count < _pages && isPrivate(page + count)) {
+      count++;
+    }
+    return true;
+  }
+
+  /// @brief How many VMAs the mapping types split this region into. Changes of
+  /// protection split VMAs further, so this is a lower bound.
+  unsigned long getRuns (void) {
+    return _runs;
+  }
+
+  /// @brief Whether another run of private pages still fits in the budget.
+  static bool withinBudget (void) {
+    return totalRuns() + 2 <= budget();
+  }
+
+  static unsigned long & totalRuns (void) {
+    static unsigned long runs = 0;
+    return runs;
+  }
+
+  /// @brief Part of vm.max_map_count, which is read once.
+  static unsigned long budget (void) {
+    static unsigned long limit = 0;
+
+    if(limit == 0) {
+      unsigned long maxCount = xdefines::DEFAULT_MAX_MAP_COUNT;
+      char buf[32];
+      int fd = open("/proc/sys/vm/max_map_count", O_RDONLY);
+      if(fd != -1) {
+        ssize_t len = read(fd, buf, sizeof(buf) - 1);
+        if(len > 0) {
+          buf[len] = '\0';
+          maxCount = strtoul(buf, NULL, 10);
+        }
+        close(fd);
+      }
+      limit = maxCount * xdefines::VMA_BUDGET_PERCENT / 100;
+    }
+    return limit;
+  }
+
+  /// @brief The number of VMAs of this process, from /proc/self/maps.
+  static int countVmas (void) {
+    char buf[4096];
+    ssize_t len;
+    int lines = 0;
+
+    int fd = open("/proc/self/maps", O_RDONLY);
+    if(fd == -1) {
+      return -1;
+    }
+    while((len = read(fd, buf, sizeof(buf))) > 0) {
+      for(ssize_t i = 0; i < len; i++) {
+        if(buf[i] == '\n') {
+          lines++;
+        }
+      }
+    }
+    close(fd);
+    return lines;
+  }
+
+private:
+
+  /// Remap every run of pages within [first, first+count) whose type differs.
+  void remapRuns (unsigned long first, unsigned long count, bool toPrivate, int prot) {
+    unsigned long last = first + count;
+    if(last > _pages) {
+      last = _pages;
+    }
+
+    unsigned long page = first;
+    while(page < last) {
+      if(isPrivate(page) == toPrivate) {
+        page++;
+        continue;
+      }
+
+      unsigned long start = page;
+      while(page < last && isPrivate(page) != toPrivate) {
+        page++;
+      }
+      remap(start, page - start, toPrivate, prot);
+    }
+  }
+
+  void remap (unsigned long first, unsigned long count, bool toPrivate, int prot) {
+    void * start = _base + first * xdefines::PageSize;
+    void * area = mmap (start,
+                        count * xdefines::PageSize,
+                        prot,
+                        (toPrivate ? MAP_PRIVATE : MAP_SHARED) | MAP_FIXED,
+                        _fd,
+                        first * xdefines::PageSize);
+    if(area == MAP_FAILED) {
+      fprintf(stderr, "%d failed to remap %p size %lx: %s\n", getpid(), start,
+              count * xdefines::PageSize, strerror(errno));
+      ::abort();
+    }
+
+    // Only the borders of the run can start or end a VMA.
+    long delta = - border(first) - border(first + count);
+    for(unsigned long page = first; page < first + count; page++) {
+      if(toPrivate) {
+        _bitmap[page/BITS_PER_WORD] |= (1UL << (page % BITS_PER_WORD));
+      }
+      else {
+        _bitmap[page/BITS_PER_WORD] &= ~(1UL << (page % BITS_PER_WORD));
+      }
+    }
+    delta += border(first) + border(first + count);
+
+    _runs += delta;
+    totalRuns() += delta;
+  }
+
+  /// 1 if page starts a new run of pages.
+  inline int border (unsigned long page) {
+    if(page == 0 || page >= _pages) {
+      return 0;
+    }
+    return (isPrivate(page - 1) != isPrivate(page)) ? 1 : 0;
+  }
+
+  char * _base;
+  unsigned long _pages;
+  int _fd;
+  unsigned long * _bitmap;
+  unsigned long _runs;
+};
+
+#endif
@@ -0,0 +1,210 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xperfevents.h
+ * @brief  Per-process perf_event counters, read at every commit.
+ *
+ * Every Sheriff thread opens one counter group at spawn: page faults,
+ * context switches, CPU migrations and task clock from the software events,
+ * and cache misses when the hardware has them. A commit reads the whole
+ * group with one read() and keeps the deltas of the transaction and of the
+ * window since the protection policy last looked at them. Counters the
+ * kernel refuses (no hardware, perf_event_paranoid) are simply absent.
+ */
+
+#ifndef SHERIFF_XPERFEVENTS_H
+#define SHERIFF_XPERFEVENTS_H
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "xdefines.h"
+#include "xtunables.h"
+
+class xperfevents {
+public:
+  enum counterType {
+    PAGE_FAULTS,
+    CONTEXT_SWITCHES,
+    CPU_MIGRATIONS,
+    TASK_CLOCK,       // Nanoseconds on CPU.
+    CACHE_MISSES,
+    COUNTERS
+  };
+
+  static xperfevents& getInstance (void) {
+    static char buf[sizeof(xperfevents)];
+    static xperfevents * theOneTrueObject = new (buf) xperfevents();
+    return *theOneTrueObject;
+  }
+
+  /// @brief Open the counters of this process. Called by the main thread
+  /// at initialization and by every thread at spawn. Since threads share
+  /// the file table, the inherited descriptors belong to the parent and
+  /// are left alone.
+  void open (void) {
+    static const struct {
+      unsigned int type;
+      unsigned long config;
+    } events[COUNTERS] = {
+      { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+      { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+      { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS },
+      { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    };
+
+    _leader = -1;
+    _opened = 0;
+    memset(_last, 0, sizeof(_last));
+    memset(_delta, 0, sizeof(_delta));
+    memset(_window, 0, sizeof(_window));
+
+    // The task clock leads, so the group is read even without hardware events.
+    _leader = openCounter(events[TASK_CLOCK].type, events[TASK_CLOCK].config, -1);
+    if(_leader == -1) {
+      return;
+    }
+    _fds[TASK_CLOCK] = _leader;
+    _index[TASK_CLOCK] = _opened++;
+
+    for(int i = 0; i < COUNTERS; i++) {
+      if(i == TASK_CLOCK) {
+        continue;
+      }
+      _fds[i] = openCounter(events[i].type, events[i].config, _leader);
+      _index[i] = (_fds[i] == -1) ? -1 : _opened++;
+    }
+
+    ioctl(_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  /// @brief Release the counters when this thread exits.
+  void close (void) {
+    if(_leader == -1) {
+      return;
+    }
+    for(int i = 0; i < COUNTERS; i++) {
+      if(_index[i] != -1) {
+        ::close(_fds[i]);
+      }
+    }
+    _leader = -1;
+  }
+
+  inline bool available (void) {
+    return (_leader != -1);
+  }
+
+  inline bool available (counterType counter) {
+    return (_leader != -1 && _index[counter] != -1);
+  }
+
+  /// @brief Read the group at the end of a transaction.
+  inline void sample (void) {
+    if(_leader == -1) {
+      return;
+    }
+
+    // Group format: number of counters, then their values in opening order.
+    unsigned long values[COUNTERS + 1];
+    if(read(_leader, values, sizeof(unsigned long) * (_opened + 1)) <= 0) {
+      return;
+    }
+
+    for(int i = 0; i < COUNTERS; i++) {
+      if(_index[i] == -1) {
+        continue;
+      }
+      unsigned long value = values[_index[i] + 1];
+      _delta[i] = value - _last[i];
+      _window[i] += _delta[i];
+      _last[i] = value;
+    }
+  }
+
+  /// @brief Change of a counter over the last transaction.
+  inline unsigned long delta (counterType counter) {
+    return _delta[counter];
+  }
+
+  /// @brief Change of a counter since the last resetWindow().
+  inline unsigned long window (counterType counter) {
+    return _window[counter];
+  }
+
+  inline void resetWindow (void) {
+    memset(_window, 0, sizeof(_window));
+  }
+
+  /// @brief Estimated percent of the CPU time in the window that went to
+  /// page faults, or -1 if it can not be measured.
+  int faultOverhead (void) {
+    if(!available(PAGE_FAULTS) || _window[TASK_CLOCK] == 0) {
+      return -1;
+    }
+    unsigned long faultNs = xtunables::get(xtunables::PROTECTION_FAULT_NS);
+    return (int)(100UL * _window[PAGE_FAULTS] * faultNs / _window[TASK_CLOCK]);
+  }
+
+private:
+
+  xperfevents()
+    : _leader(-1),
+      _opened(0)
+  {
+  }
+
+  // Count user and kernel time, or user time only if the kernel does not allow more.
+  static int openCounter (unsigned int type, unsigned long config, int group) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = (group == -1);
+
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+    if(fd == -1) {
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fd = syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+    }
+    return fd;
+  }
+
+  int _leader;
+  int _opened;
+  int _fds[COUNTERS];
+  int _index[COUNTERS];
+  unsigned long _last[COUNTERS];
+  unsigned long _delta[COUNTERS];
+  unsigned long _window[COUNTERS];
+};
+
+#endif
@@ -10,6 +10,7 @@
 #if !defined(_WIN32)
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
@@ -31,7 +32,11 @@
 #include "xplock.h"
 #include "xdefines.h"
 #include "xpageentry.h"
+#include "xpagelist.h"
 #include "xpagestore.h"
+#include "pagecopy.h"
+#include "xcounters.h"
+#include "xtunables.h"
 
 #ifdef GET_CHARACTERISTICS
 #include "xpageprof.h"
@@ -57,25 +62,32 @@ template <class Type,
 class xpersist {
 public:
   typedef std::pair<int, void *> objType;
-  typedef HL::STLAllocator<objType, privateheap> dirtyListTypeAllocator;
-  typedef std::less<int> localComparator;
-  /// A map of pointers to objects and their allocated sizes.
-  typedef std::map<int, void *, localComparator, dirtyListTypeAllocator> dirtyListType;
+
+  /// The pages written in this transaction. The fault handler adds to it.
+  typedef xpagelist dirtyListType;
 
   /// @arg startaddr  the optional starting address of local memory.
   /// @arg startsize  the optional size of local memory.
   xpersist (void * startaddr = 0, 
 	    size_t startsize = 0)
     : _startaddr (startaddr),
-      _startsize (startsize)
+      _startsize (startsize),
+      _untracedStart (0),
+      _untracedEnd (0)
   {
-    if (_startsize > 0) {
-      if (_startsize > NElts * sizeof(Type)) {
-        fprintf (stderr, "This persistent region (%d) is too small (%d).\n",
-		 NElts * sizeof(Type), _startsize);
-        ::abort();
-      }
+    // Globals are mapped with their own (page-aligned) size, while heaps
+    // use the size given by the template argument.
+    if (_startaddr) {
+      _totalSize = ((_startsize + xdefines::PAGE_SIZE_MASK) & ~xdefines::PAGE_SIZE_MASK);
+    }
+    else {
+      _totalSize = NElts * sizeof(Type);
     }
+    _totalPageNums = _totalSize/xdefines::PageSize;
+    _privatePagesList.initialize(_totalPageNums);
+    _savedPagesList.initialize(_totalPageNums);
+    _totalCacheNums = _totalSize/xdefines::CACHE_LINE_SIZE;
+    _totalWordNums = _totalSize/sizeof(unsigned long);
     
     // Get a temporary file name (which had better not be NFS-mounted...).
     char _backingFname[L_tmpnam];
@@ -87,23 +99,25 @@ public:
     }
 
     // Set the files to the sizes of the desired object.
-    if (ftruncate (_backingFd,  NElts * sizeof(Type))) { 
+    if (ftruncate (_backingFd,  _totalSize)) { 
       fprintf (stderr, "Mysterious error with ftruncate.\n");
       ::abort();
     }
 
     // Get rid of the files when we exit.
     unlink (_backingFname);
+    // Programs the application runs do not inherit it.
+    fcntl (_backingFd, F_SETFD, FD_CLOEXEC);
 
     //
     // Establish two maps to the backing file.
     //
     // The persistent map is shared.
     _persistentMemory
-      = (Type *) MM::allocateShared (NElts * sizeof(Type), _backingFd);
+      = (Type *) MM::allocateShared (_totalSize, _backingFd);
 
     if (_persistentMemory == MAP_FAILED) {
-      fprintf (stderr, "Failed to allocate memory (%u).\n", NElts * sizeof(Type));
+      fprintf (stderr, "Failed to allocate memory (%lu).\n", _totalSize);
       ::abort();
     }
 
@@ -112,7 +126,7 @@ public:
     // to squash it.
     if (_startaddr) {
       memcpy (_persistentMemory, _startaddr, _startsize);
-      _startsize = (_startsize / xdefines::PageSize + 1) * xdefines::PageSize;
+      _startsize = _totalSize;
       _isHeap = false;
     }
     else {
@@ -122,44 +136,30 @@ public:
     // The transient map is optionally fixed at the desired start
     // address. If globals, then startaddr is not zero.
     _transientMemory
-      = (Type *) MM::allocateShared (NElts * sizeof(Type), _backingFd, startaddr);
+      = (Type *) MM::allocateShared (_totalSize, _backingFd, startaddr);
 
     _isProtected = false;
   
 #ifndef NDEBUG
-    fprintf (stderr, "transient = %p, persistent = %p, size = %lx\n", _transientMemory, _persistentMemory, NElts * sizeof(Type));
+    fprintf (stderr, "transient = %p, persistent = %p, size = %lx\n", _transientMemory, _persistentMemory, _totalSize);
 #endif
    // fprintf (stderr, "transient = %p, persistent = %p\n", _transientMemory, _persistentMemory);
 
-    _cacheLastthread = (unsigned long *)
-      MM::allocateShared (TotalCacheNums * sizeof(unsigned long));
-  
-    _cacheInvalidates = (unsigned long *)
-      MM::allocateShared (TotalCacheNums * sizeof(unsigned long));
-
-    // How many users can be in the same page. We only start to keep track of 
-    // wordChanges when there are multiple user in the same page.
-    _pageUsers = (unsigned long *)
-      MM::allocateShared (TotalPageNums * sizeof(unsigned long));
-
-    // This is used to save all wordchange information about all words.
-    // Here, we are trying to allocate the same size as transientMemory.
-    // But they won't actually use that much of physical memory. 
-    _wordChanges = (wordchangeinfo *)
-      MM::allocateShared (NElts * sizeof(Type));
-
     if ((_transientMemory == MAP_FAILED) ||
 	      (_persistentMemory == MAP_FAILED) ) {
       fprintf(stderr, "mmap error with %s\n", strerror(errno));
       // If we couldn't map it, something has seriously gone wrong. Bail.
       ::abort();
     }
-  
-    if(_isHeap) {
-      xheapcleanup::getInstance().storeProtectHeapInfo
-	                ((void *)_transientMemory, size(),
-	                (void *)_cacheInvalidates, (void *)_cacheLastthread, (void *)_wordChanges);
-    }
+
+    // The shadow state is mapped when the region is first protected.
+    _cacheLastthread = NULL;
+    _cacheInvalidates = NULL;
+    _pageUsers = NULL;
+    _wordChanges = NULL;
+    _pageHints = NULL;
+    _hintedFirst = 0;
+    _hintedLast = 0;
 
 #ifdef SSE_SUPPORT
     // A string of one bits.
@@ -168,13 +168,25 @@ public:
 #endif 
   }
 
+  /// Only the regions of unloaded modules are destroyed. The loader has
+  /// unmapped the module, and the transient map with it.
   virtual ~xpersist (void) {
-#if 0
-    close (_backingFd);
-    // Unmap everything.
-    munmap (_transientMemory,  NElts * sizeof(Type));
-    munmap (_persistentMemory, NElts * sizeof(Type));
-#endif
+    unmapShadows();
+    if (_pageHints != NULL) {
+      munmap (_pageHints, _totalPageNums);
+    }
+    _privatePagesList.release();
+    _savedPagesList.release();
+
+    if (_persistentMemory != _transientMemory) {
+      munmap (_persistentMemory, _totalSize);
+    }
+    if (_isHeap) {
+      munmap (_transientMemory, _totalSize);
+    }
+    if (_backingFd != -1) {
+      close (_backingFd);
+    }
   }
 
   void initialize(void) {
@@ -229,11 +241,14 @@ public:
 #endif
      }
 
-    if(!_isHeap) {
-      _tracker.checkGlobalObjects(_cacheInvalidates, (int *)base(), size(), _wordChanges); 
-    }
-    else {
-      _tracker.checkHeapObjects(_cacheInvalidates, (int *)base(), (int *)end, _wordChanges);  
+    // A region that was never protected has recorded nothing.
+    if(_cacheInvalidates != NULL) {
+      if(!_isHeap) {
+        _tracker.checkGlobalObjects(_cacheInvalidates, (int *)base(), size(), _wordChanges); 
+      }
+      else {
+        _tracker.checkHeapObjects(_cacheInvalidates, (int *)base(), (int *)end, _wordChanges);  
+      }
     }
 
     // printf those object information.
@@ -332,14 +347,76 @@ public:
 
   // We set the attribute to Private and Readable
   void openProtection (void) {
+    mapShadows();
     mmapRdPrivate(base(), size());
     _isProtected = true;
+    restoreHints(_hintedFirst, _hintedLast);
   }
 
   void closeProtection(void) {
     mmapRwShared(base(), size());
     _isProtected = false;
   }
+
+  /// @brief Stop tracking for good in this process, whose real threads all
+  /// write this region directly. Closing maps every page shared already.
+  void shareView(void) {
+    closeProtection();
+  }
+
+  /// @brief Give a process forked by the application its own copy of the
+  /// region as the forking thread saw it, up to end (all of it if NULL).
+  /// Nothing in it is tracked, committed or reported again: the backing
+  /// file and the shadow state stay with the program.
+  void detach (void * end) {
+    size_t used = (end == NULL) ? size() : (size_t)((intptr_t)end - (intptr_t)base());
+
+    MM::privatize(base(), used, _totalSize);
+    munmap(_persistentMemory, _totalSize);
+    _persistentMemory = _transientMemory;
+    close(_backingFd);
+    _backingFd = -1;
+
+    _privatePagesList.clear();
+    unmapShadows();
+    _isProtected = false;
+  }
+
+  /// @brief Exclude or track again the pages overlapping a range, see
+  /// sheriff.h. Every page is isolated during detection already, so
+  /// isolating only cancels an exclusion. Called between transactions, once
+  /// this thread's writes are committed.
+  /// @return the number of pages of this region in the range.
+  unsigned long annotate (void * start, size_t sz, int hint) {
+    intptr_t first = (intptr_t)start & ~xdefines::PAGE_SIZE_MASK;
+    intptr_t last = ((intptr_t)start + sz + xdefines::PAGE_SIZE_MASK) & ~xdefines::PAGE_SIZE_MASK;
+
+    if(first < (intptr_t)base()) {
+      first = (intptr_t)base();
+    }
+    if(last > (intptr_t)base() + (intptr_t)size()) {
+      last = (intptr_t)base() + size();
+    }
+    if(first >= last) {
+      return 0;
+    }
+
+    unsigned long firstPage = computePage(first - (intptr_t)base());
+    unsigned long lastPage = computePage(last - (intptr_t)base());
+    setHints(firstPage, lastPage, hint);
+    return lastPage - firstPage;
+  }
+
+  /// @brief Leave the writes to a range out of the statistics. They are
+  /// still committed; the pages it shares with other data stay tracked.
+  void untrace (void * start, size_t sz) {
+    _untracedStart = (intptr_t)start;
+    _untracedEnd = (intptr_t)start + sz;
+  }
+
+  inline bool isUntraced (void * addr) {
+    return (intptr_t)addr >= _untracedStart && (intptr_t)addr < _untracedEnd;
+  }
   
   int getDirtyPages(void) {
     return _privatePagesList.size();
@@ -347,7 +424,7 @@ public:
  
   // Cleanup those counter information about one heap object when one object is re-used.
   bool cleanupHeapObject(void * ptr, size_t sz) {
-    int offset;
+    long offset;
     int cachelines;
     int index;
   
@@ -356,8 +433,13 @@ public:
     if(inRange(ptr) == false) {
       return false;
     }
+
+    // Nothing was recorded before the region was ever protected.
+    if(_cacheInvalidates == NULL) {
+      return true;
+    }
     
-    offset = (int)ptr - (int)base();
+    offset = (intptr_t)ptr - (intptr_t)base();
     index = offset/xdefines::CACHE_LINE_SIZE;
   
     // At least we will check one cache line.
@@ -367,7 +449,7 @@ public:
     
     // Cleanup the cacheinvalidates that are involved in this object.
     for(int i = index; i < index+cachelines; i++) {
-      if(_cacheInvalidates[i] >= xdefines::MIN_INVALIDATES_CARE) {
+      if(_cacheInvalidates[i] >= (unsigned long)xtunables::get(xtunables::MIN_INVALIDATES_CARE)) {
         return false;
       }
       // We don't need atomic operation here.
@@ -381,6 +463,45 @@ public:
     return true;
   }
 
+  /// @brief Give back the pages of a heap range which is no longer used.
+  /// Local changes are dropped and the backing file is zeroed, so that the
+  /// range reads as zero-filled memory when it is handed out again.
+  void discardRange(void * start, size_t sz) {
+    long offset = (intptr_t)start - (intptr_t)base();
+    int firstPage = offset/xdefines::PageSize;
+    int lastPage = (offset + sz)/xdefines::PageSize;
+
+    for(int pageNo = firstPage; pageNo < lastPage; pageNo++) {
+      dirtyListType::iterator i = _privatePagesList.find(pageNo);
+      if(i != _privatePagesList.end()) {
+        _privatePagesList.erase(i);
+      }
+    }
+
+    if(fallocate(_backingFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, sz) != 0) {
+      memset((void *)((intptr_t)_persistentMemory + offset), 0, sz);
+    }
+
+    // Annotations belonged to the old owner of the range.
+    if(_pageHints != NULL && firstPage < lastPage) {
+      setHints(firstPage, lastPage, xdefines::PAGE_TRACKED);
+    }
+
+    // Drop the private copies, the pages are read from the file again.
+    madvise(start, sz, MADV_DONTNEED);
+    if(_isProtected) {
+      mprotect(start, sz, PROT_READ);
+    }
+  }
+
+  /// @brief Check one mapped range as a heap object allocated at callsite.
+  void checkMappedObject(void * start, size_t sz, CallSite * callsite) {
+    if(_cacheInvalidates == NULL) {
+      return;
+    }
+    _tracker.checkMappedObject((unsigned long)start, sz, callsite, _cacheInvalidates, (int *)base(), _wordChanges);
+  }
+
   /// @return true iff the address is in this space.
   inline bool inRange (void * addr) {
     if (((size_t) addr >= (size_t) base())
@@ -399,7 +520,7 @@ public:
   /// @return the size in bytes of the underlying object.
   inline size_t size (void) const {
     if(_isHeap) 
-      return NElts * sizeof(Type);
+      return _totalSize;
     else
       return _startsize;
   }
@@ -423,11 +544,49 @@ public:
 
     // Unprotect the page and record the write.
     mprotect ((char *) pageStart, xdefines::PageSize, PROT_READ | PROT_WRITE);
-  
+    recordWrite (pageStart);
+  }
+
+  /// @brief Make a buffer writable before the kernel fills it. Every page
+  /// gets its twin as if it had faulted, but with a single mprotect.
+  void handleWriteRange (void * start, size_t sz) {
+    if(_isProtected) {
+      unprotectRange(start, sz);
+    }
+  }
+
+  void unprotectRange (void * start, size_t sz) {
+    intptr_t first = (intptr_t)start & ~xdefines::PAGE_SIZE_MASK;
+    intptr_t last = ((intptr_t)start + sz + xdefines::PAGE_SIZE_MASK) & ~xdefines::PAGE_SIZE_MASK;
+
+    if(first < (intptr_t)base()) {
+      first = (intptr_t)base();
+    }
+    if(last > (intptr_t)base() + (intptr_t)size()) {
+      last = (intptr_t)base() + size();
+    }
+    if(first >= last) {
+      return;
+    }
+
+    mprotect ((void *)first, last - first, PROT_READ | PROT_WRITE);
+    for(intptr_t page = first; page < last; page += xdefines::PageSize) {
+      int pageNo = computePage(page - (intptr_t)base());
+      if(isExcluded(pageNo)) {
+        continue;
+      }
+      if(_privatePagesList.find(pageNo) == _privatePagesList.end()) {
+        recordWrite ((unsigned long *)page);
+      }
+    }
+  }
+
+  /// @brief Create the twin of a page which has just been made writable.
+  inline void recordWrite (unsigned long * pageStart) {
     // Compute the page number of this item
-    int pageNo = computePage ((size_t) addr - (size_t) base());
+    int pageNo = computePage ((size_t) pageStart - (size_t) base());
 
-    //printf("handlePAGEWRITE: addr %p pageNO %d\n", addr, pageNo);
+    //printf("handlePAGEWRITE: addr %p pageNO %d\n", pageStart, pageNo);
  
     // Get an entry from page store.
     struct pageinfo * curPage = xpageentry::getInstance().alloc();
@@ -452,8 +611,9 @@ public:
                   : "memory");
   #endif
 
-    // Create the "origTwinPage" from the transient page.
-    memcpy(curPage->origTwinPage, pageStart, xdefines::PageSize);
+    // Create the "origTwinPage" from the transient page. It is not read
+    // again until commit, so keep it out of the caches.
+    pagecopy::copyNonTemporal(curPage->origTwinPage, pageStart);
 
     // We will update the users of this page.
     int origUsers = atomic::increment_and_return(&_pageUsers[pageNo]);
@@ -567,6 +727,11 @@ public:
     for(int i = 0; i < xdefines::PageSize/sizeof(int); i++) {
       if(local[i] != twin[i]) {
         int lastTid;
+
+        if(isUntraced(&local[i])) {
+          twin[i] = local[i];
+          continue;
+        }
     
      //   fprintf(stderr, "%d: difference at %p. Local %x twin %x\n", getpid(), &local[i], local[i], twin[i]);
         // Calculate the cache number for current words.  
@@ -593,6 +758,7 @@ public:
 
   /// @brief Start a transaction.
   inline void begin (void) {
+    xcycles timer(STAT_UPDATE);
     updateAll();
   }
 
@@ -705,6 +871,11 @@ public:
       }
       unsigned long wordAddr = (intptr_t)&local[i];
 
+      if(isUntraced(&local[i])) {
+        checkCommitWord((char *)&local[i], (char *)&twin[i], (char *)&share[i]);
+        continue;
+      }
+
       // Now there are some changes, at least we must commit the word.
       if(local[i] != tempTwin[i]) {
         // Calculate the cache number for current words.    
@@ -755,6 +926,9 @@ public:
     unsigned int lastpage = 0xFFFFFF00;
     struct pageinfo * pageinfo;
 
+    // Neighbouring pages share their system calls.
+    _privatePagesList.sort();
+
     // Check every pages in the private pages list.
     for (dirtyListType::iterator i = _privatePagesList.begin(); i != _privatePagesList.end(); ++i) {
       pageNo = i->first;
@@ -809,6 +983,12 @@ public:
     for (dirtyListType::iterator i = _privatePagesList.begin(); i != _privatePagesList.end(); ++i) {
       pageinfo = (struct pageinfo *)i->second;
       pageNo = pageinfo->pageNo;
+
+      // Bring in the next twin while this page is diffed.
+      dirtyListType::iterator next = i;
+      if(++next != _privatePagesList.end()) {
+        pagecopy::prefetch(((struct pageinfo *)next->second)->origTwinPage);
+      }
  
      // fprintf(stderr, "COMMIT: %d on page %d (at %p) on heap %d\n", getpid(), pageNo, pageinfo->pageStart, _isHeap);
  
@@ -839,6 +1019,133 @@ private:
     return (index * sizeof(Type)) / xdefines::PageSize;
   }
 
+  /// @brief Map the per-page, per-line and per-word state, the first time
+  /// the region is protected. That happens before the first thread is
+  /// spawned, so every thread inherits the same shared arrays.
+  void mapShadows (void) {
+    if (_cacheInvalidates != NULL) {
+      return;
+    }
+
+    _cacheLastthread = (unsigned long *)
+      MM::allocateShared (_totalCacheNums * sizeof(unsigned long));
+  
+    _cacheInvalidates = (unsigned long *)
+      MM::allocateShared (_totalCacheNums * sizeof(unsigned long));
+
+    // How many users can be in the same page. We only start to keep track of 
+    // wordChanges when there are multiple user in the same page.
+    _pageUsers = (unsigned long *)
+      MM::allocateShared (_totalPageNums * sizeof(unsigned long));
+
+    // This is used to save all wordchange information about all words.
+    // Here, we are trying to allocate the same size as transientMemory.
+    // But they won't actually use that much of physical memory. 
+    _wordChanges = (wordchangeinfo *)
+      MM::allocateShared (_totalSize);
+
+    if (_cacheLastthread == MAP_FAILED || _cacheInvalidates == MAP_FAILED
+        || _pageUsers == MAP_FAILED || _wordChanges == MAP_FAILED) {
+      fprintf(stderr, "Failed to map the shadow state of %p: %s\n", _transientMemory, strerror(errno));
+      ::abort();
+    }
+  
+    // Only the basic heap reuses objects through xheapcleanup.
+    if(_isHeap && NElts == xdefines::PROTECTEDHEAP_SIZE) {
+      xheapcleanup::getInstance().storeProtectHeapInfo
+	                ((void *)_transientMemory, size(),
+	                (void *)_cacheInvalidates, (void *)_cacheLastthread, (void *)_wordChanges);
+    }
+  }
+
+  /// @brief Drop the shadow state, see detach(). The region is left as if
+  /// it had never been protected.
+  void unmapShadows (void) {
+    if (_cacheInvalidates == NULL) {
+      return;
+    }
+
+    munmap(_cacheLastthread, _totalCacheNums * sizeof(unsigned long));
+    munmap(_cacheInvalidates, _totalCacheNums * sizeof(unsigned long));
+    munmap(_pageUsers, _totalPageNums * sizeof(unsigned long));
+    munmap(_wordChanges, _totalSize);
+    _cacheLastthread = NULL;
+    _cacheInvalidates = NULL;
+    _pageUsers = NULL;
+    _wordChanges = NULL;
+  }
+
+  inline bool isExcluded (unsigned long pageNo) {
+    return (_pageHints != NULL && _pageHints[pageNo] == xdefines::PAGE_EXCLUDED);
+  }
+
+  /// Annotate the pages [first, last), and remap them if protected. The
+  /// hints are mapped privately at the first annotation, so each thread
+  /// inherits the annotations made before it was spawned.
+  void setHints (unsigned long first, unsigned long last, int hint) {
+    if(_pageHints == NULL) {
+      if(hint == xdefines::PAGE_TRACKED) {
+        return;
+      }
+
+      _pageHints = (unsigned char *)MM::allocatePrivate(_totalPageNums);
+      if(_pageHints == MAP_FAILED) {
+        fprintf(stderr, "Failed to map the page hints of %p: %s\n", base(), strerror(errno));
+        ::abort();
+      }
+      _hintedFirst = first;
+      _hintedLast = last;
+    }
+
+    memset(&_pageHints[first], hint, last - first);
+    if(hint != xdefines::PAGE_TRACKED) {
+      _hintedFirst = (first < _hintedFirst) ? first : _hintedFirst;
+      _hintedLast = (last > _hintedLast) ? last : _hintedLast;
+    }
+
+    if(_isProtected) {
+      if(hint == xdefines::PAGE_EXCLUDED) {
+        excludePages(first, last - first);
+      }
+      else {
+        mmapRdPrivate((void *)((intptr_t)base() + first * xdefines::PageSize), (last - first) * xdefines::PageSize);
+      }
+    }
+  }
+
+  /// Exclude the annotated pages of [first, last) again after the whole
+  /// range was protected.
+  void restoreHints (unsigned long first, unsigned long last) {
+    if(_pageHints == NULL) {
+      return;
+    }
+
+    for(unsigned long page = first; page < last; ) {
+      unsigned long count = 0;
+      while(page + count < last && _pageHints[page + count] == xdefines::PAGE_EXCLUDED) {
+        count++;
+      }
+      if(count > 0) {
+        excludePages(page, count);
+        page += count;
+      }
+      else {
+        page++;
+      }
+    }
+  }
+
+  /// Writes to excluded pages go straight to the shared mapping, untracked.
+  void excludePages (unsigned long first, unsigned long count) {
+    for(unsigned long page = first; page < first + count; page++) {
+      dirtyListType::iterator i = _privatePagesList.find(page);
+      if(i != _privatePagesList.end()) {
+        _privatePagesList.erase(i);
+      }
+    }
+    mmapRwShared((void *)((intptr_t)base() + first * xdefines::PageSize), count * xdefines::PageSize);
+  }
+
   /// @brief Update the given page frame from the backing file.
   void updatePages (void * local, int size) {
     madvise (local, size, MADV_DONTNEED);
@@ -857,6 +1164,10 @@ private:
   /// The size of the region.
   size_t _startsize;
 
+  /// The range left out of the statistics, see untrace().
+  intptr_t _untracedStart;
+  intptr_t _untracedEnd;
+
   /// A map of dirtied pages.
   dirtyListType _privatePagesList;
 
@@ -880,9 +1191,18 @@ private:
   bool * _localSharedInfo;
 
  
-  /// The length of the version array.
-  enum { TotalPageNums = NElts * sizeof(Type)/(xdefines::PageSize) };
-  enum { TotalCacheNums = NElts * sizeof(Type)/(xdefines::CACHE_LINE_SIZE) };
+  /// The xdefines::PAGE_* annotation of every page, NULL before the first.
+  unsigned char * _pageHints;
+
+  /// Pages that may be annotated.
+  unsigned long _hintedFirst;
+  unsigned long _hintedLast;
+
+  /// The size of the mapping and the length of the version arrays.
+  size_t _totalSize;
+  unsigned long _totalPageNums;
+  unsigned long _totalCacheNums;
+  unsigned long _totalWordNums;
 
   unsigned long * _cacheInvalidates;
 
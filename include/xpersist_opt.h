@@ -10,6 +10,8 @@
 #if !defined(_WIN32)
 #include <sys/mman.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
@@ -31,7 +33,12 @@
 #include "xplock.h"
 #include "xdefines.h"
 #include "xpageentry.h"
+#include "xpagelist.h"
 #include "xpagestore.h"
+#include "pagecopy.h"
+#include "xcounters.h"
+#include "xtunables.h"
+#include "xcostmodel.h"
 
 #ifdef GET_CHARACTERISTICS
 #include "xpageprof.h"
@@ -41,6 +48,8 @@
 #ifdef DETECT_FALSE_SHARING_OPT
 #include "xtracker.h"
 #include "xheapcleanup.h"
+#include "xpagemap.h"
+#include "xrangequeue.h"
 #include "stats.h"
 #endif
 
@@ -59,13 +68,9 @@ template <class Type,
 class xpersist {
 public:
   typedef std::pair<int, void *> objType;
-  
-  typedef HL::STLAllocator<objType, privateheap> dirtyListTypeAllocator;
-
-  typedef std::less<int> localComparator;
 
-  /// A map of pointers to objects and their allocated sizes.
-  typedef std::map<int, void *, localComparator, dirtyListTypeAllocator> dirtyListType;
+  /// The pages written in this transaction. The fault handler adds to it.
+  typedef xpagelist dirtyListType;
 
   enum {
     PAGE_TYPE_UPDATE = 0, 
@@ -79,15 +84,23 @@ public:
   xpersist (void * startaddr = 0, 
 	    size_t startsize = 0)
     : _startaddr (startaddr),
-      _startsize (startsize)
+      _startsize (startsize),
+      _untracedStart (0),
+      _untracedEnd (0)
   {
-    if (_startsize > 0) {
-      if (_startsize > NElts * sizeof(Type)) {
-        fprintf (stderr, "This persistent region (%d) is too small (%d).\n",
-		 NElts * sizeof(Type), _startsize);
-        ::abort();
-      }
+    // Globals are mapped with their own (page-aligned) size, while heaps
+    // use the size given by the template argument.
+    if (_startaddr) {
+      _totalSize = ((_startsize + xdefines::PAGE_SIZE_MASK) & ~xdefines::PAGE_SIZE_MASK);
+    }
+    else {
+      _totalSize = NElts * sizeof(Type);
     }
+    _totalPageNums = _totalSize/xdefines::PageSize;
+    _privatePagesList.initialize(_totalPageNums);
+    _savedPagesList.initialize(_totalPageNums);
+    _totalCacheNums = _totalSize/xdefines::CACHE_LINE_SIZE;
+    _totalWordNums = _totalSize/sizeof(unsigned long);
     
     // Get a temporary file name (which had better not be NFS-mounted...).
     char _backingFname[L_tmpnam];
@@ -99,25 +112,27 @@ public:
     }
 
     // Set the files to the sizes of the desired object.
-    if (ftruncate (_backingFd,  NElts * sizeof(Type))) { 
+    if (ftruncate (_backingFd,  _totalSize)) { 
       fprintf (stderr, "Mysterious error with ftruncate.\n");
       ::abort();
     }
 
     // Get rid of the files when we exit.
     unlink (_backingFname);
+    // Programs the application runs do not inherit it.
+    fcntl (_backingFd, F_SETFD, FD_CLOEXEC);
 
     //
     // Establish two maps to the backing file.
     //
     // The persistent map is shared.
     _persistentMemory
-      = (Type *) MM::allocateShared (NElts * sizeof(Type),
+      = (Type *) MM::allocateShared (_totalSize,
 				     _backingFd);
 
     if (_persistentMemory == MAP_FAILED) {
       char buf[255];
-      sprintf (buf, "Failed to allocate memory (%u).\n", NElts * sizeof(Type));
+      sprintf (buf, "Failed to allocate memory (%lu).\n", _totalSize);
       fprintf (stderr, buf);
       ::abort();
     }
@@ -127,7 +142,7 @@ public:
     // to squash it.
     if (_startaddr) {
       memcpy (_persistentMemory, _startaddr, _startsize);
-      _startsize = (_startsize / xdefines::PageSize + 1) * xdefines::PageSize;
+      _startsize = _totalSize;
       _isHeap = false;
     }
     else {
@@ -142,77 +157,81 @@ public:
     // address.
 
     _transientMemory
-      = (Type *) MM::allocateShared (NElts * sizeof(Type),
+      = (Type *) MM::allocateShared (_totalSize,
 				     _backingFd,
 				     startaddr);
 
     _isProtected = false;
+    _sharedView = false;
   
 #ifndef NDEBUG
-    //fprintf (stderr, "transient = %p, persistent = %p, size = %lx\n", _transientMemory, _persistentMemory, NElts * sizeof(Type));
+    //fprintf (stderr, "transient = %p, persistent = %p, size = %lx\n", _transientMemory, _persistentMemory, _totalSize);
 #endif
 
-    _pageUsers = (unsigned long *)
-      MM::allocateShared (TotalPageNums * sizeof(unsigned long));
-      
-    _cacheLastthread = (unsigned long *)
-      MM::allocateShared (TotalCacheNums * sizeof(unsigned long));
-  
-#if defined(DETECT_FALSE_SHARING_OPT) 
-    // Finally, map the version numbers.
-    _globalSharedInfo = (bool *)
-      MM::allocateShared (TotalPageNums * sizeof(bool));
-    
-    _localSharedInfo = (bool *)
-      MM::allocatePrivate (TotalPageNums * sizeof(bool));
-
-    // We need to preset those shared information.
-    // In the beginning, everything are set to NON_SHARED.
-    if (_globalSharedInfo == MAP_FAILED || _localSharedInfo == MAP_FAILED) {
-      fprintf(stderr, "Failed to initialize shared info.\n");
-      ::abort();
-    }
-//  memset(_globalSharedInfo, 0, TotalPageNums * sizeof(bool));
-//  memset(_localSharedInfo, 0, TotalPageNums * sizeof(bool));
-    _cacheInvalidates = (unsigned long *)
-      MM::allocateShared (TotalCacheNums * sizeof(unsigned long));
-
-    // FIXME: Didn't make sense to have this since most pages are not shared.
-    _wordChanges = (wordchangeinfo *)
-      MM::allocateShared (TotalWordNums * sizeof(wordchangeinfo));
-
     if ((_transientMemory == MAP_FAILED) ||
-	(_globalSharedInfo == MAP_FAILED) ||
-	(_pageUsers == MAP_FAILED) ||
 	(_persistentMemory == MAP_FAILED) ) {
       fprintf(stderr, "mmap error with %s\n", strerror(errno));
       // If we couldn't map it, something has seriously gone wrong. Bail.
       ::abort();
     }
+
+    // The shadow state is mapped when the region is first protected.
+    _pageUsers = NULL;
+    _cacheLastthread = NULL;
+    _cacheInvalidates = NULL;
+    _wordChanges = NULL;
+    _globalSharedInfo = NULL;
+    _localSharedInfo = NULL;
+    _pageHints = NULL;
+    _hintedFirst = 0;
+    _hintedLast = 0;
+    _isolatedPages = 0;
+#ifndef DETECT_FALSE_SHARING_OPT
+    _runs = NULL;
+    _decisions = 0;
+    _unprotectedRuns = 0;
+#endif
   
-    if(_isHeap) {
-      xheapcleanup::getInstance().storeProtectHeapInfo
-	((void *)_transientMemory, 
-	 size(),
-	 (void *)_cacheInvalidates, 
-	 (void *)_cacheLastthread, 
-	 (void *)_wordChanges);
-    }
+#if defined(DETECT_FALSE_SHARING_OPT) 
+    // Pages start out MAP_SHARED, only shared pages become private.
+    _pagemap.initialize(_transientMemory, _totalPageNums, _backingFd);
+    _pendingRanges.initialize();
 #endif
     // A string of one bits.
     allones = _mm_setzero_si128();
     allones = _mm_cmpeq_epi32(allones, allones); 
   }
 
+  /// Only the regions of unloaded modules are destroyed. The loader has
+  /// unmapped the module, and the transient map with it.
   virtual ~xpersist (void) {
-#if 0
-    close (_backingFd);
-    // Unmap everything.
-    munmap (_transientMemory,  NElts * sizeof(Type));
-    munmap (_persistentMemory, NElts * sizeof(Type));
-    munmap (_globalSharedInfo, TotalPageNums * sizeof(unsigned long));
-    munmap (_pageUsers, TotalPageNums * sizeof(unsigned long));
+    unmapShadows();
+#ifndef DETECT_FALSE_SHARING_OPT
+    if (_runs != NULL) {
+      munmap (_runs, ((_totalPageNums + xdefines::COST_RUN_PAGES - 1) / xdefines::COST_RUN_PAGES) * sizeof(runinfo));
+    }
+#else
+    if (_localSharedInfo != NULL) {
+      munmap (_localSharedInfo, _totalPageNums * sizeof(bool));
+    }
+    _pagemap.release();
+    _pendingRanges.release();
 #endif
+    if (_pageHints != NULL) {
+      munmap (_pageHints, _totalPageNums);
+    }
+    _privatePagesList.release();
+    _savedPagesList.release();
+
+    if (_persistentMemory != _transientMemory) {
+      munmap (_persistentMemory, _totalSize);
+    }
+    if (_isHeap) {
+      munmap (_transientMemory, _totalSize);
+    }
+    if (_backingFd != -1) {
+      close (_backingFd);
+    }
   }
 
   void initialize(void) {
@@ -234,18 +253,21 @@ public:
       fprintf(stderr, "allocTimes %d cleanupSize %d\n", allocTimes, cleanupSize);
   #endif
 
+    // A region that was never protected has recorded nothing.
+    if(_cacheInvalidates != NULL) {
   #ifdef TRACK_ALL_WRITES
-    // We will check those memory writes from the beginning, if one callsite are captured to 
-    // have one bigger updates, then report that.
-    _tracker.checkWrites((int *)base(), size(),  _wordChanges); 
+      // We will check those memory writes from the beginning, if one callsite are captured to 
+      // have one bigger updates, then report that.
+      _tracker.checkWrites((int *)base(), size(),  _wordChanges); 
   #endif
 
-    if(!_isHeap) {
-      _tracker.checkGlobalObjects(_cacheInvalidates, (int *)base(), size(), _wordChanges); 
+      if(!_isHeap) {
+        _tracker.checkGlobalObjects(_cacheInvalidates, (int *)base(), size(), _wordChanges); 
+      }
+      else {
+        _tracker.checkHeapObjects(_cacheInvalidates, (int *)base(), (int *)end, _wordChanges);  
+      }
     }
-    else {
-      _tracker.checkHeapObjects(_cacheInvalidates, (int *)base(), (int *)end, _wordChanges);  
-  }
 
   // printf those object information.
   if(_isBasicHeap) {
@@ -256,6 +278,7 @@ public:
   fprintf(stderr, "\n\n Statistics information at heap: %d\n", _isHeap);
   fprintf(stderr, "trans %d, dirtypages %d, protects %d, cachelines %d\n", 
   stats::getInstance().getTrans(), stats::getInstance().getDirtyPages(), stats::getInstance().getProtects(), stats::getInstance().getCaches());
+  fprintf(stderr, "mapping runs %lu, vmas %d\n", getMappingRuns(), xpagemap::countVmas());
 #endif
 #endif
   }
@@ -283,65 +306,29 @@ public:
     return;
   }
   
+  // Mapping changes go through the page map, which only remaps the pages
+  // whose type changes, one run at a time.
   void* mapRdPrivate(void * start, unsigned long size) {
-    void * area;
-    int  offset = (intptr_t)start - (intptr_t)base();
-
-    // Map to readonly private area. 
-    area = (Type *) mmap (start,
-                      size,
-                      PROT_READ,
-                      MAP_PRIVATE | MAP_FIXED,
-                      _backingFd,
-                      offset);
-    if(area == MAP_FAILED) {
-      fprintf(stderr, "Weird, %d writeProtect failed with error %s!!!\n", getpid(), strerror(errno));
-      fprintf(stderr, "start %p size %d!!!\n", start, size);
-      exit(-1);
-    }
-    return(area);
+    int pageNo = computePage((intptr_t)start - (intptr_t)base());
+    _pagemap.mapPrivate(pageNo, size/xdefines::PageSize);
+    return(start);
   }
 
   void * setPageRdShared(int pageNo) {
-    void * area;
-    int offset = pageNo * xdefines::PageSize;
-    void * start =(void *)((intptr_t)base() + offset);
-
-    //fprintf(stderr, "%d : remove protect %x size 0x%x, offset 0x%x\n", getpid(), start, size, offset);
-    // Map to writable share area. 
-    area = (void *) mmap (start,
-                    xdefines::PageSize,
-                    PROT_READ,
-                    MAP_SHARED | MAP_FIXED,
-                    _backingFd,
-                    offset);
-
-    if(area == MAP_FAILED) {
-      fprintf(stderr, "Weird, %d remove protect failed!!!\n", getpid());
-      exit(-1);
-    }
-    return (area);
+    _pagemap.mapShared(pageNo, 1, PROT_READ);
+    return ((void *)((intptr_t)base() + pageNo * xdefines::PageSize));
   }
 
   void *mapRwShared(void * start, unsigned long size) {
-    void * area;
-    int  offset = (intptr_t)start - (intptr_t)base();
-
-    //fprintf(stderr, "%d : remove protect %x size 0x%x, offset 0x%x\n", getpid(), start, size, offset);
-    // Map to writable share area. 
-    area = (Type *) mmap (start,
-                    size,
-                    PROT_READ | PROT_WRITE,
-                    MAP_SHARED | MAP_FIXED,
-                    _backingFd,
-                    offset);
-
-    if(area == MAP_FAILED) {
-      fprintf(stderr, "Weird, %d remove protect failed!!!\n", getpid());
-      exit(-1);
-    }
-    return (area);
+    int pageNo = computePage((intptr_t)start - (intptr_t)base());
+    _pagemap.mapShared(pageNo, size/xdefines::PageSize, PROT_READ | PROT_WRITE);
+    return (start);
  }
+
+  /// @brief Runs of pages mapped MAP_PRIVATE and MAP_SHARED in this region.
+  unsigned long getMappingRuns(void) {
+    return _pagemap.getRuns();
+  }
 #else
   void *writeProtect(void * start, unsigned long size) {
     void * area;
@@ -384,14 +371,110 @@ public:
 #endif
 
   void openProtection (void) {
+    mapShadows();
     writeProtect(base(), size());
+    _sharedView = false;
     _detectPeriod = true;
     _isProtected = true;
+#ifndef DETECT_FALSE_SHARING_OPT
+    resetRuns();
+#endif
+    restoreHints(_hintedFirst, _hintedLast);
   }
 
   void closeProtection(void) {
     removeProtect(base(), size());
     _isProtected = false;
+#ifndef DETECT_FALSE_SHARING_OPT
+    resetRuns();
+
+    // Isolated pages stay protected whatever the rest of the region does.
+    unsigned long page = _hintedFirst;
+    unsigned long count;
+    int hint;
+    while(nextHintRun(page, _hintedLast, count, hint)) {
+      if(hint == xdefines::PAGE_ISOLATED) {
+        writeProtect((void *)((intptr_t)base() + page * xdefines::PageSize), count * xdefines::PageSize);
+      }
+      page += count;
+    }
+#endif
+  }
+
+  /// @brief Stop tracking for good in this process, whose real threads all
+  /// write this region directly: private pages go back to the shared
+  /// mapping and every page becomes writable, isolated ones included. The
+  /// hints stay, for the threads this process spawns later. Called once
+  /// this thread's writes are committed.
+  void shareView(void) {
+    closeProtection();
+    if(_pageUsers != NULL) {
+#ifdef DETECT_FALSE_SHARING_OPT
+      unsigned long page = 0;
+      unsigned long count;
+
+      while(_pagemap.nextPrivateRun(page, count)) {
+        mergeShared(page, count);
+        page += count;
+      }
+#endif
+      removeProtect(base(), size());
+    }
+    _sharedView = true;
+  }
+
+  /// @brief Give a process forked by the application its own copy of the
+  /// region as the forking thread saw it, up to end (all of it if NULL).
+  /// Nothing in it is tracked, committed or reported again: the backing
+  /// file and the shadow state stay with the program.
+  void detach (void * end) {
+    size_t used = (end == NULL) ? size() : (size_t)((intptr_t)end - (intptr_t)base());
+
+    MM::privatize(base(), used, _totalSize);
+    munmap(_persistentMemory, _totalSize);
+    _persistentMemory = _transientMemory;
+    close(_backingFd);
+    _backingFd = -1;
+
+    _privatePagesList.clear();
+    unmapShadows();
+    _isProtected = false;
+    _sharedView = true;
+  }
+
+  /// @brief Exclude, isolate or track again the pages overlapping a range,
+  /// see sheriff.h. Called between transactions, once this thread's writes
+  /// are committed.
+  /// @return the number of pages of this region in the range.
+  unsigned long annotate (void * start, size_t sz, int hint) {
+    intptr_t first = (intptr_t)start & ~xdefines::PAGE_SIZE_MASK;
+    intptr_t last = ((intptr_t)start + sz + xdefines::PAGE_SIZE_MASK) & ~xdefines::PAGE_SIZE_MASK;
+
+    if(first < (intptr_t)base()) {
+      first = (intptr_t)base();
+    }
+    if(last > (intptr_t)base() + (intptr_t)size()) {
+      last = (intptr_t)base() + size();
+    }
+    if(first >= last) {
+      return 0;
+    }
+
+    unsigned long firstPage = computePage(first - (intptr_t)base());
+    unsigned long lastPage = computePage(last - (intptr_t)base());
+    setHints(firstPage, lastPage, hint);
+    return lastPage - firstPage;
+  }
+
+  /// @brief Leave the writes to a range out of the statistics. They are
+  /// still committed; the pages it shares with other data stay tracked.
+  void untrace (void * start, size_t sz) {
+    _untracedStart = (intptr_t)start;
+    _untracedEnd = (intptr_t)start + sz;
+  }
+
+  inline bool isUntraced (void * addr) {
+    return (intptr_t)addr >= _untracedStart && (intptr_t)addr < _untracedEnd;
   }
   
   int getDirtyPages(void) {
@@ -400,7 +483,7 @@ public:
  
   // Cleanup those counter information about one heap object when one object is re-used.
   bool cleanupHeapObject(void * ptr, size_t sz) {
-    int offset;
+    long offset;
     int cachelines;
     int index;
   
@@ -409,9 +492,14 @@ public:
     if(inRange(ptr) == false) {
       return false;
     }
+
+    // Nothing was recorded before the region was ever protected.
+    if(_cacheInvalidates == NULL) {
+      return true;
+    }
    
     // Calculate the offset of this object. 
-    offset = (int)ptr - (int)base();
+    offset = (intptr_t)ptr - (intptr_t)base();
     index = offset/xdefines::CACHE_LINE_SIZE;
   
     // At least we will check one cache line.
@@ -421,7 +509,7 @@ public:
     
     // Cleanup the cacheinvalidates that are involved in this object.
     for(int i = index; i < index+cachelines; i++) {
-      if(_cacheInvalidates[i] >= xdefines::MIN_INVALIDATES_CARE) {
+      if(_cacheInvalidates[i] >= (unsigned long)xtunables::get(xtunables::MIN_INVALIDATES_CARE)) {
         return false;
       }
       // We don't need atomic operation here.
@@ -435,6 +523,55 @@ public:
     return true;
   }
 
+  /// @brief Give back the pages of a heap range which is no longer used.
+  /// Local changes are dropped and the backing file is zeroed, so that the
+  /// range reads as zero-filled memory when it is handed out again.
+  void discardRange(void * start, size_t sz) {
+    long offset = (intptr_t)start - (intptr_t)base();
+    int firstPage = offset/xdefines::PageSize;
+    int lastPage = (offset + sz)/xdefines::PageSize;
+
+    for(int pageNo = firstPage; pageNo < lastPage; pageNo++) {
+      dirtyListType::iterator i = _privatePagesList.find(pageNo);
+      if(i != _privatePagesList.end()) {
+        atomic::decrement(&_pageUsers[pageNo]);
+        _privatePagesList.erase(i);
+      }
+    }
+
+    if(fallocate(_backingFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, sz) != 0) {
+      memset((void *)((intptr_t)_persistentMemory + offset), 0, sz);
+    }
+
+    // Annotations belonged to the old owner of the range.
+    if(_pageHints != NULL && firstPage < lastPage) {
+      setHints(firstPage, lastPage, xdefines::PAGE_TRACKED);
+    }
+
+#ifndef DETECT_FALSE_SHARING_OPT
+    // The range is handed out again, so it starts out protected.
+    if(_isProtected) {
+      protectRuns(firstPage, lastPage);
+    }
+#endif
+
+    // Drop the private copies, the pages are read from the file again.
+    madvise(start, sz, MADV_DONTNEED);
+    if(_isProtected) {
+      mprotect(start, sz, PROT_READ);
+    }
+  }
+
+#ifdef DETECT_FALSE_SHARING_OPT
+  /// @brief Check one mapped range as a heap object allocated at callsite.
+  void checkMappedObject(void * start, size_t sz, CallSite * callsite) {
+    if(_cacheInvalidates == NULL) {
+      return;
+    }
+    _tracker.checkMappedObject((unsigned long)start, sz, callsite, _cacheInvalidates, (int *)base(), _wordChanges);
+  }
+#endif
+
   /// @return true iff the address is in this space.
   inline bool inRange (void * addr) {
     if (((size_t) addr >= (size_t) base())
@@ -454,7 +591,7 @@ public:
   /// @return the size in bytes of the underlying object.
   inline unsigned long size (void) const {
     if(_isHeap) 
-      return NElts * sizeof(Type);
+      return _totalSize;
     else
       return _startsize;
   }
@@ -470,8 +607,54 @@ public:
     return;                                                                       
   }
 
-  /// @brief Record a write to this location.
+  /// @brief Make a buffer writable before the kernel fills it. Every page
+  /// is recorded as if it had faulted, but with a single mprotect.
+  void handleWriteRange (void * start, size_t sz) {
+    if(!_sharedView && (_isProtected || _isolatedPages != 0)) {
+      unprotectRange(start, sz);
+    }
+  }
+
+  void unprotectRange (void * start, size_t sz) {
+    intptr_t first = (intptr_t)start & ~xdefines::PAGE_SIZE_MASK;
+    intptr_t last = ((intptr_t)start + sz + xdefines::PAGE_SIZE_MASK) & ~xdefines::PAGE_SIZE_MASK;
+
+    if(first < (intptr_t)base()) {
+      first = (intptr_t)base();
+    }
+    if(last > (intptr_t)base() + (intptr_t)size()) {
+      last = (intptr_t)base() + size();
+    }
+    if(first >= last) {
+      return;
+    }
+
+    mprotect ((void *)first, last - first, PROT_READ | PROT_WRITE);
+    for(intptr_t page = first; page < last; page += xdefines::PageSize) {
+      int pageNo = computePage(page - (intptr_t)base());
+      if(!tracksPage(pageNo)) {
+        continue;
+      }
+#ifndef DETECT_FALSE_SHARING_OPT
+      // Shared already, there is nothing to twin.
+      if(_runs[pageNo / xdefines::COST_RUN_PAGES].unprotected) {
+        continue;
+      }
+#endif
+      if(_privatePagesList.find(pageNo) == _privatePagesList.end()) {
+        recordWrite ((void *)page);
+      }
+    }
+  }
+
+  /// @brief Record a write fault at this location, the faulting page has
+  /// already been unprotected by the signal handler.
   void handleWrite (void * addr) {
+    recordWrite (addr);
+  }
+
+  /// @brief Record a write to this location.
+  void recordWrite (void * addr) {
     // Compute the page number of this item
     int pageNo = computePage ((size_t) addr - (size_t) base());
     int * pageStart = (int *)((intptr_t)_transientMemory + xdefines::PageSize * pageNo);
@@ -496,8 +679,8 @@ public:
               "m"(pageStart[0])
             : "memory");
 
-    // Create the "origTwinPage" from _transientMemory.
-    memcpy(curr->origTwinPage, pageStart, xdefines::PageSize);
+    // Create the "origTwinPage" from _transientMemory, around the caches.
+    pagecopy::copyNonTemporal(curr->origTwinPage, pageStart);
 #else
     if(_localSharedInfo[pageNo] == true) {
       asm volatile ("movl %0, %1 \n\t"
@@ -506,8 +689,8 @@ public:
               "m"(pageStart[0])
             : "memory");
 
-      // Create the "origTwinPage" from _transientMemory.
-      memcpy(curr->origTwinPage, pageStart, xdefines::PageSize);
+      // Create the "origTwinPage" from _transientMemory, around the caches.
+      pagecopy::copyNonTemporal(curr->origTwinPage, pageStart);
       curr->hasTwinPage = true;
     }
     else {
@@ -542,6 +725,10 @@ public:
   inline void checkDirtiedPages(void) {
     struct pageinfo * pageinfo;
     int pageNo;
+  #ifdef DETECT_FALSE_SHARING_OPT
+    int batchedStart = 0;
+    int batched = 0;
+  #endif
 
     for (dirtyListType::iterator i = _privatePagesList.begin(); i != _privatePagesList.end(); i++) {
       pageinfo = (struct pageinfo *)i->second;
@@ -571,16 +758,27 @@ public:
       // If this page is not touched again, then the twinPage is trash here.
       // How we can avoid that in the future, we don't want to commit this trash to
       // the shared copy.
-      else if(_detectPeriod) {
+      else if(_detectPeriod && xpagemap::withinBudget()) {
         // Change the local and global shared info.
         _localSharedInfo[pageNo] = true;  
         _globalSharedInfo[pageNo] = true; 
         
-        // Change the mapping to Readonly and MAP_PRIVATE.
-        mapRdPrivate(pageinfo->pageStart, xdefines::PageSize);
+        // Change the mapping to Readonly and MAP_PRIVATE, neighbouring
+        // pages are remapped together.
+        if(batched > 0 && pageNo == batchedStart + batched) {
+          batched++;
+        }
+        else {
+          _pagemap.mapPrivate(batchedStart, batched);
+          batchedStart = pageNo;
+          batched = 1;
+        }
       }
   #endif
     }
+  #ifdef DETECT_FALSE_SHARING_OPT
+    _pagemap.mapPrivate(batchedStart, batched);
+  #endif
   }
 
   inline int recordCacheInvalidates(int pageNo, int cacheNo) {
@@ -636,6 +834,11 @@ public:
     for(int i = 0; i < xdefines::PageSize/sizeof(unsigned long); i++) {
       if(local[i] != twin[i]) {
         int lastTid;
+
+        if(isUntraced(&local[i])) {
+          twin[i] = local[i];
+          continue;
+        }
     
         // Calculate the cache number for current words.  
         cacheNo = calcCacheNo(i);
@@ -672,6 +875,7 @@ public:
   /// @brief Start a transaction.
   inline void begin (void) {
     // Update all pages related in this dirty page list
+    xcycles timer(STAT_UPDATE);
     updateAll();
   }
 
@@ -771,6 +975,11 @@ public:
     if(localChanges == NULL) {
       for (int i = 0; i < xdefines::PageSize/sizeof(unsigned long); i++) {
         if(local[i] != twin[i]) {
+          if(isUntraced(&local[i])) {
+            checkCommitWord((char *)&local[i], (char *)&twin[i], (char *)&share[i]);
+            continue;
+          }
+
           // Calculate the cache number for current words.    
           cacheNo = calcCacheNo(i);
 
@@ -800,6 +1009,10 @@ public:
           recordWordChanges((void *)&globalChange[i], localChanges[i]);
           continue;
         }
+        else if(isUntraced(&local[i])) {
+          checkCommitWord((char *)&local[i], (char *)&twin[i], (char *)&share[i]);
+          continue;
+        }
         
         // Here, we find some modification. 
         if(local[i] != tempTwin[i]) {
@@ -825,27 +1038,58 @@ public:
   }
 
 #ifdef DETECT_FALSE_SHARING_OPT
+  // The system calls of a batch are only queued, so that diffing is not
+  // held up by them. See issueQueuedSystemcalls().
   inline void issueBatchedSystemcalls(int pagetype, int batched, void * batchedStart) {
-    if(batched == 0) {
+    if(batched == 0 || pagetype == PAGE_TYPE_INVALID) {
       return;
     }
 
-    switch(pagetype) {
-    case PAGE_TYPE_UPDATE:
-      updatePage(batchedStart, batched * xdefines::PageSize);
-      break; 
-        
-    case PAGE_TYPE_PRIVATE:
-      mapRdPrivate(batchedStart, batched * xdefines::PageSize);
-      break;
+    if(!_pendingRanges.append(pagetype, batchedStart, batched)) {
+      issueQueuedSystemcalls();
+      _pendingRanges.append(pagetype, batchedStart, batched);
+    }
+  }
 
-    case PAGE_TYPE_READONLY: 
-      writeProtect(batchedStart, batched * xdefines::PageSize);
-      break;
-        
-    default:
-      break;
+  /// @brief Issue the system calls queued by one commit, once all pages are
+  /// diffed. Private ranges are remapped and updated ranges dropped first,
+  /// then a single mprotect covers every stretch of updated and read-only
+  /// ranges which touch.
+  void issueQueuedSystemcalls(void) {
+    int count = _pendingRanges.size();
+
+    for(int i = 0; i < count; i++) {
+      xrangequeue::range & r = _pendingRanges.at(i);
+      if(r.type == PAGE_TYPE_PRIVATE) {
+        mapRdPrivate(r.start, r.pages * xdefines::PageSize);
+      }
+      else if(r.type == PAGE_TYPE_UPDATE) {
+        madvise(r.start, r.pages * xdefines::PageSize, MADV_DONTNEED);
+      }
+    }
+
+    char * start = NULL;
+    size_t length = 0;
+    for(int i = 0; i < count; i++) {
+      xrangequeue::range & r = _pendingRanges.at(i);
+      if(r.type != PAGE_TYPE_UPDATE && r.type != PAGE_TYPE_READONLY) {
+        continue;
+      }
+      if(start != NULL && start + length == r.start) {
+        length += r.pages * xdefines::PageSize;
+        continue;
+      }
+      if(start != NULL) {
+        writeProtect(start, length);
+      }
+      start = r.start;
+      length = r.pages * xdefines::PageSize;
     }
+    if(start != NULL) {
+      writeProtect(start, length);
+    }
+
+    _pendingRanges.clear();
   }
 #endif
  
@@ -858,7 +1102,9 @@ public:
     int    lastpage;
     int    lastpagetype = PAGE_TYPE_INVALID;
     int    pagetype = PAGE_TYPE_INVALID;
-
+#ifndef DETECT_FALSE_SHARING_OPT
+    int    myTid = getpid();
+#endif
 
 #ifdef GET_CHARACTERISTICS
     _pageprof.updateCommitInfo(_privatePagesList.size());
@@ -867,12 +1113,25 @@ public:
       return;
     }
 
+    // Neighbouring pages share their system calls.
+    _privatePagesList.sort();
+
     // Commit those private pages if _localSharedInfo is set to true since that means current page
     // are using the private copy.
     for (dirtyListType::iterator i = _privatePagesList.begin(); i != _privatePagesList.end(); ++i) {
       pageinfo = (struct pageinfo *)i->second;
       pageNo = pageinfo->pageNo;
       persistent = (unsigned long *) ((intptr_t)_persistentMemory + xdefines::PageSize * pageNo);
+
+      // Bring in the next twin while this page is diffed.
+      dirtyListType::iterator next = i;
+      if(++next != _privatePagesList.end()) {
+        struct pageinfo * nextinfo = (struct pageinfo *)next->second;
+      #ifdef DETECT_FALSE_SHARING_OPT
+        if(nextinfo->hasTwinPage)
+      #endif
+          pagecopy::prefetch(nextinfo->origTwinPage);
+      }
     
     #ifdef DETECT_FALSE_SHARING_OPT
       if(_localSharedInfo[pageNo] == true && pageinfo->hasTwinPage == true) {
@@ -890,7 +1149,8 @@ public:
       }
       else if(_detectPeriod) {
         // We don't need the commit if no private copy. Then we may change the mapping.
-        if(doChecking && (pageinfo->shared == true || _pageUsers[pageNo] > 1 || _globalSharedInfo[pageNo] == 1) && _localSharedInfo[pageNo] == false) {
+        if(doChecking && (pageinfo->shared == true || _pageUsers[pageNo] > 1 || _globalSharedInfo[pageNo] == 1)
+           && _localSharedInfo[pageNo] == false && xpagemap::withinBudget()) {
           // Change the local and global shared info.
           _globalSharedInfo[pageNo] = true; 
     
@@ -924,6 +1184,8 @@ public:
         lastpagetype = pagetype;
       }
     #else
+      accountPage(pageinfo, myTid);
+
       // It is possible that one thread are accessing the same page directly when I am trying to access,
       // It is safer to commit the changes only. Memcpy can compromise the changes by the thread directly working on that.
       writePageDiffs(pageinfo->pageStart, pageinfo->origTwinPage, persistent);
@@ -955,9 +1217,11 @@ public:
           lastpage = pageNo;
         }
       }
+      issueBatchedSystemcalls(lastpagetype, batched, batchedStart);
       _savedPagesList.clear();
     }
 
+    issueQueuedSystemcalls();
     _privatePagesList.clear();
 
     // Clean up those page entries.
@@ -967,6 +1231,41 @@ public:
   }
 
 #ifndef DETECT_FALSE_SHARING_OPT
+  /// @brief Decide the protection of the runs which have been written in
+  /// enough commits, and protect again the runs which have been left
+  /// unprotected for check_again_no_protection transactions, so that they
+  /// are sampled again. Runs only while this process protects the region,
+  /// after a commit.
+  void evaluateRuns (unsigned long trans) {
+    if(!_isProtected) {
+      return;
+    }
+
+    for(int i = 0; i < _decisions; i++) {
+      runinfo * run = &_runs[_decide[i]];
+      if(!xcostmodel::pays(run->dirty, run->interleaved) && !isolatesRun(_decide[i])
+         && _unprotectedRuns < xdefines::MAX_UNPROTECTED_RUNS) {
+        unprotectRun(_decide[i], trans);
+      }
+      run->dirty = 0;
+      run->interleaved = 0;
+      run->queued = false;
+    }
+    _decisions = 0;
+
+    unsigned long again = xtunables::get(xtunables::CHECK_AGAIN_NO_PROTECTION);
+    for(int i = 0; i < _unprotectedRuns; ) {
+      int index = _unprotected[i];
+      if(trans - _runs[index].unprotectedAt >= again) {
+        protectRun(index);
+        _unprotected[i] = _unprotected[--_unprotectedRuns];
+      }
+      else {
+        i++;
+      }
+    }
+  }
+
   /// @brief Update every page frame from the backing file.
   /// Change to this function so that it will deallocate those backup pages. Previous way
   /// will have a memory leakage here without deallocation of Backup Pages.
@@ -1013,6 +1312,7 @@ public:
 
   void setProtectionPeriod(void) {
     writeProtect(base(), size());
+    restoreHints(_hintedFirst, _hintedLast);
     _detectPeriod = true; 
   }
 
@@ -1028,20 +1328,60 @@ public:
     mprotect(startAddr, size, PROT_READ|PROT_WRITE); 
  }
 
+  /// @brief Leave the detection period. Private pages which have seen no
+  /// interleaved writes are merged back into shared runs, which gives back
+  /// their VMAs and stops the faults on them.
   void unprotectNonProfitPages(void * end) {
-    int totalpages;
+    unsigned long totalpages;
     if(end == NULL) {
       totalpages = size()/xdefines::PageSize;
     }
     else {
-      totalpages = ((intptr_t)end - (intptr_t)base())/xdefines::PageSize;
+      totalpages = ((intptr_t)end - (intptr_t)base() + xdefines::PAGE_SIZE_MASK)/xdefines::PageSize;
     }
 
-    int start = 0;
-    bool unprotect = false;
+    unsigned long page = 0;
+    unsigned long count;
+
+    while(_pagemap.nextPrivateRun(page, count) && page < totalpages) {
+      unsigned long start = page;
+      bool unprotect = false;
+
+      for(; page < start + count; page++) {
+        bool profitable = hasInvalidates(page) || hintOf(page) == xdefines::PAGE_ISOLATED;
+        if(!profitable && !unprotect) {
+          start = page;
+          unprotect = true;
+        }
+        else if(profitable && unprotect) {
+          mergeShared(start, page - start);
+          unprotect = false;
+        }
+      }
+      if(unprotect) {
+        mergeShared(start, page - start);
+      }
+    }
 
     unsetProtectionPeriod(); 
   }
+
+  inline bool hasInvalidates(unsigned long page) {
+    unsigned long * invalidates = &_cacheInvalidates[page * xdefines::CACHES_PER_PAGE];
+    for(int i = 0; i < xdefines::CACHES_PER_PAGE; i++) {
+      if(invalidates[i] != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void mergeShared(unsigned long start, unsigned long count) {
+    for(unsigned long page = start; page < start + count; page++) {
+      _localSharedInfo[page] = false;
+    }
+    _pagemap.mapShared(start, count, PROT_READ | PROT_WRITE);
+  }
 #endif
 
   // We don't need to set the page protection.
@@ -1072,6 +1412,86 @@ private:
     return (index * sizeof(Type)) / xdefines::PageSize;
   }
 
+  /// @brief Map the per-page and per-line state, the first time the region
+  /// is protected. That happens before the first thread is spawned, so every
+  /// thread inherits the same shared arrays. Programs that never spawn a
+  /// thread never map them.
+  void mapShadows (void) {
+    if (_pageUsers != NULL) {
+      return;
+    }
+
+    _pageUsers = (unsigned long *)
+      MM::allocateShared (_totalPageNums * sizeof(unsigned long));
+    _cacheLastthread = (unsigned long *)
+      MM::allocateShared (_totalCacheNums * sizeof(unsigned long));
+    if (_pageUsers == MAP_FAILED || _cacheLastthread == MAP_FAILED) {
+      fprintf(stderr, "Failed to map the shadow state of %p: %s\n", _transientMemory, strerror(errno));
+      ::abort();
+    }
+
+#ifndef DETECT_FALSE_SHARING_OPT
+    // Per process, untouched runs cost nothing.
+    _runs = (runinfo *)
+      MM::allocatePrivate (((_totalPageNums + xdefines::COST_RUN_PAGES - 1) / xdefines::COST_RUN_PAGES) * sizeof(runinfo));
+    if (_runs == MAP_FAILED) {
+      fprintf(stderr, "Failed to allocate the cost model of %p.\n", _transientMemory);
+      ::abort();
+    }
+#else
+    // In the beginning, every page is not shared.
+    _globalSharedInfo = (bool *)
+      MM::allocateShared (_totalPageNums * sizeof(bool));
+    _localSharedInfo = (bool *)
+      MM::allocatePrivate (_totalPageNums * sizeof(bool));
+
+    _cacheInvalidates = (unsigned long *)
+      MM::allocateShared (_totalCacheNums * sizeof(unsigned long));
+
+    // It is indexed by the byte offset (one entry per int), so it is as
+    // large as the region itself. Only the lines written are backed.
+    _wordChanges = (wordchangeinfo *)
+      MM::allocateShared (_totalSize);
+
+    if (_globalSharedInfo == MAP_FAILED || _localSharedInfo == MAP_FAILED
+        || _cacheInvalidates == MAP_FAILED || _wordChanges == MAP_FAILED) {
+      fprintf(stderr, "Failed to map the shadow state of %p: %s\n", _transientMemory, strerror(errno));
+      ::abort();
+    }
+
+    // Only the basic heap reuses objects through xheapcleanup.
+    if(_isBasicHeap) {
+      xheapcleanup::getInstance().storeProtectHeapInfo
+	((void *)_transientMemory,
+	 size(),
+	 (void *)_cacheInvalidates,
+	 (void *)_cacheLastthread,
+	 (void *)_wordChanges);
+    }
+#endif
+  }
+
+  /// @brief Drop the shadow state, see detach(). The region is left as if
+  /// it had never been protected.
+  void unmapShadows (void) {
+    if (_pageUsers == NULL) {
+      return;
+    }
+
+    munmap(_pageUsers, _totalPageNums * sizeof(unsigned long));
+    munmap(_cacheLastthread, _totalCacheNums * sizeof(unsigned long));
+    _pageUsers = NULL;
+    _cacheLastthread = NULL;
+#ifdef DETECT_FALSE_SHARING_OPT
+    munmap(_globalSharedInfo, _totalPageNums * sizeof(bool));
+    munmap(_cacheInvalidates, _totalCacheNums * sizeof(unsigned long));
+    munmap(_wordChanges, _totalSize);
+    _globalSharedInfo = NULL;
+    _cacheInvalidates = NULL;
+    _wordChanges = NULL;
+#endif
+  }
+
   /// @brief Update the given page frame from the backing file.
   void updatePage (void * local, int size) {
     madvise (local, size, MADV_DONTNEED);
@@ -1080,6 +1500,274 @@ private:
     mprotect (local, size, PROT_READ);
   }
  
+#ifndef DETECT_FALSE_SHARING_OPT
+  /// @brief Account a page about to be committed to its run. Lines that
+  /// another thread committed last are only looked for on pages other
+  /// threads have written concurrently. myTid is read once per commit.
+  inline void accountPage (struct pageinfo * pageinfo, int myTid) {
+    int index = pageinfo->pageNo / xdefines::COST_RUN_PAGES;
+    runinfo * run = &_runs[index];
+
+    if(pageinfo->shared || _pageUsers[pageinfo->pageNo] > 1) {
+      run->interleaved += countInterleavedLines(pageinfo, myTid);
+    }
+    // A run that reaches the samples while the queue is full is queued by
+    // one of its next pages.
+    if(++run->dirty >= (unsigned long)xtunables::get(xtunables::COST_SAMPLES)
+       && !run->queued && _decisions < xdefines::MAX_UNPROTECTED_RUNS) {
+      run->queued = true;
+      _decide[_decisions++] = index;
+    }
+  }
+
+  inline int countInterleavedLines (struct pageinfo * pageinfo, unsigned long myTid) {
+    const int words = xdefines::CACHE_LINE_SIZE / sizeof(unsigned long);
+    unsigned long * local = (unsigned long *)pageinfo->pageStart;
+    unsigned long * twin = (unsigned long *)pageinfo->origTwinPage;
+    unsigned long * lastThread = &_cacheLastthread[pageinfo->pageNo * xdefines::CACHES_PER_PAGE];
+    int interleaved = 0;
+
+    for(int line = 0; line < xdefines::CACHES_PER_PAGE; line++) {
+      if(memcmp(&local[line * words], &twin[line * words], xdefines::CACHE_LINE_SIZE) != 0) {
+        unsigned long lastTid = atomic::exchange(&lastThread[line], myTid);
+        if(lastTid != 0 && lastTid != myTid) {
+          interleaved++;
+        }
+      }
+    }
+    return interleaved;
+  }
+
+  inline void runPages (int index, unsigned long & first, unsigned long & count) {
+    first = (unsigned long)index * xdefines::COST_RUN_PAGES;
+    count = xdefines::COST_RUN_PAGES;
+    if(first + count > _totalPageNums) {
+      count = _totalPageNums - first;
+    }
+  }
+
+  /// Writes to the run go straight to the shared mapping from now on. Its
+  /// pages have been committed, their private copies are dropped.
+  void unprotectRun (int index, unsigned long trans) {
+    unsigned long first, count;
+    runPages(index, first, count);
+
+    for(unsigned long page = first; page < first + count; page++) {
+      dirtyListType::iterator i = _privatePagesList.find(page);
+      if(i != _privatePagesList.end()) {
+        _privatePagesList.erase(i);
+      }
+    }
+
+    removeProtect((void *)((intptr_t)base() + first * xdefines::PageSize), count * xdefines::PageSize);
+    _runs[index].unprotected = true;
+    _runs[index].unprotectedAt = trans;
+    _unprotected[_unprotectedRuns++] = index;
+    if(trace_enabled) {
+      xtrace::getInstance().record(xtrace::RUN_PROTECTION, xtrace::timestamp(), 0);
+    }
+  }
+
+  void protectRun (int index) {
+    unsigned long first, count;
+    runPages(index, first, count);
+
+    writeProtect((void *)((intptr_t)base() + first * xdefines::PageSize), count * xdefines::PageSize);
+    restoreHints(first, first + count);
+    _runs[index].unprotected = false;
+    if(trace_enabled) {
+      xtrace::getInstance().record(xtrace::RUN_PROTECTION, xtrace::timestamp(), 1);
+    }
+  }
+
+  /// Protect the unprotected runs overlapping these pages.
+  void protectRuns (unsigned long firstPage, unsigned long lastPage) {
+    for(int i = 0; i < _unprotectedRuns; ) {
+      int index = _unprotected[i];
+      unsigned long first, count;
+      runPages(index, first, count);
+      if(first < lastPage && first + count > firstPage) {
+        protectRun(index);
+        _unprotected[i] = _unprotected[--_unprotectedRuns];
+      }
+      else {
+        i++;
+      }
+    }
+  }
+
+  /// The whole region changed protection: forget every decision.
+  void resetRuns (void) {
+    for(int i = 0; i < _unprotectedRuns; i++) {
+      _runs[_unprotected[i]].unprotected = false;
+    }
+    for(int i = 0; i < _decisions; i++) {
+      _runs[_decide[i]].dirty = 0;
+      _runs[_decide[i]].interleaved = 0;
+      _runs[_decide[i]].queued = false;
+    }
+    _unprotectedRuns = 0;
+    _decisions = 0;
+  }
+#endif
+
+#ifndef DETECT_FALSE_SHARING_OPT
+  inline bool isolatesRun (int index) {
+    if(_isolatedPages == 0) {
+      return false;
+    }
+
+    unsigned long first, count;
+    runPages(index, first, count);
+    for(unsigned long page = first; page < first + count; page++) {
+      if(_pageHints[page] == xdefines::PAGE_ISOLATED) {
+        return true;
+      }
+    }
+    return false;
+  }
+#endif
+
+  inline int hintOf (unsigned long pageNo) {
+    return (_pageHints == NULL) ? (int)xdefines::PAGE_TRACKED : _pageHints[pageNo];
+  }
+
+  /// Whether writes to a page are twinned and committed now.
+  inline bool tracksPage (unsigned long pageNo) {
+    int hint = hintOf(pageNo);
+    return (hint == xdefines::PAGE_ISOLATED || (hint == xdefines::PAGE_TRACKED && _isProtected));
+  }
+
+  /// Find the run of pages with the same hint that starts at page, below last.
+  bool nextHintRun (unsigned long page, unsigned long last, unsigned long & count, int & hint) {
+    if(_pageHints == NULL || page >= last) {
+      return false;
+    }
+
+    hint = _pageHints[page];
+    count = 1;
+    while(page + count < last && _pageHints[page + count] == hint) {
+      count++;
+    }
+    return true;
+  }
+
+  /// Annotate the pages [first, last), and remap them if protected. The
+  /// hints are mapped privately at the first annotation, so each thread
+  /// inherits the annotations made before it was spawned.
+  void setHints (unsigned long first, unsigned long last, int hint) {
+    if(_pageHints == NULL) {
+      if(hint == xdefines::PAGE_TRACKED) {
+        return;
+      }
+
+      _pageHints = (unsigned char *)MM::allocatePrivate(_totalPageNums);
+      if(_pageHints == MAP_FAILED) {
+        fprintf(stderr, "Failed to map the page hints of %p: %s\n", base(), strerror(errno));
+        ::abort();
+      }
+      _hintedFirst = first;
+      _hintedLast = last;
+    }
+
+    for(unsigned long page = first; page < last; page++) {
+      if(_pageHints[page] == xdefines::PAGE_ISOLATED) {
+        _isolatedPages--;
+      }
+      _pageHints[page] = hint;
+      if(hint == xdefines::PAGE_ISOLATED) {
+        _isolatedPages++;
+      }
+    }
+
+    if(hint != xdefines::PAGE_TRACKED) {
+      _hintedFirst = (first < _hintedFirst) ? first : _hintedFirst;
+      _hintedLast = (last > _hintedLast) ? last : _hintedLast;
+    }
+
+    void * start = (void *)((intptr_t)base() + first * xdefines::PageSize);
+    if(!_isProtected) {
+#ifndef DETECT_FALSE_SHARING_OPT
+      // Closed after it was opened: only isolated pages are protected.
+      if(_pageUsers != NULL && !_sharedView) {
+        if(hint == xdefines::PAGE_ISOLATED) {
+          writeProtect(start, (last - first) * xdefines::PageSize);
+        }
+        else {
+          excludePages(first, last - first);
+        }
+      }
+#endif
+      return;
+    }
+
+#ifndef DETECT_FALSE_SHARING_OPT
+    // Unprotected runs are shared already, so start over from protected pages.
+    protectRuns(first, last);
+#endif
+    if(hint == xdefines::PAGE_EXCLUDED) {
+      excludePages(first, last - first);
+    }
+#ifdef DETECT_FALSE_SHARING_OPT
+    else if(hint == xdefines::PAGE_ISOLATED) {
+      isolatePages(first, last - first);
+    }
+#endif
+    else {
+      writeProtect(start, (last - first) * xdefines::PageSize);
+    }
+  }
+
+  /// Apply the hints of [first, last) again after the whole range was protected.
+  void restoreHints (unsigned long first, unsigned long last) {
+    unsigned long page = first;
+    unsigned long count;
+    int hint;
+
+    while(nextHintRun(page, last, count, hint)) {
+      if(hint == xdefines::PAGE_EXCLUDED) {
+        excludePages(page, count);
+      }
+#ifdef DETECT_FALSE_SHARING_OPT
+      else if(hint == xdefines::PAGE_ISOLATED) {
+        isolatePages(page, count);
+      }
+#endif
+      page += count;
+    }
+  }
+
+  /// Writes to excluded pages go straight to the shared mapping, untracked.
+  void excludePages (unsigned long first, unsigned long count) {
+    void * start = (void *)((intptr_t)base() + first * xdefines::PageSize);
+
+    for(unsigned long page = first; page < first + count; page++) {
+      dirtyListType::iterator i = _privatePagesList.find(page);
+      if(i != _privatePagesList.end()) {
+        _privatePagesList.erase(i);
+      }
+    }
+#ifdef DETECT_FALSE_SHARING_OPT
+    for(unsigned long page = first; page < first + count; page++) {
+      _localSharedInfo[page] = false;
+    }
+    mapRwShared(start, count * xdefines::PageSize);
+#else
+    removeProtect(start, count * xdefines::PageSize);
+#endif
+  }
+
+#ifdef DETECT_FALSE_SHARING_OPT
+  /// Isolated pages get private copies, as falsely shared pages do.
+  void isolatePages (unsigned long first, unsigned long count) {
+    for(unsigned long page = first; page < first + count; page++) {
+      _globalSharedInfo[page] = true;
+      _localSharedInfo[page] = true;
+    }
+    mapRdPrivate((void *)((intptr_t)base() + first * xdefines::PageSize), count * xdefines::PageSize);
+  }
+#endif
+
   /// True if current xpersist.h is a heap.
   bool _isHeap;
   bool _isBasicHeap;
@@ -1090,6 +1778,10 @@ private:
   /// The size of the region.
   size_t _startsize;
 
+  /// The range left out of the statistics, see untrace().
+  intptr_t _untracedStart;
+  intptr_t _untracedEnd;
+
   /// A map of dirtied pages.
   dirtyListType _privatePagesList;
 
@@ -1113,10 +1805,51 @@ private:
   bool * _localSharedInfo;
 
   unsigned long * _pageUsers;
+
+#ifdef DETECT_FALSE_SHARING_OPT
+  /// The mapping type of every page.
+  xpagemap _pagemap;
+
+  /// System calls queued by commit.
+  xrangequeue _pendingRanges;
+#endif
  
-  /// The length of the version array.
-  enum { TotalPageNums = NElts * sizeof(Type)/(xdefines::PageSize) };
-  enum { TotalCacheNums = NElts * sizeof(Type)/(xdefines::CACHE_LINE_SIZE) };
+  /// The xdefines::PAGE_* annotation of every page, NULL before the first.
+  unsigned char * _pageHints;
+
+  /// Pages that may be annotated, and how many are isolated.
+  unsigned long _hintedFirst;
+  unsigned long _hintedLast;
+  unsigned long _isolatedPages;
+
+  /// Whether this process stopped tracking the region, see shareView().
+  bool _sharedView;
+
+#ifndef DETECT_FALSE_SHARING_OPT
+  /// What the cost model knows about one run of COST_RUN_PAGES pages.
+  struct runinfo {
+    unsigned long dirty;          // Page commits since the last decision.
+    unsigned long interleaved;    // Lines other threads committed last.
+    unsigned long unprotectedAt;  // Transaction the run was unprotected in.
+    bool unprotected;
+    bool queued;                  // In _decide.
+  };
+
+  runinfo * _runs;
+
+  /// Runs with enough samples, decided after the commit.
+  int _decide[xdefines::MAX_UNPROTECTED_RUNS];
+  int _decisions;
+
+  int _unprotected[xdefines::MAX_UNPROTECTED_RUNS];
+  int _unprotectedRuns;
+#endif
+
+  /// The size of the mapping and the length of the version arrays.
+  size_t _totalSize;
+  unsigned long _totalPageNums;
+  unsigned long _totalCacheNums;
+  unsigned long _totalWordNums;
 
   unsigned long * _cacheInvalidates;
 
@@ -1126,8 +1859,6 @@ private:
   // A string of one bits.
   __m128i allones;
   
-  enum { TotalWordNums = NElts * sizeof(Type)/sizeof(unsigned long) };
-  
   // In order to save space, we will use the higher 16 bit to store the thread id
   // and use the lower 16 bit to store versions.
   wordchangeinfo * _wordChanges;
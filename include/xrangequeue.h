@@ -0,0 +1,111 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xrangequeue.h
+ * @brief  Page ranges waiting for a system call. Commit diffs every dirty
+ *         page first and queues what has to happen to the mapping afterwards,
+ *         neighbouring ranges of the same kind are merged on the way.
+ */
+
+#ifndef SHERIFF_XRANGEQUEUE_H
+#define SHERIFF_XRANGEQUEUE_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "xdefines.h"
+#include "mm.h"
+
+class xrangequeue {
+public:
+
+  struct range {
+    int    type;
+    char * start;
+    size_t pages;
+  };
+
+  xrangequeue (void)
+    : _ranges (NULL),
+      _count (0)
+  { }
+
+  void initialize (void) {
+    _ranges = (range *)MM::allocatePrivate (xdefines::MAX_QUEUED_RANGES * sizeof(range));
+    if(_ranges == MAP_FAILED) {
+      fprintf(stderr, "Failed to allocate the range queue: %s\n", strerror(errno));
+      ::abort();
+    }
+    _count = 0;
+  }
+
+  void release (void) {
+    if(_ranges != NULL) {
+      munmap(_ranges, xdefines::MAX_QUEUED_RANGES * sizeof(range));
+      _ranges = NULL;
+    }
+    _count = 0;
+  }
+
+  /// @brief Queue a range, merging it into the last one when they touch.
+  /// @return false when the queue is full.
+  bool append (int type, void * start, size_t pages) {
+    if(_count > 0) {
+      range * last = &_ranges[_count - 1];
+      if(last->type == type && last->start + last->pages * xdefines::PageSize == (char *)start) {
+        last->pages += pages;
+        return true;
+      }
+    }
+
+    if(_count == xdefines::MAX_QUEUED_RANGES) {
+      return false;
+    }
+
+    _ranges[_count].type = type;
+    _ranges[_count].start = (char *)start;
+    _ranges[_count].pages = pages;
+    _count++;
+    return true;
+  }
+
+  inline int size (void) {
+    return _count;
+  }
+
+  inline range & at (int index) {
+    return _ranges[index];
+  }
+
+  inline void clear (void) {
+    _count = 0;
+  }
+
+private:
+  range * _ranges;
+  int _count;
+};
+
+#endif
@@ -31,6 +31,8 @@
 #ifndef SHERIFF_XRUN_H
 #define SHERIFF_XRUN_H
 
+#include <linux/futex.h>
+
 #include "xdefines.h"
 
 // threads
@@ -50,6 +52,9 @@
 
 // Grace utilities
 #include "atomic.h"
+#include "xtrace.h"
+#include "xcounters.h"
+#include "xperfevents.h"
 
 class xrun {
 
@@ -59,7 +64,8 @@ private:
   : _locksHeld (0),
     _memory (xmemory::getInstance()),
     _isInitialized (false),
-    _isProtected (false)
+    _isProtected (false),
+    _detached (false)
   {
   }
 
@@ -109,8 +115,58 @@ public:
     _isProtected = false;
   }
 
+  /// @brief Stop tracking in this process for good, see xthread::spawnShared().
+  void shareMemoryView(void) {
+    _memory.shareView();
+    _isProtected = false;
+  }
+
+  /// @brief Update module information after dlopen/dlclose.
+  void refreshModules(void) {
+    xmodules::getInstance().refresh();
+    _memory.refreshModules(_isProtected);
+  }
+
+  /// @brief Leave Sheriff in the child of an application fork(), see
+  /// libsheriff.cpp. The child keeps a private copy of its memory, runs its
+  /// threads as real threads and adds nothing to the counters, trace or
+  /// report of the program.
+  void detach (void) {
+    pid_t pid = syscall(SYS_getpid);
+
+    _memory.detach();
+    _thread.detach(pid);
+    _tid = pid;
+    _memory.setMainId(pid);
+    _isProtected = false;
+    _hasProtected = false;
+    _detached = true;
+    _locksHeld = 0;
+
+    trace_enabled = false;
+    xcounters::getInstance().detach();
+    xperfevents::getInstance().close();
+  }
+
+  /// @brief Stop the checking timer before this process runs another
+  /// program: a tick pending at execve() would reach the new one.
+  /// @return the time the timer had left, for execFailed().
+  unsigned long prepareExec (void) {
+    return _memory.suspendCheckingTimer();
+  }
+
+  /// @brief The program was not run: carry on checking.
+  void execFailed (unsigned long left) {
+    _memory.resumeCheckingTimer(left);
+  }
+
   void finalize (void)
   {
+    // A forked child reports nothing, the program it was forked from does.
+    if (_detached) {
+      return;
+    }
+
     // If the tid was set, it means that this instance was
     // initialized: end the transaction (at the end of main()).
     _memory.finalize();
@@ -125,6 +181,12 @@ public:
     // Since we are a new thread, we need to use the new heap.
     _memory.setThreadIndex(threadindex+1);
 
+    xcounters::getInstance().setThread(threadindex+1);
+    xperfevents::getInstance().open();
+    if(trace_enabled) {
+      xtrace::getInstance().setThread(threadindex+1);
+    }
+
     return;
   }   
 
@@ -152,6 +214,13 @@ public:
     return _thread.spawn (this, fn, arg);
   }
 
+  /// @brief Spawn a real thread, which shares this process.
+  /// @return an opaque object used by sync, NULL if it could not start.
+  inline void * spawnShared (threadFunction * fn, void * arg)
+  {
+    return _thread.spawnShared (this, fn, arg);
+  }
+
   /// @brief Wait for a thread.
   inline void join (void * v, void ** result) {
   #if defined(DETECT_FALSE_SHARING) || defined(DETECT_FALSE_SHARING_OPT)
@@ -208,6 +277,97 @@ public:
     return newptr;
   }
 
+  /* Mapping-related functions. */
+  inline void * mmap (size_t sz) {
+    return _memory.mmap(sz);
+  }
+
+  inline bool inMappedRange (void * addr) {
+    return _memory.inMappedRange(addr);
+  }
+
+  inline int munmap (void * addr, size_t sz) {
+    return _memory.munmap(addr, sz);
+  }
+
+  inline bool inTrackedRange (void * addr) {
+    return _memory.inTrackedRange(addr);
+  }
+
+  inline int setProtectionUnit (void * addr, size_t sz, size_t unit) {
+    return _memory.setProtectionUnit(addr, sz, unit);
+  }
+
+  inline void * mremap (void * addr, size_t oldsz, size_t newsz, int flags) {
+    return _memory.mremap(addr, oldsz, newsz, flags);
+  }
+
+  /// @brief Make a buffer writable before a system call fills it.
+  inline void handleWriteRange (void * start, size_t sz) {
+    _memory.handleWriteRange(start, sz);
+  }
+
+  /* Annotations by the application (sheriff.h). */
+
+  /// @brief Annotate a range between two transactions, so that no write
+  /// of this thread is pending when its pages change mapping.
+  /// @return the number of pages annotated.
+  unsigned long annotate (void * start, size_t sz, int hint) {
+    atomicEnd(true, true);
+    unsigned long pages = _memory.annotate(start, sz, hint);
+    atomicBegin(true, false);
+    return pages;
+  }
+
+  /// @brief Publish this thread's writes and see those of other threads,
+  /// as a synchronization operation would.
+  void commitPoint (void) {
+    atomicEnd(true, true);
+    atomicBegin(true, false);
+  }
+
+  /// @brief Allocate memory that all threads share directly.
+  inline void * atomicMalloc (size_t sz) {
+    return _memory.atomicMalloc(sz);
+  }
+
+  /// @brief A futex operation of the application (syscall() in libsheriff.cpp).
+  /// Futexes in the atomic arena are shared, they only lose the private
+  /// flag. One on tracked memory can not be woken from another thread: a
+  /// wait sleeps a little between two transactions and returns as if woken,
+  /// and a wake publishes this thread's writes for the waiters to see.
+  long futex (int * uaddr, int op, long val, long timeout, long uaddr2, long val3) {
+    int command = op & FUTEX_CMD_MASK;
+
+    if (_memory.inAtomicRange(uaddr)) {
+      return WRAP(syscall)(SYS_futex, uaddr, op & ~FUTEX_PRIVATE_FLAG, val, timeout, uaddr2, val3);
+    }
+    if (!_isProtected || !_memory.inTrackedRange(uaddr)) {
+      return WRAP(syscall)(SYS_futex, uaddr, op, val, timeout, uaddr2, val3);
+    }
+
+    if (command == FUTEX_WAIT || command == FUTEX_WAIT_BITSET) {
+      struct timespec poll = { 0, xdefines::FUTEX_POLL_NS };
+
+      atomicEnd(true, true);
+      long ret = WRAP(syscall)(SYS_futex, uaddr, FUTEX_WAIT_PRIVATE, val, &poll, NULL, 0);
+      atomicBegin(true, false);
+      return (ret == -1 && errno == ETIMEDOUT) ? 0 : ret;
+    }
+    if (command == FUTEX_WAKE || command == FUTEX_WAKE_BITSET || command == FUTEX_WAKE_OP) {
+      atomicEnd(true, true);
+      atomicBegin(true, false);
+    }
+    return WRAP(syscall)(SYS_futex, uaddr, op, val, timeout, uaddr2, val3);
+  }
+
+  /// @brief Start a named phase of the trace, or end the current one.
+  void phase (const char * name) {
+    if(trace_enabled) {
+      xtrace::getInstance().phase(name);
+    }
+  }
+
   ///// conditional variable functions.
   void cond_init (void * cond) {
     _sync.cond_init(cond, false);
@@ -240,7 +400,11 @@ public:
 
   void mutex_lock(pthread_mutex_t * mutex) {
     atomicEnd(true, true);
+    unsigned long tracestart = xtrace::start();
     _sync.mutex_lock(mutex);
+    if(trace_enabled) {
+      xtrace::getInstance().record(xtrace::LOCK, tracestart, 0);
+    }
     atomicBegin(false, false);
   }
 
@@ -257,7 +421,11 @@ public:
 
   int barrier_wait(pthread_barrier_t *barrier) {
     atomicEnd(true, true);
+    unsigned long tracestart = xtrace::start();
     _sync.barrier_wait(barrier);
+    if(trace_enabled) {
+      xtrace::getInstance().record(xtrace::BARRIER, tracestart, 0);
+    }
     atomicBegin(true, false);
     return 0;
   }
@@ -265,7 +433,11 @@ public:
   /// FIXME: whether we can using the order like this.
   void cond_wait(void * cond, void * lock) {
     atomicEnd(false, true);
+    unsigned long tracestart = xtrace::start();
     _sync.cond_wait (cond, lock);
+    if(trace_enabled) {
+      xtrace::getInstance().record(xtrace::CONDWAIT, tracestart, 0);
+    }
     atomicBegin(false, false);
   }
 
@@ -328,6 +500,7 @@ private:
   volatile  bool   _isInitialized;
   volatile  bool   _isProtected;
   volatile  bool   _hasProtected;
+  bool   _detached;
   int   _tid; //The first process's id.
 };
 
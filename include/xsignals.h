@@ -0,0 +1,354 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xsignals.h
+ * @brief  Sheriff's signal handlers, chained in front of the application's.
+ *
+ * Sheriff takes SIGSEGV for its write faults, SIGALRM for the checking
+ * timer (xtimer.h tells its ticks apart) and SIGBUS to explain faults on
+ * its backing files. The handlers the application installs for these
+ * signals, before or after Sheriff, are kept here instead of in the
+ * kernel, see sigaction() in libsheriff.cpp.
+ * Signals Sheriff does not want are forwarded to them; where the
+ * application left the default action, it is taken.
+ *
+ * Everything a handler calls has to be async-signal-safe: report() formats
+ * without stdio, and the fault path only uses memory reserved beforehand.
+ */
+
+#ifndef SHERIFF_XSIGNALS_H
+#define SHERIFF_XSIGNALS_H
+
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/auxv.h>
+#include <sys/mman.h>
+
+#include "xdefines.h"
+#include "realfuncs.h"
+
+class xsignals {
+public:
+
+  typedef void (*handlerFunction) (int, siginfo_t *, void *);
+
+  static xsignals& getInstance (void) {
+    static char buf[sizeof(xsignals)];
+    static xsignals * theOneTrueObject = new (buf) xsignals();
+    return *theOneTrueObject;
+  }
+
+  /// @return whether Sheriff may take signum.
+  static inline bool chained (int signum) {
+    return (slot(signum) != SLOTS);
+  }
+
+  /// @brief Handle signum with fn from now on. Whatever was installed
+  /// before becomes the application's handler.
+  void install (int signum, handlerFunction fn) {
+    struct sigaction siga;
+    int s = slot(signum);
+
+    sigemptyset (&siga.sa_mask);
+    sigaddset (&siga.sa_mask, SIGSEGV);
+    sigaddset (&siga.sa_mask, SIGALRM);
+    sigaddset (&siga.sa_mask, SIGBUS);
+    siga.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART | SA_NODEFER;
+    siga.sa_sigaction = fn;
+
+    if (WRAP(sigaction) (signum, &siga, &_app[s]) == -1) {
+      fprintf (stderr, "Signal handler for %s failed to install.\n", strsignal(signum));
+      exit (-1);
+    }
+    _installed[s] = true;
+  }
+
+  /// @brief Give the application's handlers back to the kernel.
+  void restore (void) {
+    for (int s = 0; s < SLOTS; s++) {
+      if (_installed[s]) {
+        WRAP(sigaction) (signalOf(s), &_app[s], NULL);
+        _installed[s] = false;
+      }
+    }
+  }
+
+  /// @brief sigaction() by the application.
+  int sigaction (int signum, const struct sigaction * act, struct sigaction * oldact) {
+    int s = slot(signum);
+    if (s == SLOTS || !_installed[s]) {
+      return WRAP(sigaction) (signum, act, oldact);
+    }
+
+    // The handler reads the entry, so it must not see half of it.
+    sigset_t block, saved;
+    sigemptyset (&block);
+    sigaddset (&block, signum);
+    pthread_sigmask (SIG_BLOCK, &block, &saved);
+    if (oldact != NULL) {
+      *oldact = _app[s];
+    }
+    if (act != NULL) {
+      _app[s] = *act;
+    }
+    pthread_sigmask (SIG_SETMASK, &saved, NULL);
+    return 0;
+  }
+
+  /// @return whether the application has a function of its own for signum.
+  bool caught (int signum) {
+    int s = slot(signum);
+    return (s != SLOTS && (_app[s].sa_flags & SA_SIGINFO || (_app[s].sa_handler != SIG_DFL
+                                                              && _app[s].sa_handler != SIG_IGN)));
+  }
+
+  /// @brief Report writes to a read-only range as an error of the program
+  /// rather than forwarding them. message takes the address as its %p.
+  /// One range per process, see xomp.h.
+  void guard (void * start, size_t size, const char * message) {
+    _guardStart = (char *)start;
+    _guardEnd = (char *)start + size;
+    _guardMessage = message;
+  }
+
+  /// @brief Hand a signal that is not Sheriff's to the application.
+  void forward (int signum, siginfo_t * siginfo, void * context) {
+    struct sigaction * app = &_app[slot(signum)];
+
+    if (signum == SIGSEGV && siginfo->si_code == SEGV_ACCERR && _guardMessage != NULL
+        && (char *)siginfo->si_addr >= _guardStart && (char *)siginfo->si_addr < _guardEnd) {
+      report (_guardMessage, siginfo->si_addr);
+      ::abort();
+    }
+
+    if (app->sa_flags & SA_SIGINFO || (app->sa_handler != SIG_DFL && app->sa_handler != SIG_IGN)) {
+      sigset_t mask, saved;
+
+      // The application's mask, but its writes to tracked memory still have
+      // to fault. A fault in its own fault handler recurses until the
+      // guard page of the signal stack, and the kernel ends it there.
+      pthread_sigmask (SIG_SETMASK, NULL, &saved);
+      sigorset (&mask, &saved, &app->sa_mask);
+      if (!(app->sa_flags & SA_NODEFER)) {
+        sigaddset (&mask, signum);
+      }
+      sigdelset (&mask, SIGSEGV);
+      sigdelset (&mask, SIGBUS);
+      pthread_sigmask (SIG_SETMASK, &mask, NULL);
+      if (app->sa_flags & SA_SIGINFO) {
+        app->sa_sigaction (signum, siginfo, context);
+      }
+      else {
+        app->sa_handler (signum);
+      }
+      if (app->sa_flags & SA_RESETHAND) {
+        app->sa_flags &= ~SA_SIGINFO;
+        app->sa_handler = SIG_DFL;
+      }
+      pthread_sigmask (SIG_SETMASK, &saved, NULL);
+      return;
+    }
+
+    // An ignored alarm is dropped, a fault can not be ignored.
+    if (app->sa_handler == SIG_IGN && signum == SIGALRM) {
+      return;
+    }
+
+    // Take the default action: a fault happens again when its instruction
+    // is retried, a sent signal is sent again and arrives once the handler
+    // returns.
+    struct sigaction siga;
+    sigemptyset (&siga.sa_mask);
+    siga.sa_flags = 0;
+    siga.sa_handler = SIG_DFL;
+    WRAP(sigaction) (signum, &siga, NULL);
+    if (siginfo->si_code <= 0 || signum == SIGALRM) {
+      raise (signum);
+    }
+  }
+
+  /// @brief Run handlers of this process on a stack of its own. Each
+  /// process maps it once, with a guard page below; a process forked later
+  /// gets a copy of the mapping.
+  void installStack (void) {
+    if (_stack == NULL) {
+      size_t size = stackSize();
+      char * base = (char *)mmap (NULL, size + xdefines::PageSize, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (base == MAP_FAILED) {
+        fprintf (stderr, "Sheriff: can not map the signal stack.\n");
+        ::abort();
+      }
+      mprotect (base, xdefines::PageSize, PROT_NONE);
+      _stack = base + xdefines::PageSize;
+      _stackSize = size;
+    }
+
+    stack_t stk;
+    stk.ss_sp = _stack;
+    stk.ss_size = _stackSize;
+    stk.ss_flags = 0;
+    sigaltstack (&stk, NULL);
+  }
+
+  /// @brief Write a message to stderr from a signal handler. Knows %s, %d,
+  /// %ld, %lx, %p and %%.
+  static void report (const char * format, ...) {
+    char buf[512];
+    size_t len = 0;
+    va_list ap;
+
+    va_start (ap, format);
+    for (const char * f = format; *f != '\0' && len < sizeof(buf) - 1; f++) {
+      if (*f != '%') {
+        buf[len++] = *f;
+        continue;
+      }
+
+      f++;
+      bool isLong = (*f == 'l');
+      if (isLong) {
+        f++;
+      }
+      switch (*f) {
+      case 's': {
+        const char * s = va_arg (ap, const char *);
+        len = append (buf, sizeof(buf), len, (s != NULL) ? s : "(null)");
+        break;
+      }
+      case 'd': {
+        long value = isLong ? va_arg (ap, long) : va_arg (ap, int);
+        if (value < 0) {
+          len = append (buf, sizeof(buf), len, "-");
+          value = -value;
+        }
+        len = number (buf, sizeof(buf), len, (unsigned long)value, 10);
+        break;
+      }
+      case 'x':
+        len = number (buf, sizeof(buf), len, isLong ? va_arg (ap, unsigned long) : va_arg (ap, unsigned int), 16);
+        break;
+      case 'p':
+        len = append (buf, sizeof(buf), len, "0x");
+        len = number (buf, sizeof(buf), len, (unsigned long)va_arg (ap, void *), 16);
+        break;
+      case '%':
+        buf[len++] = '%';
+        break;
+      default:
+        f--;
+        break;
+      }
+    }
+    va_end (ap);
+
+    if (write (STDERR_FILENO, buf, len) < 0) {
+      // Nothing left to tell it to.
+    }
+  }
+
+private:
+
+  enum { SLOTS = 3 };
+
+  xsignals()
+  : _stack (NULL),
+    _stackSize (0),
+    _guardStart (NULL),
+    _guardEnd (NULL),
+    _guardMessage (NULL)
+  {
+    for (int s = 0; s < SLOTS; s++) {
+      _installed[s] = false;
+    }
+  }
+
+  static inline int slot (int signum) {
+    switch (signum) {
+    case SIGSEGV:
+      return 0;
+    case SIGBUS:
+      return 1;
+    case SIGALRM:
+      return 2;
+    default:
+      return SLOTS;
+    }
+  }
+
+  static inline int signalOf (int s) {
+    static const int signals[SLOTS] = { SIGSEGV, SIGBUS, SIGALRM };
+    return signals[s];
+  }
+
+  static size_t stackSize (void) {
+    size_t size = xdefines::SIGNAL_STACK_SIZE;
+#ifdef AT_MINSIGSTKSZ
+    size += getauxval (AT_MINSIGSTKSZ);
+#endif
+    if (size < (size_t)SIGSTKSZ) {
+      size = SIGSTKSZ;
+    }
+    return (size + xdefines::PAGE_SIZE_MASK) & ~xdefines::PAGE_SIZE_MASK;
+  }
+
+  static size_t append (char * buf, size_t size, size_t len, const char * s) {
+    while (*s != '\0' && len < size - 1) {
+      buf[len++] = *s++;
+    }
+    return len;
+  }
+
+  static size_t number (char * buf, size_t size, size_t len, unsigned long value, int base) {
+    char digits[24];
+    int n = 0;
+
+    do {
+      digits[n++] = "0123456789abcdef"[value % base];
+      value /= base;
+    } while (value != 0);
+
+    while (n > 0 && len < size - 1) {
+      buf[len++] = digits[--n];
+    }
+    return len;
+  }
+
+  /// The application's handlers of the chained signals.
+  struct sigaction _app[SLOTS];
+  bool _installed[SLOTS];
+
+  /// The alternate signal stack of this process.
+  char * _stack;
+  size_t _stackSize;
+
+  /// The range guard() reports writes to.
+  char * _guardStart;
+  char * _guardEnd;
+  const char * _guardMessage;
+};
+
+#endif
@@ -11,6 +11,7 @@
 #endif
 
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "xdefines.h"
 
@@ -52,13 +53,18 @@ private:
 
     /// Whether this thread was created by a fork or not.
     bool forked;
+
+    /// The real thread, when it was not forked.
+    pthread_t thread;
   };
 
 public:
 
   xthread()
     : _nestingLevel (0),
-      _protected (false)
+      _protected (false),
+      _sharing (false),
+      _detached (false)
   {
   }
 
@@ -72,6 +78,19 @@ public:
 		threadFunction * fn,
 		void * arg);
 
+  void * spawnShared (xrun * runner,
+		      threadFunction * fn,
+		      void * arg);
+
+  /// @brief In a process forked by the application, see xrun::detach():
+  /// every thread it creates is a real thread.
+  void detach (int pid) {
+    _tid = pid;
+    _protected = false;
+    _sharing = true;
+    _detached = true;
+  }
+
   void join (xrun * runner,
 	     void * v,
 	     void ** result);
@@ -134,6 +153,12 @@ private:
 
   int              _protected;
 
+  /// Whether this process runs real threads, and so tracks nothing.
+  bool             _sharing;
+
+  /// Whether this process was forked by the application, see detach().
+  bool             _detached;
+
 //  int              _heapid;
 };
 
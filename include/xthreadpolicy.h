@@ -0,0 +1,156 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xthreadpolicy.h
+ * @brief  Which threads run isolated, as processes, and which run as real
+ *         threads of the process that creates them.
+ *
+ * Every thread is isolated unless it is chosen to share, which is decided
+ * at pthread_create, first match wins:
+ *
+ *  1. its start routine was given a mode with sheriff_thread_mode();
+ *  2. the creating thread set a mode for all threads it creates, with
+ *     sheriff_thread_mode(NULL, mode);
+ *  3. SHERIFF_SHARED_THREADS, a comma separated list of function names,
+ *     names its start routine or the function that calls pthread_create.
+ *
+ * Names are looked up with dladdr(), so they have to be exported: link the
+ * program with -rdynamic, as Sheriff asks already. The modes are kept per
+ * thread and inherited by the threads spawned after they are set.
+ */
+
+#ifndef SHERIFF_XTHREADPOLICY_H
+#define SHERIFF_XTHREADPOLICY_H
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdefines.h"
+
+class xthreadpolicy {
+public:
+
+  typedef void * (*startRoutine) (void *);
+
+  static xthreadpolicy& getInstance (void) {
+    static char buf[sizeof(xthreadpolicy)];
+    static xthreadpolicy * theOneTrueObject = new (buf) xthreadpolicy();
+    return *theOneTrueObject;
+  }
+
+  /// @brief Read the functions named in SHERIFF_SHARED_THREADS.
+  void initialize (void) {
+    const char * names = getenv("SHERIFF_SHARED_THREADS");
+    if(names == NULL) {
+      return;
+    }
+
+    while(*names != '\0' && _names < xdefines::MAX_THREAD_POLICIES) {
+      size_t len = strcspn(names, ",");
+      if(len > 0 && len < xdefines::MAX_POLICY_NAME) {
+        memcpy(_name[_names], names, len);
+        _name[_names][len] = '\0';
+        _names++;
+      }
+      names += len;
+      if(*names == ',') {
+        names++;
+      }
+    }
+  }
+
+  /// @brief Set the mode of the threads started with routine, or with
+  /// routine NULL, of every thread created from now on.
+  /// @return false if there is no room left for another routine.
+  bool setMode (startRoutine routine, int mode) {
+    if(routine == NULL) {
+      _defaultMode = mode;
+      return true;
+    }
+
+    for(int i = 0; i < _routines; i++) {
+      if(_routine[i] == routine) {
+        _mode[i] = mode;
+        return true;
+      }
+    }
+    if(_routines == xdefines::MAX_THREAD_POLICIES) {
+      return false;
+    }
+    _routine[_routines] = routine;
+    _mode[_routines] = mode;
+    _routines++;
+    return true;
+  }
+
+  /// @brief Whether a thread started with routine, created from caller
+  /// (a return address), runs as a real thread of this process.
+  bool sharesProcess (startRoutine routine, void * caller) {
+    for(int i = 0; i < _routines; i++) {
+      if(_routine[i] == routine && _mode[i] != xdefines::THREAD_DEFAULT) {
+        return (_mode[i] == xdefines::THREAD_SHARED);
+      }
+    }
+    if(_defaultMode != xdefines::THREAD_DEFAULT) {
+      return (_defaultMode == xdefines::THREAD_SHARED);
+    }
+    return (_names > 0 && (named((void *)routine) || named(caller)));
+  }
+
+private:
+
+  xthreadpolicy()
+  : _defaultMode (xdefines::THREAD_DEFAULT),
+    _routines (0),
+    _names (0)
+  {
+  }
+
+  /// @return whether addr lies in a function listed in SHERIFF_SHARED_THREADS.
+  bool named (void * addr) {
+    Dl_info info;
+    if(addr == NULL || dladdr(addr, &info) == 0 || info.dli_sname == NULL) {
+      return false;
+    }
+
+    for(int i = 0; i < _names; i++) {
+      if(strcmp(info.dli_sname, _name[i]) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int _defaultMode;
+
+  /// Start routines given a mode with sheriff_thread_mode().
+  startRoutine _routine[xdefines::MAX_THREAD_POLICIES];
+  int _mode[xdefines::MAX_THREAD_POLICIES];
+  int _routines;
+
+  /// Functions named in SHERIFF_SHARED_THREADS.
+  char _name[xdefines::MAX_THREAD_POLICIES][xdefines::MAX_POLICY_NAME];
+  int _names;
+};
+
+#endif
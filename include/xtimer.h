@@ -0,0 +1,117 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xtimer.h
+ * @brief  The checking timer, a POSIX timer of each process.
+ *
+ * Its ticks arrive as SIGALRM, like those of alarm() and setitimer(), but
+ * carry the address of this object as their value: the handler tells them
+ * from the application's alarms by it and never forwards them (fired()).
+ * The application's own interval timer is left alone.
+ *
+ * Timers are not inherited by fork, so every Sheriff thread creates its
+ * own the first time it starts one. Starting and stopping only call
+ * timer_settime(), which fault handlers may do.
+ */
+
+#ifndef SHERIFF_XTIMER_H
+#define SHERIFF_XTIMER_H
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+class xtimer {
+public:
+
+  static xtimer& getInstance (void) {
+    static char buf[sizeof(xtimer)];
+    static xtimer * theOneTrueObject = new (buf) xtimer();
+    return *theOneTrueObject;
+  }
+
+  /// @brief Tick once, usec microseconds from now.
+  void start (unsigned long usec) {
+    struct itimerspec value;
+
+    if (_owner != getpid()) {
+      create();
+    }
+    value.it_interval.tv_sec = 0;
+    value.it_interval.tv_nsec = 0;
+    value.it_value.tv_sec = usec / 1000000;
+    value.it_value.tv_nsec = (usec % 1000000) * 1000;
+    timer_settime (_timer, 0, &value, NULL);
+  }
+
+  /// @brief Disarm the timer.
+  /// @return the microseconds it had left, 0 if it was not armed.
+  unsigned long stop (void) {
+    struct itimerspec value, old;
+
+    if (_owner != getpid()) {
+      return 0;
+    }
+    memset (&value, 0, sizeof(value));
+    if (timer_settime (_timer, 0, &value, &old) != 0) {
+      return 0;
+    }
+    return old.it_value.tv_sec * 1000000UL + (old.it_value.tv_nsec + 999) / 1000;
+  }
+
+  /// @return whether a SIGALRM is a tick of this timer.
+  bool fired (const siginfo_t * siginfo) const {
+    return (siginfo->si_code == SI_TIMER && siginfo->si_value.sival_ptr == this);
+  }
+
+private:
+
+  xtimer()
+  : _owner (0)
+  {
+  }
+
+  void create (void) {
+    struct sigevent event;
+
+    memset (&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGALRM;
+    event.sigev_value.sival_ptr = this;
+    if (timer_create (CLOCK_MONOTONIC, &event, &_timer) != 0) {
+      fprintf (stderr, "Sheriff: can not create the checking timer: %s\n", strerror(errno));
+      ::abort();
+    }
+    _owner = getpid();
+  }
+
+  timer_t _timer;
+
+  /// The process the timer belongs to.
+  pid_t _owner;
+};
+
+#endif
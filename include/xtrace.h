@@ -0,0 +1,457 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xtrace.h
+ * @brief  Event trace of transactions, commits, updates, fault bursts,
+ *         synchronization waits and protection changes.
+ *
+ * Enabled by naming the output file in SHERIFF_TRACE. Events go to a ring
+ * buffer in shared memory, mapped before any thread is spawned, so every
+ * Sheriff thread appends to the same ring with one atomic increment. At
+ * exit, and whenever the application calls sheriff_trace_dump(), the ring
+ * is written as Chrome trace JSON (chrome://tracing or Perfetto), with one
+ * track per Sheriff thread. Transactions carry the
+ * perf_event counter deltas of the thread when they could be opened, and
+ * phases named by the application (sheriff_phase_begin) show as spans of
+ * their thread. When tracing is disabled every hook costs one test of
+ * trace_enabled.
+ */
+
+#ifndef SHERIFF_XTRACE_H
+#define SHERIFF_XTRACE_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "xdefines.h"
+#include "xperfevents.h"
+#include "xtunables.h"
+
+extern "C" {
+  extern bool trace_enabled;
+}
+
+class xtrace {
+public:
+  enum eventType {
+    TRANSACTION,   // From the end of begin to the start of commit.
+    COMMIT,        // Committing the dirty pages of a transaction.
+    UPDATE,        // Refreshing the local view at begin.
+    FAULTS,        // From the first to the last write fault of a transaction.
+    LOCK,          // Waiting to acquire a mutex.
+    BARRIER,       // Waiting on a barrier.
+    CONDWAIT,      // Waiting on a condition variable.
+    PROTECTION,    // Protection switched; pages is 1 for on, 0 for off.
+    RUN_PROTECTION, // The same for one run of pages, by the cost model.
+    PHASE,         // A phase named by the application; pages is its index.
+    EVENT_TYPES
+  };
+
+  static xtrace& getInstance (void) {
+    static char buf[sizeof(xtrace)];
+    static xtrace * theOneTrueObject = new (buf) xtrace();
+    return *theOneTrueObject;
+  }
+
+  /// @brief Map the shared ring if SHERIFF_TRACE is set. Must run before
+  /// any thread is spawned.
+  void initialize (void) {
+    char path[PATH_MAX];
+
+    if(!xtunables::getInstance().outputPath("SHERIFF_TRACE", path, sizeof(path))) {
+      return;
+    }
+
+    _ring = (ring *)mmap(NULL, sizeof(ring), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(_ring == MAP_FAILED) {
+      fprintf(stderr, "Sheriff: can not map the trace buffer: %s\n", strerror(errno));
+      _ring = NULL;
+      return;
+    }
+
+    strncpy(_ring->path, path, sizeof(_ring->path) - 1);
+    _ring->next = 0;
+    _ring->startTsc = timestamp();
+    _ring->startNs = monotonicNs();
+    _ring->mainPid = syscall(SYS_getpid);
+    _ring->phases = 0;
+    _pid = _ring->mainPid;
+    trace_enabled = true;
+  }
+
+  /// @brief Called in a newly spawned thread with its Sheriff thread index.
+  void setThread (int thread) {
+    _thread = thread;
+    _pid = syscall(SYS_getpid);
+    _faults = 0;
+    _phase = -1;
+  }
+
+  static inline unsigned long timestamp (void) {
+    unsigned int low, high;
+    asm volatile ("rdtsc" : "=a" (low), "=d" (high));
+    return ((unsigned long)high << 32) | low;
+  }
+
+  /// @brief Timestamp for the start of an event, 0 when disabled.
+  static inline unsigned long start (void) {
+    return trace_enabled ? timestamp() : 0;
+  }
+
+  /// @brief Append an event that ends now.
+  void record (eventType type, unsigned long begin, unsigned long pages) {
+    record(type, begin, timestamp(), pages);
+  }
+
+  void record (eventType type, unsigned long begin, unsigned long end, unsigned long pages) {
+    unsigned long index;
+    event * e = reserve(index, type, begin, end, pages);
+    e->counters = false;
+    publish(e, index);
+  }
+
+  /// @brief A write fault in the current transaction.
+  inline void fault (void) {
+    unsigned long now = timestamp();
+    if(_faults++ == 0) {
+      _firstFault = now;
+    }
+    _lastFault = now;
+  }
+
+  /// @brief The local view is fresh and the next transaction starts.
+  void beginTransaction (unsigned long updateStart) {
+    unsigned long now = timestamp();
+    record(UPDATE, updateStart, now, 0);
+    _transactionStart = now;
+  }
+
+  /// @brief The transaction ends and pages are about to be committed.
+  void endTransaction (unsigned long commitStart) {
+    if(_transactionStart != 0) {
+      xperfevents & perf = xperfevents::getInstance();
+      unsigned long index;
+      event * e = reserve(index, TRANSACTION, _transactionStart, commitStart, _faults);
+
+      // The counters were sampled when the commit started.
+      e->counters = perf.available();
+      if(e->counters) {
+        for(int i = 0; i < xperfevents::COUNTERS; i++) {
+          e->deltas[i] = perf.available((xperfevents::counterType)i)
+            ? (long)perf.delta((xperfevents::counterType)i) : -1;
+        }
+      }
+      publish(e, index);
+    }
+    if(_faults != 0) {
+      record(FAULTS, _firstFault, _lastFault, _faults);
+      _faults = 0;
+    }
+  }
+
+  /// @brief End the current phase of this thread and start the named one,
+  /// or none when name is NULL.
+  void phase (const char * name) {
+    unsigned long now = timestamp();
+
+    if(_phase != -1) {
+      record(PHASE, _phaseStart, now, _phase);
+    }
+    _phase = (name == NULL) ? -1 : phaseIndex(name);
+    _phaseStart = now;
+  }
+
+  /// @brief Write the trace at exit.
+  void finalize (void) {
+    if(!trace_enabled) {
+      return;
+    }
+
+    // The phase the main thread is in ends with the program.
+    phase(NULL);
+
+    if(dump() == -1) {
+      fprintf(stderr, "Sheriff: can not write trace %s: %s\n", _ring->path, strerror(errno));
+    }
+    else if(_ring->next > xdefines::TRACE_EVENTS) {
+      fprintf(stderr, "Sheriff: trace kept the last %d of %lu events.\n", xdefines::TRACE_EVENTS, _ring->next);
+    }
+  }
+
+  /// @brief Write the ring as Chrome trace JSON to the SHERIFF_TRACE file.
+  /// Any thread may do so while the program runs: the file then holds the
+  /// events recorded so far, and is replaced as a whole, so that a reader
+  /// never sees half of it.
+  /// @return 0, or -1 with errno set.
+  int dump (void) {
+    if(!trace_enabled) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    char temp[xdefines::MAX_TRACE_PATH + 16];
+    snprintf(temp, sizeof(temp), "%s.%d~", _ring->path, _pid);
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1) {
+      return -1;
+    }
+
+    // Calibrate the TSC against the monotonic clock over the whole run.
+    double nsPerTick = 1.0;
+    unsigned long ticks = timestamp() - _ring->startTsc;
+    if(ticks != 0) {
+      nsPerTick = (double)(monotonicNs() - _ring->startNs) / (double)ticks;
+    }
+
+    static const char * names[EVENT_TYPES] = {
+      "transaction", "commit", "update", "faults", "lock", "barrier", "condwait", "protection",
+      "run protection", "phase"
+    };
+
+    static bool named[xdefines::MAX_TRACE_THREADS];
+    memset(named, 0, sizeof(named));
+
+    _used = 0;
+    _failed = false;
+    append(fd, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+
+    unsigned long last = _ring->next;
+    unsigned long first = (last > xdefines::TRACE_EVENTS) ? last - xdefines::TRACE_EVENTS : 0;
+    bool comma = false;
+
+    for(unsigned long index = first; index < last; index++) {
+      event * e = &_ring->events[index % xdefines::TRACE_EVENTS];
+
+      if(e->sequence != index + 1 || e->type >= EVENT_TYPES) {
+        continue;
+      }
+
+      double ts = (double)(e->start - _ring->startTsc) * nsPerTick / 1000.0;
+      double dur = (double)(e->stop - e->start) * nsPerTick / 1000.0;
+
+      if(e->thread < xdefines::MAX_TRACE_THREADS && !named[e->thread]) {
+        named[e->thread] = true;
+        append(fd, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"thread %d (pid %d)\"}}",
+               comma ? ",\n" : "", _ring->mainPid, e->thread, e->thread, e->pid);
+        comma = true;
+      }
+
+      if(e->type == PHASE) {
+        append(fd, "%s{\"name\": \"%s\", \"cat\": \"phase\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d}",
+               comma ? ",\n" : "", _ring->phaseNames[e->pages], ts, dur, _ring->mainPid, e->thread);
+      }
+      else if(e->type == PROTECTION || e->type == RUN_PROTECTION) {
+        append(fd, "%s{\"name\": \"%s %s\", \"ph\": \"i\", \"s\": \"t\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d}",
+               comma ? ",\n" : "", names[e->type], e->pages ? "on" : "off", ts, _ring->mainPid, e->thread);
+      }
+      else {
+        append(fd, "%s{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d, \"args\": {\"pages\": %lu",
+               comma ? ",\n" : "", names[e->type], ts, dur, _ring->mainPid, e->thread, e->pages);
+        if(e->type == TRANSACTION && e->counters) {
+          appendCounters(fd, e);
+        }
+        append(fd, "}}");
+      }
+      comma = true;
+    }
+
+    append(fd, "\n]}\n");
+    bool written = flush(fd);
+    if(close(fd) == -1 || !written || rename(temp, _ring->path) == -1) {
+      int error = errno;
+      unlink(temp);
+      errno = error;
+      return -1;
+    }
+    return 0;
+  }
+
+private:
+
+  xtrace()
+    : _ring(NULL),
+      _thread(0),
+      _pid(0),
+      _faults(0),
+      _transactionStart(0),
+      _phase(-1)
+  {
+  }
+
+  struct event {
+    unsigned long sequence;
+    unsigned long start;
+    unsigned long stop;
+    unsigned long pages;
+    unsigned int type;
+    unsigned int thread;
+    int pid;
+    bool counters;
+    long deltas[xperfevents::COUNTERS];   // -1 for a counter that is not available.
+  };
+
+  struct ring {
+    volatile unsigned long next;
+    unsigned long startTsc;
+    unsigned long startNs;
+    int mainPid;
+    char path[xdefines::MAX_TRACE_PATH];
+    volatile int phases;
+    char phaseNames[xdefines::MAX_TRACE_PHASES][xdefines::MAX_PHASE_NAME];
+    event events[xdefines::TRACE_EVENTS];
+  };
+
+  inline event * reserve (unsigned long & index, eventType type, unsigned long begin,
+                          unsigned long end, unsigned long pages) {
+    index = __sync_fetch_and_add(&_ring->next, 1);
+    event * e = &_ring->events[index % xdefines::TRACE_EVENTS];
+
+    e->start = begin;
+    e->stop = end;
+    e->pages = pages;
+    e->type = type;
+    e->thread = _thread;
+    e->pid = _pid;
+    return e;
+  }
+
+  // Published last: a slot is complete when its sequence matches.
+  inline void publish (event * e, unsigned long index) {
+    __sync_synchronize();
+    e->sequence = index + 1;
+  }
+
+  void appendCounters (int fd, event * e) {
+    static const char * names[xperfevents::COUNTERS] = {
+      "page_faults", "context_switches", "cpu_migrations", "task_clock_ns", "cache_misses"
+    };
+
+    for(int i = 0; i < xperfevents::COUNTERS; i++) {
+      if(e->deltas[i] != -1) {
+        append(fd, ", \"%s\": %ld", names[i], e->deltas[i]);
+      }
+    }
+  }
+
+  /// The index of a phase name, added to the ring the first time it is
+  /// seen. Characters that would need escaping in JSON are replaced. Names
+  /// beyond MAX_TRACE_PHASES are not traced.
+  int phaseIndex (const char * name) {
+    char clean[xdefines::MAX_PHASE_NAME];
+    int i;
+
+    for(i = 0; i < xdefines::MAX_PHASE_NAME - 1 && name[i] != '\0'; i++) {
+      clean[i] = (name[i] == '"' || name[i] == '\\' || (unsigned char)name[i] < 0x20) ? '_' : name[i];
+    }
+    clean[i] = '\0';
+
+    int known = _ring->phases;
+    if(known > xdefines::MAX_TRACE_PHASES) {
+      known = xdefines::MAX_TRACE_PHASES;
+    }
+    for(i = 0; i < known; i++) {
+      if(strcmp(_ring->phaseNames[i], clean) == 0) {
+        return i;
+      }
+    }
+
+    int index = __sync_fetch_and_add(&_ring->phases, 1);
+    if(index >= xdefines::MAX_TRACE_PHASES) {
+      return -1;
+    }
+    strcpy(_ring->phaseNames[index], clean);
+    return index;
+  }
+
+  static unsigned long monotonicNs (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+  }
+
+  // Buffered output without stdio, since the dump runs at exit.
+  void append (int fd, const char * format, ...) {
+    va_list args;
+
+    if(_used > (int)sizeof(_buffer) / 2) {
+      flush(fd);
+    }
+
+    va_start(args, format);
+    int len = vsnprintf(_buffer + _used, sizeof(_buffer) - _used, format, args);
+    va_end(args);
+
+    if(len > 0) {
+      _used += len;
+      if(_used > (int)sizeof(_buffer) - 1) {
+        _used = sizeof(_buffer) - 1;
+      }
+    }
+  }
+
+  bool flush (int fd) {
+    int done = 0;
+    while(done < _used) {
+      int len = write(fd, _buffer + done, _used - done);
+      if(len <= 0) {
+        if(len == 0) {
+          errno = EIO;
+        }
+        _failed = true;
+        break;
+      }
+      done += len;
+    }
+    _used = 0;
+    return !_failed;
+  }
+
+  ring * _ring;
+
+  // Per process: the Sheriff thread index and the current fault burst.
+  int _thread;
+  int _pid;
+  unsigned long _faults;
+  unsigned long _firstFault;
+  unsigned long _lastFault;
+  unsigned long _transactionStart;
+
+  // The phase this thread is in, -1 for none, and when it started.
+  int _phase;
+  unsigned long _phaseStart;
+
+  char _buffer[8192];
+  int _used;
+  bool _failed;
+};
+
+#endif
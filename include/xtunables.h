@@ -0,0 +1,359 @@
+// -*- C++ -*-
+
+/*
+  Copyright (C) 2011 University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/*
+ * @file   xtunables.h
+ * @brief  Protection and checking thresholds that can be changed at run time.
+ *
+ * Every tunable starts from its compile-time default in xdefines.h. It is
+ * then taken from a profile, and last from the environment variable
+ * SHERIFF_<NAME>, e.g. SHERIFF_LINE_BOUNCES=32. The profile is the file
+ * named by SHERIFF_PROFILE or, if that is not set,
+ * $SHERIFF_PROFILE_DIR/<program>.conf, where SHERIFF_PROFILE_DIR defaults to
+ * $HOME/.sheriff. bench/autotune.sh writes these profiles. A profile holds
+ * lines of "name = value"; '#' starts a comment.
+ *
+ * The values are read once by the main thread at initialization, so every
+ * thread sees the same ones.
+ *
+ * A Sheriff program exports its pid in SHERIFF_SESSION. A program it starts
+ * that runs under Sheriff as well is a nested session: it writes its
+ * report and trace to the given names suffixed with .<pid>.
+ */
+
+#ifndef SHERIFF_XTUNABLES_H
+#define SHERIFF_XTUNABLES_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "xdefines.h"
+
+class xtunables {
+public:
+  enum tunable {
+    // Sheriff-Protect: when protection is switched off and on again.
+    CHECK_AGAIN_NO_PROTECTION,    // Transactions before unprotected memory is sampled again.
+    CHECK_AGAIN_UNDER_PROTECTION, // Transactions between checks while protected.
+    MAX_FAULT_OVERHEAD,           // Percent of CPU time faults may take.
+    COST_SAMPLES,                 // Dirty pages of a run before its protection is decided.
+
+    // Sheriff-Protect cost model (xcostmodel.h), per page or cache line.
+    PROTECTION_FAULT_NS,          // A write fault; the first four are calibrated.
+    TWIN_NS,                      // Copying the twin.
+    COMMIT_NS,                    // Diffing at commit.
+    UPDATE_NS,                    // Refreshing at begin.
+    LINE_TRANSFER_NS,             // Moving a cache line between cores.
+    LINE_BOUNCES,                 // Transfers of an interleaved line per transaction.
+
+    // Sheriff-Detect: periodic checking and sampling of the large heap.
+    CHECKING_INTERVAL,            // us between periodic checks.
+    EVAL_CHECKING_PERIOD,         // Transactions between evaluations of the checking timer.
+    EVAL_LARGE_HEAP_BASE,         // Period of the large heap protection, in events.
+    EVAL_LARGE_HEAP_PROTECTION,   // Events of each period spent protected.
+    MIN_INTERWRITES_OUTPUT,       // Least interleaved writes of a reported object.
+    MIN_INTERWRITES_CARE,         // Interleaved writes that make an object interesting.
+    MIN_INVALIDATES_CARE,         // Invalidations that keep a line from being reused.
+
+    // All builds: atomic instructions that write tracked memory (xatomicsites.h).
+    ATOMIC_PAGES,                 // 1 to stop tracking the pages they write.
+    TUNABLES
+  };
+
+  static xtunables& getInstance (void) {
+    static char buf[sizeof(xtunables)];
+    static xtunables * theOneTrueObject = new (buf) xtunables();
+    return *theOneTrueObject;
+  }
+
+  /// @brief Current value of a tunable.
+  static inline int get (tunable t) {
+    return getInstance()._values[t];
+  }
+
+  static inline const char * name (tunable t) {
+    return definitions()[t].name;
+  }
+
+  /// @brief A measured value, used unless the tunable was set explicitly.
+  void calibrated (tunable t, int value) {
+    if(!_set[t]) {
+      _values[t] = (value < definitions()[t].minimum) ? definitions()[t].minimum : value;
+    }
+  }
+
+  /// @brief Load the profile and the environment. Must run before any
+  /// thread is spawned.
+  void initialize (void) {
+    char path[PATH_MAX];
+    const char * profile = getenv("SHERIFF_PROFILE");
+    const char * session = getenv("SHERIFF_SESSION");
+    bool invalidatesSet;
+
+    // getpid() is the thread id under Sheriff, see libsheriff.cpp.
+    _pid = syscall(SYS_getpid);
+    _nested = (session != NULL && session[0] != '\0' && atoi(session) != _pid);
+
+    if(profile != NULL && profile[0] != '\0') {
+      if(!load(profile)) {
+        fprintf(stderr, "Sheriff: can not read profile %s: %s\n", profile, strerror(errno));
+      }
+    }
+    else if(defaultProfile(path, sizeof(path)) && load(path)) {
+      fprintf(stderr, "Sheriff: using tunables from %s\n", path);
+    }
+
+    invalidatesSet = _set[MIN_INVALIDATES_CARE];
+    for(int i = 0; i < TUNABLES; i++) {
+      char variable[64];
+      snprintf(variable, sizeof(variable), "SHERIFF_%s", definitions()[i].name);
+      for(char * p = variable; *p != '\0'; p++) {
+        if(*p >= 'a' && *p <= 'z') {
+          *p = *p - 'a' + 'A';
+        }
+      }
+
+      const char * value = getenv(variable);
+      if(value != NULL && value[0] != '\0') {
+        set((tunable)i, value, variable);
+        invalidatesSet |= (i == MIN_INVALIDATES_CARE);
+      }
+    }
+
+    // As at build time, invalidations follow the interleaved writes unless given.
+    if(!invalidatesSet) {
+      _values[MIN_INVALIDATES_CARE] = _values[MIN_INTERWRITES_CARE];
+    }
+  }
+
+  /// @brief The file named by an output variable such as SHERIFF_REPORT,
+  /// with .<pid> appended in a nested session.
+  /// @return false if the variable is not set.
+  bool outputPath (const char * variable, char * path, size_t size) {
+    const char * value = getenv(variable);
+
+    if(value == NULL || value[0] == '\0') {
+      return false;
+    }
+    if(_nested) {
+      snprintf(path, size, "%s.%d", value, (int)_pid);
+    }
+    else {
+      snprintf(path, size, "%s", value);
+    }
+    return true;
+  }
+
+  /// @brief Tell the programs started from this one that they are nested.
+  /// putenv() keeps the string, so it has to stay.
+  void exportSession (void) {
+    snprintf(_session, sizeof(_session), "SHERIFF_SESSION=%d", (int)_pid);
+    putenv(_session);
+  }
+
+  /// @return the SHERIFF_SESSION entry exported by exportSession().
+  const char * session (void) const {
+    return _session;
+  }
+
+private:
+
+  struct definition {
+    const char * name;
+    int initial;
+    int minimum;
+  };
+
+  static const definition * definitions (void) {
+    static const definition table[TUNABLES] = {
+      { "check_again_no_protection",    ::CHECK_AGAIN_NO_PROTECTION, 0 },
+      { "check_again_under_protection", ::CHECK_AGAIN_UNDER_PROTECTION, 0 },
+      { "max_fault_overhead",           xdefines::MAX_FAULT_OVERHEAD_PERCENT, 0 },
+      { "cost_samples",                 xdefines::COST_SAMPLES, 1 },
+      { "protection_fault_ns",          xdefines::PROTECTION_FAULT_NS, 1 },
+      { "twin_ns",                      xdefines::TWIN_NS, 0 },
+      { "commit_ns",                    xdefines::COMMIT_NS, 0 },
+      { "update_ns",                    xdefines::UPDATE_NS, 0 },
+      { "line_transfer_ns",             xdefines::LINE_TRANSFER_NS, 0 },
+      { "line_bounces",                 xdefines::LINE_BOUNCES, 0 },
+      { "checking_interval",            xdefines::PERIODIC_CHECKING_INTERVAL, 1 },
+      { "eval_checking_period",         xdefines::EVAL_CHECKING_PERIOD, 1 },
+#if defined(DETECT_FALSE_SHARING) || defined(DETECT_FALSE_SHARING_OPT)
+      { "eval_large_heap_base",         xdefines::EVAL_LARGE_HEAP_BASE, 1 },
+      { "eval_large_heap_protection",   xdefines::EVAL_LARGE_HEAP_PROTECTION, 0 },
+#else
+      { "eval_large_heap_base",         1, 1 },
+      { "eval_large_heap_protection",   0, 0 },
+#endif
+      { "min_interwrites_output",       xdefines::MIN_INTERWRITES_OUTPUT, 0 },
+      { "min_interwrites_care",         xdefines::MIN_INTERWRITES_CARE, 0 },
+      { "min_invalidates_care",         xdefines::MIN_INVALIDATES_CARE, 0 },
+      { "atomic_pages",                 0, 0 },
+    };
+    return table;
+  }
+
+  xtunables()
+  : _pid (0),
+    _nested (false)
+  {
+    _session[0] = '\0';
+    for(int i = 0; i < TUNABLES; i++) {
+      _values[i] = definitions()[i].initial;
+      _set[i] = false;
+    }
+  }
+
+  // Set a tunable from its text, ignoring values that are not valid.
+  bool set (tunable t, const char * text, const char * origin) {
+    char * end;
+    long value = strtol(text, &end, 10);
+
+    while(*end == ' ' || *end == '\t' || *end == '\r') {
+      end++;
+    }
+    if(end == text || *end != '\0' || value < definitions()[t].minimum || value > INT_MAX) {
+      fprintf(stderr, "Sheriff: ignoring %s = \"%s\": expected an integer of at least %d\n",
+              origin, text, definitions()[t].minimum);
+      return false;
+    }
+
+    _values[t] = (int)value;
+    _set[t] = true;
+    return true;
+  }
+
+  // $SHERIFF_PROFILE_DIR/<program>.conf, or $HOME/.sheriff/<program>.conf.
+  static bool defaultProfile (char * path, size_t size) {
+    char exe[PATH_MAX];
+    const char * dir = getenv("SHERIFF_PROFILE_DIR");
+    const char * home = getenv("HOME");
+
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if(len <= 0) {
+      return false;
+    }
+    exe[len] = '\0';
+
+    const char * program = strrchr(exe, '/');
+    program = (program == NULL) ? exe : program + 1;
+
+    if(dir != NULL && dir[0] != '\0') {
+      len = snprintf(path, size, "%s/%s.conf", dir, program);
+    }
+    else if(home != NULL && home[0] != '\0') {
+      len = snprintf(path, size, "%s/.sheriff/%s.conf", home, program);
+    }
+    else {
+      return false;
+    }
+    return (len > 0 && (size_t)len < size);
+  }
+
+  // Read a profile without stdio, since no allocator is ready yet.
+  bool load (const char * path) {
+    static char text[8192];
+    int fd = open(path, O_RDONLY);
+    int used = 0;
+
+    if(fd == -1) {
+      return false;
+    }
+    while(used < (int)sizeof(text) - 1) {
+      int len = read(fd, text + used, sizeof(text) - 1 - used);
+      if(len <= 0) {
+        break;
+      }
+      used += len;
+    }
+    close(fd);
+    text[used] = '\0';
+
+    int number = 0;
+    for(char * line = text; line != NULL && *line != '\0'; ) {
+      char * next = strchr(line, '\n');
+      if(next != NULL) {
+        *next++ = '\0';
+      }
+      number++;
+      parseLine(line, path, number);
+      line = next;
+    }
+    return true;
+  }
+
+  void parseLine (char * line, const char * path, int number) {
+    char origin[PATH_MAX + 32];
+    char * comment = strchr(line, '#');
+    if(comment != NULL) {
+      *comment = '\0';
+    }
+
+    char * key = skipSpaces(line);
+    if(*key == '\0') {
+      return;
+    }
+
+    snprintf(origin, sizeof(origin), "%s:%d", path, number);
+
+    char * equals = strchr(key, '=');
+    if(equals == NULL) {
+      fprintf(stderr, "Sheriff: ignoring %s: expected \"name = value\"\n", origin);
+      return;
+    }
+
+    char * end = equals;
+    while(end > key && (end[-1] == ' ' || end[-1] == '\t')) {
+      end--;
+    }
+    *end = '\0';
+
+    for(int i = 0; i < TUNABLES; i++) {
+      if(strcmp(key, definitions()[i].name) == 0) {
+        set((tunable)i, skipSpaces(equals + 1), origin);
+        return;
+      }
+    }
+    fprintf(stderr, "Sheriff: ignoring %s: unknown tunable \"%s\"\n", origin, key);
+  }
+
+  static char * skipSpaces (char * text) {
+    while(*text == ' ' || *text == '\t') {
+      text++;
+    }
+    return text;
+  }
+
+  int _values[TUNABLES];
+  bool _set[TUNABLES];
+
+  pid_t _pid;
+  bool _nested;
+  char _session[32];
+};
+
+#endif
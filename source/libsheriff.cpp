@@ -28,12 +28,28 @@
  */
 
 #if !defined(_WIN32)
+#include <dirent.h>
 #include <dlfcn.h>
 #endif
 
+#include <spawn.h>
 #include <stdarg.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
+// The library defines the annotations, only applications refer to them weakly.
+#define SHERIFF_WEAK
+#include "sheriff.h"
 #include "xrun.h"
+#include "xmodules.h"
+#include "xlibpath.h"
+#include "xtrace.h"
+#include "xcounters.h"
+#include "xperfevents.h"
+#include "xtunables.h"
+#include "xomp.h"
+#include "xthreadpolicy.h"
+#include "xsignals.h"
 
 extern "C" {
 
@@ -42,7 +58,7 @@ extern "C" {
   void finalizer (void)   __attribute__((destructor));
 #endif
   unsigned long * global_thread_index; 
-  int textStart, textEnd; 
+  bool trace_enabled = false;
  
   static bool initialized = false;
 #ifdef GET_CHARACTERISTICS
@@ -66,11 +82,30 @@ extern "C" {
 
     init_real_functions();
 
+    // Build the map of loaded modules before any callsite is fetched.
+    xmodules::getInstance().initialize();
+
   	global_thread_index = (unsigned long *)mmap(NULL, xdefines::PageSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
     *global_thread_index = 0;
 
+    // Thresholds come from the profile and the environment.
+    xtunables::getInstance().initialize();
+    xthreadpolicy::getInstance().initialize();
+
+    // The trace ring is shared, so it has to exist before any thread.
+    xtrace::getInstance().initialize();
+    xcounters::getInstance().initialize();
+    xperfevents::getInstance().open();
+
     xrun::getInstance().initialize();
+
+    // OpenMP locks are shared as well.
+    xomp::getInstance().initialize();
     initialized = true;
+
+    // Programs run from this one are nested sessions. putenv() may
+    // allocate, which it can do from our heap now.
+    xtunables::getInstance().exportSession();
     
     // Start our first transaction.
 #ifndef NDEBUG
@@ -81,6 +116,8 @@ extern "C" {
   void finalizer (void) {
     initialized = false;
     xrun::getInstance().finalize();
+    xtrace::getInstance().finalize();
+    xcounters::getInstance().finalize();
   }
 
 
@@ -272,6 +309,10 @@ extern "C" {
   }
 
   void pthread_exit (void * value_ptr) {
+    // A real thread (xthread::spawnShared) ends as it would without Sheriff.
+    if (initialized && syscall(SYS_gettid) != xrun::getInstance().id()) {
+      WRAP(pthread_exit)(value_ptr);
+    }
     _exit (0);
     // FIX ME?
     // This should probably throw a special exception to be caught in spawn.
@@ -297,6 +338,14 @@ extern "C" {
 
   pthread_t pthread_self (void) 
   {
+    // Libraries ask from their constructors, before ours ran, and hand the
+    // answer back to libpthread: libgomp reads the main thread's affinity.
+    if(!initialized) {
+      if(WRAP(pthread_self) == NULL) {
+        WRAP(pthread_self) = (pthread_t (*)(void))dlsym(RTLD_NEXT, "pthread_self");
+      }
+      return WRAP(pthread_self)();
+    }
     return xrun::getInstance().id();
   }
 
@@ -366,7 +415,20 @@ extern "C" {
 		      void *(*start_routine) (void *),
 		      void * arg) 
   {
-    *tid = (pthread_t)xrun::getInstance().spawn (start_routine, arg);
+    void * thread;
+
+    // Threads run isolated, as processes, unless they are chosen to share.
+    if (xthreadpolicy::getInstance().sharesProcess(start_routine, __builtin_return_address(0))) {
+      thread = xrun::getInstance().spawnShared (start_routine, arg);
+    }
+    else {
+      thread = xrun::getInstance().spawn (start_routine, arg);
+    }
+    // A forked child spawns real threads only, which may fail as well.
+    if (thread == NULL) {
+      return EAGAIN;
+    }
+    *tid = (pthread_t)thread;
     return 0;
   }
 
@@ -375,22 +437,480 @@ extern "C" {
     return 0;
   }
 
-  // Make sure that all pages are readable and writable by issuing writes on them 
+  // The kernel does not fault on protected pages, a system call writing
+  // into them fails with EFAULT instead. So every buffer is made writable
+  // (and twinned) in one step before the real call, and whatever the
+  // kernel writes is then committed like any other write.
+  #define RESOLVE_WRAPPED(x) if(WRAP(x) == NULL) { WRAP(x) = (typeof(WRAP(x)))dlsym(RTLD_NEXT, #x); }
+
+  static inline void prepareBuffer (void * buf, size_t count) {
+    if(initialized && buf != NULL && count > 0) {
+      xrun::getInstance().handleWriteRange(buf, count);
+    }
+  }
+
+  static inline void prepareIovec (const struct iovec * iov, int iovcnt) {
+    for(int i = 0; i < iovcnt; i++) {
+      prepareBuffer(iov[i].iov_base, iov[i].iov_len);
+    }
+  }
+
   ssize_t read (int fd, void * buf, size_t count) {
-    char * start = (char *)buf;
-    long pages = count/xdefines::PageSize;
+    RESOLVE_WRAPPED(read);
+    prepareBuffer(buf, count);
+    return WRAP(read)(fd, buf, count);
+  }
 
-    if(pages >= 1) {
-     // fprintf(stderr, "fd %d buf %p count %d\n", fd, buf, count);
-    // Trying to read on those pages, thus there won't be a segmenation fault in 
-    // the system call.
-      for(long i = 0; i < pages; i++) {
-        start[i * xdefines::PageSize] = '\0';
+  ssize_t pread (int fd, void * buf, size_t count, off_t offset) {
+    RESOLVE_WRAPPED(pread);
+    prepareBuffer(buf, count);
+    return WRAP(pread)(fd, buf, count, offset);
+  }
+
+  ssize_t pread64 (int fd, void * buf, size_t count, off64_t offset) {
+    RESOLVE_WRAPPED(pread64);
+    prepareBuffer(buf, count);
+    return WRAP(pread64)(fd, buf, count, offset);
+  }
+
+  ssize_t readv (int fd, const struct iovec * iov, int iovcnt) {
+    RESOLVE_WRAPPED(readv);
+    prepareIovec(iov, iovcnt);
+    return WRAP(readv)(fd, iov, iovcnt);
+  }
+
+  ssize_t recv (int sockfd, void * buf, size_t len, int flags) {
+    RESOLVE_WRAPPED(recv);
+    prepareBuffer(buf, len);
+    return WRAP(recv)(sockfd, buf, len, flags);
+  }
+
+  ssize_t recvfrom (int sockfd, void * buf, size_t len, int flags,
+                    struct sockaddr * src_addr, socklen_t * addrlen) {
+    RESOLVE_WRAPPED(recvfrom);
+    prepareBuffer(buf, len);
+    if(src_addr != NULL && addrlen != NULL) {
+      prepareBuffer(addrlen, sizeof(socklen_t));
+      prepareBuffer(src_addr, *addrlen);
+    }
+    return WRAP(recvfrom)(sockfd, buf, len, flags, src_addr, addrlen);
+  }
+
+  ssize_t recvmsg (int sockfd, struct msghdr * msg, int flags) {
+    RESOLVE_WRAPPED(recvmsg);
+    // The kernel also writes back the lengths in the header itself.
+    prepareBuffer(msg, sizeof(struct msghdr));
+    prepareIovec(msg->msg_iov, msg->msg_iovlen);
+    prepareBuffer(msg->msg_name, msg->msg_namelen);
+    prepareBuffer(msg->msg_control, msg->msg_controllen);
+    return WRAP(recvmsg)(sockfd, msg, flags);
+  }
+
+#ifdef __GLIBC__
+  // Allocates the buffer of a stream as its first read would.
+  void _IO_doallocbuf (FILE * stream);
+#endif
+
+  // glibc refills the buffer of a stream with its own read(), not the one
+  // above, and allocates that buffer from our heap at the first read. So
+  // the buffer is allocated and made writable before each call that may
+  // refill it. Other readers, such as scanf(), the _unlocked variants,
+  // wide streams and C++ streams, are not covered.
+  static inline void prepareStream (FILE * stream) {
+#ifdef __GLIBC__
+    if(!initialized || stream == NULL) {
+      return;
+    }
+    if(stream->_IO_buf_base == NULL) {
+      flockfile(stream);
+      if(stream->_IO_buf_base == NULL) {
+        _IO_doallocbuf(stream);
       }
+      funlockfile(stream);
     }
-    
-    // Make sure that last page are written so the page is readable and writable
-    start[count-1] = '\0';
+    prepareBuffer(stream->_IO_buf_base, stream->_IO_buf_end - stream->_IO_buf_base);
+#endif
+  }
+
+  // Whether a read of count bytes, or of a line up to delim within count
+  // bytes, is served from the buffer without a refill.
+  static inline bool streamHolds (FILE * stream, size_t count, int delim) {
+#ifdef __GLIBC__
+    if(stream == NULL || stream->_IO_read_ptr >= stream->_IO_read_end) {
+      return false;
+    }
+    size_t available = stream->_IO_read_end - stream->_IO_read_ptr;
+    if(delim == EOF) {
+      return count <= available;
+    }
+    return memchr(stream->_IO_read_ptr, delim, (count < available) ? count : available) != NULL;
+#else
+    return false;
+#endif
+  }
+
+  // Large freads bypass the stdio buffer and read into ptr directly.
+  size_t fread (void * ptr, size_t size, size_t nmemb, FILE * stream) {
+    RESOLVE_WRAPPED(fread);
+    if(!streamHolds(stream, size * nmemb, EOF)) {
+      prepareBuffer(ptr, size * nmemb);
+      prepareStream(stream);
+    }
+    return WRAP(fread)(ptr, size, nmemb, stream);
+  }
+
+  char * fgets (char * s, int size, FILE * stream) {
+    RESOLVE_WRAPPED(fgets);
+    if(size <= 1 || !streamHolds(stream, size - 1, '\n')) {
+      prepareStream(stream);
+    }
+    return WRAP(fgets)(s, size, stream);
+  }
+
+  // fgets() of programs built with _FORTIFY_SOURCE.
+  char * __fgets_chk (char * s, size_t len, int size, FILE * stream) {
+    RESOLVE_WRAPPED(__fgets_chk);
+    if(size <= 1 || !streamHolds(stream, size - 1, '\n')) {
+      prepareStream(stream);
+    }
+    return WRAP(__fgets_chk)(s, len, size, stream);
+  }
+
+  int fgetc (FILE * stream) {
+    RESOLVE_WRAPPED(fgetc);
+    if(!streamHolds(stream, 1, EOF)) {
+      prepareStream(stream);
+    }
+    return WRAP(fgetc)(stream);
+  }
+
+  int getc (FILE * stream) {
+    RESOLVE_WRAPPED(getc);
+    if(!streamHolds(stream, 1, EOF)) {
+      prepareStream(stream);
+    }
+    return WRAP(getc)(stream);
+  }
+
+  ssize_t getdelim (char ** lineptr, size_t * n, int delim, FILE * stream) {
+    RESOLVE_WRAPPED(getdelim);
+    if(!streamHolds(stream, (size_t)-1, delim)) {
+      prepareStream(stream);
+    }
+    return WRAP(getdelim)(lineptr, n, delim, stream);
+  }
+
+  ssize_t getline (char ** lineptr, size_t * n, FILE * stream) {
+    return getdelim(lineptr, n, '\n', stream);
+  }
+
+  // Programs built for C99 or later call the __isoc99_ variant, from glibc
+  // 2.38 on the __isoc23_ one.
+  int fscanf (FILE * stream, const char * format, ...) {
+    va_list ap;
+    RESOLVE_WRAPPED(vfscanf);
+    prepareStream(stream);
+    va_start(ap, format);
+    int ret = WRAP(vfscanf)(stream, format, ap);
+    va_end(ap);
+    return ret;
+  }
+
+  int __isoc99_fscanf (FILE * stream, const char * format, ...) {
+    va_list ap;
+    RESOLVE_WRAPPED(__isoc99_vfscanf);
+    prepareStream(stream);
+    va_start(ap, format);
+    int ret = WRAP(__isoc99_vfscanf)(stream, format, ap);
+    va_end(ap);
+    return ret;
+  }
+
+  int __isoc23_fscanf (FILE * stream, const char * format, ...) {
+    va_list ap;
+    RESOLVE_WRAPPED(__isoc23_vfscanf);
+    prepareStream(stream);
+    va_start(ap, format);
+    int ret = WRAP(__isoc23_vfscanf)(stream, format, ap);
+    va_end(ap);
+    return ret;
+  }
+
+  // The entries are read into the DIR itself, which opendir() allocates
+  // from our heap.
+  static inline void prepareDir (DIR * dirp) {
+    if(initialized && dirp != NULL && xrun::getInstance().inTrackedRange(dirp)) {
+      prepareBuffer(dirp, xrun::getInstance().getSize(dirp));
+    }
+  }
+
+  struct dirent * readdir (DIR * dirp) {
+    RESOLVE_WRAPPED(readdir);
+    prepareDir(dirp);
+    return WRAP(readdir)(dirp);
+  }
+
+  struct dirent64 * readdir64 (DIR * dirp) {
+    RESOLVE_WRAPPED(readdir64);
+    prepareDir(dirp);
+    return WRAP(readdir64)(dirp);
+  }
+
+  ssize_t getdents64 (int fd, void * dirp, size_t count) {
+    prepareBuffer(dirp, count);
+    return syscall(SYS_getdents64, fd, dirp, count);
+  }
+
+  // Futexes that the application issues itself, see xrun::futex(). The
+  // futex call takes at most six arguments and ignores unused ones.
+  long __attribute__((visibility("hidden"), used)) sheriff_futex_syscall (long number, ...) {
+    long args[6];
+    va_list ap;
+
+    RESOLVE_WRAPPED(syscall);
+    va_start(ap, number);
+    for(int i = 0; i < 6; i++) {
+      args[i] = va_arg(ap, long);
+    }
+    va_end(ap);
+
+    if(initialized) {
+      return xrun::getInstance().futex((int *)args[0], (int)args[1], args[2], args[3], args[4], args[5]);
+    }
+    return WRAP(syscall)(number, args[0], args[1], args[2], args[3], args[4], args[5]);
+  }
+
+  void * __attribute__((visibility("hidden"), used)) sheriff_real_syscall (void) {
+    RESOLVE_WRAPPED(syscall);
+    return (void *)WRAP(syscall);
+  }
+
+  // syscall() itself only looks at the number, any other call goes on to
+  // the real one with its arguments untouched, however many there are.
+  // The real one is looked up with the argument registers saved.
+#define SHERIFF_STR(x) #x
+#define SHERIFF_XSTR(x) SHERIFF_STR(x)
+#ifdef X86_32BIT
+  asm (".pushsection .text\n"
+       ".globl syscall\n"
+       ".type syscall, @function\n"
+       "syscall:\n"
+       "  cmpl $" SHERIFF_XSTR(SYS_futex) ", 4(%esp)\n"
+       "  je sheriff_futex_syscall\n"
+       "  subl $12, %esp\n"
+       "  call sheriff_real_syscall\n"
+       "  addl $12, %esp\n"
+       "  jmp *%eax\n"
+       ".size syscall, .-syscall\n"
+       ".popsection\n");
+#else
+  asm (".pushsection .text\n"
+       ".globl syscall\n"
+       ".type syscall, @function\n"
+       "syscall:\n"
+       "  cmpq $" SHERIFF_XSTR(SYS_futex) ", %rdi\n"
+       "  je sheriff_futex_syscall\n"
+       "  movq _real_syscall@GOTPCREL(%rip), %r11\n"
+       "  movq (%r11), %r11\n"
+       "  testq %r11, %r11\n"
+       "  jz 1f\n"
+       "  jmp *%r11\n"
+       "1:\n"
+       "  pushq %rdi\n"
+       "  pushq %rsi\n"
+       "  pushq %rdx\n"
+       "  pushq %rcx\n"
+       "  pushq %r8\n"
+       "  pushq %r9\n"
+       "  pushq %rax\n"
+       "  call sheriff_real_syscall\n"
+       "  movq %rax, %r11\n"
+       "  popq %rax\n"
+       "  popq %r9\n"
+       "  popq %r8\n"
+       "  popq %rcx\n"
+       "  popq %rdx\n"
+       "  popq %rsi\n"
+       "  popq %rdi\n"
+       "  jmp *%r11\n"
+       ".size syscall, .-syscall\n"
+       ".popsection\n");
+#endif
+
+  // Sheriff keeps the application's handlers of the signals it takes
+  // itself, and forwards what is not its own to them, see xsignals.h.
+  int sigaction (int signum, const struct sigaction * act, struct sigaction * oldact) throw() {
+    RESOLVE_WRAPPED(sigaction);
+    if(initialized) {
+      return xsignals::getInstance().sigaction(signum, act, oldact);
+    }
+    return WRAP(sigaction)(signum, act, oldact);
+  }
+
+  // With the BSD semantics of glibc.
+  sighandler_t signal (int signum, sighandler_t handler) throw() {
+    struct sigaction act, old;
+
+    sigemptyset(&act.sa_mask);
+    act.sa_flags = SA_RESTART;
+    act.sa_handler = handler;
+    if(sigaction(signum, &act, &old) != 0) {
+      return SIG_ERR;
+    }
+    return old.sa_handler;
+  }
+
+  // Processes the application creates, see xrun::detach(). The child of
+  // a fork leaves Sheriff: it gets a private copy of the memory it uses and
+  // runs as a process of its own, as it would without Sheriff. The copy is
+  // made at once, so a fork costs time and memory in proportion to the
+  // heap and globals in use, even for a child that execs right away.
+  pid_t fork (void) {
+    RESOLVE_WRAPPED(fork);
+    pid_t pid = WRAP(fork)();
+    if(pid == 0 && initialized) {
+      xrun::getInstance().detach();
+      xomp::getInstance().detach();
+    }
+    return pid;
+  }
+
+  // A vfork child borrows the memory of its parent, which would be given
+  // away by detaching it, so it is forked instead.
+  pid_t vfork (void) {
+    return fork();
+  }
+
+  // A tick of the checking timer pending at execve() reaches the program
+  // that is run, which has no handler for it. A failed exec carries on with
+  // the time it had left.
+  // The children that posix_spawn, system and popen fork do not inherit
+  // the timer, so those leave it running.
+  static inline unsigned long prepareExec (void) {
+    return initialized ? xrun::getInstance().prepareExec() : 0;
+  }
+
+  static inline void execFailed (unsigned long left) {
+    if(initialized) {
+      int error = errno;
+      xrun::getInstance().execFailed(left);
+      errno = error;
+    }
+  }
+
+  // A program run with an environment of its own is still told that it is
+  // nested, see xtunables.h.
+  // @return a copy of envp with SHERIFF_SESSION added, NULL if not needed.
+  static char ** sessionEnvironment (char * const * envp) {
+    const char * session = xtunables::getInstance().session();
+    int count = 0;
+
+    if(!initialized || envp == NULL || session[0] == '\0') {
+      return NULL;
+    }
+    for(; envp[count] != NULL; count++) {
+      if(strncmp(envp[count], "SHERIFF_SESSION=", 16) == 0) {
+        return NULL;
+      }
+    }
+
+    char ** env = (char **)malloc((count + 2) * sizeof(char *));
+    if(env != NULL) {
+      memcpy(env, envp, count * sizeof(char *));
+      env[count] = (char *)session;
+      env[count + 1] = NULL;
+    }
+    return env;
+  }
+
+  int execve (const char * path, char * const argv[], char * const envp[]) throw() {
+    RESOLVE_WRAPPED(execve);
+    char ** env = sessionEnvironment(envp);
+    unsigned long left = prepareExec();
+    int ret = WRAP(execve)(path, argv, env ? env : envp);
+    execFailed(left);
+    free(env);
+    return ret;
+  }
+
+  int execv (const char * path, char * const argv[]) throw() {
+    return execve(path, argv, environ);
+  }
+
+  int execvpe (const char * file, char * const argv[], char * const envp[]) throw() {
+    RESOLVE_WRAPPED(execvpe);
+    char ** env = sessionEnvironment(envp);
+    unsigned long left = prepareExec();
+    int ret = WRAP(execvpe)(file, argv, env ? env : envp);
+    execFailed(left);
+    free(env);
+    return ret;
+  }
+
+  int execvp (const char * file, char * const argv[]) throw() {
+    RESOLVE_WRAPPED(execvp);
+    unsigned long left = prepareExec();
+    int ret = WRAP(execvp)(file, argv);
+    execFailed(left);
+    return ret;
+  }
+
+  // The list forms collect their arguments, and execle its environment
+  // after them.
+  #define COLLECT_ARGUMENTS(argv, arg)                        \
+    va_list ap;                                               \
+    int argc = 1;                                             \
+    va_start(ap, arg);                                        \
+    while(va_arg(ap, char *) != NULL) {                       \
+      argc++;                                                 \
+    }                                                         \
+    va_end(ap);                                               \
+    char * argv[argc + 1];                                    \
+    argv[0] = (char *)arg;                                    \
+    va_start(ap, arg);                                        \
+    for(int i = 1; i <= argc; i++) {                          \
+      argv[i] = va_arg(ap, char *);                           \
+    }
+
+  int execl (const char * path, const char * arg, ...) throw() {
+    COLLECT_ARGUMENTS(argv, arg);
+    va_end(ap);
+    return execve(path, argv, environ);
+  }
+
+  int execlp (const char * file, const char * arg, ...) throw() {
+    COLLECT_ARGUMENTS(argv, arg);
+    va_end(ap);
+    return execvp(file, argv);
+  }
+
+  int execle (const char * path, const char * arg, ...) throw() {
+    COLLECT_ARGUMENTS(argv, arg);
+    char * const * envp = va_arg(ap, char * const *);
+    va_end(ap);
+    return execve(path, argv, envp);
+  }
+
+  int posix_spawn (pid_t * pid, const char * path,
+                   const posix_spawn_file_actions_t * actions,
+                   const posix_spawnattr_t * attr,
+                   char * const argv[], char * const envp[]) {
+    RESOLVE_WRAPPED(posix_spawn);
+    char ** env = sessionEnvironment(envp);
+    int ret = WRAP(posix_spawn)(pid, path, actions, attr, argv, env ? env : envp);
+    free(env);
+    return ret;
+  }
+
+  int posix_spawnp (pid_t * pid, const char * file,
+                    const posix_spawn_file_actions_t * actions,
+                    const posix_spawnattr_t * attr,
+                    char * const argv[], char * const envp[]) {
+    RESOLVE_WRAPPED(posix_spawnp);
+    char ** env = sessionEnvironment(envp);
+    int ret = WRAP(posix_spawnp)(pid, file, actions, attr, argv, env ? env : envp);
+    free(env);
+    return ret;
   }
 
 #if 0
@@ -411,15 +931,230 @@ extern "C" {
   }
 #endif
 
-  void *NOOOOOmmap(void *addr, size_t length, int prot, 
-		     int flags,  int fd, off_t offset) {
-	  int newflags = flags;
+  /// Annotations by the application, see sheriff.h. Untracked memory
+  /// is as good as excluded, but it can not be isolated.
+  static int annotate (void * start, size_t size, int hint) {
+    unsigned long pages = 0;
+    if(initialized) {
+      pages = xrun::getInstance().annotate(start, size, hint);
+    }
+    if(pages == 0 && hint == xdefines::PAGE_ISOLATED) {
+      errno = EINVAL;
+      return -1;
+    }
+    return 0;
+  }
+
+  int sheriff_region_exclude (void * start, size_t size) {
+    return annotate(start, size, xdefines::PAGE_EXCLUDED);
+  }
+
+  int sheriff_region_include (void * start, size_t size) {
+    return annotate(start, size, xdefines::PAGE_TRACKED);
+  }
+
+  int sheriff_region_isolate (void * start, size_t size) {
+    return annotate(start, size, xdefines::PAGE_ISOLATED);
+  }
+
+  int sheriff_region_unit (void * start, size_t size, size_t unit) {
+    if(!initialized || xrun::getInstance().setProtectionUnit(start, size, unit) == 0) {
+      errno = EINVAL;
+      return -1;
+    }
+    return 0;
+  }
+
+  void sheriff_phase_begin (const char * name) {
+    if(initialized && name != NULL) {
+      xrun::getInstance().phase(name);
+    }
+  }
+
+  void sheriff_phase_end (void) {
+    if(initialized) {
+      xrun::getInstance().phase(NULL);
+    }
+  }
+
+  int sheriff_trace_dump (void) {
+    if(!initialized) {
+      errno = EINVAL;
+      return -1;
+    }
+    return xtrace::getInstance().dump();
+  }
+
+  void sheriff_commit_point (void) {
+    if(initialized) {
+      xrun::getInstance().commitPoint();
+    }
+  }
+
+  void * sheriff_atomic_alloc (size_t size) {
+    if(!initialized) {
+      errno = ENOMEM;
+      return NULL;
+    }
+    return xrun::getInstance().atomicMalloc(size);
+  }
+
+  void sheriff_atomic_free (void * ptr) {
+    sheriff_free(ptr);
+  }
+
+  int sheriff_thread_mode (void * (*start_routine)(void *), int mode) {
+    if(mode != SHERIFF_THREAD_DEFAULT && mode != SHERIFF_THREAD_ISOLATED
+       && mode != SHERIFF_THREAD_SHARED) {
+      errno = EINVAL;
+      return -1;
+    }
+    if(!xthreadpolicy::getInstance().setMode(start_routine, mode)) {
+      errno = ENOMEM;
+      return -1;
+    }
+    return 0;
+  }
+
+  // Keep the module map in sync with the loader, so that callsites 
+  // and globals inside plugins can be attributed. The loader takes the
+  // caller of the real dlopen() for the object asking, so the search along
+  // the application's RPATH, RUNPATH and $ORIGIN is done here, see
+  // xlibpath.h. A library that is loaded already is taken by its name.
+  void * dlopen (const char * filename, int flag) {
+    if(WRAP(dlopen) == NULL) {
+      WRAP(dlopen) = (void * (*)(const char *, int))dlsym(RTLD_NEXT, "dlopen");
+    }
+
+    char path[PATH_MAX];
+    void * handle = NULL;
+    if(filename != NULL && strchr(filename, '/') == NULL) {
+      handle = WRAP(dlopen)(filename, flag | RTLD_NOLOAD);
+    }
+    if(handle == NULL) {
+      bool resolved = xlibpath::resolve(filename, __builtin_return_address(0), path, sizeof(path));
+      handle = WRAP(dlopen)(resolved ? path : filename, flag);
+    }
+    if(handle != NULL && initialized) {
+      xrun::getInstance().refreshModules();
+    }
+    return handle;
+  }
+
+  int dlclose (void * handle) {
+    if(WRAP(dlclose) == NULL) {
+      WRAP(dlclose) = (int (*)(void *))dlsym(RTLD_NEXT, "dlclose");
+    }
+
+    int ret = WRAP(dlclose)(handle);
+    if(ret == 0 && initialized) {
+      xrun::getInstance().refreshModules();
+    }
+    return ret;
+  }
+
+  // Only big anonymous private read/write mappings are worth moving into the
+  // arena, shared and file mappings already behave the same for all threads.
+  // The arena is mapped read/write, so other protections keep their own
+  // mapping: code written to a buffer must stay executable.
+  static inline bool isTrackedMapping(size_t length, int prot, int flags) {
+    int excluded = MAP_SHARED | MAP_FIXED | MAP_GROWSDOWN | MAP_STACK | MAP_HUGETLB;
+#ifdef MAP_32BIT
+    excluded |= MAP_32BIT;
+#endif
+    return ((flags & MAP_ANONYMOUS) && (flags & MAP_PRIVATE) && !(flags & excluded)
+            && prot == (PROT_READ | PROT_WRITE) && length >= xdefines::MMAP_TRACK_THRESHOLD);
+  }
+
+  // Anonymous mappings of the application are served from a persistent
+  // arena, so that threads see each other's writes as they do on the heap.
+  // Sheriff's own mappings (called from inside this library) pass through.
+  static void * mapApplication(void * addr, size_t length, int prot, int flags, int fd,
+                               off_t offset, void * caller) {
+    if(WRAP(mmap) == NULL) {
+      WRAP(mmap) = (void * (*)(void *, size_t, int, int, int, off_t))dlsym(RTLD_NEXT, "mmap");
+    }
+
+    if(initialized && isTrackedMapping(length, prot, flags)
+       && !xmodules::getInstance().inSelf((unsigned long)caller)) {
+      void * ptr = xrun::getInstance().mmap(length);
+      if(ptr != NULL) {
+        return ptr;
+      }
+    }
+    return WRAP(mmap)(addr, length, prot, flags, fd, offset);
+  }
+
+  void * mmap (void * addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    return mapApplication(addr, length, prot, flags, fd, offset, __builtin_return_address(0));
+  }
+
+  void * mmap64 (void * addr, size_t length, int prot, int flags, int fd, off64_t offset) {
+    return mapApplication(addr, length, prot, flags, fd, offset, __builtin_return_address(0));
+  }
+
+  int munmap (void * addr, size_t length) {
+    if(WRAP(munmap) == NULL) {
+      WRAP(munmap) = (int (*)(void *, size_t))dlsym(RTLD_NEXT, "munmap");
+    }
+
+    if(initialized && xrun::getInstance().inMappedRange(addr)) {
+      return xrun::getInstance().munmap(addr, length);
+    }
+    return WRAP(munmap)(addr, length);
+  }
+
+  // Sheriff keeps the pages it tracks read-only and lets each thread write
+  // them page by page. An application making tracked memory writable would
+  // hide its writes, so that request is taken as already granted; other
+  // protections would be lost at the next transaction and are refused.
+  // Sheriff's own calls pass through.
+  int mprotect (void * addr, size_t len, int prot) {
+    if(WRAP(mprotect) == NULL) {
+      WRAP(mprotect) = (int (*)(void *, size_t, int))dlsym(RTLD_NEXT, "mprotect");
+    }
 
-	  if(initialized == true && (flags & MAP_PRIVATE)) {
-//		newflags = (flags & ~MAP_PRIVATE) | MAP_SHARED;
-		  printf("flags %x and newflags %x\n", flags, newflags);
-	  }
-	  return WRAP(mmap)(addr, length, prot, newflags, fd, offset);
+    if(initialized && len > 0
+       && !xmodules::getInstance().inSelf((unsigned long)__builtin_return_address(0))
+       && (xrun::getInstance().inTrackedRange(addr)
+           || xrun::getInstance().inTrackedRange((char *)addr + len - 1))) {
+      if(prot == (PROT_READ | PROT_WRITE)) {
+        return 0;
+      }
+      fprintf(stderr, "Sheriff: mprotect(%p, %zu, %#x) on memory Sheriff tracks is not supported.\n",
+              addr, len, prot);
+      ::abort();
+    }
+    return WRAP(mprotect)(addr, len, prot);
+  }
+
+  void * mremap (void * oldaddr, size_t oldsize, size_t newsize, int flags, ...) {
+    void * newaddr = NULL;
+
+    if(WRAP(mremap) == NULL) {
+      WRAP(mremap) = (void * (*)(void *, size_t, size_t, int, ...))dlsym(RTLD_NEXT, "mremap");
+    }
+
+    if(flags & MREMAP_FIXED) {
+      va_list ap;
+      va_start(ap, flags);
+      newaddr = va_arg(ap, void *);
+      va_end(ap);
+    }
+
+    if(initialized && xrun::getInstance().inMappedRange(oldaddr)) {
+      // A chunk of the arena can not be moved to a given address.
+      if(flags & MREMAP_FIXED) {
+        errno = EINVAL;
+        return MAP_FAILED;
+      }
+      return xrun::getInstance().mremap(oldaddr, oldsize, newsize, flags);
+    }
+
+    if(flags & MREMAP_FIXED) {
+      return WRAP(mremap)(oldaddr, oldsize, newsize, flags, newaddr);
+    }
+    return WRAP(mremap)(oldaddr, oldsize, newsize, flags);
   }
 }
 
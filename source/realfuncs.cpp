@@ -2,6 +2,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <signal.h>
 
 #include <pthread.h>
 
@@ -9,20 +10,58 @@
 
 // libc functions
 void* (*WRAP(mmap))(void*, size_t, int, int, int, off_t);
+int (*WRAP(munmap))(void*, size_t);
+int (*WRAP(mprotect))(void*, size_t, int);
+void* (*WRAP(mremap))(void*, size_t, size_t, int, ...);
 void* (*WRAP(malloc))(size_t);
 void  (*WRAP(free))(void *);
 void* (*WRAP(realloc))(void *, size_t);
 void* (*WRAP(memalign))(size_t, size_t);
 size_t (*WRAP(malloc_usable_size))(void *);
 ssize_t (*WRAP(read))(int, void*, size_t);
+ssize_t (*WRAP(pread))(int, void*, size_t, off_t);
+ssize_t (*WRAP(pread64))(int, void*, size_t, off64_t);
+ssize_t (*WRAP(readv))(int, const struct iovec*, int);
+ssize_t (*WRAP(recv))(int, void*, size_t, int);
+ssize_t (*WRAP(recvfrom))(int, void*, size_t, int, struct sockaddr*, socklen_t*);
+ssize_t (*WRAP(recvmsg))(int, struct msghdr*, int);
+size_t (*WRAP(fread))(void*, size_t, size_t, FILE*);
+char* (*WRAP(fgets))(char*, int, FILE*);
+char* (*WRAP(__fgets_chk))(char*, size_t, int, FILE*);
+int (*WRAP(fgetc))(FILE*);
+int (*WRAP(getc))(FILE*);
+ssize_t (*WRAP(getdelim))(char**, size_t*, int, FILE*);
+int (*WRAP(vfscanf))(FILE*, const char*, va_list);
+int (*WRAP(__isoc99_vfscanf))(FILE*, const char*, va_list);
+int (*WRAP(__isoc23_vfscanf))(FILE*, const char*, va_list);
+struct dirent* (*WRAP(readdir))(DIR*);
+struct dirent64* (*WRAP(readdir64))(DIR*);
 ssize_t (*WRAP(write))(int, const void*, size_t);
 int (*WRAP(sigwait))(const sigset_t*, int*);
+long (*WRAP(syscall))(long, ...);
+int (*WRAP(sigaction))(int, const struct sigaction*, struct sigaction*);
+
+// processes
+pid_t (*WRAP(fork))(void);
+int (*WRAP(execve))(const char*, char* const*, char* const*);
+int (*WRAP(execvp))(const char*, char* const*);
+int (*WRAP(execvpe))(const char*, char* const*, char* const*);
+int (*WRAP(posix_spawn))(pid_t*, const char*, const posix_spawn_file_actions_t*,
+                         const posix_spawnattr_t*, char* const*, char* const*);
+int (*WRAP(posix_spawnp))(pid_t*, const char*, const posix_spawn_file_actions_t*,
+                          const posix_spawnattr_t*, char* const*, char* const*);
+
+// libdl functions
+void* (*WRAP(dlopen))(const char*, int);
+int (*WRAP(dlclose))(void*);
 
 // pthread basics
 int (*WRAP(pthread_create))(pthread_t*, const pthread_attr_t*, void *(*)(void*), void*);
 int (*WRAP(pthread_cancel))(pthread_t);
 int (*WRAP(pthread_join))(pthread_t, void**);
 int (*WRAP(pthread_exit))(void*);
+pthread_t (*WRAP(pthread_self))(void);
+int (*WRAP(pthread_kill))(pthread_t, int);
 
 // pthread mutexes
 int (*WRAP(pthread_mutexattr_init))(pthread_mutexattr_t*);
@@ -54,16 +93,46 @@ int (*WRAP(pthread_barrier_destroy))(pthread_barrier_t*);
 void init_real_functions() {
 
 	SET_WRAPPED(mmap, RTLD_NEXT);
+	SET_WRAPPED(munmap, RTLD_NEXT);
+	SET_WRAPPED(mprotect, RTLD_NEXT);
+	SET_WRAPPED(mremap, RTLD_NEXT);
 	SET_WRAPPED(malloc, RTLD_NEXT);
 	SET_WRAPPED(free, RTLD_NEXT);
 	SET_WRAPPED(realloc, RTLD_NEXT);
 	SET_WRAPPED(memalign, RTLD_NEXT);
 	SET_WRAPPED(malloc_usable_size, RTLD_NEXT);
 	SET_WRAPPED(read, RTLD_NEXT);
+	SET_WRAPPED(pread, RTLD_NEXT);
+	SET_WRAPPED(pread64, RTLD_NEXT);
+	SET_WRAPPED(readv, RTLD_NEXT);
+	SET_WRAPPED(recv, RTLD_NEXT);
+	SET_WRAPPED(recvfrom, RTLD_NEXT);
+	SET_WRAPPED(recvmsg, RTLD_NEXT);
+	SET_WRAPPED(fread, RTLD_NEXT);
+	SET_WRAPPED(fgets, RTLD_NEXT);
+	SET_WRAPPED(__fgets_chk, RTLD_NEXT);
+	SET_WRAPPED(fgetc, RTLD_NEXT);
+	SET_WRAPPED(getc, RTLD_NEXT);
+	SET_WRAPPED(getdelim, RTLD_NEXT);
+	SET_WRAPPED(vfscanf, RTLD_NEXT);
+	SET_WRAPPED(__isoc99_vfscanf, RTLD_NEXT);
+	SET_WRAPPED(__isoc23_vfscanf, RTLD_NEXT);
+	SET_WRAPPED(readdir, RTLD_NEXT);
+	SET_WRAPPED(readdir64, RTLD_NEXT);
 	SET_WRAPPED(write, RTLD_NEXT);
 	SET_WRAPPED(sigwait, RTLD_NEXT);
-
-	void *pthread_handle = dlopen("libpthread.so.0", RTLD_NOW | RTLD_GLOBAL | RTLD_NOLOAD);
+	SET_WRAPPED(syscall, RTLD_NEXT);
+	SET_WRAPPED(sigaction, RTLD_NEXT);
+	SET_WRAPPED(fork, RTLD_NEXT);
+	SET_WRAPPED(execve, RTLD_NEXT);
+	SET_WRAPPED(execvp, RTLD_NEXT);
+	SET_WRAPPED(execvpe, RTLD_NEXT);
+	SET_WRAPPED(posix_spawn, RTLD_NEXT);
+	SET_WRAPPED(posix_spawnp, RTLD_NEXT);
+	SET_WRAPPED(dlopen, RTLD_NEXT);
+	SET_WRAPPED(dlclose, RTLD_NEXT);
+
+	void *pthread_handle = WRAP(dlopen)("libpthread.so.0", RTLD_NOW | RTLD_GLOBAL | RTLD_NOLOAD);
 	if (pthread_handle == NULL) {
 		fprintf(stderr, "Unable to load libpthread.so.0\n");
 		_exit(2);
@@ -73,6 +142,8 @@ void init_real_functions() {
 	SET_WRAPPED(pthread_cancel, pthread_handle);
 	SET_WRAPPED(pthread_join, pthread_handle);
 	SET_WRAPPED(pthread_exit, pthread_handle);
+	SET_WRAPPED(pthread_self, pthread_handle);
+	SET_WRAPPED(pthread_kill, pthread_handle);
 
 	SET_WRAPPED(pthread_mutex_init, pthread_handle);
 	SET_WRAPPED(pthread_mutex_lock, pthread_handle);
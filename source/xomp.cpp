@@ -0,0 +1,301 @@
+// -*- C++ -*-
+
+/*
+  Copyright (c) 2011, University of Massachusetts Amherst.
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/**
+ * @file xomp.cpp
+ * @brief The libgomp entry points GCC emits for OpenMP, run by xomp.
+ *
+ * Each loop schedule has a long and an unsigned long long flavour, and
+ * each of them a start, a next and a combined parallel entry point. All of
+ * them split the loop the same way, see xomp.h.
+ */
+
+#include <stdint.h>
+
+#include "xomp.h"
+
+typedef xomp::iteration iteration;
+
+/// @return the number of iterations of a loop with long bounds.
+static iteration longIterations (long start, long end, long incr) {
+  if(incr > 0) {
+    return (end > start) ? (iteration)(end - start + incr - 1) / incr : 0;
+  }
+  return (start > end) ? (iteration)(start - end - incr - 1) / -incr : 0;
+}
+
+static bool loopNext (long * istart, long * iend) {
+  iteration first, end;
+  if(!xomp::getInstance().nextChunk(&first, &end)) {
+    return false;
+  }
+  *istart = (long)first;
+  *iend = (long)end;
+  return true;
+}
+
+static bool loopStart (long start, long end, long incr, long chunk,
+                       long * istart, long * iend) {
+  xomp::getInstance().splitLoop(start, incr, longIterations(start, end, incr), chunk);
+  return loopNext(istart, iend);
+}
+
+static bool loopUllNext (iteration * istart, iteration * iend) {
+  return xomp::getInstance().nextChunk(istart, iend);
+}
+
+/// The schedules of GOMP_loop_start, GCC 9 and later. Only a static one
+/// keeps its chunk size, see SHERIFF_LOOP.
+enum { SCHEDULE_STATIC = 1, SCHEDULE_MONOTONIC = 0x80000000 };
+
+static bool staticSchedule (long sched) {
+  return (sched & ~(long)SCHEDULE_MONOTONIC) == SCHEDULE_STATIC;
+}
+
+/// @brief Task reductions keep their state in libgomp's team, which no
+/// Sheriff team has.
+static void taskReductions (void) {
+  fprintf(stderr, "Sheriff does not support OpenMP task reductions.\n");
+  ::abort();
+}
+
+static bool loopUllStart (bool up, iteration start, iteration end, iteration incr,
+                          iteration chunk, iteration * istart, iteration * iend) {
+  xomp::getInstance().splitLoop(start, incr, xomp::countIterations(up, start, end, incr), chunk);
+  return loopUllNext(istart, iend);
+}
+
+static void parallelLoop (void (*fn)(void *), void * data, unsigned threads,
+                          long start, long end, long incr, long chunk) {
+  xomp::loopSplit split;
+  split.active = true;
+  split.start = start;
+  split.increment = incr;
+  split.count = longIterations(start, end, incr);
+  split.chunk = chunk;
+
+  xomp& omp = xomp::getInstance();
+  omp.parallelStart(fn, data, threads, &split);
+  fn(data);
+  omp.parallelEnd();
+}
+
+// Only a static schedule with a chunk size hands out chunks in turn,
+// every other schedule gets contiguous blocks.
+#define SHERIFF_LOOP(schedule, chunked)                                      \
+  bool GOMP_loop_##schedule##_start (long start, long end, long incr,        \
+                                     long chunk, long * istart, long * iend) { \
+    return loopStart(start, end, incr, (chunked) ? chunk : 0, istart, iend); \
+  }                                                                          \
+  bool GOMP_loop_##schedule##_next (long * istart, long * iend) {            \
+    return loopNext(istart, iend);                                           \
+  }                                                                          \
+  bool GOMP_loop_ull_##schedule##_start (bool up, iteration start,           \
+                                         iteration end, iteration incr,      \
+                                         iteration chunk,                    \
+                                         iteration * istart,                 \
+                                         iteration * iend) {                 \
+    return loopUllStart(up, start, end, incr, (chunked) ? chunk : 0, istart, iend); \
+  }                                                                          \
+  bool GOMP_loop_ull_##schedule##_next (iteration * istart, iteration * iend) { \
+    return loopUllNext(istart, iend);                                        \
+  }                                                                          \
+  void GOMP_parallel_loop_##schedule (void (*fn)(void *), void * data,       \
+                                      unsigned threads, long start,          \
+                                      long end, long incr, long chunk,       \
+                                      unsigned flags) {                      \
+    parallelLoop(fn, data, threads, start, end, incr, (chunked) ? chunk : 0); \
+  }
+
+// The runtime schedules take no chunk size.
+#define SHERIFF_RUNTIME_LOOP(schedule)                                       \
+  bool GOMP_loop_##schedule##_start (long start, long end, long incr,        \
+                                     long * istart, long * iend) {           \
+    return loopStart(start, end, incr, 0, istart, iend);                     \
+  }                                                                          \
+  bool GOMP_loop_##schedule##_next (long * istart, long * iend) {            \
+    return loopNext(istart, iend);                                           \
+  }                                                                          \
+  bool GOMP_loop_ull_##schedule##_start (bool up, iteration start,           \
+                                         iteration end, iteration incr,      \
+                                         iteration * istart,                 \
+                                         iteration * iend) {                 \
+    return loopUllStart(up, start, end, incr, 0, istart, iend);              \
+  }                                                                          \
+  bool GOMP_loop_ull_##schedule##_next (iteration * istart, iteration * iend) { \
+    return loopUllNext(istart, iend);                                        \
+  }                                                                          \
+  void GOMP_parallel_loop_##schedule (void (*fn)(void *), void * data,       \
+                                      unsigned threads, long start,          \
+                                      long end, long incr, unsigned flags) { \
+    parallelLoop(fn, data, threads, start, end, incr, 0);                    \
+  }
+
+extern "C" {
+
+  void GOMP_parallel (void (*fn)(void *), void * data, unsigned threads, unsigned flags) {
+    xomp& omp = xomp::getInstance();
+    omp.parallelStart(fn, data, threads, NULL);
+    fn(data);
+    omp.parallelEnd();
+  }
+
+  void GOMP_parallel_start (void (*fn)(void *), void * data, unsigned threads) {
+    xomp::getInstance().parallelStart(fn, data, threads, NULL);
+  }
+
+  void GOMP_parallel_end (void) {
+    xomp::getInstance().parallelEnd();
+  }
+
+  void GOMP_barrier (void) {
+    xomp::getInstance().barrier();
+  }
+
+  void GOMP_critical_start (void) {
+    xomp::getInstance().criticalStart();
+  }
+
+  void GOMP_critical_end (void) {
+    xomp::getInstance().criticalEnd();
+  }
+
+  void GOMP_critical_name_start (void ** name) {
+    xomp::getInstance().criticalNameStart(name);
+  }
+
+  void GOMP_critical_name_end (void ** name) {
+    xomp::getInstance().criticalNameEnd(name);
+  }
+
+  void GOMP_atomic_start (void) {
+    xomp::getInstance().atomicStart();
+  }
+
+  void GOMP_atomic_end (void) {
+    xomp::getInstance().atomicEnd();
+  }
+
+  bool GOMP_single_start (void) {
+    return xomp::getInstance().singleStart();
+  }
+
+  // A team of one runs the block itself, NULL says so.
+  void * GOMP_single_copy_start (void) {
+    xomp::getInstance().unsupported("copyprivate");
+    return NULL;
+  }
+
+  void GOMP_single_copy_end (void * data) {
+    xomp::getInstance().unsupported("copyprivate");
+  }
+
+  unsigned GOMP_parallel_reductions (void (*fn)(void *), void * data,
+                                     unsigned threads, unsigned flags) {
+    taskReductions();
+    return 0;
+  }
+
+  // Sections are numbered from 1, 0 means there are none left.
+  unsigned GOMP_sections_next (void) {
+    iteration first, end;
+    return xomp::getInstance().nextChunk(&first, &end) ? (unsigned)first : 0;
+  }
+
+  unsigned GOMP_sections_start (unsigned count) {
+    xomp::getInstance().splitLoop(1, 1, count, 1);
+    return GOMP_sections_next();
+  }
+
+  void GOMP_parallel_sections (void (*fn)(void *), void * data, unsigned threads,
+                               unsigned count, unsigned flags) {
+    xomp::loopSplit split;
+    split.active = true;
+    split.start = 1;
+    split.increment = 1;
+    split.count = count;
+    split.chunk = 1;
+
+    xomp& omp = xomp::getInstance();
+    omp.parallelStart(fn, data, threads, &split);
+    fn(data);
+    omp.parallelEnd();
+  }
+
+  void GOMP_sections_end (void) {
+    xomp::getInstance().barrier();
+  }
+
+  void GOMP_sections_end_nowait (void) {
+  }
+
+  SHERIFF_LOOP(static, true)
+  SHERIFF_LOOP(dynamic, false)
+  SHERIFF_LOOP(guided, false)
+  SHERIFF_LOOP(nonmonotonic_dynamic, false)
+  SHERIFF_LOOP(nonmonotonic_guided, false)
+  SHERIFF_RUNTIME_LOOP(runtime)
+  SHERIFF_RUNTIME_LOOP(nonmonotonic_runtime)
+  SHERIFF_RUNTIME_LOOP(maybe_nonmonotonic_runtime)
+
+  // Without istart the loop is only set up, its chunks follow with
+  // GOMP_loop_runtime_next.
+  bool GOMP_loop_start (long start, long end, long incr, long sched, long chunk,
+                        long * istart, long * iend, uintptr_t * reductions, void ** mem) {
+    if(reductions != NULL || mem != NULL) {
+      taskReductions();
+    }
+    xomp::getInstance().splitLoop(start, incr, longIterations(start, end, incr),
+                                  staticSchedule(sched) ? chunk : 0);
+    return (istart == NULL) || loopNext(istart, iend);
+  }
+
+  bool GOMP_loop_ull_start (bool up, iteration start, iteration end, iteration incr,
+                            long sched, iteration chunk, iteration * istart, iteration * iend,
+                            uintptr_t * reductions, void ** mem) {
+    if(reductions != NULL || mem != NULL) {
+      taskReductions();
+    }
+    xomp::getInstance().splitLoop(start, incr, xomp::countIterations(up, start, end, incr),
+                                  staticSchedule(sched) ? chunk : 0);
+    return (istart == NULL) || loopUllNext(istart, iend);
+  }
+
+  void GOMP_loop_end (void) {
+    xomp::getInstance().barrier();
+  }
+
+  void GOMP_loop_end_nowait (void) {
+  }
+
+  int omp_get_thread_num (void) {
+    return xomp::getInstance().threadNum();
+  }
+
+  int omp_get_num_threads (void) {
+    return xomp::getInstance().teamSize();
+  }
+
+  int omp_in_parallel (void) {
+    return xomp::getInstance().inParallel();
+  }
+
+}
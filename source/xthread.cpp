@@ -2,13 +2,19 @@
 #include <syscall.h>
 #include "xthread.h"
 #include "xrun.h"
+#include "xcounters.h"
+#include "xperfevents.h"
+#include "xsignals.h"
 
 void * xthread::spawn (xrun * runner,
 		       threadFunction * fn,
 		       void * arg)
 {
+  if(_detached) {
+    return spawnShared (runner, fn, arg);
+  }
 
-	if(!_protected) {
+	if(!_protected && !_sharing) {
 		runner->openMemoryProtection();
   	runner->atomicBegin(false, false);
 		_protected = true;
@@ -19,12 +25,43 @@ void * xthread::spawn (xrun * runner,
   // Allocate an object to hold the thread's return value.
   void * buf = allocateSharedObject (4096);
   HL::sassert<(4096 > sizeof(ThreadStatus))> checkSize;
-  ThreadStatus * t = new (buf) ThreadStatus;
+  ThreadStatus * t = new (buf) ThreadStatus (NULL, true);
 
 	runner->atomicBegin(false, false);
   return forkSpawn (runner, fn, t, arg);
 }
 
+/// @brief Start a real thread inside this process. The first one stops
+/// tracking in this process for good: its writes and those of its real
+/// threads go straight to shared memory, and only isolated threads commit.
+/// Protection is opened first all the same, so that the shadow state is
+/// shared with the isolated threads this process may still spawn.
+void * xthread::spawnShared (xrun * runner,
+			     threadFunction * fn,
+			     void * arg)
+{
+  if(!_sharing) {
+    if(!_protected) {
+      runner->openMemoryProtection();
+      runner->atomicBegin(false, false);
+      _protected = true;
+    }
+    runner->atomicEnd(true, false);
+    runner->shareMemoryView();
+    _sharing = true;
+  }
+
+  void * buf = allocateSharedObject (4096);
+  ThreadStatus * t = new (buf) ThreadStatus (NULL, false);
+
+  // Sheriff ignores thread attributes, so there are none to pass on.
+  if(WRAP(pthread_create)(&t->thread, NULL, fn, arg) != 0) {
+    freeSharedObject(t, 4096);
+    return NULL;
+  }
+  return (void *) t;
+}
+
 
 /// @brief Do pthread_join.
 void xthread::join (xrun * runner,
@@ -38,13 +75,26 @@ void xthread::join (xrun * runner,
   }
 
   ThreadStatus * t = (ThreadStatus *) v;
+
+  // A real thread of this process commits nothing.
+  if (!t->forked) {
+    {
+      xcycles timer(STAT_JOIN);
+      WRAP(pthread_join)(t->thread, result);
+    }
+    freeSharedObject(t, 4096);
+    return;
+  }
  
   runner->atomicEnd(true, false);
 //  fprintf(stderr, "%d: joining thread %d\n", getpid(), t->tid);
   
   // FIXME: I should wait until the child thread has been finished.
   int status;
-  waitpid(t->tid, &status, 0);
+  {
+    xcycles timer(STAT_JOIN);
+    waitpid(t->tid, &status, 0);
+  }
 
   runner->atomicBegin(false, false);
 #if 0
@@ -85,7 +135,12 @@ void xthread::cancel (xrun * runner, void *v)
 {
   ThreadStatus * t = (ThreadStatus *) v;
   //fprintf(stderr, "KILL thread %d\n", t->tid);
-  kill(t->tid, SIGKILL); 
+  if (t->forked) {
+    kill(t->tid, SIGKILL); 
+  }
+  else {
+    WRAP(pthread_cancel)(t->thread);
+  }
   
   // Free the shared object held by this thread.
   freeSharedObject(t, 4096);
@@ -95,7 +150,12 @@ void xthread::thread_kill (xrun * runner, void *v, int sig)
 { 
   ThreadStatus * t = (ThreadStatus *) v;
   //fprintf(stderr, "KILL thread %d\n", t->tid);
-  kill(t->tid, sig); 
+  if (t->forked) {
+    kill(t->tid, sig); 
+  }
+  else {
+    WRAP(pthread_kill)(t->thread, sig);
+  }
 }
 
 
@@ -113,10 +173,12 @@ void * xthread::forkSpawn (xrun * runner,
   // Use fork to create the effect of a thread spawn.
   // FIXME:: For current process, we should close share. 
   // children to use MAP_PRIVATE mapping. Or just let child to do that in the beginning.
+  unsigned long spawnstart = xtrace::timestamp();
   int child = forkWithFS();
   
   if (child) {
     // I'm the parent (caller of spawn).
+    xcounters::getInstance().add(STAT_SPAWN, xtrace::timestamp() - spawnstart);
 
     // Store the tid so I can later sync on this thread.
 #ifndef NDEBUG
@@ -138,9 +200,19 @@ void * xthread::forkSpawn (xrun * runner,
     // Set "thread_self".
     setId (mypid);
 
+    // Faults run on a signal stack of this process, which the thread that
+    // forked it lacks if it was a real thread.
+    xsignals::getInstance().installStack();
+
 	  // Register to the system, we will set the heapid for myself.
 	  runner->threadRegister();
 
+    // Spawned by a process that runs real threads: track again, here only.
+    if (_sharing) {
+      _sharing = false;
+      runner->openMemoryProtection();
+    }
+
     // We're in...
     _nestingLevel++;
 
@@ -165,6 +237,11 @@ void * xthread::forkSpawn (xrun * runner,
 
 //	fprintf(stderr, "%d : EXIT thread\n", mypid);
     // And that's the end of this "thread".
+    if(trace_enabled) {
+      xtrace::getInstance().phase(NULL);
+    }
+    xcounters::getInstance().retire();
+    xperfevents::getInstance().close();
     _exit(0);
 
     // Avoid complaints.